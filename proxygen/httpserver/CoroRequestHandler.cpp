@@ -0,0 +1,171 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/CoroRequestHandler.h>
+
+#if FOLLY_HAS_COROUTINES
+
+#include <folly/ExceptionString.h>
+#include <folly/io/async/EventBaseManager.h>
+#include <proxygen/httpserver/ResponseBuilder.h>
+
+namespace proxygen {
+
+CoroRequestHandler::RequestError::RequestError(ProxygenError err)
+    : std::runtime_error(getErrorString(err)), err_(err) {
+}
+
+void CoroRequestHandler::onRequest(
+    std::unique_ptr<HTTPMessage> headers) noexcept {
+  auto evb = folly::EventBaseManager::get()->getExistingEventBase();
+  CHECK(evb);
+  handleRequest(std::move(headers))
+      .scheduleOn(evb)
+      .start([this](folly::Try<void>&& result) {
+        onTaskDone(std::move(result));
+      });
+}
+
+void CoroRequestHandler::onBody(std::unique_ptr<folly::IOBuf> body) noexcept {
+  body_.append(std::move(body));
+  if (!ingressPaused_ && body_.chainLength() >= kMaxBufferedBody) {
+    ingressPaused_ = true;
+    downstream_->pauseIngress();
+  }
+  if (waiter_ && bodyReady()) {
+    resume();
+  }
+}
+
+void CoroRequestHandler::onUpgrade(UpgradeProtocol /*prot*/) noexcept {
+}
+
+void CoroRequestHandler::onEOM() noexcept {
+  ingressEOM_ = true;
+  if (waiter_) {
+    resume();
+  }
+}
+
+void CoroRequestHandler::requestComplete() noexcept {
+  requestDone_ = true;
+  if (waiter_) {
+    resume();
+  } else {
+    maybeDestroy();
+  }
+}
+
+void CoroRequestHandler::onError(ProxygenError err) noexcept {
+  VLOG(4) << "CoroRequestHandler error: " << getErrorString(err);
+  err_ = err;
+  requestDone_ = true;
+  if (waiter_) {
+    resume();
+  } else {
+    maybeDestroy();
+  }
+}
+
+void CoroRequestHandler::onEgressPaused() noexcept {
+  egressPaused_ = true;
+}
+
+void CoroRequestHandler::onEgressResumed() noexcept {
+  egressPaused_ = false;
+  if (waiter_) {
+    resume();
+  }
+}
+
+std::unique_ptr<folly::IOBuf> CoroRequestHandler::takeBody() {
+  if (body_.empty()) {
+    // Body after a completed request is simply empty
+    checkError();
+    return nullptr;
+  }
+  if (ingressPaused_ && !requestDone_) {
+    ingressPaused_ = false;
+    downstream_->resumeIngress();
+  }
+  return body_.move();
+}
+
+void CoroRequestHandler::checkError() const {
+  if (err_ != kErrorNone) {
+    throw RequestError(err_);
+  }
+}
+
+CoroRequestHandler::EgressAwaitable CoroRequestHandler::sendBody(
+    std::unique_ptr<folly::IOBuf> body) noexcept {
+  if (!requestDone_) {
+    downstream_->sendBody(std::move(body));
+  }
+  return EgressAwaitable(*this);
+}
+
+void CoroRequestHandler::sendHeaders(HTTPMessage& msg) noexcept {
+  if (!requestDone_) {
+    headersSent_ = true;
+    downstream_->sendHeaders(msg);
+  }
+}
+
+void CoroRequestHandler::sendEOM() noexcept {
+  if (!requestDone_) {
+    eomSent_ = true;
+    downstream_->sendEOM();
+  }
+}
+
+void CoroRequestHandler::sendAbort() noexcept {
+  if (!requestDone_) {
+    eomSent_ = true;
+    downstream_->sendAbort();
+  }
+}
+
+void CoroRequestHandler::resume() noexcept {
+  auto waiter = waiter_;
+  waiter_ = nullptr;
+  waiter.resume();
+}
+
+void CoroRequestHandler::onTaskDone(folly::Try<void>&& result) noexcept {
+  if (!requestDone_ && !eomSent_) {
+    if (result.hasException()) {
+      LOG(ERROR) << "Request handler failed: "
+                 << folly::exceptionStr(result.exception());
+    } else {
+      LOG(ERROR) << "Request handler returned without completing response";
+    }
+    if (!headersSent_) {
+      eomSent_ = true;
+      ResponseBuilder(downstream_)
+          .status(500, "Internal Server Error")
+          .sendWithEOM();
+    } else {
+      downstream_->sendAbort();
+    }
+  }
+  // Set last, so a requestComplete() triggered above does not delete us
+  taskDone_ = true;
+  maybeDestroy();
+}
+
+void CoroRequestHandler::maybeDestroy() noexcept {
+  if (taskDone_ && requestDone_) {
+    delete this;
+  }
+}
+
+}
+
+#endif // FOLLY_HAS_COROUTINES
@@ -0,0 +1,199 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Portability.h>
+
+#if FOLLY_HAS_COROUTINES
+
+#include <experimental/coroutine>
+#include <folly/Executor.h>
+#include <folly/experimental/coro/Task.h>
+#include <folly/io/IOBufQueue.h>
+#include <proxygen/httpserver/RequestHandler.h>
+#include <stdexcept>
+
+namespace proxygen {
+
+/**
+ * RequestHandler that serves each request from a folly::coro::Task instead
+ * of callbacks.  Subclasses implement handleRequest(), which reads the body
+ * with `co_await readBody()` and writes with `co_await sendBody(...)`, the
+ * latter suspending while the transaction's egress is paused.
+ *
+ * The task starts on the transaction's EventBase.  The awaitables below are
+ * resumed directly from the HTTP callbacks on that thread, without an
+ * executor hop, so reading or writing a chunk does not allocate.  Awaiting
+ * other tasks (e.g. an upstream fetch) works as usual and returns to the
+ * EventBase.
+ *
+ * The handler deletes itself once handleRequest() has returned and the
+ * request is complete.  If the request fails while the task is suspended,
+ * the pending awaitable throws RequestError; the response can no longer be
+ * sent at that point.  If handleRequest() throws before sending headers a
+ * 500 is sent, otherwise the response is aborted.
+ *
+ * This needs coroutine support in the compiler and folly.  The default
+ * -std=c++14 build compiles it out, along with the samples using it; configure
+ * with -DPROXYGEN_ENABLE_COROUTINES=ON to build them.
+ */
+class CoroRequestHandler : public RequestHandler {
+ public:
+  class RequestError : public std::runtime_error {
+   public:
+    explicit RequestError(ProxygenError err);
+
+    ProxygenError getError() const {
+      return err_;
+    }
+
+   private:
+    ProxygenError err_;
+  };
+
+  class BodyAwaitable;
+  class EgressAwaitable;
+
+  void onRequest(std::unique_ptr<HTTPMessage> headers) noexcept final;
+  void onBody(std::unique_ptr<folly::IOBuf> body) noexcept final;
+  void onUpgrade(UpgradeProtocol prot) noexcept final;
+  void onEOM() noexcept final;
+  void requestComplete() noexcept final;
+  void onError(ProxygenError err) noexcept final;
+  void onEgressPaused() noexcept final;
+  void onEgressResumed() noexcept final;
+
+ protected:
+  ~CoroRequestHandler() override = default;
+
+  virtual folly::coro::Task<void> handleRequest(
+      std::unique_ptr<HTTPMessage> headers) = 0;
+
+  /**
+   * The request body received since the last call, or nullptr once the
+   * whole body has been read.
+   */
+  BodyAwaitable readBody() noexcept;
+
+  /**
+   * Sends body right away; awaiting the result waits for egress to resume
+   * if the transaction is paused.
+   */
+  EgressAwaitable sendBody(std::unique_ptr<folly::IOBuf> body) noexcept;
+
+  void sendHeaders(HTTPMessage& msg) noexcept;
+  void sendEOM() noexcept;
+  void sendAbort() noexcept;
+
+  /**
+   * True once the request has completed or failed; nothing more can be
+   * sent.  Useful after awaiting something other than the awaitables above.
+   */
+  bool isRequestDone() const noexcept {
+    return requestDone_;
+  }
+
+ private:
+  // Body buffered beyond this pauses ingress until the task reads it
+  static constexpr size_t kMaxBufferedBody = 64 * 1024;
+
+  bool bodyReady() const noexcept {
+    return !body_.empty() || ingressEOM_ || requestDone_;
+  }
+  std::unique_ptr<folly::IOBuf> takeBody();
+
+  bool egressReady() const noexcept {
+    return !egressPaused_ || requestDone_;
+  }
+  void checkError() const;
+
+  void suspend(std::experimental::coroutine_handle<> waiter) noexcept {
+    DCHECK(!waiter_);
+    waiter_ = waiter;
+  }
+  // May delete this
+  void resume() noexcept;
+
+  void onTaskDone(folly::Try<void>&& result) noexcept;
+  void maybeDestroy() noexcept;
+
+  folly::IOBufQueue body_{folly::IOBufQueue::cacheChainLength()};
+  std::experimental::coroutine_handle<> waiter_;
+  ProxygenError err_{kErrorNone};
+  bool ingressEOM_{false};
+  bool ingressPaused_{false};
+  bool egressPaused_{false};
+  bool headersSent_{false};
+  bool eomSent_{false};
+  bool requestDone_{false};
+  bool taskDone_{false};
+};
+
+class CoroRequestHandler::BodyAwaitable {
+ public:
+  explicit BodyAwaitable(CoroRequestHandler& handler) : handler_(handler) {
+  }
+
+  bool await_ready() const noexcept {
+    return handler_.bodyReady();
+  }
+
+  void await_suspend(std::experimental::coroutine_handle<> waiter) noexcept {
+    handler_.suspend(waiter);
+  }
+
+  std::unique_ptr<folly::IOBuf> await_resume() {
+    return handler_.takeBody();
+  }
+
+  // Always resumed on the handler's EventBase, so no need to hop back
+  friend BodyAwaitable co_viaIfAsync(folly::Executor::KeepAlive<>,
+                                     BodyAwaitable&& awaitable) noexcept {
+    return std::move(awaitable);
+  }
+
+ private:
+  CoroRequestHandler& handler_;
+};
+
+class CoroRequestHandler::EgressAwaitable {
+ public:
+  explicit EgressAwaitable(CoroRequestHandler& handler) : handler_(handler) {
+  }
+
+  bool await_ready() const noexcept {
+    return handler_.egressReady();
+  }
+
+  void await_suspend(std::experimental::coroutine_handle<> waiter) noexcept {
+    handler_.suspend(waiter);
+  }
+
+  void await_resume() {
+    handler_.checkError();
+  }
+
+  friend EgressAwaitable co_viaIfAsync(folly::Executor::KeepAlive<>,
+                                       EgressAwaitable&& awaitable) noexcept {
+    return std::move(awaitable);
+  }
+
+ private:
+  CoroRequestHandler& handler_;
+};
+
+inline CoroRequestHandler::BodyAwaitable
+CoroRequestHandler::readBody() noexcept {
+  return BodyAwaitable(*this);
+}
+
+}
+
+#endif // FOLLY_HAS_COROUTINES
@@ -9,6 +9,7 @@
  */
 #pragma once
 
+#include <proxygen/httpserver/RequestArena.h>
 #include <proxygen/httpserver/RequestHandler.h>
 #include <proxygen/httpserver/ResponseHandler.h>
 
@@ -25,8 +26,13 @@ namespace proxygen {
  * traces and even send direct response if they feel like.
  *
  * The default implementation just lets everything pass through.
+ *
+ * Filters created by a RequestHandlerFactory are allocated from the
+ * request's RequestArena together with the rest of the chain.
  */
-class Filter : public RequestHandler, public ResponseHandler {
+class Filter : public RequestHandler,
+               public ResponseHandler,
+               public RequestArenaAllocated {
  public:
   explicit Filter(RequestHandler* upstream)
       : ResponseHandler(upstream) {
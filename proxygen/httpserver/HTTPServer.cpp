@@ -13,6 +13,7 @@
 #include <folly/executors/thread_factory/NamedThreadFactory.h>
 #include <folly/system/ThreadName.h>
 #include <folly/io/async/EventBaseManager.h>
+#include <folly/portability/Sockets.h>
 #include <proxygen/httpserver/HTTPServerAcceptor.h>
 #include <proxygen/httpserver/SignalHandler.h>
 #include <proxygen/httpserver/filters/RejectConnectFilter.h>
@@ -66,12 +67,18 @@ HTTPServer::HTTPServer(HTTPServerOptions options):
         std::make_unique<RejectConnectFilterFactory>());
   }
 
-  // Add Content Compression filter (gzip), if needed. Should be
+  // Add Content Compression filter (gzip, zstd), if needed. Should be
   // final filter
   if (options_->enableContentCompression) {
     CompressionFilterFactory::Options opts;
     opts.minimumCompressionSize = options_->contentCompressionMinimumSize;
     opts.zlibCompressionLevel = options_->contentCompressionLevel;
+    opts.enableZstd = options_->enableContentCompressionZstd &&
+                      options_->contentCompressionZstdLevel > 0;
+    opts.zstdCompressionLevel = options_->contentCompressionZstdLevel;
+    opts.compressionExecutor = options_->contentCompressionExecutor;
+    opts.offloadCompressionSize = options_->contentCompressionOffloadSize;
+    opts.variantCache = options_->contentCompressionCache;
     opts.compressibleContentTypes = options_->contentCompressionTypes;
     options_->handlerFactories.insert(
         options_->handlerFactories.begin(),
@@ -93,12 +100,35 @@ void HTTPServer::bind(std::vector<IPConfig> const& addrs) {
 
 class HandlerCallbacks : public ThreadPoolExecutor::Observer {
  public:
-  explicit HandlerCallbacks(std::shared_ptr<HTTPServerOptions> options) : options_(options) {}
+  HandlerCallbacks(
+      std::shared_ptr<HTTPServerOptions> options,
+      std::vector<std::vector<int>> cpuSets,
+      std::vector<std::shared_ptr<CpuMigrationObserver>> migrationObservers)
+      : options_(options),
+        cpuSets_(std::move(cpuSets)),
+        migrationObservers_(std::move(migrationObservers)) {}
 
   void threadStarted(ThreadPoolExecutor::ThreadHandle* h) override {
     auto evb = IOThreadPoolExecutor::getEventBase(h);
     CHECK(evb) << "Invariant violated - started thread must have an EventBase";
+    // Threads are numbered in start order, which in reusePortPerThread mode
+    // matches the index passed to reusePortSocketCallback
+    size_t index = nextThread_++;
     evb->runInEventBaseThread([=](){
+      // Pin first so that everything the handlers allocate is node local
+      if (!cpuSets_.empty()) {
+        auto& cpus = cpuSets_[index % cpuSets_.size()];
+        if (!pinCurrentThread(cpus)) {
+          LOG(WARNING) << "Failed to pin IO thread " << index;
+        } else if (options_->threadNumaLocalMemory &&
+                   !preferLocalNumaMemory()) {
+          LOG(WARNING) << "Failed to set NUMA policy for IO thread " << index;
+        }
+      }
+      if (!migrationObservers_.empty()) {
+        evb->setObserver(
+            migrationObservers_[index % migrationObservers_.size()]);
+      }
       for (auto& factory: options_->handlerFactories) {
         factory->onServerStart(evb);
       }
@@ -114,6 +144,9 @@ class HandlerCallbacks : public ThreadPoolExecutor::Observer {
 
  private:
   std::shared_ptr<HTTPServerOptions> options_;
+  const std::vector<std::vector<int>> cpuSets_;
+  const std::vector<std::shared_ptr<CpuMigrationObserver>> migrationObservers_;
+  std::atomic<size_t> nextThread_{0};
 };
 
 
@@ -121,12 +154,41 @@ void HTTPServer::start(std::function<void()> onSuccess,
                        std::function<void(std::exception_ptr)> onError) {
   mainEventBase_ = EventBaseManager::get()->getEventBase();
 
-  auto accExe = std::make_shared<IOThreadPoolExecutor>(1);
-  auto exe = std::make_shared<IOThreadPoolExecutor>(options_->threads,
-    std::make_shared<folly::NamedThreadFactory>("HTTPSrvExec"));
-  auto exeObserver = std::make_shared<HandlerCallbacks>(options_);
+  auto threadFactory =
+      std::make_shared<folly::NamedThreadFactory>("HTTPSrvExec");
+  std::shared_ptr<IOThreadPoolExecutor> accExe;
+  std::vector<std::shared_ptr<IOThreadPoolExecutor>> exes;
+  if (options_->reusePortPerThread) {
+    // Each IO thread accepts for itself, so each gets its own pool
+    FOR_EACH_RANGE (t, 0, options_->threads) {
+      exes.push_back(std::make_shared<IOThreadPoolExecutor>(1, threadFactory));
+    }
+  } else {
+    accExe = std::make_shared<IOThreadPoolExecutor>(1);
+    exes.push_back(std::make_shared<IOThreadPoolExecutor>(options_->threads,
+                                                          threadFactory));
+  }
+  auto cpuSets = options_->threadCpuSets;
+  if (cpuSets.empty() && !options_->threadCpusFromNicRxQueues.empty()) {
+    for (auto cpu : getNicRxQueueCpus(options_->threadCpusFromNicRxQueues)) {
+      cpuSets.push_back({cpu});
+    }
+    LOG_IF(WARNING, cpuSets.empty())
+        << "No RX queue IRQ affinity found for "
+        << options_->threadCpusFromNicRxQueues << ", IO threads not pinned";
+  }
+  if (options_->threadCpuMigrationStats) {
+    FOR_EACH_RANGE (t, 0, options_->threads) {
+      cpuMigrationObservers_.push_back(
+          std::make_shared<CpuMigrationObserver>());
+    }
+  }
+  auto exeObserver = std::make_shared<HandlerCallbacks>(
+      options_, std::move(cpuSets), cpuMigrationObservers_);
   // Observer has to be set before bind(), so onServerStart() callbacks run
-  exe->addObserver(exeObserver);
+  for (auto& exe : exes) {
+    exe->addObserver(exeObserver);
+  }
 
   try {
     FOR_EACH_RANGE (i, 0, addresses_.size()) {
@@ -137,23 +199,21 @@ void HTTPServer::start(std::function<void()> onSuccess,
           codecFactory,
           accConfig,
           sessionInfoCb_);
-      bootstrap_.push_back(
-          wangle::ServerBootstrap<wangle::DefaultPipeline>());
-      bootstrap_[i].childHandler(factory);
-      if (accConfig.enableTCPFastOpen) {
-        // We need to do this because wangle's bootstrap has 2 acceptor configs
-        // and the socketConfig gets passed to the SocketFactory. The number of
-        // configs should really be one, and when that happens, we can remove
-        // this code path.
-        bootstrap_[i].socketConfig.enableTCPFastOpen = true;
-        bootstrap_[i].socketConfig.fastOpenQueueSize =
-            accConfig.fastOpenQueueSize;
-      }
-      bootstrap_[i].group(accExe, exe);
+      AsyncServerSocket::UniquePtr prebound;
       if (options_->preboundSockets_.size() > 0) {
-        bootstrap_[i].bind(std::move(options_->preboundSockets_[i]));
+        prebound = std::move(options_->preboundSockets_[i]);
+      }
+      if (options_->reusePortPerThread) {
+        bindReusePortPerThread(
+            addresses_[i], std::move(prebound), accConfig, factory, exes);
+        continue;
+      }
+      auto& bootstrap = addBootstrap(accConfig, factory);
+      bootstrap.group(accExe, exes[0]);
+      if (prebound) {
+        bootstrap.bind(std::move(prebound));
       } else {
-        bootstrap_[i].bind(addresses_[i].address);
+        bootstrap.bind(addresses_[i].address);
       }
     }
   } catch (const std::exception& ex) {
@@ -185,6 +245,71 @@ void HTTPServer::start(std::function<void()> onSuccess,
   mainEventBase_->loopForever();
 }
 
+wangle::ServerBootstrap<wangle::DefaultPipeline>& HTTPServer::addBootstrap(
+    const AcceptorConfiguration& accConfig,
+    std::shared_ptr<wangle::AcceptorFactory> factory) {
+  bootstrap_.push_back(wangle::ServerBootstrap<wangle::DefaultPipeline>());
+  auto& bootstrap = bootstrap_.back();
+  bootstrap.childHandler(factory);
+  if (accConfig.enableTCPFastOpen) {
+    // We need to do this because wangle's bootstrap has 2 acceptor configs
+    // and the socketConfig gets passed to the SocketFactory. The number of
+    // configs should really be one, and when that happens, we can remove
+    // this code path.
+    bootstrap.socketConfig.enableTCPFastOpen = true;
+    bootstrap.socketConfig.fastOpenQueueSize = accConfig.fastOpenQueueSize;
+  }
+  return bootstrap;
+}
+
+void HTTPServer::bindReusePortPerThread(
+    IPConfig& ipConfig,
+    AsyncServerSocket::UniquePtr prebound,
+    const AcceptorConfiguration& accConfig,
+    std::shared_ptr<wangle::AcceptorFactory> factory,
+    const std::vector<std::shared_ptr<IOThreadPoolExecutor>>& exes) {
+  // The first thread binds (or adopts the prebound socket) so that the rest
+  // can join the same port even if an ephemeral one was requested
+  std::vector<SocketAddress> boundAddresses;
+  FOR_EACH_RANGE (t, 0, exes.size()) {
+    auto& bootstrap = addBootstrap(accConfig, factory);
+    // Acceptor and worker share the thread, so accepted connections never
+    // change threads
+    bootstrap.group(exes[t], exes[t]);
+    bootstrap.setReusePort(true);
+    if (t > 0) {
+      for (auto& address : boundAddresses) {
+        bootstrap.bind(address);
+      }
+    } else if (prebound) {
+      for (auto fd : prebound->getNetworkSockets()) {
+        int reusePort = 0;
+        socklen_t len = sizeof(reusePort);
+        if (getsockopt(fd.toFd(), SOL_SOCKET, SO_REUSEPORT, &reusePort, &len) !=
+                0 ||
+            !reusePort) {
+          throw std::runtime_error(
+              "reusePortPerThread requires prebound sockets with SO_REUSEPORT");
+        }
+      }
+      boundAddresses = prebound->getAddresses();
+      bootstrap.bind(std::move(prebound));
+    } else {
+      bootstrap.bind(ipConfig.address);
+      boundAddresses.push_back(ipConfig.address);
+    }
+
+    if (options_->reusePortSocketCallback) {
+      for (auto& socket : bootstrap.getSockets()) {
+        auto serverSocket =
+            std::dynamic_pointer_cast<AsyncServerSocket>(socket);
+        serverSocket->getEventBase()->runInEventBaseThreadAndWait(
+            [&] { options_->reusePortSocketCallback(*serverSocket, t); });
+      }
+    }
+  }
+}
+
 void HTTPServer::stopListening() {
   for (auto& bootstrap : bootstrap_) {
     bootstrap.stop();
@@ -278,4 +403,14 @@ void HTTPServer::updateTicketSeeds(wangle::TLSTicketKeySeeds seeds) {
   }
 }
 
+HTTPServer::CpuMigrationStats HTTPServer::getCpuMigrationStats() const {
+  CpuMigrationStats stats;
+  for (auto& observer : cpuMigrationObservers_) {
+    stats.samples += observer->getNumSamples();
+    stats.cpuMigrations += observer->getNumCpuMigrations();
+    stats.nodeMigrations += observer->getNumNodeMigrations();
+  }
+  return stats;
+}
+
 }
@@ -15,6 +15,8 @@
 #include <proxygen/httpserver/HTTPServerOptions.h>
 #include <proxygen/lib/http/codec/HTTPCodecFactory.h>
 #include <proxygen/lib/http/session/HTTPSession.h>
+#include <proxygen/lib/services/AcceptorConfiguration.h>
+#include <proxygen/lib/utils/ThreadAffinity.h>
 #include <thread>
 
 namespace proxygen {
@@ -164,6 +166,20 @@ class HTTPServer final {
    */
   void updateTicketSeeds(wangle::TLSTicketKeySeeds seeds);
 
+  struct CpuMigrationStats {
+    uint64_t samples{0};
+    uint64_t cpuMigrations{0};
+    uint64_t nodeMigrations{0};
+  };
+
+  /**
+   * CPU migrations of the IO threads, as seen by sampling the CPU once per
+   * loop iteration, summed over all threads, if
+   * HTTPServerOptions::threadCpuMigrationStats is set.  Can be called from
+   * any thread once start() has called onSuccess.
+   */
+  CpuMigrationStats getCpuMigrationStats() const;
+
  private:
   std::shared_ptr<HTTPServerOptions> options_;
 
@@ -183,6 +199,26 @@ class HTTPServer final {
   std::vector<IPConfig> addresses_;
   std::vector<wangle::ServerBootstrap<wangle::DefaultPipeline>> bootstrap_;
 
+  wangle::ServerBootstrap<wangle::DefaultPipeline>& addBootstrap(
+      const AcceptorConfiguration& accConfig,
+      std::shared_ptr<wangle::AcceptorFactory> factory);
+
+  /**
+   * Bind one SO_REUSEPORT socket per IO thread, each accepting only on its
+   * own thread (see HTTPServerOptions::reusePortPerThread).
+   */
+  void bindReusePortPerThread(
+      IPConfig& ipConfig,
+      folly::AsyncServerSocket::UniquePtr prebound,
+      const AcceptorConfiguration& accConfig,
+      std::shared_ptr<wangle::AcceptorFactory> factory,
+      const std::vector<std::shared_ptr<folly::IOThreadPoolExecutor>>& exes);
+
+  /**
+   * One per IO thread, if threadCpuMigrationStats is set
+   */
+  std::vector<std::shared_ptr<CpuMigrationObserver>> cpuMigrationObservers_;
+
   /**
    * Callback for session create/destruction
    */
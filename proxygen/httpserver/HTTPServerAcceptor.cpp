@@ -10,8 +10,11 @@
 #include <proxygen/httpserver/HTTPServerAcceptor.h>
 
 #include <folly/ExceptionString.h>
+#include <proxygen/httpserver/RequestArena.h>
 #include <proxygen/httpserver/RequestHandlerAdaptor.h>
 #include <proxygen/httpserver/RequestHandlerFactory.h>
+#include <proxygen/httpserver/filters/AdmissionController.h>
+#include <proxygen/httpserver/filters/StaticResponseHandler.h>
 #include <proxygen/lib/http/codec/HTTP1xCodec.h>
 #include <proxygen/lib/http/codec/HTTP2Constants.h>
 #include <proxygen/lib/http/session/HTTPDownstreamSession.h>
@@ -31,6 +34,13 @@ AcceptorConfiguration HTTPServerAcceptor::makeConfig(
   conf.initialReceiveWindow = opts.initialReceiveWindow;
   conf.receiveStreamWindowSize = opts.receiveStreamWindowSize;
   conf.receiveSessionWindowSize = opts.receiveSessionWindowSize;
+  conf.flowControlAutoTuning = opts.flowControlAutoTuning;
+  conf.maxReceiveStreamWindowSize = opts.maxReceiveStreamWindowSize;
+  conf.maxReceiveSessionWindowSize = opts.maxReceiveSessionWindowSize;
+  conf.socketTimestampByteEvents = opts.socketTimestampByteEvents;
+  conf.egressNotSentLowWatermark = opts.egressNotSentLowWatermark;
+  conf.zeroCopyEgressThreshold = opts.zeroCopyEgressThreshold;
+  conf.kernelTLSEgress = opts.kernelTLSEgress;
   conf.acceptBacklog = opts.listenBacklog;
   conf.maxConcurrentIncomingStreams = opts.maxConcurrentIncomingStreams;
 
@@ -105,7 +115,24 @@ HTTPTransactionHandler* HTTPServerAcceptor::newHandler(
   msg->setClientAddress(clientAddr);
   msg->setDstAddress(vipAddr);
 
-  // Create filters chain
+  // Create filters chain, in one arena with the adaptor for the classes
+  // that opt in
+  RequestArena::Scope arena;
+  if (!serverOptions_.staticResponses.empty() &&
+      (msg->getMethod() == HTTPMethod::GET ||
+       msg->getMethod() == HTTPMethod::HEAD)) {
+    auto it = serverOptions_.staticResponses.find(msg->getPath());
+    if (it != serverOptions_.staticResponses.end()) {
+      return new RequestHandlerAdaptor(new StaticResponseHandler(it->second));
+    }
+  }
+
+  auto& admission = serverOptions_.admissionController;
+  if (admission && admission->shouldShed(*getEventBase())) {
+    VLOG(4) << "shedding request for " << msg->getPath();
+    return AdmissionController::makeRejectHandler(txn);
+  }
+
   RequestHandler* h = nullptr;
   for (auto& factory: handlerFactories_) {
     h = factory->onRequest(h, msg);
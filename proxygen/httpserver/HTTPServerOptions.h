@@ -9,15 +9,21 @@
  */
 #pragma once
 
+#include <folly/Executor.h>
 #include <folly/Function.h>
 #include <folly/SocketAddress.h>
 #include <folly/io/async/AsyncServerSocket.h>
 #include <proxygen/httpserver/Filters.h>
 #include <proxygen/httpserver/RequestHandlerFactory.h>
+#include <proxygen/lib/http/StaticResponse.h>
 #include <signal.h>
+#include <unordered_map>
 
 namespace proxygen {
 
+class AdmissionController;
+class CompressedVariantCache;
+
 /**
  * Configuration options for HTTPServer
  *
@@ -49,6 +55,59 @@ class HTTPServerOptions {
    */
   size_t threads = 1;
 
+  /**
+   * Set to true to give every IO thread its own SO_REUSEPORT listening
+   * socket and acceptor, instead of accepting on a single thread and
+   * handing connections to the IO threads. The kernel then spreads new
+   * connections across threads by flow hash, which removes the acceptor
+   * thread as a bottleneck under connection storms.
+   *
+   * Works with preboundSockets_: the prebound socket is used by the first
+   * IO thread and the others bind new sockets to the same addresses, so
+   * prebound sockets must have SO_REUSEPORT set.
+   */
+  bool reusePortPerThread{false};
+
+  /**
+   * Invoked in reusePortPerThread mode for each listening socket, on the IO
+   * thread that owns it, with the thread's index (0 to threads - 1). Use it
+   * to steer connections, e.g. by setting SO_INCOMING_CPU or attaching a
+   * SO_ATTACH_REUSEPORT_CBPF program, and to pin the thread to a CPU.
+   */
+  using ReusePortSocketCallback =
+      std::function<void(folly::AsyncServerSocket&, size_t /* threadIndex */)>;
+  ReusePortSocketCallback reusePortSocketCallback;
+
+  /**
+   * CPU sets to pin IO threads to; IO thread i is pinned to
+   * threadCpuSets[i % threadCpuSets.size()]. Leave empty to let the
+   * scheduler place threads. Pinning one thread per core, on the cores
+   * that take the NIC interrupts, avoids cross-core wakeups on every read.
+   */
+  std::vector<std::vector<int>> threadCpuSets;
+
+  /**
+   * If set and threadCpuSets is empty, pin IO thread i to the CPU servicing
+   * the i-th RX queue interrupt of this network interface, as read from
+   * /sys and /proc. Combine with reusePortPerThread and a
+   * reusePortSocketCallback setting SO_INCOMING_CPU so that a connection is
+   * accepted and served on the core its packets arrive on.
+   */
+  std::string threadCpusFromNicRxQueues;
+
+  /**
+   * Prefer allocating memory for pinned IO threads on their local NUMA
+   * node. Has no effect on threads that are not pinned.
+   */
+  bool threadNumaLocalMemory{false};
+
+  /**
+   * Count IO loop iterations that ran on a different CPU or NUMA node than
+   * the previous one; see HTTPServer::getCpuMigrationStats(). Costs a
+   * sched_getcpu() per loop iteration.
+   */
+  bool threadCpuMigrationStats{false};
+
   /**
    * Chain of RequestHandlerFactory that are used to create RequestHandler
    * which handles requests.
@@ -64,6 +123,24 @@ class HTTPServerOptions {
    */
   std::vector<std::unique_ptr<RequestHandlerFactory>> handlerFactories;
 
+  /**
+   * Responses served straight from the acceptor for GET and HEAD requests
+   * whose path (ignoring any query string) is a key here, before
+   * handlerFactories run.
+   * Their headers are serialized once for every protocol, and each request
+   * only clones buffers; use for health checks, fixed redirects and the
+   * like.  These requests bypass the filters in handlerFactories.
+   */
+  std::unordered_map<std::string, std::shared_ptr<const StaticResponse>>
+      staticResponses;
+
+  /**
+   * When set, consulted for every request after staticResponses and before
+   * handlerFactories; requests it sheds are rejected without building a
+   * handler chain.  See filters/AdmissionController.h.
+   */
+  std::shared_ptr<AdmissionController> admissionController;
+
   /**
    * This idle timeout serves two purposes -
    *
@@ -107,6 +184,51 @@ class HTTPServerOptions {
   size_t receiveStreamWindowSize{65536};
   size_t receiveSessionWindowSize{65536};
 
+  /**
+   * Set to true to autotune HTTP/2 and SPDY receive windows. The stream and
+   * session windows start at the sizes above and grow toward the measured
+   * bandwidth-delay product, up to the maximums below, so that long-RTT
+   * uploads are not window limited. They shrink back when the peer is slow.
+   */
+  bool flowControlAutoTuning{false};
+  size_t maxReceiveStreamWindowSize{16 * 1024 * 1024};
+  size_t maxReceiveSessionWindowSize{64 * 1024 * 1024};
+
+  /**
+   * Set to true to measure when response bytes are transmitted and
+   * acknowledged using kernel socket timestamps (Linux only). Handlers
+   * receive the time to last byte acked through
+   * HTTPTransactionTransportCallback::lastByteAcked.
+   */
+  bool socketTimestampByteEvents{false};
+
+  /**
+   * If non-zero, set TCP_NOTSENT_LOWAT to this many bytes and only generate
+   * response body once the kernel's unsent backlog falls below it. This
+   * keeps the choice of what to send next in the HTTP/2 priority queue
+   * rather than in the socket buffer, lowering time to first byte for high
+   * priority streams that compete with bulk transfers (Linux only).
+   */
+  uint32_t egressNotSentLowWatermark{0};
+
+  /**
+   * If non-zero, plaintext connections send writes of at least this many
+   * bytes with MSG_ZEROCOPY (Linux 4.14+), avoiding the copy of large
+   * response bodies into the kernel. Falls back to regular writes where
+   * unsupported. Zerocopy only pays off for large writes; 64KB or more is a
+   * reasonable starting point.
+   */
+  uint64_t zeroCopyEgressThreshold{0};
+
+  /**
+   * Move egress encryption of TLS connections into the kernel (kTLS, Linux
+   * 4.13+ with the tls module loaded) once the handshake completes. Response
+   * bodies are then copied into the kernel once instead of being encrypted
+   * in userspace first. Only TLS 1.2 with AES-GCM over OpenSSL qualifies;
+   * other connections, or hosts without kTLS, are served as before.
+   */
+  bool kernelTLSEgress{false};
+
   /**
    * The maximum number of transactions the remote could initiate
    * per connection on protocols that allow multiplexing.
@@ -114,8 +236,8 @@ class HTTPServerOptions {
   uint32_t maxConcurrentIncomingStreams{100};
 
   /**
-   * Set to true to enable gzip content compression. Currently false for
-   * backwards compatibility.
+   * Set to true to enable gzip (and, see below, zstd) content compression.
+   * Currently false for backwards compatibility.
    */
   bool enableContentCompression{false};
 
@@ -130,6 +252,31 @@ class HTTPServerOptions {
    */
   int contentCompressionLevel{-1};
 
+  /**
+   * Set to true to also offer zstd to clients that accept it.  Off by
+   * default, so turning on content compression keeps negotiating gzip only.
+   */
+  bool enableContentCompressionZstd{false};
+
+  /**
+   * Zstd compression level used with enableContentCompressionZstd, 1 to 19.
+   */
+  int contentCompressionZstdLevel{3};
+
+  /**
+   * If set, response body chunks of at least contentCompressionOffloadSize
+   * bytes are compressed on this executor rather than on the IO threads,
+   * so that large responses do not hold up other connections.
+   */
+  std::shared_ptr<folly::Executor> contentCompressionExecutor;
+  uint32_t contentCompressionOffloadSize{64 * 1024};
+
+  /**
+   * If set, compressed bodies of non-chunked responses are kept here and
+   * reused for byte-identical responses instead of compressing them again.
+   */
+  std::shared_ptr<CompressedVariantCache> contentCompressionCache;
+
   /**
    * Enable support for pub-sub extension.
    */
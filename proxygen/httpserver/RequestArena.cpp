@@ -0,0 +1,135 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/RequestArena.h>
+
+#include <new>
+
+namespace {
+
+constexpr size_t kAlign = alignof(std::max_align_t);
+
+constexpr size_t alignUp(size_t n) {
+  return (n + kAlign - 1) & ~(kAlign - 1);
+}
+
+// Each allocation is preceded by a header holding its arena, or nullptr
+// for heap allocations
+constexpr size_t kHeaderSize = alignUp(sizeof(void*));
+
+// Enough for a burst of concurrent requests on one thread
+constexpr size_t kMaxCachedSlabs = 256;
+
+} // namespace
+
+namespace proxygen {
+
+struct RequestArena::ThreadCache {
+  RequestArena* head{nullptr};
+  size_t size{0};
+  Stats stats;
+
+  ~ThreadCache() {
+    while (head) {
+      auto next = head->nextFree_;
+      head->~RequestArena();
+      ::operator delete(head);
+      head = next;
+    }
+  }
+};
+
+FOLLY_TLS RequestArena* RequestArena::current_ = nullptr;
+
+RequestArena::ThreadCache& RequestArena::threadCache() {
+  static thread_local ThreadCache cache;
+  return cache;
+}
+
+const RequestArena::Stats& RequestArena::getThreadStats() {
+  return threadCache().stats;
+}
+
+RequestArena* RequestArena::acquire() {
+  auto& cache = threadCache();
+  RequestArena* arena = cache.head;
+  if (arena) {
+    cache.head = arena->nextFree_;
+    cache.size--;
+    cache.stats.slabReuses++;
+  } else {
+    arena = new (::operator new(kSlabSize)) RequestArena();
+    cache.stats.slabAllocations++;
+  }
+  arena->used_ = alignUp(sizeof(RequestArena));
+  arena->refs_.store(1, std::memory_order_relaxed);
+  arena->nextFree_ = nullptr;
+  return arena;
+}
+
+void RequestArena::release() noexcept {
+  if (refs_.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+    return;
+  }
+  // Cache on whichever thread drops the last reference
+  auto& cache = threadCache();
+  if (cache.size < kMaxCachedSlabs) {
+    nextFree_ = cache.head;
+    cache.head = this;
+    cache.size++;
+  } else {
+    this->~RequestArena();
+    ::operator delete(this);
+  }
+}
+
+RequestArena::Scope::Scope() : arena_(acquire()), prev_(current_) {
+  current_ = arena_;
+}
+
+RequestArena::Scope::~Scope() {
+  current_ = prev_;
+  arena_->release();
+}
+
+void* RequestArena::allocate(size_t size) {
+  size_t total = kHeaderSize + alignUp(size);
+  RequestArena* owner = nullptr;
+  char* block;
+  auto arena = current_;
+  if (arena && arena->used_ + total <= kSlabSize) {
+    block = reinterpret_cast<char*>(arena) + arena->used_;
+    arena->used_ += total;
+    arena->refs_.fetch_add(1, std::memory_order_relaxed);
+    owner = arena;
+    threadCache().stats.objects++;
+  } else {
+    block = static_cast<char*>(::operator new(total));
+    if (arena) {
+      threadCache().stats.overflows++;
+    }
+  }
+  *reinterpret_cast<RequestArena**>(block) = owner;
+  return block + kHeaderSize;
+}
+
+void RequestArena::deallocate(void* ptr) noexcept {
+  if (!ptr) {
+    return;
+  }
+  auto block = static_cast<char*>(ptr) - kHeaderSize;
+  auto owner = *reinterpret_cast<RequestArena**>(block);
+  if (owner) {
+    owner->release();
+  } else {
+    ::operator delete(block);
+  }
+}
+
+}
@@ -0,0 +1,121 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <folly/Portability.h>
+
+namespace proxygen {
+
+/**
+ * Per-request slab that the handler chain of a request is allocated from.
+ *
+ * HTTPServerAcceptor opens a RequestArena::Scope while it runs the
+ * RequestHandlerFactory chain for a new transaction.  Every object of a
+ * class deriving from RequestArenaAllocated that is created in that scope
+ * (Filters, the RequestHandlerAdaptor, and any handler that opts in) is
+ * carved out of one slab instead of being heap allocated.  Objects still
+ * delete themselves as usual; the slab goes back to a per-thread cache once
+ * the last object in it is destroyed, so in steady state building a chain
+ * does not touch malloc at all.
+ *
+ * Objects that do not fit, or that are created outside a scope, fall back
+ * to the heap transparently.
+ */
+class RequestArena {
+ public:
+  static constexpr size_t kSlabSize = 2048;
+
+  /**
+   * Counters for the calling thread.
+   */
+  struct Stats {
+    // Objects allocated from a slab
+    uint64_t objects{0};
+    // Objects that did not fit in the slab of their scope
+    uint64_t overflows{0};
+    // Slabs that had to be allocated from the heap
+    uint64_t slabAllocations{0};
+    // Slabs reused from the thread's cache
+    uint64_t slabReuses{0};
+  };
+
+  static const Stats& getThreadStats();
+
+  /**
+   * Makes a fresh arena current on this thread until destroyed.  Scopes
+   * nest.
+   */
+  class Scope {
+   public:
+    Scope();
+    ~Scope();
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+   private:
+    RequestArena* arena_;
+    RequestArena* prev_;
+  };
+
+  /**
+   * Allocate from the current arena, or from the heap if there is none or it
+   * is full.  The result must be freed with deallocate().
+   */
+  static void* allocate(size_t size);
+  static void deallocate(void* ptr) noexcept;
+
+ private:
+  struct ThreadCache;
+  static ThreadCache& threadCache();
+
+  RequestArena() = default;
+
+  static RequestArena* acquire();
+  void release() noexcept;
+
+  size_t used_{0};
+  std::atomic<uint32_t> refs_{1};
+  RequestArena* nextFree_{nullptr};
+
+  static FOLLY_TLS RequestArena* current_;
+};
+
+/**
+ * Inherit from this to have instances allocated from the current
+ * RequestArena.  Safe to delete from any thread and at any time, including
+ * after the rest of the chain is gone; the slab lives until its last object
+ * does.
+ */
+class RequestArenaAllocated {
+ public:
+  static void* operator new(size_t size) {
+    return RequestArena::allocate(size);
+  }
+
+  static void operator delete(void* ptr) noexcept {
+    RequestArena::deallocate(ptr);
+  }
+
+  static void* operator new(size_t, void* ptr) noexcept {
+    return ptr;
+  }
+
+  static void operator delete(void*, void*) noexcept {
+  }
+
+ protected:
+  ~RequestArenaAllocated() = default;
+};
+
+}
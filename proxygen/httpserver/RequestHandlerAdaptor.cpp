@@ -162,6 +162,18 @@ void RequestHandlerAdaptor::sendAbort() noexcept {
   txn_->sendAbort();
 }
 
+void RequestHandlerAdaptor::sendStaticResponse(
+    const StaticResponse& response) noexcept {
+  auto body = response.cloneBody();
+  if (!body) {
+    txn_->sendHeadersWithEOM(response.getMessage());
+    return;
+  }
+  txn_->sendHeaders(response.getMessage());
+  txn_->sendBody(std::move(body));
+  txn_->sendEOM();
+}
+
 void RequestHandlerAdaptor::refreshTimeout() noexcept {
   txn_->refreshTimeout();
 }
@@ -9,6 +9,7 @@
  */
 #pragma once
 
+#include <proxygen/httpserver/RequestArena.h>
 #include <proxygen/httpserver/ResponseHandler.h>
 #include <proxygen/lib/http/session/HTTPTransaction.h>
 
@@ -34,7 +35,8 @@ class PushHandler;
  */
 class RequestHandlerAdaptor
     : public HTTPTransactionHandler,
-      public ResponseHandler {
+      public ResponseHandler,
+      public RequestArenaAllocated {
  public:
   explicit RequestHandlerAdaptor(RequestHandler* requestHandler);
 
@@ -61,6 +63,7 @@ class RequestHandlerAdaptor
   void sendChunkTerminator() noexcept override;
   void sendEOM() noexcept override;
   void sendAbort() noexcept override;
+  void sendStaticResponse(const StaticResponse& response) noexcept override;
   void refreshTimeout() noexcept override;
   void pauseIngress() noexcept override;
   void resumeIngress() noexcept override;
@@ -9,6 +9,7 @@
  */
 #pragma once
 
+#include <proxygen/lib/http/StaticResponse.h>
 #include <proxygen/lib/http/session/HTTPTransaction.h>
 
 namespace proxygen {
@@ -68,6 +69,22 @@ class ResponseHandler {
 
   virtual void sendAbort() noexcept = 0;
 
+  /**
+   * Sends a complete response whose headers were serialized up front.
+   *
+   * The default sends a copy of the message through sendHeaders(), so that
+   * filters may still modify it, at the cost of serializing it again.  The
+   * handler talking to the transaction sends the shared message unchanged.
+   */
+  virtual void sendStaticResponse(const StaticResponse& response) noexcept {
+    HTTPMessage msg(response.getMessage());
+    sendHeaders(msg);
+    if (auto body = response.cloneBody()) {
+      sendBody(std::move(body));
+    }
+    sendEOM();
+  }
+
   virtual void refreshTimeout() noexcept = 0;
 
   virtual void pauseIngress() noexcept = 0;
@@ -0,0 +1,135 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/filters/AdmissionController.h>
+
+#include <folly/Random.h>
+#include <proxygen/lib/http/session/HTTPDirectResponseHandler.h>
+
+namespace {
+
+// 0 below soft, 1 at or above hard and linear in between
+double ramp(double value, double soft, double hard) {
+  if (soft <= 0 || value < soft) {
+    return 0;
+  }
+  if (value >= hard) {
+    return 1;
+  }
+  return (value - soft) / (hard - soft);
+}
+
+class RefuseStreamHandler : public proxygen::HTTPTransaction::Handler {
+ public:
+  void setTransaction(proxygen::HTTPTransaction* txn) noexcept override {
+    txn_ = txn;
+  }
+
+  void detachTransaction() noexcept override {
+    delete this;
+  }
+
+  void onHeadersComplete(
+      std::unique_ptr<proxygen::HTTPMessage> /*msg*/) noexcept override {
+    txn_->sendAbortWithCode(proxygen::ErrorCode::REFUSED_STREAM);
+  }
+
+  void onBody(std::unique_ptr<folly::IOBuf> /*chain*/) noexcept override {}
+
+  void onTrailers(
+      std::unique_ptr<proxygen::HTTPHeaders> /*trailers*/) noexcept override {}
+
+  void onEOM() noexcept override {}
+
+  void onUpgrade(proxygen::UpgradeProtocol /*protocol*/) noexcept override {}
+
+  void onError(const proxygen::HTTPException& /*error*/) noexcept override {}
+
+  void onEgressPaused() noexcept override {}
+
+  void onEgressResumed() noexcept override {}
+
+ private:
+  proxygen::HTTPTransaction* txn_{nullptr};
+};
+
+}
+
+namespace proxygen {
+
+AdmissionController::AdmissionController(
+    std::shared_ptr<const ResourceStats> stats,
+    Options options)
+    : stats_(std::move(stats)), options_(std::move(options)) {
+  CHECK_LE(options_.cpuSoftLimit, options_.cpuHardLimit);
+  CHECK_LE(options_.softIrqCpuSoftLimit, options_.softIrqCpuHardLimit);
+  CHECK_LE(options_.memSoftLimit, options_.memHardLimit);
+  CHECK_LE(options_.loopTimeSoftLimit.count(),
+           options_.loopTimeHardLimit.count());
+  CHECK(options_.maxShedRatio >= 0 && options_.maxShedRatio <= 1.0);
+}
+
+double AdmissionController::getShedRatio(
+    const ResourceData& data,
+    std::chrono::microseconds avgLoopTime) const {
+  double ratio = ramp(data.getCpuRatioUtil(),
+                      options_.cpuSoftLimit,
+                      options_.cpuHardLimit);
+  ratio = std::max(ratio,
+                   ramp(data.getSoftIrqCpuRatioUtil(),
+                        options_.softIrqCpuSoftLimit,
+                        options_.softIrqCpuHardLimit));
+  if (data.getTotalMemBytes() > 0) {
+    ratio = std::max(ratio,
+                     ramp(data.getUsedMemRatio(),
+                          options_.memSoftLimit,
+                          options_.memHardLimit));
+  }
+  if (options_.shedOnTcpMemPressure) {
+    // Both ratios are 0 when the limits are unknown, which disables this
+    ratio = std::max(ratio,
+                     ramp(data.getTcpMemRatio(),
+                          data.getPressureTcpMemLimitRatio(),
+                          1.0));
+  }
+  ratio = std::max(ratio,
+                   ramp(avgLoopTime.count(),
+                        options_.loopTimeSoftLimit.count(),
+                        options_.loopTimeHardLimit.count()));
+  return std::min(ratio, options_.maxShedRatio);
+}
+
+bool AdmissionController::shouldShed(folly::EventBase& evb) const {
+  ResourceData data;
+  if (stats_) {
+    data = stats_->getLoadSnapshot();
+    if (options_.maxStatsAge.count() > 0 &&
+        data.getLastUpdateTime() + options_.maxStatsAge <
+            ResourceData::getEpochTime()) {
+      VLOG(5) << "ignoring stale resource stats";
+      data = ResourceData();
+    }
+  }
+  auto avgLoopTime =
+      std::chrono::microseconds(static_cast<int64_t>(evb.getAvgLoopTime()));
+  auto ratio = getShedRatio(data, avgLoopTime);
+  return ratio > 0 && folly::Random::randDouble01() < ratio;
+}
+
+HTTPTransaction::Handler* AdmissionController::makeRejectHandler(
+    HTTPTransaction& txn) {
+  if (txn.getTransport().getCodec().supportsParallelRequests()) {
+    return new RefuseStreamHandler();
+  }
+  auto handler = new HTTPDirectResponseHandler(503, "Service Unavailable");
+  handler->forceConnectionClose(false);
+  return handler;
+}
+
+}
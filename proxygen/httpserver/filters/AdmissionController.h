@@ -0,0 +1,99 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <folly/io/async/EventBase.h>
+#include <proxygen/lib/http/session/HTTPTransaction.h>
+#include <proxygen/lib/statistics/ResourceStats.h>
+
+namespace proxygen {
+
+/**
+ * Sheds requests when the server is overloaded, before any handler is built
+ * for them, so that the requests that are admitted keep their latency.
+ *
+ * Each signal has a soft and a hard limit.  Below the soft limit it does not
+ * shed, at the hard limit it sheds everything and in between the fraction
+ * shed grows linearly.  The signal with the highest fraction wins.  The
+ * signals are
+ *  - system CPU, soft IRQ CPU and memory utilization, read from a
+ *    ResourceStats snapshot (lock free, see ResourceStats::getLoadSnapshot())
+ *  - TCP memory, ramping from the kernel's pressure threshold to its limit
+ *  - the average busy time of an event loop iteration on the IO thread that
+ *    read the request, which is roughly how long ready events wait there
+ *
+ * Shed HTTP/2 and HTTP/3 requests are refused with REFUSED_STREAM, which
+ * tells the client the request was not processed and can be retried; shed
+ * HTTP/1.x requests get a 503 without closing the connection.
+ *
+ * Set HTTPServerOptions::admissionController to use it.  One instance is
+ * shared by all IO threads; the ResourceStats must be refreshing
+ * (ResourceStats::refreshWithPeriod()) for the resource signals to apply.
+ */
+class AdmissionController {
+ public:
+  struct Options {
+    // Utilization ratios (0-1.0).  A soft limit of 0 disables the signal.
+    double cpuSoftLimit{0.90};
+    double cpuHardLimit{0.99};
+    double softIrqCpuSoftLimit{0};
+    double softIrqCpuHardLimit{1.0};
+    double memSoftLimit{0.90};
+    double memHardLimit{0.98};
+
+    bool shedOnTcpMemPressure{true};
+
+    // Average event loop busy time.  A soft limit of 0 disables the signal.
+    std::chrono::microseconds loopTimeSoftLimit{5000};
+    std::chrono::microseconds loopTimeHardLimit{50000};
+
+    // Resource signals are ignored when the snapshot is older than this,
+    // e.g. because the ResourceStats stopped refreshing.  0 to disable.
+    std::chrono::milliseconds maxStatsAge{5000};
+
+    // Never shed more than this fraction of requests
+    double maxShedRatio{1.0};
+  };
+
+  AdmissionController(std::shared_ptr<const ResourceStats> stats,
+                      Options options);
+
+  explicit AdmissionController(std::shared_ptr<const ResourceStats> stats)
+      : AdmissionController(std::move(stats), Options()) {
+  }
+
+  const Options& getOptions() const {
+    return options_;
+  }
+
+  /**
+   * The fraction of requests (0-1.0) to shed given these readings.
+   */
+  double getShedRatio(const ResourceData& data,
+                      std::chrono::microseconds avgLoopTime) const;
+
+  /**
+   * Randomly decides whether to shed a request read by evb's thread, in
+   * proportion to getShedRatio().  Must be called from that thread.
+   */
+  bool shouldShed(folly::EventBase& evb) const;
+
+  /**
+   * A handler that rejects the request on txn as described above.
+   */
+  static HTTPTransaction::Handler* makeRejectHandler(HTTPTransaction& txn);
+
+ private:
+  std::shared_ptr<const ResourceStats> stats_;
+  Options options_;
+};
+
+}
@@ -0,0 +1,210 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/filters/CompressedVariantCache.h>
+
+#include <folly/Conv.h>
+#include <folly/FileUtil.h>
+#include <folly/ScopeGuard.h>
+#include <folly/hash/SpookyHashV2.h>
+#include <folly/portability/Fcntl.h>
+#include <folly/portability/SysStat.h>
+
+using folly::StringPiece;
+using std::chrono::nanoseconds;
+
+namespace proxygen {
+
+struct CompressedVariantCache::Entry {
+  std::unique_ptr<folly::IOBuf> body;
+  size_t uncompressedSize{0};
+  nanoseconds compressionTime{0};
+  // For sidecars, the state of the files the body was read from
+  std::string version;
+  size_t size{0};
+};
+
+CompressedVariantCache::CompressedVariantCache(Options options)
+    : options_(std::move(options)),
+      cache_(options_.maxBytes, options_.numShards) {
+}
+
+CompressedVariantCache::~CompressedVariantCache() {
+}
+
+std::unique_ptr<folly::IOBuf> CompressedVariantCache::lookupVersion(
+    const std::string& key, StringPiece version) {
+  auto& shard = cache_.getShard(Cache::hashKey(key));
+  std::lock_guard<std::mutex> guard(shard.mutex);
+  auto& stats = shard.extra;
+  auto it = shard.map.find(key);
+  if (it == shard.map.end() || it->second->version != version) {
+    stats.misses++;
+    return nullptr;
+  }
+  const auto& entry = *it->second;
+  stats.hits++;
+  stats.bytesNotCompressed += entry.uncompressedSize;
+  stats.compressionTimeSaved += entry.compressionTime;
+  return entry.body->clone();
+}
+
+void CompressedVariantCache::insertEntry(const std::string& key,
+                                         std::shared_ptr<const Entry> entry) {
+  auto& shard = cache_.getShard(Cache::hashKey(key));
+  if (entry->size > options_.maxEntryBytes ||
+      !shard.fits(key, entry->size)) {
+    VLOG(4) << "not caching " << key << ", " << entry->size
+            << " bytes is too big";
+    return;
+  }
+  std::lock_guard<std::mutex> guard(shard.mutex);
+  shard.extra.evictions += shard.set(key, std::move(entry));
+  shard.extra.stores++;
+}
+
+folly::Optional<std::string> CompressedVariantCache::getStrongETag(
+    const HTTPMessage& msg) {
+  const auto& etag = msg.getHeaders().getSingleOrEmpty(HTTP_HEADER_ETAG);
+  if (etag.empty() || StringPiece(etag).startsWith("W/")) {
+    return folly::none;
+  }
+  return etag;
+}
+
+std::string CompressedVariantCache::identifyByETag(StringPiece host,
+                                                   StringPiece url,
+                                                   StringPiece etag) {
+  return folly::to<std::string>(host, " ", url, " ", etag);
+}
+
+std::string CompressedVariantCache::hashContent(const folly::IOBuf& body) {
+  folly::hash::SpookyHashV2 hasher;
+  hasher.Init(0, 0);
+  size_t length = 0;
+  for (auto range : body) {
+    hasher.Update(range.data(), range.size());
+    length += range.size();
+  }
+  uint64_t hash1;
+  uint64_t hash2;
+  hasher.Final(&hash1, &hash2);
+  return folly::to<std::string>("#", length, ":", hash1, ":", hash2);
+}
+
+std::string CompressedVariantCache::makeKey(StringPiece id,
+                                            StringPiece encoding,
+                                            int level) {
+  return folly::to<std::string>(encoding, " ", level, " ", id);
+}
+
+StringPiece CompressedVariantCache::getSidecarSuffix(StringPiece encoding) {
+  if (encoding == "gzip") {
+    return ".gz";
+  } else if (encoding == "zstd") {
+    return ".zst";
+  }
+  return "";
+}
+
+std::unique_ptr<folly::IOBuf> CompressedVariantCache::lookup(
+    const std::string& key) {
+  return lookupVersion(key, "");
+}
+
+void CompressedVariantCache::insert(const std::string& key,
+                                    std::unique_ptr<folly::IOBuf> body,
+                                    size_t uncompressedSize,
+                                    nanoseconds compressionTime) {
+  auto entry = std::make_shared<Entry>();
+  entry->size = body->computeChainDataLength();
+  entry->body = std::move(body);
+  entry->uncompressedSize = uncompressedSize;
+  entry->compressionTime = compressionTime;
+  insertEntry(key, std::move(entry));
+}
+
+std::unique_ptr<folly::IOBuf> CompressedVariantCache::getSidecar(
+    const std::string& path, StringPiece encoding) {
+  auto suffix = getSidecarSuffix(encoding);
+  if (suffix.empty()) {
+    return nullptr;
+  }
+  auto sidecarPath = folly::to<std::string>(path, suffix);
+  struct stat original;
+  struct stat sidecar;
+  if (stat(path.c_str(), &original) != 0 ||
+      stat(sidecarPath.c_str(), &sidecar) != 0 ||
+      !S_ISREG(sidecar.st_mode) || sidecar.st_mtime < original.st_mtime) {
+    return nullptr;
+  }
+
+  // A change to either file makes the cached copy stale
+  auto getVersion = [&original](const struct stat& sidecarStat) {
+    return folly::to<std::string>(original.st_mtime, " ",
+                                  original.st_size, " ",
+                                  sidecarStat.st_mtime, " ",
+                                  sidecarStat.st_size);
+  };
+  auto key = makeKey(path, encoding, 0);
+  auto body = lookupVersion(key, getVersion(sidecar));
+  if (body) {
+    return body;
+  }
+
+  int fd = folly::openNoInt(sidecarPath.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return nullptr;
+  }
+  SCOPE_EXIT {
+    folly::closeNoInt(fd);
+  };
+  // The file may have been replaced since; describe the one read
+  if (fstat(fd, &sidecar) != 0 || !S_ISREG(sidecar.st_mode)) {
+    return nullptr;
+  }
+  size_t size = sidecar.st_size;
+  body = folly::IOBuf::create(size);
+  if (folly::readFull(fd, body->writableTail(), size) != ssize_t(size)) {
+    VLOG(4) << "failed to read " << sidecarPath;
+    return nullptr;
+  }
+  body->append(size);
+  {
+    auto& shard = cache_.getShard(Cache::hashKey(key));
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    shard.extra.sidecarLoads++;
+  }
+  auto entry = std::make_shared<Entry>();
+  entry->body = body->clone();
+  entry->uncompressedSize = original.st_size;
+  entry->version = getVersion(sidecar);
+  entry->size = size;
+  insertEntry(key, std::move(entry));
+  return body;
+}
+
+CompressedVariantCache::Stats CompressedVariantCache::getStats() const {
+  Stats total;
+  cache_.forEachShard([&total](const Cache::Shard& shard) {
+    const auto& stats = shard.extra;
+    total.hits += stats.hits;
+    total.misses += stats.misses;
+    total.stores += stats.stores;
+    total.evictions += stats.evictions;
+    total.sidecarLoads += stats.sidecarLoads;
+    total.bytesNotCompressed += stats.bytesNotCompressed;
+    total.compressionTimeSaved += stats.compressionTimeSaved;
+    total.entries += shard.map.size();
+    total.bytes += shard.bytes;
+  });
+  return total;
+}
+
+}
@@ -0,0 +1,140 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <folly/Optional.h>
+#include <folly/Range.h>
+#include <folly/io/IOBuf.h>
+#include <proxygen/httpserver/filters/ShardedLRUCache.h>
+#include <proxygen/lib/http/HTTPMessage.h>
+
+namespace proxygen {
+
+/**
+ * Compressed response bodies shared by all IO threads, so that
+ * CompressionFilter compresses a byte-identical response once rather than
+ * on every request.
+ *
+ * Entries are keyed by the identity of the uncompressed body (the host, URL
+ * and strong ETag of the response, or else a hash of its content), the
+ * encoding and the level.
+ * Bodies are immutable once stored and handed out as clones.
+ *
+ * The cache can also serve precompressed sidecar files of static content
+ * (foo.html.gz, foo.html.zst), re-reading them only when they change.
+ *
+ * Bodies are kept in a ShardedLRUCache.
+ */
+class CompressedVariantCache {
+ public:
+  struct Options {
+    // Byte budget for compressed bodies and keys, split evenly between shards
+    size_t maxBytes{32 * 1024 * 1024};
+    // Rounded up to a power of two
+    size_t numShards{8};
+    // Larger compressed bodies are not stored
+    size_t maxEntryBytes{4 * 1024 * 1024};
+  };
+
+  struct Stats {
+    uint64_t hits{0};
+    uint64_t misses{0};
+    uint64_t stores{0};
+    uint64_t evictions{0};
+    uint64_t sidecarLoads{0};
+    // Uncompressed bytes that hits did not have to compress
+    uint64_t bytesNotCompressed{0};
+    // Time the compressions that hits replaced took when the entries were
+    // made.  Sidecar hits do not count here.
+    std::chrono::nanoseconds compressionTimeSaved{0};
+    uint64_t entries{0};
+    uint64_t bytes{0};
+
+    double getHitRate() const {
+      auto lookups = hits + misses;
+      return lookups ? double(hits) / lookups : 0;
+    }
+  };
+
+  explicit CompressedVariantCache(Options options);
+
+  CompressedVariantCache() : CompressedVariantCache(Options()) {
+  }
+
+  ~CompressedVariantCache();
+
+  /**
+   * The response's ETag if it is a strong one.  A weak ETag does not
+   * promise byte-identical bodies, so it can not key compressed output.
+   */
+  static folly::Optional<std::string> getStrongETag(const HTTPMessage& msg);
+
+  /**
+   * Identifies a body by the resource it was served for and its strong
+   * ETag.  An ETag is only unique within one resource.
+   */
+  static std::string identifyByETag(folly::StringPiece host,
+                                    folly::StringPiece url,
+                                    folly::StringPiece etag);
+
+  /**
+   * Identifies a body by length and a 128 bit hash of its content.
+   */
+  static std::string hashContent(const folly::IOBuf& body);
+
+  static std::string makeKey(folly::StringPiece id,
+                             folly::StringPiece encoding,
+                             int level);
+
+  /**
+   * File name suffix of sidecars for an encoding, empty if there are none.
+   */
+  static folly::StringPiece getSidecarSuffix(folly::StringPiece encoding);
+
+  /**
+   * A clone of the body stored under key, or nullptr.
+   */
+  std::unique_ptr<folly::IOBuf> lookup(const std::string& key);
+
+  /**
+   * Stores body, the compressed form of uncompressedSize bytes that took
+   * compressionTime to produce.
+   */
+  void insert(const std::string& key,
+              std::unique_ptr<folly::IOBuf> body,
+              size_t uncompressedSize,
+              std::chrono::nanoseconds compressionTime);
+
+  /**
+   * The contents of path's sidecar for encoding, if it exists and is at
+   * least as recent as path.  Loaded once and kept until either file
+   * changes.  Does blocking file IO on a miss.
+   */
+  std::unique_ptr<folly::IOBuf> getSidecar(const std::string& path,
+                                           folly::StringPiece encoding);
+
+  Stats getStats() const;
+
+ private:
+  struct Entry;
+  using Cache = ShardedLRUCache<Entry, Stats>;
+
+  // A clone of the body under key if it was stored for version
+  std::unique_ptr<folly::IOBuf> lookupVersion(const std::string& key,
+                                              folly::StringPiece version);
+
+  void insertEntry(const std::string& key, std::shared_ptr<const Entry> entry);
+
+  Options options_;
+  Cache cache_;
+};
+
+}
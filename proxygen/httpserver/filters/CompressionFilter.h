@@ -9,55 +9,128 @@
  */
 #pragma once
 
+#include <deque>
+#include <folly/Executor.h>
 #include <folly/Memory.h>
+#include <folly/String.h>
+#include <folly/io/async/EventBase.h>
 
 #include <proxygen/httpserver/Filters.h>
 #include <proxygen/httpserver/RequestHandlerFactory.h>
+#include <proxygen/httpserver/filters/CompressedVariantCache.h>
 #include <proxygen/lib/http/RFC2616.h>
 #include <proxygen/lib/utils/StreamCompressor.h>
+#include <proxygen/lib/utils/UtilInl.h>
 #include <proxygen/lib/utils/ZlibStreamCompressor.h>
+#include <proxygen/lib/utils/ZstdStreamCompressor.h>
 
 namespace proxygen {
 
 /**
  * A Server filter to perform compression. If there are any errors it will
  * fall back to sending uncompressed responses.
+ *
+ * If given an executor, body chunks of at least offloadCompressionSize bytes
+ * are compressed on it rather than on the IO thread.  Everything sent after
+ * such a chunk is queued behind it, so output order is unchanged, and the
+ * queue is only worked through while egress is not paused.  The handler is
+ * paused while more than kMaxQueuedChunks' worth of bytes wait in the
+ * queue.
+ *
+ * If given a CompressedVariantCache, non-chunked 200 responses are looked up
+ * in it by host, URL and strong ETag, or failing that by a hash of the body,
+ * and compressed output is stored there.  On a hit the stored body is sent
+ * as is, with its Content-Length, and whatever the handler sends is
+ * dropped.  The factory only hands the cache to filters of GET requests.
  */
 class CompressionFilter : public Filter {
  public:
   using StreamCompressorFactory =
       std::function<std::unique_ptr<StreamCompressor>()>;
 
+  // Bytes the queue may hold, in units of offloadCompressionSize, before
+  // the handler is paused
+  static constexpr uint32_t kMaxQueuedChunks = 4;
+
   CompressionFilter(
       RequestHandler* downstream,
       uint32_t minimumCompressionSize,
       StreamCompressorFactory factory,
       std::string headerEncoding,
-      const std::shared_ptr<std::set<std::string>> compressibleContentTypes)
+      const std::shared_ptr<std::set<std::string>> compressibleContentTypes,
+      std::shared_ptr<folly::Executor> executor = nullptr,
+      uint32_t offloadCompressionSize = 0,
+      std::shared_ptr<CompressedVariantCache> variantCache = nullptr,
+      int32_t compressionLevel = 0,
+      std::string host = "",
+      std::string url = "")
       : Filter(downstream),
         minimumCompressionSize_(minimumCompressionSize),
         compressorFactory_(std::move(factory)),
         headerEncoding_(std::move(headerEncoding)),
-        compressibleContentTypes_(compressibleContentTypes) {
+        compressibleContentTypes_(compressibleContentTypes),
+        executor_(std::move(executor)),
+        offloadCompressionSize_(offloadCompressionSize),
+        variantCache_(std::move(variantCache)),
+        compressionLevel_(compressionLevel),
+        host_(std::move(host)),
+        url_(std::move(url)) {
   }
 
   virtual ~CompressionFilter() override {
   }
 
+  void requestComplete() noexcept override {
+    if (compressing_) {
+      // Deleted once the compression job is back
+      upstream_->requestComplete();
+      detach();
+      return;
+    }
+    Filter::requestComplete();
+  }
+
+  void onError(ProxygenError err) noexcept override {
+    if (compressing_) {
+      upstream_->onError(err);
+      detach();
+      return;
+    }
+    Filter::onError(err);
+  }
+
+  void onEgressPaused() noexcept override {
+    egressPaused_ = true;
+    updateUpstreamPaused();
+  }
+
+  void onEgressResumed() noexcept override {
+    egressPaused_ = false;
+    if (drainQueue()) {
+      updateUpstreamPaused();
+    }
+  }
+
   void sendHeaders(HTTPMessage& msg) noexcept override {
     DCHECK(compressor_ == nullptr);
     DCHECK(header_ == false);
 
     chunked_ = msg.getIsChunked();
 
-    // Make final determination of whether to compress
-    compress_ = isCompressibleContentType(msg) &&
+    // Make final determination of whether to compress.  Responses the
+    // handler already encoded are left alone.
+    compress_ = !msg.getHeaders().exists(HTTP_HEADER_CONTENT_ENCODING) &&
+                isCompressibleContentType(msg) &&
                 (chunked_ || isMinimumCompressibleSize(msg));
 
-    // Add the header
+    // Add the headers
     if (compress_) {
       auto& headers = msg.getHeaders();
       headers.set(HTTP_HEADER_CONTENT_ENCODING, headerEncoding_);
+      if (!msg.checkForHeaderToken(HTTP_HEADER_VARY, "Accept-Encoding",
+                                   false)) {
+        headers.add(HTTP_HEADER_VARY, "Accept-Encoding");
+      }
     }
 
     // Initialize compressor
@@ -74,6 +147,21 @@ class CompressionFilter : public Filter {
       header_ = true;
     } else {
       responseMessage_ = std::make_unique<HTTPMessage>(msg);
+      useCache_ = variantCache_ && msg.getStatusCode() == 200;
+      folly::Optional<std::string> etag;
+      if (useCache_) {
+        etag = CompressedVariantCache::getStrongETag(msg);
+      }
+      if (etag) {
+        cacheKey_ = CompressedVariantCache::makeKey(
+            CompressedVariantCache::identifyByETag(host_, url_, *etag),
+            headerEncoding_,
+            compressionLevel_);
+        auto cached = variantCache_->lookup(cacheKey_);
+        if (cached) {
+          sendCached(std::move(cached));
+        }
+      }
     }
   }
 
@@ -100,41 +188,71 @@ class CompressionFilter : public Filter {
       return;
     }
 
-    CHECK(compressor_ && !compressor_->hasError());
+    // The cached body has gone in place of this one, or the response has
+    // already failed
+    if (cacheHit_ || aborted_) {
+      return;
+    }
 
-    // If it's chunked, never write the trailer, it will be written on EOM
-    auto compressed = compressor_->compress(body.get(), !chunked_);
-    if (compressor_->hasError()) {
-      return fail();
+    // A job on the executor owns compressor_ until it is back on the
+    // EventBase, and deals with any error it hits then
+    if (isQueueing()) {
+      return queueBody(std::move(body));
     }
 
-    auto compressedBodyLength = compressed->computeChainDataLength();
+    DCHECK(compressor_ && !compressor_->hasError());
+
+    if (useCache_) {
+      uncompressedSize_ = body->computeChainDataLength();
+      if (cacheKey_.empty()) {
+        cacheKey_ = CompressedVariantCache::makeKey(
+            CompressedVariantCache::hashContent(*body),
+            headerEncoding_,
+            compressionLevel_);
+        auto cached = variantCache_->lookup(cacheKey_);
+        if (cached) {
+          return sendCached(std::move(cached));
+        }
+      }
+    }
 
-    if (chunked_) {
-      // Send on the swallowed chunk header.
-      Filter::sendChunkHeader(compressedBodyLength);
-    } else {
-      // Send the content length on compressed, non-chunked messages
-      DCHECK(header_ == false);
-      DCHECK(compress_ == true);
-      auto& headers = responseMessage_->getHeaders();
-      headers.set(HTTP_HEADER_CONTENT_LENGTH,
-                  folly::to<std::string>(compressedBodyLength));
+    if (shouldOffload(body.get())) {
+      return queueBody(std::move(body));
+    }
 
-      Filter::sendHeaders(*responseMessage_);
-      header_ = true;
+    // If it's chunked, never write the trailer, it will be written on EOM
+    auto compressed = compress(body.get());
+    if (compressor_->hasError()) {
+      return fail();
     }
+    sendCompressed(std::move(compressed));
+  }
 
-    Filter::sendBody(std::move(compressed));
+  void sendChunkTerminator() noexcept override {
+    if (compress_ && aborted_) {
+      return;
+    }
+    if (compress_ && isQueueing()) {
+      queue_.push_back({QueuedOp::CHUNK_TERMINATOR, nullptr});
+      return;
+    }
+    Filter::sendChunkTerminator();
   }
 
   void sendEOM() noexcept override {
+    if (compress_ && aborted_) {
+      return;
+    }
+    if (compress_ && isQueueing()) {
+      queue_.push_back({QueuedOp::EOM, nullptr});
+      return;
+    }
 
     // Need to send the trailer for compressed chunked messages
     if (compress_ && chunked_) {
 
       auto emptyBuffer = folly::IOBuf::copyBuffer("");
-      CHECK(compressor_ && !compressor_->hasError());
+      DCHECK(compressor_ && !compressor_->hasError());
       auto compressed = compressor_->compress(emptyBuffer.get(), true);
 
       if (compressor_->hasError()) {
@@ -151,9 +269,186 @@ class CompressionFilter : public Filter {
     Filter::sendEOM();
   }
 
+  void sendAbort() noexcept override {
+    aborted_ = true;
+    queue_.clear();
+    queuedBytes_ = 0;
+    Filter::sendAbort();
+  }
+
  protected:
+  struct QueuedOp {
+    enum Type { BODY, CHUNK_TERMINATOR, EOM };
+    Type type;
+    std::unique_ptr<folly::IOBuf> body;
+  };
+
   void fail() {
-    Filter::sendAbort();
+    sendAbort();
+  }
+
+  // Hold a body until the bodies ahead of it are out, sending it to the
+  // executor from the front of the queue if it is large enough
+  void queueBody(std::unique_ptr<folly::IOBuf> body) {
+    queuedBytes_ += body->computeChainDataLength();
+    queue_.push_back({QueuedOp::BODY, std::move(body)});
+    if (drainQueue()) {
+      updateUpstreamPaused();
+    }
+  }
+
+  // Whether output is held up behind a body being compressed off-thread
+  bool isQueueing() const {
+    return compressing_ || !queue_.empty();
+  }
+
+  // The result has to come back to the transaction's EventBase, so
+  // compress inline if there is none
+  bool shouldOffload(const folly::IOBuf* body) const {
+    return executor_ && offloadCompressionSize_ > 0 &&
+           body->computeChainDataLength() >= offloadCompressionSize_ &&
+           txn_ && txn_->getEventBase();
+  }
+
+  // Compress a body, with the trailer unless chunked, keeping track of the
+  // time spent.  Runs on the executor for offloaded bodies.
+  std::unique_ptr<folly::IOBuf> compress(const folly::IOBuf* body) {
+    auto start = std::chrono::steady_clock::now();
+    auto compressed = compressor_->compress(body, !chunked_);
+    compressTime_ += std::chrono::steady_clock::now() - start;
+    return compressed;
+  }
+
+  // Send a body from the variant cache in place of the handler's
+  void sendCached(std::unique_ptr<folly::IOBuf> cached) {
+    DCHECK(!chunked_);
+    DCHECK(!header_);
+    responseMessage_->getHeaders().set(
+        HTTP_HEADER_CONTENT_LENGTH,
+        folly::to<std::string>(cached->computeChainDataLength()));
+    Filter::sendHeaders(*responseMessage_);
+    header_ = true;
+    cacheHit_ = true;
+    Filter::sendBody(std::move(cached));
+  }
+
+  // Send a compressed body: as a chunk, or with the Content-Length it makes
+  // for a non-chunked response
+  void sendCompressed(std::unique_ptr<folly::IOBuf> compressed) {
+    auto compressedBodyLength = compressed->computeChainDataLength();
+
+    if (!chunked_ && !cacheKey_.empty()) {
+      variantCache_->insert(
+          cacheKey_, compressed->clone(), uncompressedSize_, compressTime_);
+    }
+
+    if (chunked_) {
+      // Send on the swallowed chunk header.
+      Filter::sendChunkHeader(compressedBodyLength);
+    } else {
+      // Send the content length on compressed, non-chunked messages
+      DCHECK(header_ == false);
+      DCHECK(compress_ == true);
+      auto& headers = responseMessage_->getHeaders();
+      headers.set(HTTP_HEADER_CONTENT_LENGTH,
+                  folly::to<std::string>(compressedBodyLength));
+
+      Filter::sendHeaders(*responseMessage_);
+      header_ = true;
+    }
+
+    Filter::sendBody(std::move(compressed));
+  }
+
+  // Work through the queue in order until it is empty, egress pauses or a
+  // body goes to the executor.  Small bodies queued behind a large one are
+  // compressed inline once they reach the front.  Returns false once the
+  // response is over (EOM sent or aborted).
+  bool drainQueue() {
+    while (!queue_.empty() && !compressing_ && !egressPaused_) {
+      auto op = std::move(queue_.front());
+      queue_.pop_front();
+      switch (op.type) {
+        case QueuedOp::CHUNK_TERMINATOR:
+          Filter::sendChunkTerminator();
+          break;
+        case QueuedOp::EOM:
+          DCHECK(queue_.empty());
+          sendEOM();
+          return false;
+        case QueuedOp::BODY: {
+          queuedBytes_ -= op.body->computeChainDataLength();
+          if (shouldOffload(op.body.get())) {
+            startCompression(std::move(op.body));
+            return true;
+          }
+          auto compressed = compress(op.body.get());
+          if (compressor_->hasError()) {
+            fail();
+            return false;
+          }
+          sendCompressed(std::move(compressed));
+          break;
+        }
+      }
+    }
+    return true;
+  }
+
+  void startCompression(std::unique_ptr<folly::IOBuf> body) {
+    auto evb = txn_->getEventBase();
+    compressing_ = true;
+    // The compressor is only touched by the job until it is back on evb
+    executor_->add([this, evb, body = std::move(body)]() mutable {
+      auto compressed = compress(body.get());
+      bool error = compressor_->hasError();
+      evb->runInEventBaseThread(
+          [this, error, compressed = std::move(compressed)]() mutable {
+            onCompressed(std::move(compressed), error);
+          });
+    });
+  }
+
+  void onCompressed(std::unique_ptr<folly::IOBuf> compressed, bool error) {
+    compressing_ = false;
+    if (detached_) {
+      delete this;
+      return;
+    }
+    if (aborted_) {
+      return;
+    }
+    if (error) {
+      return fail();
+    }
+    sendCompressed(std::move(compressed));
+    if (drainQueue()) {
+      updateUpstreamPaused();
+    }
+  }
+
+  // Pause the handler while egress is paused or the queue is too long
+  void updateUpstreamPaused() {
+    bool paused =
+        egressPaused_ ||
+        queuedBytes_ > uint64_t(offloadCompressionSize_) * kMaxQueuedChunks;
+    if (paused == upstreamPaused_) {
+      return;
+    }
+    upstreamPaused_ = paused;
+    if (paused) {
+      upstream_->onEgressPaused();
+    } else {
+      upstream_->onEgressResumed();
+    }
+  }
+
+  // The transaction is gone while a compression job is out
+  void detach() {
+    downstream_ = nullptr;
+    detached_ = true;
+    queue_.clear();
+    queuedBytes_ = 0;
   }
 
   // Verify the response is large enough to compress
@@ -197,9 +492,31 @@ class CompressionFilter : public Filter {
   StreamCompressorFactory compressorFactory_{};
   const std::string headerEncoding_{};
   const std::shared_ptr<std::set<std::string>> compressibleContentTypes_;
+  const std::shared_ptr<folly::Executor> executor_;
+  const uint32_t offloadCompressionSize_{0};
+  const std::shared_ptr<CompressedVariantCache> variantCache_;
+  const int32_t compressionLevel_{0};
+  // Of the request, to tell apart resources that share an ETag
+  const std::string host_;
+  const std::string url_;
+  // Key of this response in variantCache_, once known
+  std::string cacheKey_;
+  size_t uncompressedSize_{0};
+  std::chrono::nanoseconds compressTime_{0};
+  std::deque<QueuedOp> queue_;
+  // Uncompressed bytes in queue_
+  uint64_t queuedBytes_{0};
   bool header_{false};
   bool chunked_{false};
   bool compress_{false};
+  bool compressing_{false};
+  bool egressPaused_{false};
+  bool upstreamPaused_{false};
+  bool detached_{false};
+  bool aborted_{false};
+  // Whether this response is looked up in and stored to variantCache_
+  bool useCache_{false};
+  bool cacheHit_{false};
 };
 
 class CompressionFilterFactory : public RequestHandlerFactory {
@@ -207,6 +524,7 @@ class CompressionFilterFactory : public RequestHandlerFactory {
   enum class CodecType : uint8_t {
     ZLIB = 0,
     NO_COMPRESSION = 1,
+    ZSTD = 2,
   };
 
  public:
@@ -215,11 +533,26 @@ class CompressionFilterFactory : public RequestHandlerFactory {
     uint32_t minimumCompressionSize = 1000;
     std::set<std::string> compressibleContentTypes = {};
     int32_t zlibCompressionLevel = 4;
+    // Offer zstd to clients that accept it, at this level (1 to 19).  Off
+    // by default: only gzip is negotiated unless asked for.
+    bool enableZstd = false;
+    int32_t zstdCompressionLevel = 3;
+    // If set, body chunks of at least offloadCompressionSize bytes are
+    // compressed on this executor instead of the IO thread
+    std::shared_ptr<folly::Executor> compressionExecutor;
+    uint32_t offloadCompressionSize = 64 * 1024;
+    // If set, compressed non-chunked responses are reused from here
+    std::shared_ptr<CompressedVariantCache> variantCache;
   };
 
   CompressionFilterFactory(const Options& opts)
       : minimumCompressionSize_(opts.minimumCompressionSize),
         zlibCompressionLevel_(opts.zlibCompressionLevel),
+        enableZstd_(opts.enableZstd),
+        zstdCompressionLevel_(opts.zstdCompressionLevel),
+        compressionExecutor_(opts.compressionExecutor),
+        offloadCompressionSize_(opts.offloadCompressionSize),
+        variantCache_(opts.variantCache),
         compressibleContentTypes_(std::make_shared<std::set<std::string>>(
             opts.compressibleContentTypes)) {
   }
@@ -235,6 +568,9 @@ class CompressionFilterFactory : public RequestHandlerFactory {
 
   RequestHandler* onRequest(RequestHandler* h,
                             HTTPMessage* msg) noexcept override {
+    // Only GET responses are stored, a HEAD has no body to store or serve
+    auto variantCache =
+        msg->getMethod() == HTTPMethod::GET ? variantCache_ : nullptr;
     switch (determineCompressionType(msg)) {
       case CodecType::ZLIB:
         return new CompressionFilter{
@@ -246,7 +582,29 @@ class CompressionFilterFactory : public RequestHandlerFactory {
                   proxygen::CompressionType::GZIP, level);
             },
             "gzip",
-            compressibleContentTypes_};
+            compressibleContentTypes_,
+            compressionExecutor_,
+            offloadCompressionSize_,
+            variantCache,
+            zlibCompressionLevel_,
+            msg->getHeaders().getSingleOrEmpty(HTTP_HEADER_HOST),
+            msg->getURL()};
+      case CodecType::ZSTD:
+        return new CompressionFilter{
+            h,
+            minimumCompressionSize_,
+            [level =
+                 zstdCompressionLevel_]() -> std::unique_ptr<StreamCompressor> {
+              return std::make_unique<ZstdStreamCompressor>(level);
+            },
+            "zstd",
+            compressibleContentTypes_,
+            compressionExecutor_,
+            offloadCompressionSize_,
+            variantCache,
+            zstdCompressionLevel_,
+            msg->getHeaders().getSingleOrEmpty(HTTP_HEADER_HOST),
+            msg->getURL()};
       case CodecType::NO_COMPRESSION:
         return h;
     };
@@ -254,7 +612,9 @@ class CompressionFilterFactory : public RequestHandlerFactory {
   }
 
  private:
-  // Check whether the client supports a compression type we support
+  // Pick the encoding the client prefers among those we support, going by
+  // the qvalues in Accept-Encoding.  "*" covers encodings not listed, q=0
+  // rules an encoding out, and zstd wins ties.
   CodecType determineCompressionType(HTTPMessage* msg) noexcept {
 
     std::vector<RFC2616::TokenQPair> output;
@@ -267,19 +627,45 @@ class CompressionFilterFactory : public RequestHandlerFactory {
       return CodecType::NO_COMPRESSION;
     }
 
-    auto it = std::find_if(
-        output.begin(), output.end(), [](RFC2616::TokenQPair elem) {
-          return elem.first.compare(folly::StringPiece("gzip")) == 0;
-        });
+    // -1 means not listed
+    double gzipQ = -1;
+    double zstdQ = -1;
+    double starQ = -1;
+    for (const auto& elem : output) {
+      auto token = folly::rtrimWhitespace(elem.first);
+      if (caseInsensitiveEqual(token, "gzip")) {
+        gzipQ = elem.second;
+      } else if (caseInsensitiveEqual(token, "zstd")) {
+        zstdQ = elem.second;
+      } else if (token == "*") {
+        starQ = elem.second;
+      }
+    }
+    if (gzipQ < 0) {
+      gzipQ = starQ;
+    }
+    if (!enableZstd_) {
+      zstdQ = 0;
+    } else if (zstdQ < 0) {
+      zstdQ = starQ;
+    }
 
-    if (it == output.end()) {
-      return CodecType::NO_COMPRESSION;
+    if (zstdQ > 0 && zstdQ >= gzipQ) {
+      return CodecType::ZSTD;
+    }
+    if (gzipQ > 0) {
+      return CodecType::ZLIB;
     }
-    return CodecType::ZLIB;
+    return CodecType::NO_COMPRESSION;
   }
 
   const uint32_t minimumCompressionSize_;
   const int32_t zlibCompressionLevel_;
+  const bool enableZstd_;
+  const int32_t zstdCompressionLevel_;
+  const std::shared_ptr<folly::Executor> compressionExecutor_;
+  const uint32_t offloadCompressionSize_;
+  const std::shared_ptr<CompressedVariantCache> variantCache_;
   const std::shared_ptr<std::set<std::string>> compressibleContentTypes_;
 };
 } // namespace proxygen
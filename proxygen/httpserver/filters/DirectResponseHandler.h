@@ -9,6 +9,7 @@
  */
 #pragma once
 
+#include <proxygen/httpserver/RequestArena.h>
 #include <proxygen/httpserver/RequestHandler.h>
 #include <proxygen/httpserver/ResponseBuilder.h>
 
@@ -17,7 +18,8 @@ namespace proxygen {
 /**
  * Handler that sends a fixed response back.
  */
-class DirectResponseHandler : public RequestHandler {
+class DirectResponseHandler : public RequestHandler,
+                              public RequestArenaAllocated {
  public:
   DirectResponseHandler(int code,
                         std::string message,
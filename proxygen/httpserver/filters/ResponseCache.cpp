@@ -0,0 +1,477 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/filters/ResponseCache.h>
+
+#include <folly/Conv.h>
+#include <folly/String.h>
+#include <folly/lang/Bits.h>
+#include <proxygen/lib/http/RFC2616.h>
+#include <proxygen/lib/utils/HTTPTime.h>
+#include <proxygen/lib/utils/UtilInl.h>
+
+using folly::StringPiece;
+using std::chrono::seconds;
+
+namespace {
+
+using namespace proxygen;
+
+seconds parseDeltaSeconds(StringPiece value) {
+  value = folly::trimWhitespace(value);
+  if (value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+    value = value.subpiece(1, value.size() - 2);
+  }
+  // Invalid values are treated as 0 (stale), as RFC 7234 asks
+  auto delta = folly::tryTo<int64_t>(value);
+  if (delta.hasError() || *delta < 0) {
+    return seconds(0);
+  }
+  return seconds(*delta);
+}
+
+folly::Optional<int64_t> parseDate(const HTTPHeaders& headers,
+                                   HTTPHeaderCode code) {
+  const auto& value = headers.getSingleOrEmpty(code);
+  if (value.empty()) {
+    return folly::none;
+  }
+  return parseHTTPDateTime(value);
+}
+
+// The opaque part of an entity tag, for weak comparison
+StringPiece opaqueTag(StringPiece etag) {
+  etag = folly::trimWhitespace(etag);
+  if (etag.startsWith("W/")) {
+    etag.advance(2);
+  }
+  return etag;
+}
+
+size_t getHeadersSize(const HTTPHeaders& headers) {
+  size_t size = 0;
+  headers.forEach([&size] (const std::string& name, const std::string& value) {
+    size += name.size() + value.size();
+  });
+  return size;
+}
+
+// Recomputes everything an entry derives from its response headers
+void refreshFromHeaders(ResponseCache::Entry& entry, TimePoint responseTime) {
+  auto& headers = entry.response.getHeaders();
+  auto cc = CacheControl::parse(entry.response);
+  auto date = parseDate(headers, HTTP_HEADER_DATE);
+  auto nowSeconds = int64_t(time(nullptr));
+
+  if (cc.noCache) {
+    entry.freshnessLifetime = seconds(0);
+  } else if (cc.sMaxAge) {
+    entry.freshnessLifetime = *cc.sMaxAge;
+  } else if (cc.maxAge) {
+    entry.freshnessLifetime = *cc.maxAge;
+  } else if (headers.exists(HTTP_HEADER_EXPIRES)) {
+    auto expires = parseDate(headers, HTTP_HEADER_EXPIRES);
+    auto base = date ? *date : nowSeconds;
+    entry.freshnessLifetime =
+        seconds(expires ? std::max<int64_t>(*expires - base, 0) : 0);
+  } else {
+    // No heuristic freshness: without explicit freshness information
+    // responses are only kept if they can be revalidated
+    entry.freshnessLifetime = seconds(0);
+  }
+
+  auto ageValue = parseDeltaSeconds(headers.getSingleOrEmpty(HTTP_HEADER_AGE));
+  auto apparentAge =
+      seconds(date ? std::max<int64_t>(nowSeconds - *date, 0) : 0);
+  entry.initialAge = std::max(ageValue, apparentAge);
+  headers.remove(HTTP_HEADER_AGE);
+
+  entry.etag = headers.getSingleOrEmpty(HTTP_HEADER_ETAG);
+  entry.lastModified = headers.getSingleOrEmpty(HTTP_HEADER_LAST_MODIFIED);
+  entry.responseTime = responseTime;
+
+  entry.size = sizeof(entry) + getHeadersSize(headers) +
+    (entry.body ? entry.body->computeChainDataLength() : 0);
+  for (const auto& vary : entry.vary) {
+    entry.size += vary.first.size() + vary.second.size();
+  }
+}
+
+std::string makeKey(const HTTPMessage& request) {
+  auto host = request.getHeaders().getSingleOrEmpty(HTTP_HEADER_HOST);
+  folly::toLowerAscii(host);
+  return folly::to<std::string>(host, " ", request.getURL());
+}
+
+/**
+ * Count-min sketch of 4 bit saturating counters, halved every 10 * width
+ * increments so that it tracks recent popularity (TinyLFU).
+ */
+class FrequencySketch {
+ public:
+  explicit FrequencySketch(size_t width)
+      : mask_(width - 1),
+        resetAt_(10 * width),
+        table_(kDepth * width) {
+    DCHECK_EQ(width & mask_, 0);
+  }
+
+  void increment(uint64_t hash) {
+    for (size_t row = 0; row < kDepth; ++row) {
+      auto& counter = table_[index(hash, row)];
+      if (counter < kMaxCount) {
+        ++counter;
+      }
+    }
+    if (++additions_ >= resetAt_) {
+      for (auto& counter : table_) {
+        counter >>= 1;
+      }
+      additions_ /= 2;
+    }
+  }
+
+  uint8_t estimate(uint64_t hash) const {
+    uint8_t count = kMaxCount;
+    for (size_t row = 0; row < kDepth; ++row) {
+      count = std::min(count, table_[index(hash, row)]);
+    }
+    return count;
+  }
+
+ private:
+  static constexpr size_t kDepth = 4;
+  static constexpr uint8_t kMaxCount = 15;
+
+  size_t index(uint64_t hash, size_t row) const {
+    auto mixed = folly::hash::twang_mix64(hash + row * 0x9e3779b97f4a7c15ULL);
+    return row * (mask_ + 1) + (mixed & mask_);
+  }
+
+  const size_t mask_;
+  const size_t resetAt_;
+  size_t additions_{0};
+  std::vector<uint8_t> table_;
+};
+
+}
+
+namespace proxygen {
+
+CacheControl CacheControl::parse(const HTTPMessage& msg) {
+  CacheControl cc;
+  msg.getHeaders().forEachValueOfHeader(
+      HTTP_HEADER_CACHE_CONTROL, [&cc] (const std::string& value) {
+    HTTPMessage::splitNameValuePieces(
+        value, ',', '=', [&cc] (StringPiece name, StringPiece arg) {
+      name = folly::trimWhitespace(name);
+      if (caseInsensitiveEqual(name, "no-store")) {
+        cc.noStore = true;
+      } else if (caseInsensitiveEqual(name, "no-cache")) {
+        cc.noCache = true;
+      } else if (caseInsensitiveEqual(name, "private")) {
+        cc.isPrivate = true;
+      } else if (caseInsensitiveEqual(name, "max-age")) {
+        cc.maxAge = parseDeltaSeconds(arg);
+      } else if (caseInsensitiveEqual(name, "s-maxage")) {
+        cc.sMaxAge = parseDeltaSeconds(arg);
+      }
+    });
+    // Keep going, directives may be split over several headers
+    return false;
+  });
+  if (msg.isRequest() && !msg.getHeaders().exists(HTTP_HEADER_CACHE_CONTROL) &&
+      msg.checkForHeaderToken(HTTP_HEADER_PRAGMA, "no-cache", false)) {
+    cc.noCache = true;
+  }
+  return cc;
+}
+
+seconds ResponseCache::Entry::getAge(TimePoint now) const {
+  return initialAge +
+    std::chrono::duration_cast<seconds>(now - responseTime);
+}
+
+bool ResponseCache::Entry::matchesVary(const HTTPMessage& request) const {
+  for (const auto& vary : this->vary) {
+    if (request.getHeaders().combine(vary.first) != vary.second) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ResponseCache::Entry::matchesConditional(
+    const HTTPMessage& request) const {
+  const auto& headers = request.getHeaders();
+  if (headers.exists(HTTP_HEADER_IF_NONE_MATCH)) {
+    if (etag.empty()) {
+      return false;
+    }
+    auto ifNoneMatch = headers.combine(HTTP_HEADER_IF_NONE_MATCH);
+    if (folly::trimWhitespace(ifNoneMatch) == "*") {
+      return true;
+    }
+    std::vector<StringPiece> tags;
+    folly::split(',', ifNoneMatch, tags);
+    auto ours = opaqueTag(etag);
+    return std::any_of(tags.begin(), tags.end(), [ours] (StringPiece tag) {
+      return opaqueTag(tag) == ours;
+    });
+  }
+  if (lastModified.empty()) {
+    return false;
+  }
+  auto ifModifiedSince = parseDate(headers, HTTP_HEADER_IF_MODIFIED_SINCE);
+  auto modified = parseHTTPDateTime(lastModified);
+  return ifModifiedSince && modified && *modified <= *ifModifiedSince;
+}
+
+HTTPMessage ResponseCache::Entry::makeResponse(const HTTPMessage& request,
+                                               TimePoint now) const {
+  HTTPMessage msg(response);
+  msg.getHeaders().set(HTTP_HEADER_AGE,
+                       folly::to<std::string>(getAge(now).count()));
+  if (response.getStatusCode() == 200 && matchesConditional(request)) {
+    msg.setStatusCode(304);
+    msg.setStatusMessage(HTTPMessage::getDefaultReason(304));
+    msg.getHeaders().remove(HTTP_HEADER_CONTENT_LENGTH);
+  }
+  return msg;
+}
+
+struct ResponseCache::ShardState {
+  explicit ShardState(size_t sketchWidth) : sketch(sketchWidth) {
+  }
+
+  FrequencySketch sketch;
+  Stats stats;
+};
+
+ResponseCache::ResponseCache(Options options)
+    : options_(std::move(options)),
+      cache_(options_.maxBytes,
+             options_.numShards,
+             getSketchWidth(options_)) {
+}
+
+ResponseCache::~ResponseCache() {
+}
+
+size_t ResponseCache::getSketchWidth(const Options& options) {
+  auto numShards = folly::nextPowTwo(std::max<size_t>(options.numShards, 1));
+  auto shardBytes = options.maxBytes / numShards;
+  auto expectedEntries = std::max<size_t>(
+      shardBytes / std::max<size_t>(options.expectedEntryBytes, 1), 64);
+  return folly::nextPowTwo(expectedEntries);
+}
+
+folly::Optional<std::string> ResponseCache::getKey(
+    const HTTPMessage& request) {
+  auto method = request.getMethod();
+  if (method != HTTPMethod::GET && method != HTTPMethod::HEAD) {
+    return folly::none;
+  }
+  const auto& headers = request.getHeaders();
+  if (headers.exists(HTTP_HEADER_AUTHORIZATION) ||
+      CacheControl::parse(request).noStore) {
+    return folly::none;
+  }
+  return makeKey(request);
+}
+
+folly::Optional<std::string> ResponseCache::getInvalidationKey(
+    const HTTPMessage& request) {
+  auto method = request.getMethod();
+  if (method == HTTPMethod::GET || method == HTTPMethod::HEAD ||
+      method == HTTPMethod::OPTIONS || method == HTTPMethod::TRACE) {
+    return folly::none;
+  }
+  return makeKey(request);
+}
+
+std::shared_ptr<ResponseCache::Entry> ResponseCache::makeEntry(
+    const HTTPMessage& request,
+    const HTTPMessage& response,
+    std::unique_ptr<folly::IOBuf> body,
+    TimePoint responseTime) {
+  if (request.getMethod() != HTTPMethod::GET) {
+    return nullptr;
+  }
+  switch (response.getStatusCode()) {
+    case 200: case 203: case 204: case 300: case 301: case 404: case 410:
+      break;
+    default:
+      return nullptr;
+  }
+  auto cc = CacheControl::parse(response);
+  const auto& headers = response.getHeaders();
+  if (cc.noStore || cc.isPrivate || headers.exists(HTTP_HEADER_SET_COOKIE)) {
+    return nullptr;
+  }
+
+  auto entry = std::make_shared<Entry>();
+  bool varyAll = headers.forEachValueOfHeader(
+      HTTP_HEADER_VARY, [&] (const std::string& value) {
+    std::vector<StringPiece> names;
+    folly::split(',', value, names);
+    for (auto name : names) {
+      name = folly::trimWhitespace(name);
+      if (name == "*") {
+        return true;
+      }
+      if (!name.empty()) {
+        entry->vary.emplace_back(name.str(),
+                                 request.getHeaders().combine(name.str()));
+      }
+    }
+    return false;
+  });
+  if (varyAll) {
+    return nullptr;
+  }
+
+  entry->response = response;
+  HTTPHeaders hopByHop;
+  entry->response.getHeaders().stripPerHopHeaders(hopByHop);
+  entry->response.setIsChunked(false);
+  if (body && body->computeChainDataLength() == 0) {
+    body.reset();
+  }
+  entry->body = std::move(body);
+  if (!RFC2616::responseBodyMustBeEmpty(response.getStatusCode())) {
+    entry->response.getHeaders().set(
+        HTTP_HEADER_CONTENT_LENGTH,
+        folly::to<std::string>(
+            entry->body ? entry->body->computeChainDataLength() : 0));
+  }
+  refreshFromHeaders(*entry, responseTime);
+
+  if (entry->freshnessLifetime.count() == 0 && entry->etag.empty() &&
+      entry->lastModified.empty()) {
+    return nullptr;
+  }
+  return entry;
+}
+
+std::shared_ptr<ResponseCache::Entry> ResponseCache::updateEntry(
+    const Entry& entry,
+    const HTTPMessage& notModified,
+    TimePoint responseTime) {
+  auto updated = std::make_shared<Entry>();
+  updated->response = entry.response;
+  updated->body = entry.body ? entry.body->clone() : nullptr;
+  updated->vary = entry.vary;
+
+  // The 304's headers replace the stored ones, except those describing the
+  // body the 304 does not have
+  HTTPHeaders headers;
+  notModified.getHeaders().forEachWithCode(
+      [&headers] (HTTPHeaderCode code,
+                  const std::string& name,
+                  const std::string& value) {
+    if (code != HTTP_HEADER_CONTENT_LENGTH &&
+        code != HTTP_HEADER_CONTENT_TYPE &&
+        code != HTTP_HEADER_CONTENT_ENCODING) {
+      headers.add(name, value);
+    }
+  });
+  HTTPHeaders hopByHop;
+  headers.stripPerHopHeaders(hopByHop);
+  auto& stored = updated->response.getHeaders();
+  headers.forEach([&stored] (const std::string& name, const std::string&) {
+    stored.remove(name);
+  });
+  headers.forEach([&stored] (const std::string& name,
+                             const std::string& value) {
+    stored.add(name, value);
+  });
+  refreshFromHeaders(*updated, responseTime);
+  return updated;
+}
+
+ResponseCache::LookupResult ResponseCache::lookup(const std::string& key,
+                                                  const HTTPMessage& request,
+                                                  TimePoint now) {
+  auto requestCacheControl = CacheControl::parse(request);
+  auto hash = Cache::hashKey(key);
+  auto& shard = cache_.getShard(hash);
+  auto& state = shard.extra;
+  LookupResult result;
+
+  std::lock_guard<std::mutex> guard(shard.mutex);
+  if (options_.tinyLFUAdmission) {
+    state.sketch.increment(hash);
+  }
+  auto it = shard.map.find(key);
+  if (it == shard.map.end() || !it->second->matchesVary(request)) {
+    state.stats.misses++;
+    return result;
+  }
+  result.entry = it->second;
+  auto age = result.entry->getAge(now);
+  result.fresh = age < result.entry->freshnessLifetime &&
+    !requestCacheControl.noCache &&
+    (!requestCacheControl.maxAge || age <= *requestCacheControl.maxAge);
+  if (result.fresh) {
+    state.stats.hits++;
+  } else {
+    state.stats.staleHits++;
+  }
+  return result;
+}
+
+void ResponseCache::insert(const std::string& key, EntryPtr entry) {
+  auto size = entry->size + key.size();
+  auto hash = Cache::hashKey(key);
+  auto& shard = cache_.getShard(hash);
+  auto& state = shard.extra;
+  if (size > options_.maxEntryBytes || !shard.fits(key, entry->size)) {
+    VLOG(4) << "not caching " << key << ", " << size << " bytes is too big";
+    return;
+  }
+
+  std::lock_guard<std::mutex> guard(shard.mutex);
+  if (options_.tinyLFUAdmission &&
+      shard.bytes + size > shard.maxBytes && !shard.map.empty() &&
+      shard.map.findWithoutPromotion(key) == shard.map.end()) {
+    const auto& victim = *shard.map.rbegin();
+    if (state.sketch.estimate(hash) <=
+        state.sketch.estimate(Cache::hashKey(victim.first))) {
+      state.stats.admissionRejects++;
+      return;
+    }
+  }
+  state.stats.evictions += shard.set(key, std::move(entry));
+  state.stats.stores++;
+}
+
+void ResponseCache::erase(const std::string& key) {
+  auto& shard = cache_.getShard(Cache::hashKey(key));
+  std::lock_guard<std::mutex> guard(shard.mutex);
+  shard.erase(key);
+}
+
+ResponseCache::Stats ResponseCache::getStats() const {
+  Stats total;
+  cache_.forEachShard([&total](const Cache::Shard& shard) {
+    const auto& stats = shard.extra.stats;
+    total.hits += stats.hits;
+    total.staleHits += stats.staleHits;
+    total.misses += stats.misses;
+    total.stores += stats.stores;
+    total.evictions += stats.evictions;
+    total.admissionRejects += stats.admissionRejects;
+    total.entries += shard.map.size();
+    total.bytes += shard.bytes;
+  });
+  return total;
+}
+
+}
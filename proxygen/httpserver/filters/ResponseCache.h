@@ -0,0 +1,180 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <folly/Optional.h>
+#include <folly/io/IOBuf.h>
+#include <proxygen/httpserver/filters/ShardedLRUCache.h>
+#include <proxygen/lib/http/HTTPMessage.h>
+#include <proxygen/lib/utils/Time.h>
+
+namespace proxygen {
+
+/**
+ * Cache-Control directives that matter to a shared cache, from either a
+ * request or a response.  A request with "Pragma: no-cache" and no
+ * Cache-Control is treated as no-cache.
+ */
+struct CacheControl {
+  bool noStore{false};
+  bool noCache{false};
+  bool isPrivate{false};
+  folly::Optional<std::chrono::seconds> maxAge;
+  folly::Optional<std::chrono::seconds> sMaxAge;
+
+  static CacheControl parse(const HTTPMessage& msg);
+};
+
+/**
+ * An in-memory HTTP response cache shared by all IO threads, for use by
+ * ResponseCacheFilter.
+ *
+ * Entries are keyed by Host and URL.  Each key holds one variant: the most
+ * recently stored response, along with the request header values named by
+ * its Vary header, which later requests must match for it to be used.
+ * Entries are immutable once stored; bodies are kept as the IOBuf chains the
+ * handler sent, so a hit only clones them.
+ *
+ * Entries are kept in a ShardedLRUCache.  With TinyLFU admission enabled, a
+ * new key that would need an eviction is only admitted when it has been looked
+ * up more often recently than the entry it would evict (going by a small
+ * frequency sketch per shard), so that one-off URLs do not flush popular
+ * ones.
+ */
+class ResponseCache {
+ public:
+  struct Options {
+    // Byte budget for bodies, headers and keys, split evenly between shards
+    size_t maxBytes{64 * 1024 * 1024};
+    // Rounded up to a power of two
+    size_t numShards{16};
+    // Larger responses are not stored
+    size_t maxEntryBytes{1024 * 1024};
+    bool tinyLFUAdmission{true};
+    // Typical entry size, used to size the TinyLFU sketch
+    size_t expectedEntryBytes{16 * 1024};
+  };
+
+  struct Entry {
+    // Hop-by-hop headers and Age removed, Content-Length set
+    HTTPMessage response;
+    std::unique_ptr<folly::IOBuf> body;
+    // Name and request value of each header the response varies on
+    std::vector<std::pair<std::string, std::string>> vary;
+    std::string etag;
+    std::string lastModified;
+    TimePoint responseTime;
+    std::chrono::seconds initialAge{0};
+    std::chrono::seconds freshnessLifetime{0};
+    size_t size{0};
+
+    std::chrono::seconds getAge(TimePoint now) const;
+
+    bool matchesVary(const HTTPMessage& request) const;
+
+    /**
+     * Whether the request's If-None-Match (or, without one,
+     * If-Modified-Since) is satisfied, i.e. a 304 can be sent.
+     */
+    bool matchesConditional(const HTTPMessage& request) const;
+
+    /**
+     * The response to send for request: a copy of the stored one with its
+     * Age set, turned into a 304 if matchesConditional().
+     */
+    HTTPMessage makeResponse(const HTTPMessage& request, TimePoint now) const;
+  };
+  using EntryPtr = std::shared_ptr<const Entry>;
+
+  struct LookupResult {
+    EntryPtr entry;
+    // Usable without revalidation, taking the request's Cache-Control into
+    // account.  False when there is no entry.
+    bool fresh{false};
+  };
+
+  struct Stats {
+    uint64_t hits{0};
+    uint64_t staleHits{0};
+    uint64_t misses{0};
+    uint64_t stores{0};
+    uint64_t evictions{0};
+    uint64_t admissionRejects{0};
+    uint64_t entries{0};
+    uint64_t bytes{0};
+  };
+
+  explicit ResponseCache(Options options);
+
+  ResponseCache() : ResponseCache(Options()) {
+  }
+
+  ~ResponseCache();
+
+  /**
+   * The cache key for a request, or none if the request must not be served
+   * from (or stored in) a shared cache: methods other than GET and HEAD,
+   * requests with credentials and requests with no-store.
+   */
+  static folly::Optional<std::string> getKey(const HTTPMessage& request);
+
+  /**
+   * The key an unsafe request would invalidate, if any.
+   */
+  static folly::Optional<std::string> getInvalidationKey(
+      const HTTPMessage& request);
+
+  /**
+   * Builds an entry for response, or returns nullptr if it may not be
+   * stored.  request is the GET that produced it.
+   */
+  static std::shared_ptr<Entry> makeEntry(const HTTPMessage& request,
+                                          const HTTPMessage& response,
+                                          std::unique_ptr<folly::IOBuf> body,
+                                          TimePoint responseTime);
+
+  /**
+   * entry, freshened by the headers of a 304 received for it.
+   */
+  static std::shared_ptr<Entry> updateEntry(const Entry& entry,
+                                            const HTTPMessage& notModified,
+                                            TimePoint responseTime);
+
+  LookupResult lookup(const std::string& key,
+                      const HTTPMessage& request,
+                      TimePoint now);
+
+  /**
+   * Stores entry under key, replacing what was there.  It may not be stored
+   * if it is too big or TinyLFU turns it away.
+   */
+  void insert(const std::string& key, EntryPtr entry);
+
+  void erase(const std::string& key);
+
+  Stats getStats() const;
+
+  size_t getMaxEntryBytes() const {
+    return options_.maxEntryBytes;
+  }
+
+ private:
+  // TinyLFU sketch and stats of a shard
+  struct ShardState;
+  using Cache = ShardedLRUCache<Entry, ShardState>;
+
+  static size_t getSketchWidth(const Options& options);
+
+  Options options_;
+  Cache cache_;
+};
+
+}
@@ -0,0 +1,243 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/io/IOBufQueue.h>
+#include <proxygen/httpserver/Filters.h>
+#include <proxygen/httpserver/RequestHandlerFactory.h>
+#include <proxygen/httpserver/filters/ResponseCache.h>
+
+namespace proxygen {
+
+/**
+ * A Server filter that answers GET and HEAD requests from a shared
+ * ResponseCache.
+ *
+ *  - fresh hit: the handler is cancelled (onError(kErrorCanceled)) and the
+ *    stored response is sent, or a 304 if the request's conditionals match
+ *  - stale hit with a validator: the request is sent to the handler with the
+ *    entry's If-None-Match/If-Modified-Since.  A 304 freshens the entry,
+ *    which is then sent as for a fresh hit; anything else is treated as a
+ *    miss
+ *  - miss: the response goes through untouched, and is stored on EOM if it
+ *    is cacheable; body buffers are cloned, not copied
+ *
+ * Other methods bypass the filter and invalidate the URL they target.
+ */
+class ResponseCacheFilter : public Filter {
+ public:
+  ResponseCacheFilter(RequestHandler* upstream,
+                      std::shared_ptr<ResponseCache> cache,
+                      std::string key)
+      : Filter(upstream), cache_(std::move(cache)), key_(std::move(key)) {
+  }
+
+  void onRequest(std::unique_ptr<HTTPMessage> msg) noexcept override {
+    auto lookup = cache_->lookup(key_, *msg, getCurrentTime());
+    if (lookup.fresh) {
+      entry_ = std::move(lookup.entry);
+      request_ = std::move(msg);
+      hit_ = true;
+      upstream_->onError(kErrorCanceled);
+      upstream_ = nullptr;
+      return;
+    }
+
+    request_ = std::make_unique<HTTPMessage>(*msg);
+    if (lookup.entry && (!lookup.entry->etag.empty() ||
+                         !lookup.entry->lastModified.empty())) {
+      entry_ = std::move(lookup.entry);
+      auto& headers = msg->getHeaders();
+      headers.remove(HTTP_HEADER_IF_NONE_MATCH);
+      headers.remove(HTTP_HEADER_IF_MODIFIED_SINCE);
+      if (!entry_->etag.empty()) {
+        headers.set(HTTP_HEADER_IF_NONE_MATCH, entry_->etag);
+      }
+      if (!entry_->lastModified.empty()) {
+        headers.set(HTTP_HEADER_IF_MODIFIED_SINCE, entry_->lastModified);
+      }
+    }
+    Filter::onRequest(std::move(msg));
+  }
+
+  void onBody(std::unique_ptr<folly::IOBuf> body) noexcept override {
+    if (upstream_) {
+      Filter::onBody(std::move(body));
+    }
+  }
+
+  void onUpgrade(UpgradeProtocol protocol) noexcept override {
+    if (upstream_) {
+      Filter::onUpgrade(protocol);
+    }
+  }
+
+  void onEOM() noexcept override {
+    if (hit_) {
+      sendEntry(*entry_);
+    } else if (upstream_) {
+      Filter::onEOM();
+    }
+  }
+
+  void requestComplete() noexcept override {
+    if (upstream_) {
+      upstream_->requestComplete();
+    }
+    delete this;
+  }
+
+  void onError(ProxygenError err) noexcept override {
+    if (upstream_) {
+      upstream_->onError(err);
+    }
+    delete this;
+  }
+
+  void onEgressPaused() noexcept override {
+    if (upstream_) {
+      Filter::onEgressPaused();
+    }
+  }
+
+  void onEgressResumed() noexcept override {
+    if (upstream_) {
+      Filter::onEgressResumed();
+    }
+  }
+
+  void sendHeaders(HTTPMessage& msg) noexcept override {
+    if (msg.is1xxResponse()) {
+      Filter::sendHeaders(msg);
+      return;
+    }
+    if (entry_ && msg.getStatusCode() == 304) {
+      // Our revalidation succeeded; answer from the freshened entry once the
+      // handler is done with its 304
+      auto updated =
+          ResponseCache::updateEntry(*entry_, msg, getCurrentTime());
+      cache_->insert(key_, updated);
+      entry_ = std::move(updated);
+      replay_ = true;
+      return;
+    }
+    entry_.reset();
+    if (request_->getMethod() == HTTPMethod::GET) {
+      response_ = std::make_unique<HTTPMessage>(msg);
+    }
+    Filter::sendHeaders(msg);
+  }
+
+  void sendChunkHeader(size_t len) noexcept override {
+    if (!replay_) {
+      Filter::sendChunkHeader(len);
+    }
+  }
+
+  void sendBody(std::unique_ptr<folly::IOBuf> body) noexcept override {
+    if (replay_) {
+      return;
+    }
+    if (response_ && body) {
+      body_.append(body->clone());
+      if (body_.chainLength() > cache_->getMaxEntryBytes()) {
+        response_.reset();
+        body_.move();
+      }
+    }
+    Filter::sendBody(std::move(body));
+  }
+
+  void sendChunkTerminator() noexcept override {
+    if (!replay_) {
+      Filter::sendChunkTerminator();
+    }
+  }
+
+  void sendEOM() noexcept override {
+    if (replay_) {
+      sendEntry(*entry_);
+      return;
+    }
+    if (response_) {
+      auto entry = ResponseCache::makeEntry(
+          *request_, *response_, body_.move(), getCurrentTime());
+      if (entry) {
+        cache_->insert(key_, std::move(entry));
+      }
+      response_.reset();
+    }
+    Filter::sendEOM();
+  }
+
+  void sendAbort() noexcept override {
+    response_.reset();
+    body_.move();
+    Filter::sendAbort();
+  }
+
+ private:
+  void sendEntry(const ResponseCache::Entry& entry) {
+    auto response = entry.makeResponse(*request_, getCurrentTime());
+    Filter::sendHeaders(response);
+    if (entry.body && response.getStatusCode() != 304 &&
+        request_->getMethod() != HTTPMethod::HEAD) {
+      Filter::sendBody(entry.body->clone());
+    }
+    Filter::sendEOM();
+  }
+
+  std::shared_ptr<ResponseCache> cache_;
+  const std::string key_;
+  // Request as received, for Vary, HEAD and the client's own conditionals
+  std::unique_ptr<HTTPMessage> request_;
+  // The entry being sent or revalidated
+  ResponseCache::EntryPtr entry_;
+  // Response being collected for the cache
+  std::unique_ptr<HTTPMessage> response_;
+  folly::IOBufQueue body_{folly::IOBufQueue::cacheChainLength()};
+  bool hit_{false};
+  bool replay_{false};
+};
+
+class ResponseCacheFilterFactory : public RequestHandlerFactory {
+ public:
+  explicit ResponseCacheFilterFactory(std::shared_ptr<ResponseCache> cache)
+      : cache_(std::move(cache)) {
+  }
+
+  void onServerStart(folly::EventBase* /*evb*/) noexcept override {
+  }
+
+  void onServerStop() noexcept override {
+  }
+
+  RequestHandler* onRequest(RequestHandler* h,
+                            HTTPMessage* msg) noexcept override {
+    auto key = ResponseCache::getKey(*msg);
+    if (key) {
+      return new ResponseCacheFilter(h, cache_, std::move(*key));
+    }
+    auto invalidated = ResponseCache::getInvalidationKey(*msg);
+    if (invalidated) {
+      cache_->erase(*invalidated);
+    }
+    return h;
+  }
+
+  const std::shared_ptr<ResponseCache>& getCache() const {
+    return cache_;
+  }
+
+ private:
+  std::shared_ptr<ResponseCache> cache_;
+};
+
+}
@@ -0,0 +1,131 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <algorithm>
+#include <folly/container/EvictingCacheMap.h>
+#include <folly/hash/Hash.h>
+#include <folly/lang/Bits.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace proxygen {
+
+/**
+ * Immutable entries by string key, bounded by bytes rather than count, for
+ * the caches shared by all IO threads.
+ *
+ * The map is split in shards by key hash, each with its own lock, LRU order
+ * and an even share of the byte budget.  An entry counts as its size member
+ * plus the size of its key.  Each shard also holds an Extra, e.g. the
+ * stats of the cache using it, guarded by the same lock.
+ */
+template <class Entry, class Extra>
+class ShardedLRUCache {
+ public:
+  using EntryPtr = std::shared_ptr<const Entry>;
+
+  class Shard {
+   public:
+    template <class... Args>
+    explicit Shard(size_t maxBytes, Args&&... args)
+        : maxBytes(maxBytes), extra(std::forward<Args>(args)...) {
+    }
+
+    /**
+     * Whether an entry of size bytes under key fits in the shard at all.
+     */
+    bool fits(const std::string& key, size_t size) const {
+      return size + key.size() <= maxBytes;
+    }
+
+    /**
+     * Stores entry under key, replacing what was there, then evicts least
+     * recently used entries until the shard is within its budget.  Returns
+     * the number evicted.  Requires mutex.
+     */
+    size_t set(const std::string& key, EntryPtr entry) {
+      auto it = map.findWithoutPromotion(key);
+      if (it != map.end()) {
+        bytes -= it->second->size + key.size();
+      }
+      bytes += entry->size + key.size();
+      map.set(key, std::move(entry));
+      size_t evictions = 0;
+      while (bytes > maxBytes) {
+        map.prune(1, [&](std::string evictedKey, EntryPtr&& evicted) {
+          bytes -= evicted->size + evictedKey.size();
+          evictions++;
+        });
+      }
+      return evictions;
+    }
+
+    /**
+     * Requires mutex.
+     */
+    void erase(const std::string& key) {
+      auto it = map.findWithoutPromotion(key);
+      if (it != map.end()) {
+        bytes -= it->second->size + key.size();
+        map.erase(key);
+      }
+    }
+
+    const size_t maxBytes;
+    mutable std::mutex mutex;
+    // 0 turns off count based eviction, bytes are managed by set()
+    folly::EvictingCacheMap<std::string, EntryPtr> map{0};
+    size_t bytes{0};
+    Extra extra;
+  };
+
+  /**
+   * numShards is rounded up to a power of two.  args construct each
+   * shard's Extra.
+   */
+  template <class... Args>
+  ShardedLRUCache(size_t maxBytes, size_t numShards, const Args&... args) {
+    numShards = folly::nextPowTwo(std::max<size_t>(numShards, 1));
+    for (size_t i = 0; i < numShards; ++i) {
+      shards_.push_back(std::make_unique<Shard>(maxBytes / numShards, args...));
+    }
+  }
+
+  static size_t hashKey(const std::string& key) {
+    return std::hash<std::string>()(key);
+  }
+
+  /**
+   * The shard for a key with hashKey() hash.
+   */
+  Shard& getShard(size_t hash) const {
+    return *shards_[folly::hash::twang_mix64(hash) & (shards_.size() - 1)];
+  }
+
+  /**
+   * Calls fn with each shard, holding its lock.
+   */
+  template <class Fn>
+  void forEachShard(Fn&& fn) const {
+    for (const auto& shard : shards_) {
+      std::lock_guard<std::mutex> guard(shard->mutex);
+      fn(static_cast<const Shard&>(*shard));
+    }
+  }
+
+ private:
+  std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+}
@@ -0,0 +1,51 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <proxygen/httpserver/RequestArena.h>
+#include <proxygen/httpserver/RequestHandler.h>
+#include <proxygen/httpserver/ResponseHandler.h>
+#include <proxygen/lib/http/StaticResponse.h>
+
+namespace proxygen {
+
+/**
+ * Handler that sends a StaticResponse back.  Unlike DirectResponseHandler
+ * nothing is built or serialized per request.
+ */
+class StaticResponseHandler : public RequestHandler,
+                              public RequestArenaAllocated {
+ public:
+  explicit StaticResponseHandler(
+      std::shared_ptr<const StaticResponse> response)
+      : response_(std::move(response)) {
+  }
+
+  void onRequest(std::unique_ptr<HTTPMessage> /*headers*/) noexcept override {}
+
+  void onBody(std::unique_ptr<folly::IOBuf> /*body*/) noexcept override {}
+
+  void onUpgrade(proxygen::UpgradeProtocol /*prot*/) noexcept override {}
+
+  void onEOM() noexcept override {
+    downstream_->sendStaticResponse(*response_);
+  }
+
+  void requestComplete() noexcept override {
+    delete this;
+  }
+
+  void onError(ProxygenError /*err*/) noexcept override { delete this; }
+
+ private:
+  std::shared_ptr<const StaticResponse> response_;
+};
+
+}
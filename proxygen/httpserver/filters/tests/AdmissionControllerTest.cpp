@@ -0,0 +1,126 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/io/async/EventBase.h>
+#include <folly/portability/GTest.h>
+#include <proxygen/httpserver/filters/AdmissionController.h>
+
+using namespace proxygen;
+using namespace testing;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+
+namespace {
+
+class FakeResources : public Resources {
+ public:
+  explicit FakeResources(ResourceData* data) : data_(data) {
+  }
+
+  ResourceData getCurrentData() override {
+    return *data_;
+  }
+
+ private:
+  ResourceData* data_;
+};
+
+class TestResourceStats : public ResourceStats {
+ public:
+  explicit TestResourceStats(ResourceData* data)
+      : ResourceStats(std::make_unique<FakeResources>(data)) {
+  }
+
+  using ResourceStats::publishSnapshot;
+  using ResourceStats::updateCachedData;
+};
+
+ResourceData makeData(double cpu) {
+  ResourceData data;
+  data.setCpuStats(cpu, 0.1, {0.1, 0.1});
+  data.setMemStats(40, 100);
+  data.setTcpMemStats(10, 50, 100, 200);
+  data.setUdpMemStats(1, 5, 10, 20);
+  data.refreshLastUpdateTime();
+  return data;
+}
+
+}
+
+TEST(AdmissionControllerTest, ShedRatio) {
+  AdmissionController::Options options;
+  options.cpuSoftLimit = 0.8;
+  options.cpuHardLimit = 1.0;
+  options.loopTimeSoftLimit = microseconds(1000);
+  options.loopTimeHardLimit = microseconds(3000);
+  AdmissionController controller(nullptr, options);
+
+  EXPECT_EQ(controller.getShedRatio(makeData(0.5), microseconds(0)), 0);
+  EXPECT_DOUBLE_EQ(
+      controller.getShedRatio(makeData(0.9), microseconds(0)), 0.5);
+  EXPECT_EQ(controller.getShedRatio(makeData(1.0), microseconds(0)), 1);
+
+  // The worst signal wins
+  EXPECT_DOUBLE_EQ(
+      controller.getShedRatio(makeData(0.9), microseconds(2500)), 0.75);
+
+  auto data = makeData(0.5);
+  data.setMemStats(94, 100);
+  EXPECT_DOUBLE_EQ(controller.getShedRatio(data, microseconds(0)), 0.5);
+
+  data = makeData(0.5);
+  data.setTcpMemStats(150, 50, 100, 200);
+  EXPECT_DOUBLE_EQ(controller.getShedRatio(data, microseconds(0)), 0.5);
+}
+
+TEST(AdmissionControllerTest, DisabledSignals) {
+  AdmissionController::Options options;
+  options.cpuSoftLimit = 0;
+  options.memSoftLimit = 0;
+  options.shedOnTcpMemPressure = false;
+  options.loopTimeSoftLimit = microseconds(0);
+  AdmissionController controller(nullptr, options);
+
+  auto data = makeData(1.0);
+  data.setMemStats(100, 100);
+  data.setTcpMemStats(200, 50, 100, 200);
+  EXPECT_EQ(controller.getShedRatio(data, microseconds(1000000)), 0);
+}
+
+TEST(AdmissionControllerTest, MaxShedRatio) {
+  AdmissionController::Options options;
+  options.maxShedRatio = 0.9;
+  AdmissionController controller(nullptr, options);
+  EXPECT_DOUBLE_EQ(
+      controller.getShedRatio(makeData(1.0), microseconds(0)), 0.9);
+}
+
+TEST(AdmissionControllerTest, ShouldShed) {
+  folly::EventBase evb;
+  AdmissionController::Options options;
+  options.loopTimeSoftLimit = microseconds(0);
+
+  auto data = makeData(0.5);
+  auto stats = std::make_shared<TestResourceStats>(&data);
+  AdmissionController controller(stats, options);
+  EXPECT_FALSE(controller.shouldShed(evb));
+
+  data = makeData(1.0);
+  stats->updateCachedData();
+  EXPECT_TRUE(controller.shouldShed(evb));
+
+  // Stats that stopped refreshing are ignored
+  data.setLastUpdateTime(ResourceData::getEpochTime() - milliseconds(10000));
+  stats->publishSnapshot(data);
+  EXPECT_FALSE(controller.shouldShed(evb));
+
+  options.maxStatsAge = milliseconds(0);
+  AdmissionController noMaxAgeController(stats, options);
+  EXPECT_TRUE(noMaxAgeController.shouldShed(evb));
+}
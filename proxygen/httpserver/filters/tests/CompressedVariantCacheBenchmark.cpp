@@ -0,0 +1,104 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <cstring>
+#include <folly/Benchmark.h>
+#include <folly/Conv.h>
+#include <folly/Random.h>
+#include <proxygen/httpserver/filters/CompressedVariantCache.h>
+#include <proxygen/lib/utils/ZlibStreamCompressor.h>
+#include <proxygen/lib/utils/ZstdStreamCompressor.h>
+
+using namespace folly;
+using namespace proxygen;
+
+// What CompressionFilter spends per non-chunked response on the body: a
+// fresh compression, against a CompressedVariantCache hit found by content
+// hash (which has to hash the body) or by ETag.  time/iter is per response.
+//
+// ./compressed_variant_cache_benchmark -bm_min_iters 1000
+//
+// Prints, for 16KB and 256KB JSON-like bodies
+//   compressBench(<codec>_<level>_<size>) - compressing the body
+//   hitBench(hitByHash_<size>)            - hashContent() plus lookup()
+//   hitBench(hitByETag_<size>)            - lookup() alone
+
+namespace {
+
+std::unique_ptr<IOBuf> makeBody(size_t size) {
+  std::string body = "[";
+  while (body.size() < size) {
+    body += folly::to<std::string>("{\"id\":", folly::Random::rand32(100000),
+                                   ",\"name\":\"item\",\"tags\":[\"a\",\"b\"]},");
+  }
+  body.resize(size);
+  return IOBuf::copyBuffer(body);
+}
+
+void compressBench(size_t iters, const char* codec, int level, size_t size) {
+  BenchmarkSuspender suspender;
+  auto body = makeBody(size);
+  suspender.dismiss();
+  for (size_t i = 0; i < iters; i++) {
+    std::unique_ptr<StreamCompressor> compressor;
+    if (strcmp(codec, "zstd") == 0) {
+      compressor = std::make_unique<ZstdStreamCompressor>(level);
+    } else {
+      compressor =
+          std::make_unique<ZlibStreamCompressor>(CompressionType::GZIP, level);
+    }
+    doNotOptimizeAway(compressor->compress(body.get(), true));
+  }
+}
+
+void hitBench(size_t iters, bool byHash, size_t size) {
+  BenchmarkSuspender suspender;
+  CompressedVariantCache cache;
+  auto body = makeBody(size);
+  auto etagKey = CompressedVariantCache::makeKey(
+      CompressedVariantCache::identifyByETag("localhost", "/foo", "\"v1\""),
+      "gzip",
+      4);
+  auto hashKey = CompressedVariantCache::makeKey(
+      CompressedVariantCache::hashContent(*body), "gzip", 4);
+  ZlibStreamCompressor compressor(CompressionType::GZIP, 4);
+  auto compressed = compressor.compress(body.get(), true);
+  cache.insert(etagKey, compressed->clone(), size, std::chrono::nanoseconds(0));
+  cache.insert(hashKey, compressed->clone(), size, std::chrono::nanoseconds(0));
+  suspender.dismiss();
+  for (size_t i = 0; i < iters; i++) {
+    if (byHash) {
+      auto key = CompressedVariantCache::makeKey(
+          CompressedVariantCache::hashContent(*body), "gzip", 4);
+      doNotOptimizeAway(cache.lookup(key));
+    } else {
+      doNotOptimizeAway(cache.lookup(etagKey));
+    }
+  }
+}
+
+}
+
+BENCHMARK_NAMED_PARAM(compressBench, gzip_4_16KB, "gzip", 4, 16 * 1024)
+BENCHMARK_NAMED_PARAM(compressBench, gzip_6_16KB, "gzip", 6, 16 * 1024)
+BENCHMARK_NAMED_PARAM(compressBench, zstd_3_16KB, "zstd", 3, 16 * 1024)
+BENCHMARK_NAMED_PARAM(hitBench, hitByHash_16KB, true, 16 * 1024)
+BENCHMARK_NAMED_PARAM(hitBench, hitByETag_16KB, false, 16 * 1024)
+BENCHMARK_DRAW_LINE();
+BENCHMARK_NAMED_PARAM(compressBench, gzip_4_256KB, "gzip", 4, 256 * 1024)
+BENCHMARK_NAMED_PARAM(compressBench, gzip_6_256KB, "gzip", 6, 256 * 1024)
+BENCHMARK_NAMED_PARAM(compressBench, zstd_3_256KB, "zstd", 3, 256 * 1024)
+BENCHMARK_NAMED_PARAM(hitBench, hitByHash_256KB, true, 256 * 1024)
+BENCHMARK_NAMED_PARAM(hitBench, hitByETag_256KB, false, 256 * 1024)
+
+int main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  folly::runBenchmarks();
+  return 0;
+}
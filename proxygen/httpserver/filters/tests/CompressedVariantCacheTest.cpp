@@ -0,0 +1,141 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Conv.h>
+#include <folly/FileUtil.h>
+#include <folly/experimental/TestUtil.h>
+#include <folly/io/IOBuf.h>
+#include <folly/portability/GTest.h>
+#include <proxygen/httpserver/filters/CompressedVariantCache.h>
+#include <sys/time.h>
+
+using namespace proxygen;
+using std::chrono::milliseconds;
+
+namespace {
+
+std::string toString(const std::unique_ptr<folly::IOBuf>& buf) {
+  return buf ? buf->cloneCoalescedAsValue().moveToFbString().toStdString()
+             : "";
+}
+
+void setMtime(const std::string& path, time_t mtime) {
+  struct timeval times[2] = {{mtime, 0}, {mtime, 0}};
+  ASSERT_EQ(utimes(path.c_str(), times), 0);
+}
+
+}
+
+TEST(CompressedVariantCacheTest, StrongETag) {
+  HTTPMessage msg;
+  EXPECT_FALSE(CompressedVariantCache::getStrongETag(msg));
+  msg.getHeaders().set(HTTP_HEADER_ETAG, "W/\"v1\"");
+  EXPECT_FALSE(CompressedVariantCache::getStrongETag(msg));
+  msg.getHeaders().set(HTTP_HEADER_ETAG, "\"v1\"");
+  EXPECT_EQ(*CompressedVariantCache::getStrongETag(msg), "\"v1\"");
+}
+
+TEST(CompressedVariantCacheTest, HashContent) {
+  auto chain = folly::IOBuf::copyBuffer("Hello");
+  chain->prependChain(folly::IOBuf::copyBuffer(" World"));
+  auto flat = folly::IOBuf::copyBuffer("Hello World");
+  auto other = folly::IOBuf::copyBuffer("Hello world");
+  EXPECT_EQ(CompressedVariantCache::hashContent(*chain),
+            CompressedVariantCache::hashContent(*flat));
+  EXPECT_NE(CompressedVariantCache::hashContent(*flat),
+            CompressedVariantCache::hashContent(*other));
+}
+
+TEST(CompressedVariantCacheTest, InsertLookup) {
+  CompressedVariantCache cache;
+  auto key = CompressedVariantCache::makeKey("\"v1\"", "gzip", 4);
+  EXPECT_EQ(cache.lookup(key), nullptr);
+
+  cache.insert(key, folly::IOBuf::copyBuffer("compressed"), 1000,
+               milliseconds(5));
+  EXPECT_EQ(toString(cache.lookup(key)), "compressed");
+  // Other encodings and levels are other variants
+  EXPECT_EQ(cache.lookup(CompressedVariantCache::makeKey("\"v1\"", "zstd", 4)),
+            nullptr);
+  EXPECT_EQ(cache.lookup(CompressedVariantCache::makeKey("\"v1\"", "gzip", 6)),
+            nullptr);
+  // As is the same ETag of another resource
+  EXPECT_NE(CompressedVariantCache::identifyByETag("a", "/foo", "\"v1\""),
+            CompressedVariantCache::identifyByETag("a", "/bar", "\"v1\""));
+  EXPECT_NE(CompressedVariantCache::identifyByETag("a", "/foo", "\"v1\""),
+            CompressedVariantCache::identifyByETag("b", "/foo", "\"v1\""));
+
+  auto stats = cache.getStats();
+  EXPECT_EQ(stats.hits, 1);
+  EXPECT_EQ(stats.misses, 3);
+  EXPECT_EQ(stats.stores, 1);
+  EXPECT_EQ(stats.entries, 1);
+  EXPECT_EQ(stats.bytesNotCompressed, 1000);
+  EXPECT_EQ(stats.compressionTimeSaved, milliseconds(5));
+  EXPECT_DOUBLE_EQ(stats.getHitRate(), 0.25);
+}
+
+TEST(CompressedVariantCacheTest, Eviction) {
+  CompressedVariantCache::Options options;
+  options.maxBytes = 1024;
+  options.numShards = 1;
+  CompressedVariantCache cache(options);
+
+  for (int i = 0; i < 3; i++) {
+    cache.insert(folly::to<std::string>(i),
+                 folly::IOBuf::copyBuffer(std::string(400, 'a')), 1000,
+                 milliseconds(1));
+  }
+  auto stats = cache.getStats();
+  EXPECT_EQ(stats.evictions, 1);
+  EXPECT_EQ(stats.entries, 2);
+  EXPECT_LE(stats.bytes, 1024);
+  EXPECT_EQ(cache.lookup("0"), nullptr);
+  EXPECT_NE(cache.lookup("2"), nullptr);
+}
+
+TEST(CompressedVariantCacheTest, TooBig) {
+  CompressedVariantCache::Options options;
+  options.maxEntryBytes = 10;
+  CompressedVariantCache cache(options);
+  cache.insert("key", folly::IOBuf::copyBuffer(std::string(11, 'a')), 1000,
+               milliseconds(1));
+  EXPECT_EQ(cache.lookup("key"), nullptr);
+  EXPECT_EQ(cache.getStats().stores, 0);
+}
+
+TEST(CompressedVariantCacheTest, Sidecars) {
+  folly::test::TemporaryDirectory dir;
+  auto path = (dir.path() / "index.html").string();
+  ASSERT_TRUE(folly::writeFile(std::string("<html></html>"), path.c_str()));
+  ASSERT_TRUE(folly::writeFile(std::string("gzipped"),
+                               (path + ".gz").c_str()));
+
+  CompressedVariantCache cache;
+  EXPECT_EQ(toString(cache.getSidecar(path, "gzip")), "gzipped");
+  EXPECT_EQ(toString(cache.getSidecar(path, "gzip")), "gzipped");
+  EXPECT_EQ(cache.getSidecar(path, "zstd"), nullptr);
+  EXPECT_EQ(cache.getSidecar(path, "deflate"), nullptr);
+  auto stats = cache.getStats();
+  EXPECT_EQ(stats.sidecarLoads, 1);
+  EXPECT_EQ(stats.hits, 1);
+  EXPECT_EQ(stats.bytesNotCompressed, 13);
+
+  // Rewritten sidecars are reloaded
+  ASSERT_TRUE(folly::writeFile(std::string("gzipped again"),
+                               (path + ".gz").c_str()));
+  EXPECT_EQ(toString(cache.getSidecar(path, "gzip")), "gzipped again");
+  EXPECT_EQ(cache.getStats().sidecarLoads, 2);
+
+  // and those older than the file they are for are ignored
+  auto now = time(nullptr);
+  setMtime(path, now);
+  setMtime(path + ".gz", now - 100);
+  EXPECT_EQ(cache.getSidecar(path, "gzip"), nullptr);
+}
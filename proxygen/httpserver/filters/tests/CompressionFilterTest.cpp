@@ -8,15 +8,21 @@
  *
  */
 #include <folly/Conv.h>
+#include <folly/Random.h>
 #include <folly/ScopeGuard.h>
+#include <folly/executors/ManualExecutor.h>
 #include <folly/io/IOBuf.h>
+#include <folly/io/IOBufQueue.h>
+#include <folly/io/async/EventBase.h>
 
 #include <folly/portability/GMock.h>
 #include <folly/portability/GTest.h>
 #include <proxygen/httpserver/filters/CompressionFilter.h>
 #include <proxygen/lib/utils/ZlibStreamCompressor.h>
+#include <proxygen/lib/utils/ZstdStreamDecompressor.h>
 #include <proxygen/httpserver/Mocks.h>
 #include <proxygen/httpserver/ResponseBuilder.h>
+#include <proxygen/lib/http/session/test/HTTPTransactionMocks.h>
 
 using namespace proxygen;
 using namespace testing;
@@ -54,6 +60,7 @@ class CompressionFilterTest : public Test {
   std::unique_ptr<MockResponseHandler> responseHandler_;
   std::unique_ptr<StreamDecompressor> zd_;
   ResponseHandler* downstream_{nullptr};
+  bool enableZstd_{true};
 
   void exercise_compression(bool expectCompression,
                             std::string url,
@@ -65,6 +72,10 @@ class CompressionFilterTest : public Test {
                             int32_t compressionLevel = 4,
                             uint32_t minimumCompressionSize = 1) {
 
+    if (expectedEncoding == "zstd") {
+      zd_ = std::make_unique<ZstdStreamDecompressor>();
+    }
+
     // If there is only one IOBuf, then it's not chunked.
     bool isResponseChunked = originalResponseBody->isChained();
     size_t chunkCount = originalResponseBody->countChainElements();
@@ -90,6 +101,8 @@ class CompressionFilterTest : public Test {
           if (expectCompression) {
             EXPECT_TRUE(msg.checkForHeaderToken(
                 HTTP_HEADER_CONTENT_ENCODING, expectedEncoding.c_str(), false));
+            EXPECT_TRUE(msg.checkForHeaderToken(
+                HTTP_HEADER_VARY, "Accept-Encoding", false));
           }
 
           if (msg.getIsChunked()) {
@@ -149,6 +162,7 @@ class CompressionFilterTest : public Test {
     opts.zlibCompressionLevel = compressionLevel;
     opts.minimumCompressionSize = minimumCompressionSize;
     opts.compressibleContentTypes = compressibleTypes;
+    opts.enableZstd = enableZstd_;
     auto filterFactory = std::make_unique<CompressionFilterFactory>(opts);
 
     auto filter = filterFactory->onRequest(requestHandler_, &msg);
@@ -310,6 +324,109 @@ TEST_F(CompressionFilterTest, MissingAcceptedEncodings) {
   });
 }
 
+TEST_F(CompressionFilterTest, ZstdCompression) {
+  ASSERT_NO_FATAL_FAILURE({
+    exercise_compression(true,
+                         std::string("http://locahost/foo.compressme"),
+                         std::string("zstd"),
+                         std::string("zstd"),
+                         std::string("Hello World"),
+                         std::string("text/html"),
+                         folly::IOBuf::copyBuffer("Hello World"));
+  });
+}
+
+TEST_F(CompressionFilterTest, ChunkedZstdCompression) {
+  std::vector<std::string> chunks = {"Hello", " World"};
+  ASSERT_NO_FATAL_FAILURE({
+    exercise_compression(true,
+                         std::string("http://locahost/foo.compressme"),
+                         std::string("zstd"),
+                         std::string("zstd"),
+                         std::string("Hello World"),
+                         std::string("text/html"),
+                         createResponseChain(chunks));
+  });
+}
+
+// zstd is preferred when the client has no preference
+TEST_F(CompressionFilterTest, ZstdPreferredOnEqualQvalues) {
+  ASSERT_NO_FATAL_FAILURE({
+    exercise_compression(true,
+                         std::string("http://locahost/foo.compressme"),
+                         std::string("gzip, deflate, br, zstd"),
+                         std::string("zstd"),
+                         std::string("Hello World"),
+                         std::string("text/html"),
+                         folly::IOBuf::copyBuffer("Hello World"));
+  });
+}
+
+// zstd has to be turned on: by default the filter negotiates as it always
+// did, gzip only
+TEST_F(CompressionFilterTest, ZstdOffByDefault) {
+  enableZstd_ = CompressionFilterFactory::Options().enableZstd;
+  EXPECT_FALSE(enableZstd_);
+  ASSERT_NO_FATAL_FAILURE({
+    exercise_compression(true,
+                         std::string("http://locahost/foo.compressme"),
+                         std::string("gzip, deflate, br, zstd"),
+                         std::string("gzip"),
+                         std::string("Hello World"),
+                         std::string("text/html"),
+                         folly::IOBuf::copyBuffer("Hello World"));
+  });
+}
+
+TEST_F(CompressionFilterTest, ZstdOnlyClientByDefault) {
+  enableZstd_ = CompressionFilterFactory::Options().enableZstd;
+  ASSERT_NO_FATAL_FAILURE({
+    exercise_compression(false,
+                         std::string("http://locahost/foo.compressme"),
+                         std::string("zstd"),
+                         std::string(""),
+                         std::string("Hello World"),
+                         std::string("text/html"),
+                         folly::IOBuf::copyBuffer("Hello World"));
+  });
+}
+
+TEST_F(CompressionFilterTest, GzipPreferredByQvalue) {
+  ASSERT_NO_FATAL_FAILURE({
+    exercise_compression(true,
+                         std::string("http://locahost/foo.compressme"),
+                         std::string("zstd;q=0.5, gzip;q=0.8"),
+                         std::string("gzip"),
+                         std::string("Hello World"),
+                         std::string("text/html"),
+                         folly::IOBuf::copyBuffer("Hello World"));
+  });
+}
+
+TEST_F(CompressionFilterTest, WildcardAcceptedEncoding) {
+  ASSERT_NO_FATAL_FAILURE({
+    exercise_compression(true,
+                         std::string("http://locahost/foo.compressme"),
+                         std::string("zstd;q=0, *"),
+                         std::string("gzip"),
+                         std::string("Hello World"),
+                         std::string("text/html"),
+                         folly::IOBuf::copyBuffer("Hello World"));
+  });
+}
+
+TEST_F(CompressionFilterTest, AllEncodingsRefused) {
+  ASSERT_NO_FATAL_FAILURE({
+    exercise_compression(false,
+                         std::string("http://locahost/foo.compressme"),
+                         std::string("gzip;q=0, zstd;q=0"),
+                         std::string(""),
+                         std::string("Hello World"),
+                         std::string("text/html"),
+                         folly::IOBuf::copyBuffer("Hello World"));
+  });
+}
+
 // Content is of an-uncompressible content-type
 TEST_F(CompressionFilterTest, UncompressibleContenttype) {
   ASSERT_NO_FATAL_FAILURE({
@@ -427,6 +544,7 @@ TEST_F(CompressionFilterTest, NoResponseBody){
     opts.zlibCompressionLevel = compressionLevel;
     opts.minimumCompressionSize = minimumCompressionSize;
     opts.compressibleContentTypes = compressibleTypes;
+    opts.enableZstd = enableZstd_;
     auto filterFactory = std::make_unique<CompressionFilterFactory>(opts);
 
     auto filter = filterFactory->onRequest(requestHandler_, &msg);
@@ -445,3 +563,397 @@ TEST_F(CompressionFilterTest, NoResponseBody){
     filter->requestComplete();
   });
 }
+
+// A MockResponseHandler whose transaction the filter can ask for its
+// EventBase
+class MockTxnResponseHandler : public MockResponseHandler {
+ public:
+  MockTxnResponseHandler(RequestHandler* h, HTTPTransaction* txn)
+      : MockResponseHandler(h) {
+    txn_ = txn;
+  }
+};
+
+// Compression offloaded to an executor
+class CompressionFilterOffloadTest : public CompressionFilterTest {
+ public:
+  void SetUp() override {
+    CompressionFilterTest::SetUp();
+    txn_ = std::make_unique<NiceMock<MockHTTPTransaction>>(
+        TransportDirection::DOWNSTREAM, 1, 1, egressQueue_);
+    ON_CALL(txn_->mockTransport_, getEventBase()).WillByDefault(Return(&evb_));
+    responseHandler_ =
+        std::make_unique<MockTxnResponseHandler>(requestHandler_, txn_.get());
+  }
+
+ protected:
+  RequestHandler* makeFilter(std::shared_ptr<folly::Executor> executor,
+                             uint32_t offloadCompressionSize) {
+    EXPECT_CALL(*requestHandler_, setResponseHandler(_))
+        .WillOnce(DoAll(SaveArg<0>(&downstream_), Return()));
+    EXPECT_CALL(*requestHandler_, onEOM()).Times(1);
+
+    HTTPMessage msg;
+    msg.setURL("http://localhost/foo.compressme");
+    msg.getHeaders().set(HTTP_HEADER_ACCEPT_ENCODING, "gzip");
+
+    CompressionFilterFactory::Options opts;
+    opts.zlibCompressionLevel = 9;
+    opts.compressibleContentTypes = {"text/html"};
+    opts.compressionExecutor = std::move(executor);
+    opts.offloadCompressionSize = offloadCompressionSize;
+    CompressionFilterFactory filterFactory(opts);
+
+    auto filter = filterFactory.onRequest(requestHandler_, &msg);
+    filter->setResponseHandler(responseHandler_.get());
+    filter->onEOM();
+    return filter;
+  }
+
+  // Decompress whatever reaches the client, and note the EOM
+  void expectResponse(bool expectEOM = true) {
+    EXPECT_CALL(*responseHandler_, sendHeaders(_)).Times(1);
+    EXPECT_CALL(*responseHandler_, sendChunkHeader(_)).Times(AnyNumber());
+    EXPECT_CALL(*responseHandler_, sendChunkTerminator())
+        .WillRepeatedly(Invoke([this] { terminators_++; }));
+    EXPECT_CALL(*responseHandler_, sendBody(_))
+        .WillRepeatedly(Invoke([this](std::shared_ptr<folly::IOBuf> body) {
+          ASSERT_FALSE(eom_);
+          bodies_++;
+          decompressed_.append(zd_->decompress(body.get()));
+          ASSERT_FALSE(zd_->hasError()) << "Failed to decompress body!";
+        }));
+    EXPECT_CALL(*responseHandler_, sendEOM())
+        .Times(expectEOM ? 1 : 0)
+        .WillRepeatedly(Invoke([this] { eom_ = true; }));
+
+    ResponseBuilder(downstream_)
+        .status(200, "OK")
+        .header(HTTP_HEADER_CONTENT_TYPE, "text/html")
+        .send();
+  }
+
+  void sendChunk(const std::string& data) {
+    sent_ += data;
+    ResponseBuilder(downstream_).body(folly::IOBuf::copyBuffer(data)).send();
+  }
+
+  std::string getDecompressed() {
+    auto buf = decompressed_.move();
+    return buf ? buf->moveToFbString().toStdString() : "";
+  }
+
+  static std::string makeText(size_t size) {
+    static const char* kWords[] = {
+        "<li>", "</li>", "proxygen", "compress", "response", "body", "the"};
+    std::string text;
+    while (text.size() < size) {
+      text += kWords[folly::Random::rand32(7)];
+      text += folly::to<std::string>(folly::Random::rand32(1000));
+    }
+    text.resize(size);
+    return text;
+  }
+
+  folly::EventBase evb_;
+  HTTP2PriorityQueue egressQueue_;
+  std::unique_ptr<NiceMock<MockHTTPTransaction>> txn_;
+  folly::IOBufQueue decompressed_{folly::IOBufQueue::cacheChainLength()};
+  std::string sent_;
+  size_t bodies_{0};
+  size_t terminators_{0};
+  bool eom_{false};
+};
+
+TEST_F(CompressionFilterOffloadTest, OrderPreserved) {
+  auto executor = std::make_shared<folly::ManualExecutor>();
+  auto filter = makeFilter(executor, 1024);
+  expectResponse();
+
+  sendChunk("small before");
+  EXPECT_EQ(bodies_, 1u);
+  // Goes to the executor; everything after it has to wait
+  sendChunk(makeText(4096));
+  sendChunk("small after");
+  ResponseBuilder(downstream_).sendWithEOM();
+  EXPECT_EQ(bodies_, 1u);
+  EXPECT_EQ(terminators_, 1u);
+  EXPECT_FALSE(eom_);
+
+  EXPECT_EQ(executor->run(), 1u);
+  evb_.loopOnce();
+  EXPECT_TRUE(eom_);
+  // 3 chunks and the trailer
+  EXPECT_EQ(bodies_, 4u);
+  EXPECT_EQ(terminators_, 4u);
+  EXPECT_EQ(getDecompressed(), sent_);
+
+  filter->requestComplete();
+}
+
+TEST_F(CompressionFilterOffloadTest, SmallChunksInline) {
+  auto executor = std::make_shared<folly::ManualExecutor>();
+  auto filter = makeFilter(executor, 1024);
+  expectResponse();
+
+  sendChunk(makeText(1000));
+  sendChunk(makeText(1000));
+  ResponseBuilder(downstream_).sendWithEOM();
+  EXPECT_TRUE(eom_);
+  EXPECT_EQ(executor->run(), 0u);
+  EXPECT_EQ(getDecompressed(), sent_);
+
+  filter->requestComplete();
+}
+
+// Without an EventBase to come back to, nothing is offloaded
+TEST_F(CompressionFilterOffloadTest, NoEventBaseCompressesInline) {
+  ON_CALL(txn_->mockTransport_, getEventBase())
+      .WillByDefault(Return(nullptr));
+  auto executor = std::make_shared<folly::ManualExecutor>();
+  auto filter = makeFilter(executor, 1024);
+  expectResponse();
+
+  sendChunk(makeText(4096));
+  EXPECT_EQ(bodies_, 1u);
+  ResponseBuilder(downstream_).sendWithEOM();
+  EXPECT_TRUE(eom_);
+  EXPECT_EQ(executor->run(), 0u);
+  EXPECT_EQ(getDecompressed(), sent_);
+
+  filter->requestComplete();
+}
+
+TEST_F(CompressionFilterOffloadTest, Backpressure) {
+  auto executor = std::make_shared<folly::ManualExecutor>();
+  auto filter = makeFilter(executor, 1024);
+  expectResponse();
+
+  // One chunk being compressed and more than 4 chunks' worth queued
+  EXPECT_CALL(*requestHandler_, onEgressPaused()).Times(1);
+  for (int i = 0; i < 6; i++) {
+    sendChunk(makeText(1024));
+  }
+  Mock::VerifyAndClearExpectations(requestHandler_);
+
+  // Egress pauses while a chunk is being compressed: its output is sent,
+  // but the next one is not started
+  filter->onEgressPaused();
+  EXPECT_EQ(executor->run(), 1u);
+  evb_.loopOnce();
+  EXPECT_EQ(bodies_, 1u);
+  EXPECT_EQ(executor->run(), 0u);
+
+  // The handler is resumed once egress is and the queue drained enough
+  EXPECT_CALL(*requestHandler_, onEgressResumed()).Times(1);
+  filter->onEgressResumed();
+  while (executor->run() > 0) {
+    evb_.loopOnce();
+  }
+  Mock::VerifyAndClearExpectations(requestHandler_);
+  EXPECT_EQ(bodies_, 6u);
+
+  ResponseBuilder(downstream_).sendWithEOM();
+  EXPECT_TRUE(eom_);
+  EXPECT_EQ(getDecompressed(), sent_);
+
+  filter->requestComplete();
+}
+
+TEST_F(CompressionFilterOffloadTest, ErrorWhileCompressing) {
+  auto executor = std::make_shared<folly::ManualExecutor>();
+  auto filter = makeFilter(executor, 1024);
+  expectResponse(false);
+
+  sendChunk(makeText(4096));
+  EXPECT_CALL(*requestHandler_, onError(_)).Times(1);
+  filter->onError(kErrorConnectionReset);
+  // The filter goes away once the job is back
+  EXPECT_EQ(executor->run(), 1u);
+  evb_.loopOnce();
+  EXPECT_EQ(bodies_, 0u);
+}
+
+// Large bodies are never compressed on the IO thread, which keeps running
+// other work while they are out on the executor
+TEST_F(CompressionFilterOffloadTest, LoopNotHeldUp) {
+  auto executor = std::make_shared<folly::ManualExecutor>();
+  auto filter = makeFilter(executor, 64 * 1024);
+  expectResponse();
+
+  for (int i = 0; i < 4; i++) {
+    sendChunk(makeText(256 * 1024));
+  }
+  ResponseBuilder(downstream_).sendWithEOM();
+  EXPECT_EQ(bodies_, 0u);
+
+  // The loop runs its callbacks with nothing compressed yet
+  bool ran = false;
+  evb_.runInLoop([&] { ran = true; });
+  evb_.loopOnce(EVLOOP_NONBLOCK);
+  EXPECT_TRUE(ran);
+  EXPECT_EQ(bodies_, 0u);
+
+  // Each chunk is compressed by its own job, one at a time
+  size_t jobs = 0;
+  while (!eom_) {
+    size_t ranJobs = executor->run();
+    ASSERT_EQ(ranJobs, 1u);
+    jobs += ranJobs;
+    evb_.loopOnce();
+  }
+  EXPECT_EQ(jobs, 4u);
+  EXPECT_EQ(getDecompressed(), sent_);
+
+  filter->requestComplete();
+}
+
+// Bodies sent once the response has been aborted while a job is out go
+// nowhere, and the compressor is left to the job
+TEST_F(CompressionFilterOffloadTest, SendAfterAbort) {
+  auto executor = std::make_shared<folly::ManualExecutor>();
+  auto filter = makeFilter(executor, 1024);
+  expectResponse(false);
+  EXPECT_CALL(*responseHandler_, sendAbort()).Times(1);
+
+  sendChunk(makeText(4096));
+  sendChunk(makeText(4096));
+  downstream_->sendAbort();
+  sendChunk(makeText(4096));
+  sendChunk("small");
+  ResponseBuilder(downstream_).sendWithEOM();
+
+  EXPECT_EQ(executor->run(), 1u);
+  evb_.loopOnce();
+  EXPECT_EQ(executor->run(), 0u);
+  EXPECT_EQ(bodies_, 0u);
+  EXPECT_FALSE(eom_);
+
+  filter->requestComplete();
+}
+
+// Reuse of compressed bodies through a CompressedVariantCache
+class CompressionFilterCacheTest : public CompressionFilterTest {
+ protected:
+  struct Response {
+    std::string contentLength;
+    std::string body;
+  };
+
+  // Send a non-chunked response through a new filter, returning what the
+  // client gets
+  Response send(const std::string& body,
+                const std::string& etag = "",
+                const std::string& url = "/foo.compressme",
+                HTTPMethod method = HTTPMethod::GET) {
+    Response response;
+    zd_ = std::make_unique<ZlibStreamDecompressor>(CompressionType::GZIP);
+
+    EXPECT_CALL(*requestHandler_, setResponseHandler(_))
+        .WillOnce(DoAll(SaveArg<0>(&downstream_), Return()));
+    EXPECT_CALL(*requestHandler_, onEOM()).Times(1);
+    EXPECT_CALL(*responseHandler_, sendHeaders(_))
+        .WillOnce(Invoke([&](HTTPMessage& msg) {
+          EXPECT_TRUE(msg.checkForHeaderToken(
+              HTTP_HEADER_CONTENT_ENCODING, "gzip", false));
+          response.contentLength =
+              msg.getHeaders().getSingleOrEmpty(HTTP_HEADER_CONTENT_LENGTH);
+        }));
+    EXPECT_CALL(*responseHandler_, sendBody(_))
+        .WillOnce(Invoke([&](std::shared_ptr<folly::IOBuf> compressed) {
+          EXPECT_EQ(folly::to<std::string>(
+                        compressed->computeChainDataLength()),
+                    response.contentLength);
+          auto decompressed = zd_->decompress(compressed.get());
+          ASSERT_FALSE(zd_->hasError()) << "Failed to decompress body!";
+          response.body =
+              decompressed->moveToFbString().toStdString();
+        }));
+    EXPECT_CALL(*responseHandler_, sendEOM()).Times(1);
+
+    HTTPMessage msg;
+    msg.setMethod(method);
+    msg.setURL(url);
+    msg.getHeaders().set(HTTP_HEADER_HOST, "localhost");
+    msg.getHeaders().set(HTTP_HEADER_ACCEPT_ENCODING, "gzip");
+
+    CompressionFilterFactory::Options opts;
+    opts.minimumCompressionSize = 1;
+    opts.compressibleContentTypes = {"text/html"};
+    opts.variantCache = cache_;
+    CompressionFilterFactory filterFactory(opts);
+
+    auto filter = filterFactory.onRequest(requestHandler_, &msg);
+    filter->setResponseHandler(responseHandler_.get());
+    filter->onEOM();
+
+    ResponseBuilder builder(downstream_);
+    builder.status(200, "OK").header(HTTP_HEADER_CONTENT_TYPE, "text/html");
+    if (!etag.empty()) {
+      builder.header(HTTP_HEADER_ETAG, etag);
+    }
+    builder.body(body).sendWithEOM();
+    filter->requestComplete();
+
+    Mock::VerifyAndClearExpectations(requestHandler_);
+    Mock::VerifyAndClearExpectations(responseHandler_.get());
+    return response;
+  }
+
+  std::shared_ptr<CompressedVariantCache> cache_{
+      std::make_shared<CompressedVariantCache>()};
+};
+
+TEST_F(CompressionFilterCacheTest, IdenticalBodies) {
+  const std::string body(4000, 'a');
+  auto first = send(body);
+  EXPECT_EQ(first.body, body);
+  EXPECT_EQ(cache_->getStats().stores, 1);
+
+  auto second = send(body);
+  EXPECT_EQ(second.body, body);
+  EXPECT_EQ(second.contentLength, first.contentLength);
+  auto stats = cache_->getStats();
+  EXPECT_EQ(stats.hits, 1);
+  EXPECT_EQ(stats.stores, 1);
+  EXPECT_EQ(stats.bytesNotCompressed, body.size());
+
+  // A different body is compressed on its own
+  EXPECT_EQ(send("b" + body).body, "b" + body);
+  EXPECT_EQ(cache_->getStats().stores, 2);
+}
+
+TEST_F(CompressionFilterCacheTest, StrongETag) {
+  EXPECT_EQ(send("version one", "\"v1\"").body, "version one");
+  // Found by ETag before the body is seen, which is dropped
+  EXPECT_EQ(send("ignored", "\"v1\"").body, "version one");
+  EXPECT_EQ(cache_->getStats().hits, 1);
+
+  // Weak ETags fall back to the content hash
+  EXPECT_EQ(send("version one", "W/\"v1\"").body, "version one");
+  EXPECT_EQ(send("version two", "W/\"v1\"").body, "version two");
+}
+
+TEST_F(CompressionFilterCacheTest, ETagIsPerResource) {
+  EXPECT_EQ(send("foo", "\"v1\"", "/foo").body, "foo");
+  EXPECT_EQ(send("bar", "\"v1\"", "/bar").body, "bar");
+  EXPECT_EQ(send("ignored", "\"v1\"", "/foo").body, "foo");
+  EXPECT_EQ(send("ignored", "\"v1\"", "/bar").body, "bar");
+  auto stats = cache_->getStats();
+  EXPECT_EQ(stats.hits, 2);
+  EXPECT_EQ(stats.stores, 2);
+}
+
+TEST_F(CompressionFilterCacheTest, HeadIsNotCached) {
+  EXPECT_EQ(send("version one", "\"v1\"").body, "version one");
+  // Neither served from the cache nor stored to it
+  EXPECT_EQ(
+      send("version two", "\"v1\"", "/foo.compressme", HTTPMethod::HEAD).body,
+      "version two");
+  EXPECT_EQ(send("version three", "\"v2\"", "/foo.compressme",
+                 HTTPMethod::HEAD).body,
+            "version three");
+  auto stats = cache_->getStats();
+  EXPECT_EQ(stats.hits, 0);
+  EXPECT_EQ(stats.stores, 1);
+}
@@ -0,0 +1,129 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Benchmark.h>
+#include <folly/Conv.h>
+#include <proxygen/httpserver/filters/ResponseCache.h>
+#include <thread>
+
+using namespace folly;
+using namespace proxygen;
+
+// Cost of the ResponseCache hit path: lookup, building the response to send
+// (copy of the stored headers plus Age) and cloning the body.  time/iter is
+// per hit.
+//
+// ./response_cache_benchmark -bm_min_iters 100000
+//
+// Prints
+//   hitPath(<size>)               - one thread, 1KB and 64KB bodies; the
+//                                   body size should not matter since hits
+//                                   clone rather than copy
+//   multiThreadHits(<n>shard_<t>threads)
+//                                 - t threads sharing iters hits over 1024
+//                                   URLs, with 1 and with 16 shards.  With
+//                                   perfect scaling time/iter drops as 1/t;
+//                                   the 1 shard rows show the lock being the
+//                                   limit.
+
+namespace {
+
+const size_t kNumURLs = 1024;
+
+HTTPMessage makeRequest(size_t i) {
+  HTTPMessage req;
+  req.setMethod(HTTPMethod::GET);
+  req.setURL(folly::to<std::string>("/object/", i));
+  req.getHeaders().set(HTTP_HEADER_HOST, "www.example.com");
+  return req;
+}
+
+struct CacheFixture {
+  CacheFixture(size_t numShards, size_t bodySize) {
+    ResponseCache::Options options;
+    options.numShards = numShards;
+    options.maxBytes = size_t(1) << 30;
+    options.maxEntryBytes = options.maxBytes;
+    cache = std::make_unique<ResponseCache>(options);
+    auto now = getCurrentTime();
+    std::string body(bodySize, 'a');
+    for (size_t i = 0; i < kNumURLs; i++) {
+      requests.push_back(makeRequest(i));
+      keys.push_back(*ResponseCache::getKey(requests.back()));
+      HTTPMessage resp;
+      resp.setHTTPVersion(1, 1);
+      resp.setStatusCode(200);
+      resp.setStatusMessage("OK");
+      resp.getHeaders().set(HTTP_HEADER_CACHE_CONTROL, "max-age=3600");
+      resp.getHeaders().set(HTTP_HEADER_CONTENT_TYPE, "text/plain");
+      cache->insert(keys.back(),
+                    ResponseCache::makeEntry(requests.back(), resp,
+                                             IOBuf::copyBuffer(body), now));
+    }
+  }
+
+  void hit(size_t i) {
+    auto now = getCurrentTime();
+    auto result = cache->lookup(keys[i], requests[i], now);
+    auto response = result.entry->makeResponse(requests[i], now);
+    auto body = result.entry->body->clone();
+    doNotOptimizeAway(response);
+    doNotOptimizeAway(body);
+  }
+
+  std::unique_ptr<ResponseCache> cache;
+  std::vector<HTTPMessage> requests;
+  std::vector<std::string> keys;
+};
+
+void hitPath(size_t iters, size_t bodySize) {
+  BenchmarkSuspender suspender;
+  CacheFixture fixture(16, bodySize);
+  suspender.dismiss();
+  for (size_t i = 0; i < iters; i++) {
+    fixture.hit(i % kNumURLs);
+  }
+}
+
+void multiThreadHits(size_t iters, size_t numShards, size_t numThreads) {
+  BenchmarkSuspender suspender;
+  CacheFixture fixture(numShards, 1024);
+  suspender.dismiss();
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < numThreads; t++) {
+    threads.emplace_back([&fixture, iters, numThreads, t] {
+      for (size_t i = t; i < iters; i += numThreads) {
+        fixture.hit((i * 7919) % kNumURLs);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+}
+
+BENCHMARK_PARAM(hitPath, 1024);
+BENCHMARK_PARAM(hitPath, 65536);
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_NAMED_PARAM(multiThreadHits, 1shard_1threads, 1, 1);
+BENCHMARK_NAMED_PARAM(multiThreadHits, 1shard_4threads, 1, 4);
+BENCHMARK_NAMED_PARAM(multiThreadHits, 1shard_8threads, 1, 8);
+BENCHMARK_NAMED_PARAM(multiThreadHits, 16shard_1threads, 16, 1);
+BENCHMARK_NAMED_PARAM(multiThreadHits, 16shard_4threads, 16, 4);
+BENCHMARK_NAMED_PARAM(multiThreadHits, 16shard_8threads, 16, 8);
+
+int main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  folly::runBenchmarks();
+  return 0;
+}
@@ -0,0 +1,367 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/io/IOBuf.h>
+#include <folly/portability/GMock.h>
+#include <folly/portability/GTest.h>
+#include <proxygen/httpserver/Mocks.h>
+#include <proxygen/httpserver/ResponseBuilder.h>
+#include <proxygen/httpserver/filters/ResponseCacheFilter.h>
+
+using namespace proxygen;
+using namespace testing;
+using std::chrono::seconds;
+
+namespace {
+
+HTTPMessage makeRequest(const std::string& url,
+                        HTTPMethod method = HTTPMethod::GET) {
+  HTTPMessage req;
+  req.setMethod(method);
+  req.setURL(url);
+  req.getHeaders().set(HTTP_HEADER_HOST, "www.example.com");
+  return req;
+}
+
+HTTPMessage makeResponse(const std::string& cacheControl) {
+  HTTPMessage resp;
+  resp.setHTTPVersion(1, 1);
+  resp.setStatusCode(200);
+  resp.setStatusMessage("OK");
+  if (!cacheControl.empty()) {
+    resp.getHeaders().set(HTTP_HEADER_CACHE_CONTROL, cacheControl);
+  }
+  return resp;
+}
+
+std::string toString(const folly::IOBuf& buf) {
+  return buf.cloneCoalescedAsValue().moveToFbString().toStdString();
+}
+
+}
+
+TEST(ResponseCacheTest, Storable) {
+  auto now = getCurrentTime();
+  auto req = makeRequest("/");
+  auto body = [] { return folly::IOBuf::copyBuffer("hello"); };
+
+  auto entry = ResponseCache::makeEntry(
+      req, makeResponse("public, max-age=60"), body(), now);
+  ASSERT_TRUE(entry);
+  EXPECT_EQ(entry->freshnessLifetime, seconds(60));
+  EXPECT_EQ(entry->response.getHeaders().getSingleOrEmpty(
+                HTTP_HEADER_CONTENT_LENGTH), "5");
+
+  EXPECT_FALSE(ResponseCache::makeEntry(
+      req, makeResponse("no-store"), body(), now));
+  EXPECT_FALSE(ResponseCache::makeEntry(
+      req, makeResponse("private, max-age=60"), body(), now));
+  // No freshness and no validator
+  EXPECT_FALSE(ResponseCache::makeEntry(req, makeResponse(""), body(), now));
+
+  auto resp = makeResponse("max-age=60");
+  resp.getHeaders().set(HTTP_HEADER_VARY, "*");
+  EXPECT_FALSE(ResponseCache::makeEntry(req, resp, body(), now));
+
+  resp = makeResponse("max-age=60");
+  resp.getHeaders().set(HTTP_HEADER_SET_COOKIE, "a=b");
+  EXPECT_FALSE(ResponseCache::makeEntry(req, resp, body(), now));
+
+  resp = makeResponse("max-age=60");
+  resp.setStatusCode(500);
+  EXPECT_FALSE(ResponseCache::makeEntry(req, resp, body(), now));
+
+  EXPECT_FALSE(ResponseCache::getKey(makeRequest("/", HTTPMethod::POST)));
+  req.getHeaders().set(HTTP_HEADER_AUTHORIZATION, "Basic Zm9vOmJhcg==");
+  EXPECT_FALSE(ResponseCache::getKey(req));
+}
+
+TEST(ResponseCacheTest, Freshness) {
+  auto now = getCurrentTime();
+  auto req = makeRequest("/");
+
+  auto entry = ResponseCache::makeEntry(
+      req, makeResponse("max-age=60, s-maxage=10"), nullptr, now);
+  EXPECT_EQ(entry->freshnessLifetime, seconds(10));
+
+  auto resp = makeResponse("max-age=60");
+  resp.getHeaders().set(HTTP_HEADER_AGE, "50");
+  entry = ResponseCache::makeEntry(req, resp, nullptr, now);
+  EXPECT_EQ(entry->getAge(now), seconds(50));
+  EXPECT_EQ(entry->getAge(now + seconds(5)), seconds(55));
+  EXPECT_FALSE(entry->response.getHeaders().exists(HTTP_HEADER_AGE));
+
+  resp = makeResponse("");
+  resp.getHeaders().set(HTTP_HEADER_DATE, "Sun, 06 Nov 1994 08:49:37 GMT");
+  resp.getHeaders().set(HTTP_HEADER_EXPIRES, "Sun, 06 Nov 1994 08:50:07 GMT");
+  resp.getHeaders().set(HTTP_HEADER_ETAG, "\"v1\"");
+  entry = ResponseCache::makeEntry(req, resp, nullptr, now);
+  EXPECT_EQ(entry->freshnessLifetime, seconds(30));
+
+  ResponseCache cache;
+  cache.insert("k", std::move(entry));
+  // Already stale, from its Date
+  EXPECT_FALSE(cache.lookup("k", req, now).fresh);
+}
+
+TEST(ResponseCacheTest, LookupVaryAndRequestDirectives) {
+  auto now = getCurrentTime();
+  ResponseCache cache;
+  auto req = makeRequest("/");
+  req.getHeaders().set(HTTP_HEADER_ACCEPT_ENCODING, "gzip");
+  auto resp = makeResponse("max-age=60");
+  resp.getHeaders().set(HTTP_HEADER_VARY, "Accept-Encoding");
+  cache.insert("k", ResponseCache::makeEntry(req, resp, nullptr, now));
+
+  EXPECT_TRUE(cache.lookup("k", req, now).fresh);
+
+  auto other = makeRequest("/");
+  EXPECT_FALSE(cache.lookup("k", other, now).entry);
+
+  req.getHeaders().set(HTTP_HEADER_CACHE_CONTROL, "no-cache");
+  auto result = cache.lookup("k", req, now);
+  EXPECT_TRUE(result.entry);
+  EXPECT_FALSE(result.fresh);
+
+  req.getHeaders().set(HTTP_HEADER_CACHE_CONTROL, "max-age=5");
+  EXPECT_TRUE(cache.lookup("k", req, now).fresh);
+  EXPECT_FALSE(cache.lookup("k", req, now + seconds(10)).fresh);
+
+  auto stats = cache.getStats();
+  EXPECT_EQ(stats.hits, 2);
+  EXPECT_EQ(stats.staleHits, 2);
+  EXPECT_EQ(stats.misses, 1);
+  EXPECT_EQ(stats.entries, 1);
+}
+
+TEST(ResponseCacheTest, Conditional) {
+  auto now = getCurrentTime();
+  auto req = makeRequest("/");
+  auto resp = makeResponse("max-age=60");
+  resp.getHeaders().set(HTTP_HEADER_ETAG, "W/\"v1\"");
+  resp.getHeaders().set(HTTP_HEADER_LAST_MODIFIED,
+                        "Sun, 06 Nov 1994 08:49:37 GMT");
+  auto entry = ResponseCache::makeEntry(
+      req, resp, folly::IOBuf::copyBuffer("hello"), now);
+
+  EXPECT_FALSE(entry->matchesConditional(req));
+  req.getHeaders().set(HTTP_HEADER_IF_NONE_MATCH, "\"v0\", \"v1\"");
+  EXPECT_TRUE(entry->matchesConditional(req));
+  auto notModified = entry->makeResponse(req, now);
+  EXPECT_EQ(notModified.getStatusCode(), 304);
+  EXPECT_FALSE(notModified.getHeaders().exists(HTTP_HEADER_CONTENT_LENGTH));
+
+  req.getHeaders().set(HTTP_HEADER_IF_NONE_MATCH, "\"v2\"");
+  req.getHeaders().set(HTTP_HEADER_IF_MODIFIED_SINCE,
+                       "Sun, 06 Nov 1994 08:49:37 GMT");
+  // If-None-Match takes precedence
+  EXPECT_FALSE(entry->matchesConditional(req));
+  req.getHeaders().remove(HTTP_HEADER_IF_NONE_MATCH);
+  EXPECT_TRUE(entry->matchesConditional(req));
+}
+
+TEST(ResponseCacheTest, LRUEviction) {
+  auto now = getCurrentTime();
+  auto req = makeRequest("/");
+  auto makeEntry = [&] {
+    return ResponseCache::makeEntry(
+        req, makeResponse("max-age=60"), folly::IOBuf::copyBuffer("x"), now);
+  };
+  auto entrySize = makeEntry()->size + 1;
+
+  ResponseCache::Options options;
+  options.numShards = 1;
+  options.maxBytes = 2 * entrySize;
+  options.tinyLFUAdmission = false;
+  ResponseCache cache(options);
+  cache.insert("a", makeEntry());
+  cache.insert("b", makeEntry());
+  EXPECT_TRUE(cache.lookup("a", req, now).entry);
+  cache.insert("c", makeEntry());
+
+  EXPECT_TRUE(cache.lookup("a", req, now).entry);
+  EXPECT_FALSE(cache.lookup("b", req, now).entry);
+  EXPECT_TRUE(cache.lookup("c", req, now).entry);
+  auto stats = cache.getStats();
+  EXPECT_EQ(stats.evictions, 1);
+  EXPECT_EQ(stats.entries, 2);
+  EXPECT_EQ(stats.bytes, 2 * entrySize);
+
+  cache.erase("a");
+  EXPECT_EQ(cache.getStats().bytes, entrySize);
+}
+
+TEST(ResponseCacheTest, TinyLFUAdmission) {
+  auto now = getCurrentTime();
+  auto req = makeRequest("/");
+  auto makeEntry = [&] {
+    return ResponseCache::makeEntry(
+        req, makeResponse("max-age=60"), folly::IOBuf::copyBuffer("x"), now);
+  };
+  auto entrySize = makeEntry()->size + 1;
+
+  ResponseCache::Options options;
+  options.numShards = 1;
+  options.maxBytes = 2 * entrySize;
+  ResponseCache cache(options);
+  for (auto key : {"a", "b"}) {
+    for (int i = 0; i < 3; i++) {
+      cache.lookup(key, req, now);
+    }
+    cache.insert(key, makeEntry());
+  }
+
+  // Seen once, less popular than the LRU entry
+  cache.lookup("c", req, now);
+  cache.insert("c", makeEntry());
+  EXPECT_FALSE(cache.lookup("c", req, now).entry);
+  EXPECT_EQ(cache.getStats().admissionRejects, 1);
+
+  for (int i = 0; i < 5; i++) {
+    cache.lookup("d", req, now);
+  }
+  cache.insert("d", makeEntry());
+  EXPECT_TRUE(cache.lookup("d", req, now).entry);
+  EXPECT_EQ(cache.getStats().evictions, 1);
+}
+
+class ResponseCacheFilterTest : public Test {
+ public:
+  void SetUp() override {
+    cache_ = std::make_shared<ResponseCache>();
+    factory_ = std::make_unique<ResponseCacheFilterFactory>(cache_);
+  }
+
+ protected:
+  // Runs req through a new filter in front of handler, and returns it
+  RequestHandler* sendRequest(const HTTPMessage& req,
+                              MockRequestHandler& handler,
+                              MockResponseHandler& client) {
+    EXPECT_CALL(handler, setResponseHandler(_))
+        .WillOnce(SaveArg<0>(&downstream_));
+    auto msg = req;
+    auto filter = factory_->onRequest(&handler, &msg);
+    filter->setResponseHandler(&client);
+    filter->onRequest(std::make_unique<HTTPMessage>(req));
+    filter->onEOM();
+    return filter;
+  }
+
+  // Fills the cache with a response to req
+  void store(const HTTPMessage& req, HTTPMessage resp) {
+    MockRequestHandler handler;
+    MockResponseHandler client(nullptr);
+    EXPECT_CALL(handler, onRequest(_));
+    EXPECT_CALL(handler, onEOM());
+    EXPECT_CALL(handler, requestComplete());
+    EXPECT_CALL(client, sendHeaders(_));
+    EXPECT_CALL(client, sendBody(_));
+    EXPECT_CALL(client, sendEOM());
+    auto filter = sendRequest(req, handler, client);
+    ResponseBuilder builder(downstream_);
+    builder.status(resp.getStatusCode(), resp.getStatusMessage());
+    resp.getHeaders().forEach([&builder] (const std::string& name,
+                                          const std::string& value) {
+      builder.header(name, value);
+    });
+    builder.body(folly::IOBuf::copyBuffer("hello")).sendWithEOM();
+    filter->requestComplete();
+  }
+
+  std::shared_ptr<ResponseCache> cache_;
+  std::unique_ptr<ResponseCacheFilterFactory> factory_;
+  ResponseHandler* downstream_{nullptr};
+};
+
+TEST_F(ResponseCacheFilterTest, MissThenHit) {
+  auto req = makeRequest("/hello");
+  store(req, makeResponse("max-age=60"));
+  EXPECT_EQ(cache_->getStats().stores, 1);
+
+  MockRequestHandler handler;
+  MockResponseHandler client(nullptr);
+  EXPECT_CALL(handler, onRequest(_)).Times(0);
+  EXPECT_CALL(handler, onError(kErrorCanceled));
+  EXPECT_CALL(client, sendHeaders(_)).WillOnce(Invoke([] (HTTPMessage& msg) {
+    EXPECT_EQ(msg.getStatusCode(), 200);
+    EXPECT_TRUE(msg.getHeaders().exists(HTTP_HEADER_AGE));
+    EXPECT_EQ(msg.getHeaders().getSingleOrEmpty(HTTP_HEADER_CONTENT_LENGTH),
+              "5");
+  }));
+  EXPECT_CALL(client, sendBody(_))
+      .WillOnce(Invoke([] (std::shared_ptr<folly::IOBuf> body) {
+    EXPECT_EQ(toString(*body), "hello");
+  }));
+  EXPECT_CALL(client, sendEOM());
+  auto filter = sendRequest(req, handler, client);
+  filter->requestComplete();
+  EXPECT_EQ(cache_->getStats().hits, 1);
+}
+
+TEST_F(ResponseCacheFilterTest, ConditionalHit) {
+  auto req = makeRequest("/hello");
+  auto resp = makeResponse("max-age=60");
+  resp.getHeaders().set(HTTP_HEADER_ETAG, "\"v1\"");
+  store(req, resp);
+
+  req.getHeaders().set(HTTP_HEADER_IF_NONE_MATCH, "\"v1\"");
+  MockRequestHandler handler;
+  MockResponseHandler client(nullptr);
+  EXPECT_CALL(handler, onError(kErrorCanceled));
+  EXPECT_CALL(client, sendHeaders(_)).WillOnce(Invoke([] (HTTPMessage& msg) {
+    EXPECT_EQ(msg.getStatusCode(), 304);
+  }));
+  EXPECT_CALL(client, sendBody(_)).Times(0);
+  EXPECT_CALL(client, sendEOM());
+  sendRequest(req, handler, client)->requestComplete();
+}
+
+TEST_F(ResponseCacheFilterTest, Revalidate) {
+  auto req = makeRequest("/hello");
+  auto resp = makeResponse("no-cache");
+  resp.getHeaders().set(HTTP_HEADER_ETAG, "\"v1\"");
+  store(req, resp);
+
+  MockRequestHandler handler;
+  MockResponseHandler client(nullptr);
+  EXPECT_CALL(handler, onRequest(_))
+      .WillOnce(Invoke([] (std::shared_ptr<HTTPMessage> msg) {
+    EXPECT_EQ(msg->getHeaders().getSingleOrEmpty(HTTP_HEADER_IF_NONE_MATCH),
+              "\"v1\"");
+  }));
+  EXPECT_CALL(handler, onEOM());
+  EXPECT_CALL(handler, requestComplete());
+  // The handler's 304 is turned into the stored 200
+  EXPECT_CALL(client, sendHeaders(_)).WillOnce(Invoke([] (HTTPMessage& msg) {
+    EXPECT_EQ(msg.getStatusCode(), 200);
+  }));
+  EXPECT_CALL(client, sendBody(_))
+      .WillOnce(Invoke([] (std::shared_ptr<folly::IOBuf> body) {
+    EXPECT_EQ(toString(*body), "hello");
+  }));
+  EXPECT_CALL(client, sendEOM());
+  auto filter = sendRequest(req, handler, client);
+  ResponseBuilder(downstream_)
+      .status(304, "Not Modified")
+      .header(HTTP_HEADER_ETAG, "\"v1\"")
+      .sendWithEOM();
+  filter->requestComplete();
+  EXPECT_EQ(cache_->getStats().staleHits, 1);
+}
+
+TEST_F(ResponseCacheFilterTest, UnsafeMethodInvalidates) {
+  auto req = makeRequest("/hello");
+  store(req, makeResponse("max-age=60"));
+  EXPECT_EQ(cache_->getStats().entries, 1);
+
+  MockRequestHandler handler;
+  auto post = makeRequest("/hello", HTTPMethod::POST);
+  EXPECT_EQ(factory_->onRequest(&handler, &post), &handler);
+  EXPECT_EQ(cache_->getStats().entries, 0);
+}
@@ -0,0 +1,78 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/portability/GTest.h>
+#include <proxygen/httpserver/filters/ShardedLRUCache.h>
+
+using namespace proxygen;
+
+namespace {
+
+struct TestEntry {
+  explicit TestEntry(size_t s) : size(s) {
+  }
+  size_t size;
+};
+
+struct TestState {
+  explicit TestState(int v) : value(v) {
+  }
+  int value;
+};
+
+using TestCache = ShardedLRUCache<TestEntry, TestState>;
+
+}
+
+TEST(ShardedLRUCacheTest, BytesIncludeKeys) {
+  TestCache cache(1000, 1, 7);
+  auto& shard = cache.getShard(TestCache::hashKey("a"));
+  EXPECT_EQ(shard.extra.value, 7);
+  EXPECT_EQ(shard.maxBytes, 1000u);
+  EXPECT_TRUE(shard.fits("a", 999));
+  EXPECT_FALSE(shard.fits("a", 1000));
+
+  EXPECT_EQ(shard.set("a", std::make_shared<TestEntry>(99)), 0u);
+  EXPECT_EQ(shard.bytes, 100u);
+  // Replacing an entry does not count it twice
+  EXPECT_EQ(shard.set("a", std::make_shared<TestEntry>(199)), 0u);
+  EXPECT_EQ(shard.bytes, 200u);
+  shard.erase("a");
+  shard.erase("a");
+  EXPECT_EQ(shard.bytes, 0u);
+  EXPECT_TRUE(shard.map.empty());
+}
+
+TEST(ShardedLRUCacheTest, EvictsLeastRecentlyUsed) {
+  TestCache cache(300, 1, 0);
+  auto& shard = cache.getShard(TestCache::hashKey("a"));
+  shard.set("a", std::make_shared<TestEntry>(99));
+  shard.set("b", std::make_shared<TestEntry>(99));
+  shard.set("c", std::make_shared<TestEntry>(99));
+  // Touch a, so b is the least recently used
+  EXPECT_NE(shard.map.find("a"), shard.map.end());
+  EXPECT_EQ(shard.set("d", std::make_shared<TestEntry>(199)), 2u);
+  EXPECT_NE(shard.map.findWithoutPromotion("a"), shard.map.end());
+  EXPECT_EQ(shard.map.findWithoutPromotion("b"), shard.map.end());
+  EXPECT_EQ(shard.map.findWithoutPromotion("c"), shard.map.end());
+  EXPECT_EQ(shard.bytes, 300u);
+}
+
+TEST(ShardedLRUCacheTest, SplitsBudget) {
+  TestCache cache(1000, 3, 0);
+  size_t shards = 0;
+  size_t maxBytes = 0;
+  cache.forEachShard([&](const TestCache::Shard& shard) {
+    shards++;
+    maxBytes += shard.maxBytes;
+  });
+  // Rounded up to a power of two
+  EXPECT_EQ(shards, 4u);
+  EXPECT_EQ(maxBytes, 1000u);
+}
@@ -0,0 +1,50 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "CoroEchoHandler.h"
+
+#if FOLLY_HAS_COROUTINES
+
+#include <folly/Conv.h>
+
+#include "EchoStats.h"
+
+using namespace proxygen;
+
+namespace EchoService {
+
+CoroEchoHandler::CoroEchoHandler(EchoStats* stats): stats_(stats) {
+}
+
+folly::coro::Task<void> CoroEchoHandler::handleRequest(
+    std::unique_ptr<HTTPMessage> /*headers*/) {
+  stats_->recordRequest();
+
+  folly::IOBufQueue body{folly::IOBufQueue::cacheChainLength()};
+  while (auto chunk = co_await readBody()) {
+    body.append(std::move(chunk));
+  }
+
+  HTTPMessage response;
+  response.setStatusCode(200);
+  response.setStatusMessage("OK");
+  response.getHeaders().add(
+      "Request-Number", folly::to<std::string>(stats_->getRequestCount()));
+  response.getHeaders().add(HTTP_HEADER_CONTENT_LENGTH,
+                            folly::to<std::string>(body.chainLength()));
+  sendHeaders(response);
+  if (!body.empty()) {
+    co_await sendBody(body.move());
+  }
+  sendEOM();
+}
+
+}
+
+#endif // FOLLY_HAS_COROUTINES
@@ -0,0 +1,36 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <proxygen/httpserver/CoroRequestHandler.h>
+
+#if FOLLY_HAS_COROUTINES
+
+namespace EchoService {
+
+class EchoStats;
+
+/**
+ * EchoHandler written as a coroutine.
+ */
+class CoroEchoHandler : public proxygen::CoroRequestHandler {
+ public:
+  explicit CoroEchoHandler(EchoStats* stats);
+
+ private:
+  folly::coro::Task<void> handleRequest(
+      std::unique_ptr<proxygen::HTTPMessage> headers) override;
+
+  EchoStats* const stats_{nullptr};
+};
+
+}
+
+#endif // FOLLY_HAS_COROUTINES
@@ -14,6 +14,7 @@
 #include <proxygen/httpserver/HTTPServer.h>
 #include <proxygen/httpserver/RequestHandlerFactory.h>
 
+#include "CoroEchoHandler.h"
 #include "EchoHandler.h"
 #include "EchoStats.h"
 
@@ -32,6 +33,8 @@ DEFINE_int32(h2_port, 11002, "Port to listen on with HTTP/2 protocol");
 DEFINE_string(ip, "localhost", "IP/Hostname to bind to");
 DEFINE_int32(threads, 0, "Number of threads to listen on. Numbers <= 0 "
              "will use the number of cores on this machine.");
+DEFINE_bool(coro, false, "Use the coroutine handler, in builds with "
+            "PROXYGEN_ENABLE_COROUTINES");
 
 class EchoHandlerFactory : public RequestHandlerFactory {
  public:
@@ -44,6 +47,11 @@ class EchoHandlerFactory : public RequestHandlerFactory {
   }
 
   RequestHandler* onRequest(RequestHandler*, HTTPMessage*) noexcept override {
+#if FOLLY_HAS_COROUTINES
+    if (FLAGS_coro) {
+      return new CoroEchoHandler(stats_.get());
+    }
+#endif
     return new EchoHandler(stats_.get());
   }
 
@@ -8,9 +8,11 @@
  *
  */
 #include <proxygen/httpserver/samples/echo/EchoHandler.h>
+#include <folly/io/async/EventBaseManager.h>
 #include <folly/portability/GMock.h>
 #include <folly/portability/GTest.h>
 #include <proxygen/httpserver/Mocks.h>
+#include <proxygen/httpserver/samples/echo/CoroEchoHandler.h>
 #include <proxygen/httpserver/samples/echo/EchoStats.h>
 
 using namespace EchoService;
@@ -93,3 +95,93 @@ TEST_F(EchoHandlerFixture, ReplaysBodyProperly) {
   EXPECT_EQ(200, response.getStatusCode());
   EXPECT_EQ("part1part2", body);
 }
+
+#if FOLLY_HAS_COROUTINES
+
+// Records when the handler deletes itself
+class TrackedCoroEchoHandler : public CoroEchoHandler {
+ public:
+  TrackedCoroEchoHandler(EchoStats* stats, bool* destroyed)
+      : CoroEchoHandler(stats), destroyed_(destroyed) {
+  }
+
+  ~TrackedCoroEchoHandler() override {
+    *destroyed_ = true;
+  }
+
+ private:
+  bool* destroyed_;
+};
+
+class CoroEchoHandlerFixture : public testing::Test {
+ public:
+  void SetUp() override {
+    folly::EventBaseManager::get()->setEventBase(&evb, false);
+    handler = new TrackedCoroEchoHandler(&stats, &destroyed);
+    responseHandler = std::make_unique<MockResponseHandler>(handler);
+    handler->setResponseHandler(responseHandler.get());
+  }
+
+  void TearDown() override {
+    folly::EventBaseManager::get()->clearEventBase();
+    Mock::VerifyAndClear(&stats);
+    Mock::VerifyAndClear(responseHandler.get());
+  }
+
+ protected:
+  folly::EventBase evb;
+  CoroEchoHandler* handler{nullptr};
+  bool destroyed{false};
+  StrictMock<MockEchoStats> stats;
+  std::unique_ptr<MockResponseHandler> responseHandler;
+};
+
+TEST_F(CoroEchoHandlerFixture, ReplaysBodyProperly) {
+  EXPECT_CALL(stats, recordRequest()).WillOnce(Return());
+  EXPECT_CALL(stats, getRequestCount()).WillOnce(Return(5));
+
+  HTTPMessage response;
+  folly::fbstring body;
+  EXPECT_CALL(*responseHandler, sendHeaders(_))
+      .WillOnce(DoAll(SaveArg<0>(&response), Return()));
+  EXPECT_CALL(*responseHandler, sendBody(_))
+      .WillRepeatedly(DoAll(Invoke([&](std::shared_ptr<folly::IOBuf> b) {
+                              body += b->moveToFbString();
+                            }),
+                            Return()));
+  EXPECT_CALL(*responseHandler, sendEOM()).WillOnce(Return());
+
+  handler->onRequest(nullptr);
+  // The task starts on the next loop; body arriving before then is queued
+  handler->onBody(folly::IOBuf::copyBuffer("part1"));
+  evb.loop();
+  handler->onBody(folly::IOBuf::copyBuffer("part2"));
+  handler->onEOM();
+  evb.loop();
+  handler->requestComplete();
+  evb.loop();
+
+  EXPECT_EQ("5", response.getHeaders().getSingleOrEmpty("Request-Number"));
+  EXPECT_EQ(200, response.getStatusCode());
+  EXPECT_EQ("part1part2", body);
+  EXPECT_TRUE(destroyed);
+}
+
+TEST_F(CoroEchoHandlerFixture, ErrorWhileReadingBody) {
+  EXPECT_CALL(stats, recordRequest()).WillOnce(Return());
+  EXPECT_CALL(*responseHandler, sendHeaders(_)).Times(0);
+  EXPECT_CALL(*responseHandler, sendBody(_)).Times(0);
+  EXPECT_CALL(*responseHandler, sendEOM()).Times(0);
+  EXPECT_CALL(*responseHandler, sendAbort()).Times(0);
+
+  handler->onRequest(nullptr);
+  evb.loop();
+  handler->onBody(folly::IOBuf::copyBuffer("part1"));
+  // Resumes the task with RequestError, which ends it without a response
+  handler->onError(kErrorTimeout);
+  evb.loop();
+
+  EXPECT_TRUE(destroyed);
+}
+
+#endif // FOLLY_HAS_COROUTINES
@@ -0,0 +1,305 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "CoroProxyHandler.h"
+
+#if FOLLY_HAS_COROUTINES
+
+#include <folly/io/async/EventBaseManager.h>
+#include <folly/portability/GFlags.h>
+#include <proxygen/lib/http/HTTPConnector.h>
+#include <proxygen/lib/http/session/HTTPUpstreamSession.h>
+#include <proxygen/lib/utils/URL.h>
+
+#include "ProxyStats.h"
+#include "SessionWrapper.h"
+
+using namespace proxygen;
+using std::string;
+using std::unique_ptr;
+
+DECLARE_int32(proxy_connect_timeout);
+
+namespace {
+
+/**
+ * Suspends the coroutine until wake() is called from a callback on the same
+ * EventBase.  Resumes inline rather than through the executor.
+ */
+class Wakeup {
+ public:
+  class Awaitable {
+   public:
+    explicit Awaitable(Wakeup& wakeup) : wakeup_(wakeup) {
+    }
+
+    bool await_ready() const noexcept {
+      return false;
+    }
+
+    void await_suspend(std::experimental::coroutine_handle<> waiter) noexcept {
+      DCHECK(!wakeup_.waiter_);
+      wakeup_.waiter_ = waiter;
+    }
+
+    void await_resume() noexcept {
+    }
+
+    friend Awaitable co_viaIfAsync(folly::Executor::KeepAlive<>,
+                                   Awaitable&& awaitable) noexcept {
+      return std::move(awaitable);
+    }
+
+   private:
+    Wakeup& wakeup_;
+  };
+
+  Awaitable wait() {
+    return Awaitable(*this);
+  }
+
+  void wake() {
+    if (waiter_) {
+      auto waiter = waiter_;
+      waiter_ = nullptr;
+      waiter.resume();
+    }
+  }
+
+ private:
+  std::experimental::coroutine_handle<> waiter_;
+};
+
+class UpstreamConnector : public HTTPConnector::Callback {
+ public:
+  explicit UpstreamConnector(folly::HHWheelTimer* timer)
+      : connector_(this, timer) {
+  }
+
+  void connect(const folly::SocketAddress& addr) {
+    const folly::AsyncSocket::OptionMap opts{
+      {{SOL_SOCKET, SO_REUSEADDR}, 1}};
+    connector_.connect(folly::EventBaseManager::get()->getEventBase(), addr,
+                       std::chrono::milliseconds(FLAGS_proxy_connect_timeout),
+                       opts);
+  }
+
+  void connectSuccess(HTTPUpstreamSession* session) override {
+    session_ = session;
+    done_ = true;
+    wakeup_.wake();
+  }
+
+  void connectError(const folly::AsyncSocketException& ex) override {
+    LOG(ERROR) << "Failed to connect: " << folly::exceptionStr(ex);
+    done_ = true;
+    wakeup_.wake();
+  }
+
+  HTTPConnector connector_;
+  Wakeup wakeup_;
+  HTTPUpstreamSession* session_{nullptr};
+  bool done_{false};
+};
+
+class ServerTransaction : public HTTPTransactionHandler {
+ public:
+  // Response body buffered beyond this pauses the upstream transaction
+  static constexpr size_t kMaxBufferedBody = 64 * 1024;
+
+  void setTransaction(HTTPTransaction* txn) noexcept override {
+    txn_ = txn;
+  }
+
+  void detachTransaction() noexcept override {
+    txn_ = nullptr;
+    wakeup_.wake();
+  }
+
+  void onHeadersComplete(unique_ptr<HTTPMessage> msg) noexcept override {
+    headers_ = std::move(msg);
+    wakeup_.wake();
+  }
+
+  void onBody(unique_ptr<folly::IOBuf> chain) noexcept override {
+    body_.append(std::move(chain));
+    if (!ingressPaused_ && body_.chainLength() >= kMaxBufferedBody) {
+      ingressPaused_ = true;
+      txn_->pauseIngress();
+    }
+    wakeup_.wake();
+  }
+
+  void onTrailers(unique_ptr<HTTPHeaders> /*trailers*/) noexcept override {
+    // ignore for now
+  }
+
+  void onEOM() noexcept override {
+    eom_ = true;
+    wakeup_.wake();
+  }
+
+  void onUpgrade(UpgradeProtocol /*protocol*/) noexcept override {
+    // ignore for now
+  }
+
+  void onError(const HTTPException& error) noexcept override {
+    LOG(ERROR) << "Server error: " << error;
+    error_ = true;
+    wakeup_.wake();
+  }
+
+  void onEgressPaused() noexcept override {
+    egressPaused_ = true;
+  }
+
+  void onEgressResumed() noexcept override {
+    egressPaused_ = false;
+    wakeup_.wake();
+  }
+
+  unique_ptr<folly::IOBuf> takeBody() {
+    if (ingressPaused_ && txn_) {
+      ingressPaused_ = false;
+      txn_->resumeIngress();
+    }
+    return body_.move();
+  }
+
+  bool failed() const {
+    return error_ || !txn_;
+  }
+
+  HTTPTransaction* txn_{nullptr};
+  Wakeup wakeup_;
+  unique_ptr<HTTPMessage> headers_;
+  folly::IOBufQueue body_{folly::IOBufQueue::cacheChainLength()};
+  bool eom_{false};
+  bool error_{false};
+  bool ingressPaused_{false};
+  bool egressPaused_{false};
+};
+
+} // namespace
+
+namespace ProxyService {
+
+CoroProxyHandler::CoroProxyHandler(ProxyStats* stats,
+                                   folly::HHWheelTimer* timer)
+    : stats_(stats), timer_(timer) {
+}
+
+void CoroProxyHandler::sendError(uint16_t code, const string& message) {
+  HTTPMessage response;
+  response.setStatusCode(code);
+  response.setStatusMessage(message);
+  response.getHeaders().add(HTTP_HEADER_CONTENT_LENGTH, "0");
+  sendHeaders(response);
+  sendEOM();
+}
+
+folly::coro::Task<void> CoroProxyHandler::handleRequest(
+    unique_ptr<HTTPMessage> request) {
+  // This HTTP proxy does not obey the rules in the spec, such as stripping
+  // hop-by-hop headers.  Example only!
+  stats_->recordRequest();
+  if (request->getMethod() == HTTPMethod::CONNECT) {
+    sendError(501, "Not Implemented");
+    co_return;
+  }
+
+  folly::SocketAddress addr;
+  try {
+    // Note, this does a synchronous DNS lookup which is bad in event driven
+    // code
+    proxygen::URL url(request->getURL());
+    addr.setFromHostPort(url.getHost(), url.getPort());
+  } catch (...) {
+    sendError(503, "Bad Gateway");
+    co_return;
+  }
+
+  // A more sophisticated proxy would have a connection pool here
+  UpstreamConnector connector(timer_);
+  connector.connect(addr);
+  while (!connector.done_) {
+    co_await connector.wakeup_.wait();
+  }
+  if (!connector.session_) {
+    sendError(503, "Bad Gateway");
+    co_return;
+  }
+  SessionWrapper session(connector.session_);
+  if (isRequestDone()) {
+    // Client went away while we were connecting
+    co_return;
+  }
+
+  ServerTransaction server;
+  if (!session->newTransaction(&server)) {
+    sendError(503, "Bad Gateway");
+    co_return;
+  }
+  server.txn_->sendHeaders(*request);
+
+  bool clientFailed = false;
+  try {
+    while (auto body = co_await readBody()) {
+      while (server.egressPaused_ && !server.failed()) {
+        co_await server.wakeup_.wait();
+      }
+      if (server.failed()) {
+        break;
+      }
+      server.txn_->sendBody(std::move(body));
+    }
+    if (!server.failed()) {
+      server.txn_->sendEOM();
+    }
+
+    while (!server.headers_ && !server.failed()) {
+      co_await server.wakeup_.wait();
+    }
+    if (server.headers_) {
+      sendHeaders(*server.headers_);
+      while (true) {
+        while (server.body_.empty() && !server.eom_ && !server.failed()) {
+          co_await server.wakeup_.wait();
+        }
+        if (server.body_.empty()) {
+          break;
+        }
+        co_await sendBody(server.takeBody());
+      }
+    }
+    if (server.eom_) {
+      sendEOM();
+    } else if (server.headers_) {
+      sendAbort();
+    } else {
+      sendError(502, "Bad Gateway");
+    }
+  } catch (const RequestError& ex) {
+    LOG(ERROR) << "Client error: " << ex.what();
+    clientFailed = true;
+  }
+
+  // The transaction refers to the server handler on our frame, so wait for
+  // it to go away before returning
+  if (server.txn_ && (clientFailed || !server.eom_)) {
+    server.txn_->sendAbort();
+  }
+  while (server.txn_) {
+    co_await server.wakeup_.wait();
+  }
+}
+
+}
+
+#endif // FOLLY_HAS_COROUTINES
@@ -0,0 +1,44 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <proxygen/httpserver/CoroRequestHandler.h>
+
+#if FOLLY_HAS_COROUTINES
+
+#include <folly/io/async/HHWheelTimer.h>
+
+namespace ProxyService {
+
+class ProxyStats;
+
+/**
+ * ProxyHandler written as a coroutine: connect, forward the request and
+ * relay the response in straight-line code.  Unlike ProxyHandler it does
+ * not support CONNECT, and it forwards the whole request body before
+ * reading the response.
+ */
+class CoroProxyHandler : public proxygen::CoroRequestHandler {
+ public:
+  CoroProxyHandler(ProxyStats* stats, folly::HHWheelTimer* timer);
+
+ private:
+  folly::coro::Task<void> handleRequest(
+      std::unique_ptr<proxygen::HTTPMessage> request) override;
+
+  void sendError(uint16_t code, const std::string& message);
+
+  ProxyStats* const stats_{nullptr};
+  folly::HHWheelTimer* const timer_{nullptr};
+};
+
+}
+
+#endif // FOLLY_HAS_COROUTINES
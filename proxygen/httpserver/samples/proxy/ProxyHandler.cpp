@@ -36,14 +36,18 @@ static const uint8_t CLOSED = READS_SHUTDOWN | WRITES_SHUTDOWN;
 
 namespace ProxyService {
 
-ProxyHandler::ProxyHandler(ProxyStats* stats, folly::HHWheelTimer* timer):
+ProxyHandler::ProxyHandler(ProxyStats* stats,
+                           UpstreamSessionPools* upstreams):
     stats_(stats),
-    connector_{this, timer},
+    upstreams_(upstreams),
     serverHandler_(*this) {
 }
 
 ProxyHandler::~ProxyHandler() {
   VLOG(4) << "deleting ProxyHandler";
+  if (waitingForUpstream_) {
+    upstreams_->cancel(this);
+  }
 }
 
 void ProxyHandler::onRequest(std::unique_ptr<HTTPMessage> headers) noexcept {
@@ -76,13 +80,15 @@ void ProxyHandler::onRequest(std::unique_ptr<HTTPMessage> headers) noexcept {
     upstreamSock_ = folly::AsyncSocket::newSocket(evb);
     upstreamSock_->connect(this, addr, FLAGS_proxy_connect_timeout);
   } else {
-    // A more sophisticated proxy would have a connection pool here
-    const folly::AsyncSocket::OptionMap opts{
-      {{SOL_SOCKET, SO_REUSEADDR}, 1}};
-    downstream_->pauseIngress();
-    connector_.connect(folly::EventBaseManager::get()->getEventBase(), addr,
-                       std::chrono::milliseconds(FLAGS_proxy_connect_timeout),
-                       opts);
+    // Connection: close from the client must not end a pooled upstream
+    // session, and origins expect origin-form request targets.
+    request_->stripPerHopHeaders();
+    if (!request_->getHeaders().exists(HTTP_HEADER_HOST)) {
+      request_->getHeaders().set(HTTP_HEADER_HOST, url.getHostAndPort());
+    }
+    request_->setURL(url.makeRelativeURL());
+    waitingForUpstream_ = true;
+    upstreams_->getTransaction(addr, &serverHandler_, this);
   }
 }
 
@@ -117,16 +123,21 @@ void ProxyHandler::onEOM() noexcept {
   }
 }
 
-void ProxyHandler::connectSuccess(HTTPUpstreamSession* session) {
-  LOG(INFO) << "Established " << *session;
-  session_ = std::make_unique<SessionWrapper>(session);
-  txn_ = session->newTransaction(&serverHandler_);
+void ProxyHandler::upstreamReady(HTTPTransaction* txn) noexcept {
+  waitingForUpstream_ = false;
+  txn_ = txn;
   LOG(INFO) << "Forwarding client request: " << request_->getURL()
-            << " to server";
+            << " to server on " << *txn_;
   txn_->sendHeaders(*request_);
   downstream_->resumeIngress();
 }
 
+void ProxyHandler::upstreamError(
+    const folly::AsyncSocketException& ex) noexcept {
+  waitingForUpstream_ = false;
+  connectError(ex);
+}
+
 void ProxyHandler::connectError(const folly::AsyncSocketException& ex) {
   LOG(ERROR) << "Failed to connect: " << folly::exceptionStr(ex);
   if (!clientTerminated_) {
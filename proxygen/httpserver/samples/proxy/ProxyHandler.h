@@ -12,8 +12,7 @@
 #include <folly/Memory.h>
 #include <folly/io/async/AsyncSocket.h>
 #include <proxygen/httpserver/RequestHandler.h>
-#include <proxygen/lib/http/HTTPConnector.h>
-#include "SessionWrapper.h"
+#include "UpstreamSessionPools.h"
 
 namespace proxygen {
 class ResponseHandler;
@@ -24,12 +23,12 @@ namespace ProxyService {
 class ProxyStats;
 
 class ProxyHandler : public proxygen::RequestHandler,
-                     private proxygen::HTTPConnector::Callback,
+                     private UpstreamSessionPools::Callback,
                      private folly::AsyncSocket::ConnectCallback,
                      private folly::AsyncReader::ReadCallback,
                      private folly::AsyncWriter::WriteCallback {
  public:
-  ProxyHandler(ProxyStats* stats, folly::HHWheelTimer* timer);
+  ProxyHandler(ProxyStats* stats, UpstreamSessionPools* upstreams);
 
   ~ProxyHandler() override;
 
@@ -61,8 +60,11 @@ class ProxyHandler : public proxygen::RequestHandler,
 
  private:
 
-  void connectSuccess(proxygen::HTTPUpstreamSession* session) override;
-  void connectError(const folly::AsyncSocketException& ex) override;
+  // UpstreamSessionPools::Callback
+  void upstreamReady(proxygen::HTTPTransaction* txn) noexcept override;
+  void upstreamError(const folly::AsyncSocketException& ex) noexcept override;
+
+  void connectError(const folly::AsyncSocketException& ex);
 
   class ServerTransactionHandler: public proxygen::HTTPTransactionHandler {
    public:
@@ -128,9 +130,9 @@ class ProxyHandler : public proxygen::RequestHandler,
   bool checkForShutdown();
 
   ProxyStats* const stats_{nullptr};
-  proxygen::HTTPConnector connector_;
+  UpstreamSessionPools* const upstreams_{nullptr};
   ServerTransactionHandler serverHandler_;
-  std::unique_ptr<SessionWrapper> session_;
+  bool waitingForUpstream_{false};
   proxygen::HTTPTransaction* txn_{nullptr};
   bool clientTerminated_{false};
 
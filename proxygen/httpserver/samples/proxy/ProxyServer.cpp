@@ -13,8 +13,10 @@
 #include <proxygen/httpserver/HTTPServer.h>
 #include <proxygen/httpserver/RequestHandlerFactory.h>
 
+#include "CoroProxyHandler.h"
 #include "ProxyHandler.h"
 #include "ProxyStats.h"
+#include "UpstreamSessionPools.h"
 
 using namespace ProxyService;
 using namespace proxygen;
@@ -33,9 +35,27 @@ DEFINE_int32(threads, 0, "Number of threads to listen on. Numbers <= 0 "
              "will use the number of cores on this machine.");
 DEFINE_int32(server_timeout, 60,
              "How long to wait for a server response (sec)");
+DEFINE_bool(coro, false, "Use the coroutine handler (non-CONNECT only), in "
+            "builds with PROXYGEN_ENABLE_COROUTINES");
+DEFINE_int32(upstream_max_idle, 8, "Idle upstream sessions kept per origin "
+             "and IO thread, 0 to close each one after its request");
+DEFINE_int32(upstream_idle_timeout, 5000, "How long an idle upstream "
+             "session may be kept (ms)");
+DEFINE_int32(upstream_max_age, 0, "Upstream sessions are drained after this "
+             "long (ms), 0 for no limit");
+DEFINE_string(upstream_protocol, "", "Protocol spoken to every origin "
+              "without negotiation, e.g. h2 for HTTP/2 multiplexing.  "
+              "Empty for HTTP/1.1");
+DEFINE_bool(upstream_borrow_idle, true, "Take idle upstream sessions from "
+            "other IO threads before opening new ones");
+DECLARE_int32(proxy_connect_timeout);
 
 class ProxyHandlerFactory : public RequestHandlerFactory {
  public:
+  ProxyHandlerFactory()
+      : idleControllers_(FLAGS_upstream_max_idle) {
+  }
+
   void onServerStart(folly::EventBase* evb) noexcept override {
     stats_.reset(new ProxyStats);
     timer_->timer = HHWheelTimer::newTimer(
@@ -43,15 +63,35 @@ class ProxyHandlerFactory : public RequestHandlerFactory {
       std::chrono::milliseconds(HHWheelTimer::DEFAULT_TICK_INTERVAL),
       folly::AsyncTimeout::InternalEnum::NORMAL,
       std::chrono::seconds(FLAGS_server_timeout));
+
+    UpstreamSessionPools::Options options;
+    options.maxIdleSessions = FLAGS_upstream_max_idle;
+    options.idleTimeout =
+      std::chrono::milliseconds(FLAGS_upstream_idle_timeout);
+    options.maxAge = std::chrono::milliseconds(FLAGS_upstream_max_age);
+    options.connectTimeout =
+      std::chrono::milliseconds(FLAGS_proxy_connect_timeout);
+    options.plaintextProtocol = FLAGS_upstream_protocol;
+    upstreams_.reset(new UpstreamSessionPools(
+      evb, timer_->timer.get(), std::move(options),
+      FLAGS_upstream_borrow_idle ? &idleControllers_ : nullptr));
   }
 
   void onServerStop() noexcept override {
+    // Stop transfers between threads before any of them drops its pools
+    idleControllers_.markForDeath();
+    upstreams_.reset();
     stats_.reset();
     timer_->timer.reset();
   }
 
   RequestHandler* onRequest(RequestHandler*, HTTPMessage*) noexcept override {
-    return new ProxyHandler(stats_.get(), timer_->timer.get());
+#if FOLLY_HAS_COROUTINES
+    if (FLAGS_coro) {
+      return new CoroProxyHandler(stats_.get(), timer_->timer.get());
+    }
+#endif
+    return new ProxyHandler(stats_.get(), upstreams_.get());
   }
 
  private:
@@ -60,6 +100,8 @@ class ProxyHandlerFactory : public RequestHandlerFactory {
   };
   folly::ThreadLocalPtr<ProxyStats> stats_;
   folly::ThreadLocal<TimerWrapper> timer_;
+  IdleSessionControllers idleControllers_;
+  folly::ThreadLocalPtr<UpstreamSessionPools> upstreams_;
 };
 
 int main(int argc, char* argv[]) {
@@ -0,0 +1,248 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "UpstreamSessionPools.h"
+
+#include <algorithm>
+#include <proxygen/lib/http/codec/CodecProtocol.h>
+#include <proxygen/lib/http/session/HTTPUpstreamSession.h>
+
+using namespace proxygen;
+
+namespace ProxyService {
+
+ServerIdleSessionController* IdleSessionControllers::get(
+    const Endpoint& endpoint) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (markedForDeath_) {
+    return nullptr;
+  }
+  auto& controller = controllers_[endpoint];
+  if (!controller) {
+    controller =
+      std::make_unique<ServerIdleSessionController>(maxIdlePerPool_);
+  }
+  return controller.get();
+}
+
+void IdleSessionControllers::markForDeath() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  markedForDeath_ = true;
+  for (auto& controller : controllers_) {
+    controller.second->markForDeath();
+  }
+}
+
+UpstreamSessionPools::Origin::Origin(
+    const folly::SocketAddress& addr,
+    const Options& options,
+    ServerIdleSessionController* controller)
+    : address(addr),
+      idleController(controller),
+      pool(std::make_unique<SessionPool>(nullptr,
+                                         options.maxIdleSessions,
+                                         options.idleTimeout,
+                                         options.maxAge,
+                                         nullptr,
+                                         controller)) {
+}
+
+UpstreamSessionPools::Connect::Connect(UpstreamSessionPools& parent,
+                                       Origin& origin)
+    : parent_(parent), origin_(origin), connector_(this, parent.timer_) {
+  if (!parent_.options_.plaintextProtocol.empty()) {
+    connector_.setPlaintextProtocol(parent_.options_.plaintextProtocol);
+  }
+}
+
+void UpstreamSessionPools::Connect::start() {
+  const folly::AsyncSocket::OptionMap opts{
+    {{SOL_SOCKET, SO_REUSEADDR}, 1}};
+  connector_.connect(parent_.evb_,
+                     origin_.address,
+                     parent_.options_.connectTimeout,
+                     opts);
+}
+
+void UpstreamSessionPools::Connect::connectSuccess(
+    HTTPUpstreamSession* session) {
+  auto& parent = parent_;
+  auto& origin = origin_;
+  parent.connects_.erase(self);
+  parent.onSession(origin, session);
+}
+
+void UpstreamSessionPools::Connect::connectError(
+    const folly::AsyncSocketException& ex) {
+  auto& parent = parent_;
+  auto& origin = origin_;
+  parent.connects_.erase(self);
+  parent.onSessionError(origin, ex);
+}
+
+UpstreamSessionPools::UpstreamSessionPools(
+    folly::EventBase* evb,
+    folly::HHWheelTimer* timer,
+    Options options,
+    IdleSessionControllers* controllers)
+    : evb_(CHECK_NOTNULL(evb)),
+      timer_(timer),
+      options_(std::move(options)),
+      multiplexed_(isParallelCodecProtocol(
+          getCodecProtocolFromStr(options_.plaintextProtocol))),
+      controllers_(controllers) {
+}
+
+UpstreamSessionPools::~UpstreamSessionPools() {
+  // Cancel connects before the origins they refer to go away
+  connects_.clear();
+}
+
+void UpstreamSessionPools::getTransaction(const folly::SocketAddress& addr,
+                                          HTTPTransaction::Handler* handler,
+                                          Callback* cb) {
+  evb_->dcheckIsInEventBaseThread();
+  auto& origin = getOrigin(addr);
+  auto txn = origin.pool->getTransaction(handler);
+  if (txn) {
+    VLOG(4) << "Reusing session to " << addr << " " << *origin.pool;
+    cb->upstreamReady(txn);
+    return;
+  }
+  origin.waiters.push_back({handler, cb});
+  openSessions(origin);
+}
+
+void UpstreamSessionPools::cancel(Callback* cb) {
+  for (auto& origin : origins_) {
+    origin.second->waiters.remove_if(
+      [cb] (const Waiter& waiter) { return waiter.cb == cb; });
+  }
+}
+
+uint32_t UpstreamSessionPools::getNumSessions(
+    const folly::SocketAddress& addr) const {
+  auto it = origins_.find(Endpoint(addr, false));
+  return it == origins_.end() ? 0 : it->second->pool->getNumSessions();
+}
+
+UpstreamSessionPools::Origin& UpstreamSessionPools::getOrigin(
+    const folly::SocketAddress& addr) {
+  Endpoint endpoint(addr, false);
+  auto& origin = origins_[endpoint];
+  if (!origin) {
+    origin = std::make_unique<Origin>(
+      addr, options_, controllers_ ? controllers_->get(endpoint) : nullptr);
+  }
+  return *origin;
+}
+
+void UpstreamSessionPools::openSessions(Origin& origin) {
+  // An HTTP/1.1 session carries one request at a time, so each waiter needs
+  // its own.  One multiplexed session serves them all.
+  size_t wanted = multiplexed_ ? std::min<size_t>(origin.waiters.size(), 1) :
+    origin.waiters.size();
+  if (origin.sessionsOpening >= wanted) {
+    return;
+  }
+  uint32_t needed = wanted - origin.sessionsOpening;
+  origin.sessionsOpening += needed;
+  if (!origin.idleController) {
+    for (uint32_t i = 0; i < needed; ++i) {
+      connect(origin);
+    }
+    return;
+  }
+  // Borrow as many as another thread can spare in one hop, and connect for
+  // the rest
+  std::weak_ptr<bool> alive = alive_;
+  auto evb = evb_;
+  auto originPtr = &origin;
+  origin.idleController->getIdleSessions(needed)
+    .via(evb_)
+    .thenValue([this, alive, evb, originPtr, needed] (
+                   std::vector<HTTPSessionBase*> sessions) {
+        if (!alive.expired()) {
+          for (auto i = sessions.size(); i < needed; ++i) {
+            connect(*originPtr);
+          }
+          for (auto session : sessions) {
+            borrowedSession(*originPtr, session);
+          }
+        } else {
+          for (auto session : sessions) {
+            session->attachThreadLocals(
+              evb, nullptr, WheelTimerInstance(), nullptr,
+              [] (HTTPCodecFilter*) {}, nullptr, nullptr);
+            session->dropConnection();
+          }
+        }
+      });
+}
+
+void UpstreamSessionPools::connect(Origin& origin) {
+  VLOG(4) << "Connecting to " << origin.address;
+  connects_.push_front(std::make_unique<Connect>(*this, origin));
+  auto connect = connects_.front().get();
+  connect->self = connects_.begin();
+  connect->start();
+}
+
+void UpstreamSessionPools::borrowedSession(Origin& origin,
+                                           HTTPSessionBase* session) {
+  VLOG(4) << "Borrowed idle session to " << origin.address
+          << " from another thread";
+  session->attachThreadLocals(
+    evb_, nullptr, WheelTimerInstance(timer_), nullptr,
+    [] (HTTPCodecFilter*) {}, nullptr, nullptr);
+  onSession(origin, session);
+}
+
+void UpstreamSessionPools::onSession(Origin& origin,
+                                     HTTPSessionBase* session) {
+  CHECK_GT(origin.sessionsOpening, 0);
+  origin.sessionsOpening--;
+  origin.pool->putSession(session);
+  serveWaiters(origin);
+}
+
+void UpstreamSessionPools::onSessionError(
+    Origin& origin,
+    const folly::AsyncSocketException& ex) {
+  CHECK_GT(origin.sessionsOpening, 0);
+  origin.sessionsOpening--;
+  LOG(ERROR) << "Failed to connect to " << origin.address << ": "
+             << folly::exceptionStr(ex);
+  // Fail the waiters no other session on the way can serve
+  size_t keep = origin.sessionsOpening;
+  if (multiplexed_ && keep > 0) {
+    keep = origin.waiters.size();
+  }
+  while (origin.waiters.size() > keep) {
+    auto waiter = origin.waiters.front();
+    origin.waiters.pop_front();
+    waiter.cb->upstreamError(ex);
+  }
+}
+
+void UpstreamSessionPools::serveWaiters(Origin& origin) {
+  while (!origin.waiters.empty()) {
+    auto waiter = origin.waiters.front();
+    auto txn = origin.pool->getTransaction(waiter.handler);
+    if (!txn) {
+      break;
+    }
+    origin.waiters.pop_front();
+    waiter.cb->upstreamReady(txn);
+  }
+  // The session was not usable, or is full
+  openSessions(origin);
+}
+
+}
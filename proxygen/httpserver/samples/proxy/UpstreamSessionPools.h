@@ -0,0 +1,179 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/SocketAddress.h>
+#include <folly/io/async/HHWheelTimer.h>
+#include <list>
+#include <mutex>
+#include <proxygen/lib/http/HTTPConnector.h>
+#include <proxygen/lib/http/connpool/Endpoint.h>
+#include <proxygen/lib/http/connpool/ServerIdleSessionController.h>
+#include <proxygen/lib/http/connpool/SessionPool.h>
+#include <unordered_map>
+
+namespace ProxyService {
+
+/**
+ * One ServerIdleSessionController per origin, shared by the
+ * UpstreamSessionPools of every IO thread so that a thread without an idle
+ * session to an origin can take one from another thread.
+ *
+ * Call markForDeath() before the first UpstreamSessionPools is destroyed;
+ * transfers already queued to a thread check it before touching its pools.
+ */
+class IdleSessionControllers {
+ public:
+  // maxIdlePerPool is how many of its idle sessions to an origin each
+  // thread offers to the others
+  explicit IdleSessionControllers(uint32_t maxIdlePerPool)
+      : maxIdlePerPool_(maxIdlePerPool) {
+  }
+
+  proxygen::ServerIdleSessionController* get(
+      const proxygen::Endpoint& endpoint);
+
+  void markForDeath();
+
+ private:
+  const uint32_t maxIdlePerPool_;
+  std::mutex mutex_;
+  bool markedForDeath_{false};
+  std::unordered_map<proxygen::Endpoint,
+                     std::unique_ptr<proxygen::ServerIdleSessionController>,
+                     proxygen::EndpointHash,
+                     proxygen::EndpointEqual>
+      controllers_;
+};
+
+/**
+ * Upstream sessions of one IO thread, in a SessionPool per origin.
+ * Requests go out on a pooled session when one can take another
+ * transaction.  Otherwise an idle session is borrowed from another thread
+ * if there is one, and only then is a new connection made.  With an HTTP/2
+ * upstream protocol, requests waiting for a session share the connection
+ * being made rather than each opening their own.
+ *
+ * Must be created, used and destroyed on its IO thread.
+ */
+class UpstreamSessionPools {
+ public:
+  struct Options {
+    // Idle sessions kept per origin; 0 closes sessions after each request
+    uint32_t maxIdleSessions{8};
+    std::chrono::milliseconds idleTimeout{std::chrono::seconds(5)};
+    // 0 for no limit
+    std::chrono::milliseconds maxAge{0};
+    std::chrono::milliseconds connectTimeout{1000};
+    // Empty for HTTP/1.1, or a multiplexed protocol such as "h2" that all
+    // the origins speak without negotiation
+    std::string plaintextProtocol;
+  };
+
+  class Callback {
+   public:
+    virtual ~Callback() {
+    }
+    virtual void upstreamReady(proxygen::HTTPTransaction* txn) noexcept = 0;
+    virtual void upstreamError(
+        const folly::AsyncSocketException& ex) noexcept = 0;
+  };
+
+  /**
+   * controllers is optional and must outlive this object.
+   */
+  UpstreamSessionPools(folly::EventBase* evb,
+                       folly::HHWheelTimer* timer,
+                       Options options,
+                       IdleSessionControllers* controllers = nullptr);
+
+  ~UpstreamSessionPools();
+
+  /**
+   * Open a transaction to addr for handler.  cb is called exactly once,
+   * possibly before this returns, unless cancel() is called first.
+   */
+  void getTransaction(const folly::SocketAddress& addr,
+                      proxygen::HTTPTransaction::Handler* handler,
+                      Callback* cb);
+
+  void cancel(Callback* cb);
+
+  /**
+   * Sessions pooled to addr, idle or not.
+   */
+  uint32_t getNumSessions(const folly::SocketAddress& addr) const;
+
+ private:
+  struct Waiter {
+    proxygen::HTTPTransaction::Handler* handler;
+    Callback* cb;
+  };
+
+  struct Origin {
+    Origin(const folly::SocketAddress& addr,
+           const Options& options,
+           proxygen::ServerIdleSessionController* idleController);
+
+    folly::SocketAddress address;
+    proxygen::ServerIdleSessionController* idleController;
+    std::unique_ptr<proxygen::SessionPool> pool;
+    std::list<Waiter> waiters;
+    uint32_t sessionsOpening{0};
+  };
+
+  class Connect : public proxygen::HTTPConnector::Callback {
+   public:
+    Connect(UpstreamSessionPools& parent, Origin& origin);
+
+    void start();
+
+    void connectSuccess(proxygen::HTTPUpstreamSession* session) override;
+    void connectError(const folly::AsyncSocketException& ex) override;
+
+    std::list<std::unique_ptr<Connect>>::iterator self;
+
+   private:
+    UpstreamSessionPools& parent_;
+    Origin& origin_;
+    proxygen::HTTPConnector connector_;
+  };
+
+  Origin& getOrigin(const folly::SocketAddress& addr);
+
+  /**
+   * Start borrowing or connecting until there are enough sessions on the
+   * way for the waiters.
+   */
+  void openSessions(Origin& origin);
+  void connect(Origin& origin);
+  void borrowedSession(Origin& origin, proxygen::HTTPSessionBase* session);
+
+  void onSession(Origin& origin, proxygen::HTTPSessionBase* session);
+  void onSessionError(Origin& origin, const folly::AsyncSocketException& ex);
+  void serveWaiters(Origin& origin);
+
+  folly::EventBase* const evb_;
+  folly::HHWheelTimer* const timer_;
+  const Options options_;
+  const bool multiplexed_;
+  IdleSessionControllers* const controllers_;
+
+  std::unordered_map<proxygen::Endpoint,
+                     std::unique_ptr<Origin>,
+                     proxygen::EndpointHash,
+                     proxygen::EndpointEqual>
+      origins_;
+  std::list<std::unique_ptr<Connect>> connects_;
+  // Lets borrowed sessions that arrive after destruction be dropped
+  std::shared_ptr<bool> alive_{std::make_shared<bool>(true)};
+};
+
+}
@@ -11,9 +11,18 @@
 
 #include <proxygen/httpserver/RequestHandler.h>
 #include <proxygen/httpserver/ResponseBuilder.h>
+#include <proxygen/httpserver/filters/CompressedVariantCache.h>
+#include <proxygen/lib/http/RFC2616.h>
+#include <proxygen/lib/utils/UtilInl.h>
+#include <proxygen/lib/http/codec/CodecProtocol.h>
+#include <proxygen/lib/transport/KTLSAsyncSSLSocket.h>
 #include <folly/io/async/EventBaseManager.h>
 #include <folly/FileUtil.h>
+#include <folly/Random.h>
+#include <folly/String.h>
 #include <folly/executors/GlobalExecutor.h>
+#include <algorithm>
+#include <sys/stat.h>
 
 using namespace proxygen;
 
@@ -21,10 +30,65 @@ namespace StaticService {
 
 /**
  * Handles requests by serving the file named in path.  Only supports GET.
- * reads happen in a CPU thread pool since read(2) is blocking.
- * If egress pauses, file reading is also paused.
+ * The body is read through the thread's AsyncFileReader, keeping about a
+ * send window of reads, up to kMaxReads, in flight, or without a reader in
+ * a CPU thread pool since read(2) is blocking.  With mapFiles, plaintext
+ * HTTP/1.x bodies are instead mapped and sent from the IO thread.  If
+ * egress pauses, file reading is also paused.
+ *
+ * Single and multiple byte Range requests are answered with 206.
  */
 
+namespace {
+
+// Bytes mapped per sendBody on the IO thread
+const size_t kMapChunkSize = 1024 * 1024;
+// Bytes read per hop to the IO thread on the CPU executor
+const size_t kReadChunkSize = 64 * 1024;
+// Bounds of the bytes read ahead of what was sent through an
+// AsyncFileReader
+const size_t kMinReadAhead = 256 * 1024;
+const size_t kMaxReadAhead = 4 * 1024 * 1024;
+// Reads in flight or waiting to be sent at once.  Each holds one of the
+// reader's buffers, which all handlers on the thread share.
+const size_t kMaxReads = 8;
+// More ranges than this in one request are more likely an attempt to
+// amplify the response than a download manager; serve the whole file
+const size_t kMaxRanges = 16;
+
+// Encodings the client accepts that sidecars exist for, most preferred
+// first
+std::vector<std::string> getSidecarEncodings(const HTTPMessage& msg) {
+  std::vector<RFC2616::TokenQPair> accepted;
+  std::vector<std::pair<double, std::string>> candidates;
+  if (RFC2616::parseQvalues(
+          msg.getHeaders().getSingleOrEmpty(HTTP_HEADER_ACCEPT_ENCODING),
+          accepted)) {
+    // zstd first, so it wins ties
+    for (const char* encoding : {"zstd", "gzip"}) {
+      for (const auto& token : accepted) {
+        if (caseInsensitiveEqual(folly::rtrimWhitespace(token.first),
+                                 encoding) &&
+            token.second > 0) {
+          candidates.emplace_back(token.second, encoding);
+        }
+      }
+    }
+  }
+  std::stable_sort(candidates.begin(), candidates.end(),
+                   [] (const std::pair<double, std::string>& a,
+                       const std::pair<double, std::string>& b) {
+                     return a.first > b.first;
+                   });
+  std::vector<std::string> encodings;
+  for (auto& candidate : candidates) {
+    encodings.push_back(std::move(candidate.second));
+  }
+  return encodings;
+}
+
+}
+
 void StaticHandler::onRequest(std::unique_ptr<HTTPMessage> headers) noexcept {
   if (headers->getMethod() != HTTPMethod::GET) {
     ResponseBuilder(downstream_)
@@ -35,20 +99,309 @@ void StaticHandler::onRequest(std::unique_ptr<HTTPMessage> headers) noexcept {
   }
   // a real webserver would validate this path didn't contain malicious
   // characters like '//' or '..'
+  // + 1 to kill leading /
+  std::string path(headers->getPath().c_str() + 1);
+  range_ = headers->getHeaders().getSingleOrEmpty(HTTP_HEADER_RANGE);
+  if (sidecars_) {
+    auto encodings = getSidecarEncodings(*headers);
+    if (!encodings.empty()) {
+      serveSidecar(path, std::move(encodings));
+      return;
+    }
+  }
+  serveFile(path);
+}
+
+void StaticHandler::serveSidecar(const std::string& path,
+                                 std::vector<std::string> encodings) {
+  // stat(2) and read(2) of the sidecar can block as well
+  readFileScheduled_ = true;
+  folly::getCPUExecutor()->add(
+    [this, path, encodings = std::move(encodings),
+     evb = folly::EventBaseManager::get()->getEventBase()] {
+      std::unique_ptr<folly::IOBuf> body;
+      std::string encoding;
+      for (const auto& candidate : encodings) {
+        body = sidecars_->getSidecar(path, candidate);
+        if (body) {
+          encoding = candidate;
+          break;
+        }
+      }
+      evb->runInEventBaseThread(
+        [this, path, encoding, body = std::move(body)] () mutable {
+          readFileScheduled_ = false;
+          if (checkForCompletion()) {
+            return;
+          }
+          if (!body) {
+            serveFile(path);
+            return;
+          }
+          ResponseBuilder(downstream_)
+            .status(200, "Ok")
+            .header(HTTP_HEADER_CONTENT_ENCODING, encoding)
+            .header(HTTP_HEADER_VARY, "Accept-Encoding")
+            .body(std::move(body))
+            .sendWithEOM();
+        });
+    });
+}
+
+void StaticHandler::serveFile(const std::string& path) {
   try {
-    // + 1 to kill leading /
-    file_ = std::make_unique<folly::File>(headers->getPath().c_str() + 1);
+    file_ = std::make_shared<folly::File>(path);
   } catch (const std::system_error& ex) {
     ResponseBuilder(downstream_)
       .status(404, "Not Found")
-      .body(folly::to<std::string>("Could not find ", headers->getPath(),
+      .body(folly::to<std::string>("Could not find /", path,
                                    " ex=", folly::exceptionStr(ex)))
       .sendWithEOM();
     return;
   }
-  ResponseBuilder(downstream_)
-    .status(200, "Ok")
-    .send();
+  struct stat st;
+  if (fstat(file_->fd(), &st) != 0 || !S_ISREG(st.st_mode)) {
+    file_.reset();
+    ResponseBuilder(downstream_)
+      .status(404, "Not Found")
+      .body(folly::to<std::string>("/", path, " is not a regular file"))
+      .sendWithEOM();
+    return;
+  }
+  unsigned long size = st.st_size;
+  FileRegion whole(file_, 0, size);
+
+  HTTPMessage response;
+  response.setHTTPVersion(1, 1);
+  response.getHeaders().add(HTTP_HEADER_ACCEPT_RANGES, "bytes");
+  std::vector<RFC2616::ByteRangePair> ranges;
+  bool useRanges = !range_.empty() &&
+                   RFC2616::parseRangeHeader(range_, size, ranges);
+  // Malformed Range headers are ignored, and ranges that overlap are
+  // served once
+  RFC2616::coalesceByteRanges(ranges);
+  if (!useRanges || ranges.size() > kMaxRanges) {
+    response.setStatusCode(200);
+    response.setStatusMessage("OK");
+    response.getHeaders().add(HTTP_HEADER_CONTENT_LENGTH,
+                              folly::to<std::string>(size));
+    if (size > 0) {
+      parts_.push_back({nullptr, whole});
+    }
+  } else if (ranges.empty()) {
+    file_.reset();
+    ResponseBuilder(downstream_)
+      .status(416, "Range Not Satisfiable")
+      .header(HTTP_HEADER_CONTENT_RANGE,
+              folly::to<std::string>("bytes */", size))
+      .sendWithEOM();
+    return;
+  } else if (ranges.size() == 1) {
+    auto& range = ranges.front();
+    response.setStatusCode(206);
+    response.setStatusMessage("Partial Content");
+    response.getHeaders().add(
+      HTTP_HEADER_CONTENT_RANGE,
+      folly::to<std::string>("bytes ", range.first, "-", range.second,
+                             "/", size));
+    response.getHeaders().add(
+      HTTP_HEADER_CONTENT_LENGTH,
+      folly::to<std::string>(range.second - range.first + 1));
+    parts_.push_back(
+      {nullptr, whole.subRegion(range.first, range.second - range.first + 1)});
+  } else {
+    // multipart/byteranges (RFC 7233 section 4.1).  The file has no
+    // Content-Type, so neither do the parts.
+    auto boundary = folly::to<std::string>(folly::Random::rand64());
+    size_t length = 0;
+    for (const auto& range : ranges) {
+      auto partHeader = folly::IOBuf::copyBuffer(
+        folly::to<std::string>("\r\n--", boundary, "\r\nContent-Range: bytes ",
+                               range.first, "-", range.second, "/", size,
+                               "\r\n\r\n"));
+      auto region =
+        whole.subRegion(range.first, range.second - range.first + 1);
+      length += partHeader->length() + region.getLength();
+      parts_.push_back({std::move(partHeader), folly::none});
+      parts_.push_back({nullptr, std::move(region)});
+    }
+    auto trailer = folly::IOBuf::copyBuffer(
+      folly::to<std::string>("\r\n--", boundary, "--\r\n"));
+    length += trailer->length();
+    parts_.push_back({std::move(trailer), folly::none});
+    response.setStatusCode(206);
+    response.setStatusMessage("Partial Content");
+    response.getHeaders().add(
+      HTTP_HEADER_CONTENT_TYPE,
+      folly::to<std::string>("multipart/byteranges; boundary=", boundary));
+    response.getHeaders().add(HTTP_HEADER_CONTENT_LENGTH,
+                              folly::to<std::string>(length));
+  }
+  downstream_->sendHeaders(response);
+
+  mapped_ = mapFiles_ && canMapFile();
+  if (mapped_) {
+    sendMapped();
+  } else {
+    sendBuffered();
+  }
+}
+
+bool StaticHandler::canMapFile() const {
+  // Only HTTP/1.x over plaintext or kTLS writes the body to the socket as
+  // is.  Userspace TLS and HTTP/2 framing copy it anyway, and page faults
+  // on the mapping would then block the IO thread for nothing.
+  auto txn = downstream_->getTransaction();
+  if (!txn) {
+    return false;
+  }
+  const auto& transport = txn->getTransport();
+  if (isParallelCodecProtocol(transport.getCodec().getProtocol())) {
+    return false;
+  }
+  if (transport.getSecurityProtocol().empty()) {
+    return true;
+  }
+  auto sock = transport.getUnderlyingTransport();
+  auto ktlsSock =
+    sock ? sock->getUnderlyingTransport<KTLSAsyncSSLSocket>() : nullptr;
+  return ktlsSock && ktlsSock->isKernelTLSEgressEnabled();
+}
+
+void StaticHandler::sendMapped() {
+  while (!paused_ && !parts_.empty()) {
+    auto& part = parts_.front();
+    std::unique_ptr<folly::IOBuf> body;
+    if (part.data) {
+      body = std::move(part.data);
+      parts_.pop_front();
+    } else {
+      auto chunk = part.region->subRegion(0, kMapChunkSize);
+      body = chunk.map();
+      if (!body) {
+        VLOG(4) << "Cannot map file, reading it instead";
+        mapped_ = false;
+        sendBuffered();
+        return;
+      }
+      part.region->advance(chunk.getLength());
+      if (part.region->empty()) {
+        parts_.pop_front();
+      }
+    }
+    // Pauses synchronously once the transaction buffers too much
+    downstream_->sendBody(std::move(body));
+  }
+  if (parts_.empty()) {
+    file_.reset();
+    downstream_->sendEOM();
+  }
+}
+
+void StaticHandler::sendBuffered() {
+  if (reader_) {
+    pumpReads();
+  } else {
+    scheduleReadFile();
+  }
+}
+
+size_t StaticHandler::getReadAheadWindow() const {
+  // On HTTP/2 a whole stream window can be sent as soon as the peer opens
+  // it, so have that much ready.  HTTP/1.x is bounded by the session's
+  // write buffer, which a few reads cover.
+  size_t window = kMinReadAhead;
+  auto txn = downstream_->getTransaction();
+  if (txn && txn->getTransport().getCodec().supportsStreamFlowControl()) {
+    window = std::max<size_t>(window, txn->getSendWindow().getCapacity());
+  }
+  return std::min(window, kMaxReadAhead);
+}
+
+void StaticHandler::pumpReads() {
+  // Send completed reads in order
+  while (!paused_ && !reads_.empty() && reads_.front()->done) {
+    auto read = std::move(reads_.front());
+    reads_.pop_front();
+    if (read->error) {
+      LOG(ERROR) << "Error reading file errno=" << read->error;
+      parts_.clear();
+      file_.reset();
+      downstream_->sendAbort();
+      return;
+    }
+    readAheadBytes_ -= read->length;
+    downstream_->sendBody(std::move(read->data));
+  }
+  if (!file_) {
+    return;
+  }
+  if (parts_.empty() && reads_.empty()) {
+    file_.reset();
+    downstream_->sendEOM();
+    return;
+  }
+
+  // Reads already in flight complete while paused, but no more are made:
+  // a client that stopped reading must not tie up the reader's buffers
+  auto window = getReadAheadWindow();
+  while (!paused_ && !parts_.empty() && readAheadBytes_ < window &&
+         reads_.size() < kMaxReads) {
+    auto& part = parts_.front();
+    auto read = std::make_unique<PendingRead>(this);
+    if (part.data) {
+      read->length = part.data->computeChainDataLength();
+      read->data = std::move(part.data);
+      read->done = true;
+      parts_.pop_front();
+    } else {
+      auto chunk = part.region->subRegion(0, reader_->getMaxReadSize());
+      part.region->advance(chunk.getLength());
+      if (part.region->empty()) {
+        parts_.pop_front();
+      }
+      read->length = chunk.getLength();
+      readsInFlight_++;
+      reader_->read(chunk, read.get());
+    }
+    readAheadBytes_ += read->length;
+    reads_.push_back(std::move(read));
+  }
+  if (!paused_ && !reads_.empty() && reads_.front()->done) {
+    // Literal parts need no read
+    pumpReads();
+  }
+}
+
+void StaticHandler::onReadDone() {
+  readsInFlight_--;
+  if (finished_ || !file_) {
+    // Nothing to send this to; drop what has completed
+    reads_.erase(std::remove_if(reads_.begin(), reads_.end(),
+                                [] (const std::unique_ptr<PendingRead>& r) {
+                                  return r->done;
+                                }),
+                 reads_.end());
+    checkForCompletion();
+    return;
+  }
+  pumpReads();
+}
+
+void StaticHandler::PendingRead::readSuccess(
+    std::unique_ptr<folly::IOBuf> buf) noexcept {
+  data = std::move(buf);
+  done = true;
+  handler->onReadDone();
+}
+
+void StaticHandler::PendingRead::readError(int errnum) noexcept {
+  error = errnum;
+  done = true;
+  handler->onReadDone();
+}
+
+void StaticHandler::scheduleReadFile() {
   // use a CPU executor since read(2) of a file can block
   readFileScheduled_ = true;
   folly::getCPUExecutor()->add(
@@ -57,37 +410,41 @@ void StaticHandler::onRequest(std::unique_ptr<HTTPMessage> headers) noexcept {
 }
 
 void StaticHandler::readFile(folly::EventBase* evb) {
-  folly::IOBufQueue buf;
-  while (file_ && !paused_) {
-    // read 4k-ish chunks and foward each one to the client
-    auto data = buf.preallocate(4000, 4000);
-    auto rc = folly::readNoInt(file_->fd(), data.first, data.second);
-    if (rc < 0) {
-      // error
-      VLOG(4) << "Read error=" << rc;
-      file_.reset();
-      evb->runInEventBaseThread([this] {
-          LOG(ERROR) << "Error reading file";
-          downstream_->sendAbort();
-        });
-      break;
-    } else if (rc == 0) {
-      // done
-      file_.reset();
-      VLOG(4) << "Read EOF";
-      evb->runInEventBaseThread([this] {
-          ResponseBuilder(downstream_)
-            .sendWithEOM();
-        });
-      break;
+  while (file_ && !paused_ && !parts_.empty()) {
+    auto& part = parts_.front();
+    std::unique_ptr<folly::IOBuf> body;
+    if (part.data) {
+      body = std::move(part.data);
+      parts_.pop_front();
     } else {
-      buf.postallocate(rc);
-      evb->runInEventBaseThread([this, body=buf.move()] () mutable {
-          ResponseBuilder(downstream_)
-            .body(std::move(body))
-            .send();
-        });
+      auto chunk = part.region->subRegion(0, kReadChunkSize);
+      body = chunk.read();
+      if (!body) {
+        // error or the file shrank
+        parts_.clear();
+        file_.reset();
+        evb->runInEventBaseThread([this] {
+            LOG(ERROR) << "Error reading file";
+            downstream_->sendAbort();
+          });
+        break;
+      }
+      part.region->advance(chunk.getLength());
+      if (part.region->empty()) {
+        parts_.pop_front();
+      }
     }
+    evb->runInEventBaseThread([this, body = std::move(body)] () mutable {
+        downstream_->sendBody(std::move(body));
+      });
+  }
+  if (file_ && parts_.empty()) {
+    // done
+    file_.reset();
+    VLOG(4) << "Read EOF";
+    evb->runInEventBaseThread([this] {
+        downstream_->sendEOM();
+      });
   }
 
   // Notify the request thread that we terminated the readFile loop
@@ -101,7 +458,7 @@ void StaticHandler::readFile(folly::EventBase* evb) {
 }
 
 void StaticHandler::onEgressPaused() noexcept {
-  // This will terminate readFile soon
+  // This will terminate readFile or sendMapped soon
   VLOG(4) << "StaticHandler paused";
   paused_ = true;
 }
@@ -109,12 +466,17 @@ void StaticHandler::onEgressPaused() noexcept {
 void StaticHandler::onEgressResumed() noexcept {
   VLOG(4) << "StaticHandler resumed";
   paused_ = false;
+  if (mapped_ || reader_) {
+    if (file_ && mapped_) {
+      sendMapped();
+    } else if (file_) {
+      pumpReads();
+    }
+    return;
+  }
   // If readFileScheduled_, it will reschedule itself
   if (!readFileScheduled_ && file_) {
-    readFileScheduled_ = true;
-    folly::getCPUExecutor()->add(
-      std::bind(&StaticHandler::readFile, this,
-                folly::EventBaseManager::get()->getEventBase()));
+    scheduleReadFile();
   } else {
     VLOG(4) << "Deferred scheduling readFile";
   }
@@ -145,8 +507,14 @@ void StaticHandler::onError(ProxygenError /*err*/) noexcept {
 }
 
 bool StaticHandler::checkForCompletion() {
-  if (finished_ && !readFileScheduled_) {
+  if (finished_ && !readFileScheduled_ && readsInFlight_ == 0) {
     VLOG(4) << "deleting StaticHandler";
+    if (reader_) {
+      // This may be the reader's last owner, and be called back from the
+      // reader.  Let it go once the callback has returned.
+      auto evb = reader_->getEventBase();
+      evb->runInLoop([reader = std::move(reader_)] {});
+    }
     delete this;
     return true;
   }
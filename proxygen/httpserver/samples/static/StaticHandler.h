@@ -9,11 +9,16 @@
  */
 #pragma once
 
+#include <deque>
 #include <folly/Memory.h>
 #include <folly/File.h>
+#include <folly/Optional.h>
 #include <proxygen/httpserver/RequestHandler.h>
+#include <proxygen/lib/utils/AsyncFileReader.h>
+#include <proxygen/lib/utils/FileRegion.h>
 
 namespace proxygen {
+class CompressedVariantCache;
 class ResponseHandler;
 }
 
@@ -21,6 +26,28 @@ namespace StaticService {
 
 class StaticHandler : public proxygen::RequestHandler {
  public:
+  /**
+   * With a sidecar cache, requests for foo are answered with foo.zst or
+   * foo.gz when they exist and the client accepts that encoding.
+   *
+   * With mapFiles, bodies sent over plaintext HTTP/1.x are mapped and
+   * written from the IO thread rather than read off it.  Page faults on a
+   * file that is not in the page cache then block the IO thread, and a
+   * file truncated while it is sent raises SIGBUS.  Only map files that
+   * are hot and only ever replaced by rename(2).
+   *
+   * reader, if set, belongs to the IO thread and reads the bodies that are
+   * not mapped.  The handler keeps it alive until its last read is done.
+   */
+  explicit StaticHandler(
+      std::shared_ptr<proxygen::CompressedVariantCache> sidecars = nullptr,
+      bool mapFiles = false,
+      std::shared_ptr<proxygen::AsyncFileReader> reader = nullptr)
+      : sidecars_(std::move(sidecars)),
+        mapFiles_(mapFiles),
+        reader_(std::move(reader)) {
+  }
+
   void onRequest(std::unique_ptr<proxygen::HTTPMessage> headers)
       noexcept override;
 
@@ -39,10 +66,53 @@ class StaticHandler : public proxygen::RequestHandler {
   void onEgressResumed() noexcept override;
 
  private:
+  // A piece of the response body: literal data, such as the part headers
+  // of a multipart/byteranges response, or a region of file_
+  struct BodyPart {
+    std::unique_ptr<folly::IOBuf> data;
+    folly::Optional<proxygen::FileRegion> region;
+  };
+
+  // A read through reader_, or a literal part that needs none
+  struct PendingRead : public proxygen::AsyncFileReader::Callback {
+    explicit PendingRead(StaticHandler* h) : handler(h) {
+    }
+
+    void readSuccess(std::unique_ptr<folly::IOBuf> buf) noexcept override;
+    void readError(int errnum) noexcept override;
+
+    StaticHandler* handler;
+    std::unique_ptr<folly::IOBuf> data;
+    size_t length{0};
+    bool done{false};
+    int error{0};
+  };
+
+  void serveFile(const std::string& path);
+  void serveSidecar(const std::string& path,
+                    std::vector<std::string> encodings);
+  bool canMapFile() const;
+  void sendMapped();
+  void sendBuffered();
+  size_t getReadAheadWindow() const;
+  void pumpReads();
+  void onReadDone();
+  void scheduleReadFile();
   void readFile(folly::EventBase* evb);
   bool checkForCompletion();
 
-  std::unique_ptr<folly::File> file_;
+  std::shared_ptr<proxygen::CompressedVariantCache> sidecars_;
+  const bool mapFiles_;
+  std::shared_ptr<proxygen::AsyncFileReader> reader_;
+
+  std::string range_;
+  std::shared_ptr<folly::File> file_;
+  std::deque<BodyPart> parts_;
+  bool mapped_{false};
+  // Reads in body order, and the bytes they hold or will hold
+  std::deque<std::unique_ptr<PendingRead>> reads_;
+  size_t readAheadBytes_{0};
+  uint32_t readsInFlight_{0};
   bool readFileScheduled_{false};
   std::atomic<bool> paused_{false};
   bool finished_{false};
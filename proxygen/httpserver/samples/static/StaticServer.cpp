@@ -9,6 +9,7 @@
  */
 
 #include <folly/Memory.h>
+#include <folly/ThreadLocal.h>
 #include <folly/executors/GlobalExecutor.h>
 #include <folly/executors/CPUThreadPoolExecutor.h>
 #include <folly/init/Init.h>
@@ -17,6 +18,8 @@
 #include <folly/portability/Unistd.h>
 #include <proxygen/httpserver/HTTPServer.h>
 #include <proxygen/httpserver/RequestHandlerFactory.h>
+#include <proxygen/httpserver/filters/CompressedVariantCache.h>
+#include <proxygen/lib/utils/AsyncFileReader.h>
 
 #include "StaticHandler.h"
 
@@ -34,18 +37,50 @@ DEFINE_int32(h2_port, 11002, "Port to listen on with HTTP/2 protocol");
 DEFINE_string(ip, "localhost", "IP/Hostname to bind to");
 DEFINE_int32(threads, 0, "Number of threads to listen on. Numbers <= 0 "
              "will use the number of cores on this machine.");
+DEFINE_bool(precompressed, false, "Serve foo.zst or foo.gz in place of foo "
+            "to clients that accept the encoding, when they exist");
+DEFINE_bool(map_files, false, "Map files and send them from the IO thread "
+            "over plaintext HTTP/1.x instead of reading them off it.  Only "
+            "safe for files that stay in the page cache and are only ever "
+            "replaced by rename, never truncated or rewritten in place");
+DEFINE_bool(async_file_reader, true, "Read bodies that are not mapped "
+            "through a per thread io_uring, or a thread pool where io_uring "
+            "is unavailable, with several reads in flight");
+DEFINE_int32(read_queue_depth, 64, "Reads in flight per IO thread with "
+             "--async_file_reader");
+DEFINE_uint64(zero_copy_threshold, 0, "Send writes of at least this many "
+              "bytes with MSG_ZEROCOPY on plaintext connections; 0 disables");
 
 namespace {
 
 class StaticHandlerFactory : public RequestHandlerFactory {
  public:
-  void onServerStart(folly::EventBase* /*evb*/) noexcept override {}
+  StaticHandlerFactory(std::shared_ptr<CompressedVariantCache> sidecars,
+                       bool mapFiles)
+      : sidecars_(std::move(sidecars)), mapFiles_(mapFiles) {
+  }
+
+  void onServerStart(folly::EventBase* evb) noexcept override {
+    if (FLAGS_async_file_reader) {
+      AsyncFileReader::Options options;
+      options.queueDepth = FLAGS_read_queue_depth;
+      *reader_ = AsyncFileReader::make(evb, folly::getCPUExecutor(), options);
+    }
+  }
 
-  void onServerStop() noexcept override {}
+  void onServerStop() noexcept override {
+    // Handlers still reading hold on to the reader until they are done
+    reader_->reset();
+  }
 
   RequestHandler* onRequest(RequestHandler*, HTTPMessage*) noexcept override {
-    return new StaticHandler;
+    return new StaticHandler(sidecars_, mapFiles_, *reader_);
   }
+
+ private:
+  std::shared_ptr<CompressedVariantCache> sidecars_;
+  bool mapFiles_;
+  folly::ThreadLocal<std::shared_ptr<AsyncFileReader>> reader_;
 };
 
 }
@@ -68,8 +103,13 @@ int main(int argc, char* argv[]) {
   options.idleTimeout = std::chrono::milliseconds(60000);
   options.shutdownOn = {SIGINT, SIGTERM};
   options.enableContentCompression = false;
+  options.zeroCopyEgressThreshold = FLAGS_zero_copy_threshold;
+  std::shared_ptr<CompressedVariantCache> sidecars;
+  if (FLAGS_precompressed) {
+    sidecars = std::make_shared<CompressedVariantCache>();
+  }
   options.handlerFactories = RequestHandlerChain()
-      .addThen<StaticHandlerFactory>()
+      .addThen<StaticHandlerFactory>(sidecars, FLAGS_map_files)
       .build();
   options.h2cEnabled = true;
 
@@ -0,0 +1,137 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/String.h>
+#include <folly/init/Init.h>
+#include <folly/portability/Sockets.h>
+#include <gflags/gflags.h>
+#include <proxygen/httpserver/ScopedHTTPServer.h>
+#include <proxygen/lib/utils/Time.h>
+
+#include <algorithm>
+#include <thread>
+#include <unistd.h>
+
+// Connection storm against a local HTTPServer: client threads open a new
+// connection per request as fast as they can.  Reports accepted
+// connections per second and the p50/p99 time from connect() to the first
+// response byte, for the shared acceptor thread and for
+// reusePortPerThread, with 1, 8 and 32 IO threads.
+//
+// ./accept_benchmark --clients=64 --duration_ms=5000
+//
+// Prints one line per configuration:
+//   threads=8  mode=reuseport  accepts/s=...  p50=...us  p99=...us
+
+DEFINE_int32(clients, 64, "Concurrent client threads");
+DEFINE_int32(duration_ms, 3000, "Run time per configuration");
+DEFINE_string(threads, "1,8,32", "Comma separated IO thread counts");
+
+using namespace proxygen;
+
+namespace {
+
+struct Result {
+  uint64_t connections{0};
+  std::vector<uint32_t> latenciesUs;
+};
+
+void runClient(const folly::SocketAddress& addr,
+               TimePoint deadline,
+               Result& result) {
+  sockaddr_storage ss;
+  auto len = addr.getAddress(&ss);
+  const char req[] = "GET / HTTP/1.1\r\nHost: localhost\r\n"
+                     "Connection: close\r\n\r\n";
+  char buf[4096];
+  while (getCurrentTime() < deadline) {
+    int fd = socket(addr.getFamily(), SOCK_STREAM, 0);
+    PCHECK(fd >= 0);
+    // Reset on close so the client does not run out of ephemeral ports
+    linger lin{1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_LINGER, &lin, sizeof(lin));
+    auto start = getCurrentTime();
+    if (connect(fd, (sockaddr*)&ss, len) != 0 ||
+        write(fd, req, sizeof(req) - 1) != sizeof(req) - 1 ||
+        read(fd, buf, sizeof(buf)) <= 0) {
+      close(fd);
+      continue;
+    }
+    result.latenciesUs.push_back(
+        microsecondsBetween(getCurrentTime(), start).count());
+    result.connections++;
+    close(fd);
+  }
+}
+
+void runConfig(size_t threads, bool reusePort) {
+  HTTPServer::IPConfig cfg{folly::SocketAddress("127.0.0.1", 0),
+                           HTTPServer::Protocol::HTTP};
+  HTTPServerOptions options;
+  options.threads = threads;
+  options.reusePortPerThread = reusePort;
+  options.listenBacklog = 4096;
+  auto handler = [](const HTTPMessage&,
+                    std::unique_ptr<folly::IOBuf>,
+                    ResponseBuilder& response) {
+    response.status(200, "OK").body("ok");
+  };
+  options.handlerFactories.push_back(
+      std::make_unique<ScopedHandlerFactory<decltype(handler)>>(handler));
+  auto server = ScopedHTTPServer::start(cfg, std::move(options));
+  auto addr = server->getAddresses()[0].address;
+
+  std::vector<Result> results(FLAGS_clients);
+  std::vector<std::thread> clients;
+  auto start = getCurrentTime();
+  auto deadline = start + std::chrono::milliseconds(FLAGS_duration_ms);
+  for (auto& result : results) {
+    clients.emplace_back(
+        [&addr, deadline, &result] { runClient(addr, deadline, result); });
+  }
+  for (auto& client : clients) {
+    client.join();
+  }
+  auto elapsed = microsecondsBetween(getCurrentTime(), start);
+
+  Result total;
+  for (auto& result : results) {
+    total.connections += result.connections;
+    total.latenciesUs.insert(total.latenciesUs.end(),
+                             result.latenciesUs.begin(),
+                             result.latenciesUs.end());
+  }
+  std::sort(total.latenciesUs.begin(), total.latenciesUs.end());
+  auto pct = [&](double p) -> uint32_t {
+    if (total.latenciesUs.empty()) {
+      return 0;
+    }
+    return total.latenciesUs[std::min(total.latenciesUs.size() - 1,
+                                      size_t(total.latenciesUs.size() * p))];
+  };
+  printf("threads=%-3zu mode=%-9s accepts/s=%9.0f  p50=%6uus  p99=%6uus\n",
+         threads,
+         reusePort ? "reuseport" : "shared",
+         total.connections / (elapsed.count() / 1e6),
+         pct(0.5),
+         pct(0.99));
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  folly::init(&argc, &argv);
+  std::vector<size_t> threadCounts;
+  folly::split(',', FLAGS_threads, threadCounts);
+  for (auto threads : threadCounts) {
+    runConfig(threads, false);
+    runConfig(threads, true);
+  }
+  return 0;
+}
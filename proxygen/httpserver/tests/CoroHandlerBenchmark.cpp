@@ -0,0 +1,254 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Portability.h>
+
+#if FOLLY_HAS_COROUTINES
+
+#include <folly/String.h>
+#include <folly/ThreadLocal.h>
+#include <folly/init/Init.h>
+#include <folly/io/async/HHWheelTimer.h>
+#include <folly/portability/Sockets.h>
+#include <gflags/gflags.h>
+#include <proxygen/httpserver/ScopedHTTPServer.h>
+#include <proxygen/httpserver/samples/echo/CoroEchoHandler.h>
+#include <proxygen/httpserver/samples/echo/EchoHandler.h>
+#include <proxygen/httpserver/samples/echo/EchoStats.h>
+#include <proxygen/httpserver/samples/proxy/CoroProxyHandler.h>
+#include <proxygen/httpserver/samples/proxy/ProxyHandler.h>
+#include <proxygen/httpserver/samples/proxy/ProxyStats.h>
+#include <proxygen/lib/utils/Time.h>
+
+#include <atomic>
+#include <new>
+#include <thread>
+#include <unistd.h>
+
+// Requests per second and heap allocations per request for the callback
+// and coroutine versions of the echo and proxy samples, over keep-alive
+// HTTP/1.1 connections from blocking client threads.  The proxy forwards to
+// an in-process echo server and opens an upstream connection per request,
+// as the samples do.
+//
+// Build together with the echo and proxy sample handlers:
+// ./coro_handler_benchmark --clients=16 --duration_ms=5000 --body_size=1024 \
+//     --minloglevel=1
+//
+// (ProxyHandler logs every request at INFO, which would dominate otherwise)
+//
+// Prints one line per configuration:
+//   echo   callback   rps=...  allocs/req=...
+//   echo   coro       rps=...  allocs/req=...
+//   proxy  callback   rps=...  allocs/req=...
+//   proxy  coro       rps=...  allocs/req=...
+//
+// allocs/req counts every operator new in the process during the run,
+// divided by completed requests; the clients do not allocate.
+
+DEFINE_int32(clients, 16, "Concurrent keep-alive client connections");
+DEFINE_int32(duration_ms, 3000, "Run time per configuration");
+DEFINE_int32(body_size, 1024, "Request body size, echoed back");
+DEFINE_int32(threads, 4, "Server IO threads");
+
+namespace {
+std::atomic<uint64_t> gAllocations{0};
+}
+
+void* operator new(size_t size) {
+  gAllocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = malloc(size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  free(p);
+}
+
+using namespace proxygen;
+
+namespace {
+
+template <typename Handler>
+class EchoFactory : public RequestHandlerFactory {
+ public:
+  void onServerStart(folly::EventBase*) noexcept override {
+  }
+  void onServerStop() noexcept override {
+  }
+  RequestHandler* onRequest(RequestHandler*, HTTPMessage*) noexcept override {
+    return new Handler(stats_.get());
+  }
+
+ private:
+  folly::ThreadLocal<EchoService::EchoStats> stats_;
+};
+
+template <typename Handler>
+class ProxyFactory : public RequestHandlerFactory {
+ public:
+  void onServerStart(folly::EventBase* evb) noexcept override {
+    *timer_ = folly::HHWheelTimer::newTimer(
+        evb,
+        std::chrono::milliseconds(folly::HHWheelTimer::DEFAULT_TICK_INTERVAL),
+        folly::AsyncTimeout::InternalEnum::NORMAL,
+        std::chrono::seconds(10));
+  }
+  void onServerStop() noexcept override {
+    timer_->reset();
+  }
+  RequestHandler* onRequest(RequestHandler*, HTTPMessage*) noexcept override {
+    return new Handler(stats_.get(), timer_->get());
+  }
+
+ private:
+  folly::ThreadLocal<ProxyService::ProxyStats> stats_;
+  folly::ThreadLocal<folly::HHWheelTimer::UniquePtr> timer_;
+};
+
+std::unique_ptr<ScopedHTTPServer> startServer(
+    std::unique_ptr<RequestHandlerFactory> factory) {
+  HTTPServer::IPConfig cfg{folly::SocketAddress("127.0.0.1", 0),
+                           HTTPServer::Protocol::HTTP};
+  HTTPServerOptions options;
+  options.threads = FLAGS_threads;
+  options.enableContentCompression = false;
+  options.handlerFactories.push_back(std::move(factory));
+  return ScopedHTTPServer::start(cfg, std::move(options));
+}
+
+// Sends requests on one connection until the deadline; returns the number
+// of complete responses
+uint64_t runClient(const folly::SocketAddress& addr,
+                   const std::string& target,
+                   TimePoint deadline) {
+  sockaddr_storage ss;
+  auto len = addr.getAddress(&ss);
+  int fd = socket(addr.getFamily(), SOCK_STREAM, 0);
+  PCHECK(fd >= 0);
+  PCHECK(connect(fd, (sockaddr*)&ss, len) == 0);
+
+  auto request = folly::to<std::string>(
+      "POST ", target, " HTTP/1.1\r\nHost: localhost\r\nContent-Length: ",
+      FLAGS_body_size, "\r\n\r\n", std::string(FLAGS_body_size, 'a'));
+  std::vector<char> buf(64 * 1024);
+  uint64_t responses = 0;
+  while (getCurrentTime() < deadline) {
+    if (write(fd, request.data(), request.size()) != ssize_t(request.size())) {
+      break;
+    }
+    // Read headers, then Content-Length bytes of body
+    size_t have = 0;
+    size_t need = 0;
+    while (need == 0 || have < need) {
+      auto n = read(fd, buf.data() + have, buf.size() - have);
+      if (n <= 0) {
+        close(fd);
+        return responses;
+      }
+      have += n;
+      if (need == 0) {
+        folly::StringPiece data(buf.data(), have);
+        auto end = data.find("\r\n\r\n");
+        if (end == folly::StringPiece::npos) {
+          continue;
+        }
+        auto cl = data.find("Content-Length: ");
+        CHECK(cl != folly::StringPiece::npos && cl < end);
+        need = end + 4 +
+            folly::to<size_t>(data.subpiece(cl + 16, data.find('\r', cl) -
+                                                         cl - 16));
+      }
+    }
+    responses++;
+  }
+  close(fd);
+  return responses;
+}
+
+void run(const char* sample,
+         const char* mode,
+         const folly::SocketAddress& addr,
+         const std::string& target) {
+  std::vector<uint64_t> responses(FLAGS_clients);
+  std::vector<std::thread> clients;
+  auto start = getCurrentTime();
+  auto deadline = start + std::chrono::milliseconds(FLAGS_duration_ms);
+  auto allocationsBefore = gAllocations.load();
+  for (int i = 0; i < FLAGS_clients; i++) {
+    clients.emplace_back([&, i] {
+      responses[i] = runClient(addr, target, deadline);
+    });
+  }
+  for (auto& client : clients) {
+    client.join();
+  }
+  auto allocations = gAllocations.load() - allocationsBefore;
+  auto elapsed = microsecondsBetween(getCurrentTime(), start);
+  uint64_t total = 0;
+  for (auto n : responses) {
+    total += n;
+  }
+  printf("%-6s %-9s rps=%9.0f  allocs/req=%6.1f\n",
+         sample,
+         mode,
+         total / (elapsed.count() / 1e6),
+         total ? double(allocations) / total : 0.0);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  folly::init(&argc, &argv);
+  using EchoService::CoroEchoHandler;
+  using EchoService::EchoHandler;
+  using ProxyService::CoroProxyHandler;
+  using ProxyService::ProxyHandler;
+
+  {
+    auto server = startServer(std::make_unique<EchoFactory<EchoHandler>>());
+    run("echo", "callback", server->getAddresses()[0].address, "/");
+  }
+  {
+    auto server =
+        startServer(std::make_unique<EchoFactory<CoroEchoHandler>>());
+    run("echo", "coro", server->getAddresses()[0].address, "/");
+  }
+
+  auto backend = startServer(std::make_unique<EchoFactory<EchoHandler>>());
+  auto target = folly::to<std::string>(
+      "http://127.0.0.1:", backend->getAddresses()[0].address.getPort(), "/");
+  {
+    auto proxy = startServer(std::make_unique<ProxyFactory<ProxyHandler>>());
+    run("proxy", "callback", proxy->getAddresses()[0].address, target);
+  }
+  {
+    auto proxy =
+        startServer(std::make_unique<ProxyFactory<CoroProxyHandler>>());
+    run("proxy", "coro", proxy->getAddresses()[0].address, target);
+  }
+  return 0;
+}
+
+#else
+
+#include <cstdio>
+
+int main() {
+  fprintf(stderr, "Built without coroutine support\n");
+  return 1;
+}
+
+#endif // FOLLY_HAS_COROUTINES
@@ -15,14 +15,24 @@
 #include <folly/io/async/AsyncServerSocket.h>
 #include <folly/io/async/EventBaseManager.h>
 #include <folly/portability/GTest.h>
+#include <folly/portability/Unistd.h>
 #include <folly/ssl/OpenSSLCertUtils.h>
 #include <proxygen/httpclient/samples/curl/CurlClient.h>
+#include <proxygen/httpserver/RequestArena.h>
 #include <proxygen/httpserver/ResponseBuilder.h>
 #include <proxygen/httpserver/ScopedHTTPServer.h>
+#include <proxygen/httpserver/filters/AdmissionController.h>
 #include <proxygen/lib/http/HTTPConnector.h>
+#include <proxygen/lib/http/codec/HTTP2Constants.h>
+#include <proxygen/lib/transport/KTLSAsyncSSLSocket.h>
 #include <proxygen/lib/utils/TestUtils.h>
 #include <wangle/client/ssl/SSLSession.h>
 
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <set>
+
 using namespace folly;
 using namespace folly::ssl;
 using namespace proxygen;
@@ -783,3 +793,498 @@ TEST_F(ConnectionFilterTest, Test) {
   auto headers = response->getHeaders();
   EXPECT_EQ("testuser1", headers.getSingleOrEmpty("X-Client-CN"));
 }
+
+namespace {
+
+const size_t kKernelTLSBodySize = 1024 * 1024 + 17;
+
+std::string kernelTLSBody() {
+  std::string body;
+  for (size_t i = 0; i < kKernelTLSBodySize; i++) {
+    body.push_back('a' + i % 26);
+  }
+  return body;
+}
+
+class KernelTLSHandlerFactory : public RequestHandlerFactory {
+ public:
+  class KernelTLSHandler : public RequestHandler {
+    void onRequest(std::unique_ptr<HTTPMessage>) noexcept override {
+    }
+    void onBody(std::unique_ptr<folly::IOBuf>) noexcept override {}
+    void onUpgrade(UpgradeProtocol) noexcept override {
+    }
+
+    void onEOM() noexcept override {
+      auto txn = CHECK_NOTNULL(downstream_->getTransaction());
+      auto sock = txn->getTransport().getUnderlyingTransport();
+      auto ktlsSock = sock->getUnderlyingTransport<KTLSAsyncSSLSocket>();
+      bool enabled = ktlsSock && ktlsSock->isKernelTLSEgressEnabled();
+      ResponseBuilder(downstream_)
+          .status(200, "OK")
+          .header("X-Kernel-TLS", enabled ? "1" : "0")
+          .body(IOBuf::copyBuffer(kernelTLSBody()))
+          .sendWithEOM();
+    }
+
+    void requestComplete() noexcept override { delete this; }
+
+    void onError(ProxygenError) noexcept override { delete this; }
+  };
+
+  RequestHandler* onRequest(RequestHandler*, HTTPMessage*) noexcept override {
+    return new KernelTLSHandler();
+  }
+
+  void onServerStart(folly::EventBase*) noexcept override {}
+  void onServerStop() noexcept override {}
+};
+
+// Whether the kernel can take over TLS egress: built with its headers, and
+// the tls module is loaded (or built in)
+bool kernelTLSAvailable() {
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/tls.h>)
+  return access("/sys/module/tls", F_OK) == 0;
+#endif
+#endif
+  return false;
+}
+
+class BodyCollectingClient : public CurlClient {
+ public:
+  using CurlClient::CurlClient;
+
+  void onBody(std::unique_ptr<folly::IOBuf> chain) noexcept override {
+    body_.append(chain->moveToFbString().toStdString());
+  }
+
+  const std::string& getBody() const {
+    return body_;
+  }
+
+ private:
+  std::string body_;
+};
+
+}
+
+class KernelTLSServerTest : public ScopedServerTest {
+ protected:
+  void SetUp() override {
+    ScopedServerTest::SetUp();
+    wangle::SSLContextConfig sslCfg;
+    sslCfg.isDefault = true;
+    sslCfg.setCertificate(
+        kTestDir + "certs/test_cert1.pem",
+        kTestDir + "certs/test_key1.pem",
+        "");
+    cfg_.sslConfigs.push_back(sslCfg);
+  }
+
+  HTTPServerOptions createDefaultOpts() override {
+    HTTPServerOptions options;
+    options.threads = 4;
+    options.kernelTLSEgress = kernelTLSEgress_;
+    options.handlerFactories =
+        RequestHandlerChain().addThen<KernelTLSHandlerFactory>().build();
+    return options;
+  }
+
+  // kTLS only takes TLS 1.2 connections
+  std::unique_ptr<BodyCollectingClient> fetchOverTLS12() {
+    return fetch(TLS1_2_VERSION, TLS1_2_VERSION);
+  }
+
+  std::unique_ptr<BodyCollectingClient> fetch(int minVersion,
+                                              int maxVersion) {
+    URL url(folly::to<std::string>("https://localhost:", address_.getPort()));
+    HTTPHeaders headers;
+    auto client = std::make_unique<BodyCollectingClient>(
+      &evb_, HTTPMethod::GET, url, nullptr, headers, "");
+    client->setFlowControlSettings(64 * 1024);
+    client->setLogging(false);
+    client->initializeSsl("", "http/1.1");
+    SSL_CTX_set_min_proto_version(
+      client->getSSLContext()->getSSLCtx(), minVersion);
+    SSL_CTX_set_max_proto_version(
+      client->getSSLContext()->getSSLCtx(), maxVersion);
+    HTTPConnector connector(client.get(), timer_.get());
+    connector.connectSSL(
+      &evb_,
+      address_,
+      client->getSSLContext(),
+      nullptr,
+      std::chrono::milliseconds(1000));
+    evb_.loop();
+    return client;
+  }
+
+  bool kernelTLSEgress_{true};
+};
+
+TEST_F(KernelTLSServerTest, LargeBody) {
+  if (!kernelTLSAvailable()) {
+    GTEST_SKIP() << "kTLS is not available on this host";
+  }
+  auto server = createScopedServer();
+  for (int i = 0; i < 2; i++) {
+    auto client = fetchOverTLS12();
+    auto response = client->getResponse();
+    ASSERT_NE(nullptr, response);
+    EXPECT_EQ(200, response->getStatusCode());
+    EXPECT_EQ("1", response->getHeaders().getSingleOrEmpty("X-Kernel-TLS"));
+    EXPECT_EQ(kernelTLSBody(), client->getBody());
+  }
+}
+
+// Connections kTLS can't take are served through OpenSSL as before
+TEST_F(KernelTLSServerTest, FallbackForTLS13) {
+#ifdef TLS1_3_VERSION
+  auto server = createScopedServer();
+  auto client = fetch(TLS1_3_VERSION, TLS1_3_VERSION);
+  auto response = client->getResponse();
+  ASSERT_NE(nullptr, response);
+  EXPECT_EQ(200, response->getStatusCode());
+  EXPECT_EQ("0", response->getHeaders().getSingleOrEmpty("X-Kernel-TLS"));
+  EXPECT_EQ(kernelTLSBody(), client->getBody());
+#else
+  GTEST_SKIP() << "OpenSSL has no TLS 1.3";
+#endif
+}
+
+TEST_F(KernelTLSServerTest, DisabledByDefault) {
+  kernelTLSEgress_ = HTTPServerOptions().kernelTLSEgress;
+  auto server = createScopedServer();
+  auto client = fetchOverTLS12();
+  auto response = client->getResponse();
+  ASSERT_NE(nullptr, response);
+  EXPECT_EQ(200, response->getStatusCode());
+  EXPECT_EQ("0", response->getHeaders().getSingleOrEmpty("X-Kernel-TLS"));
+  EXPECT_EQ(kernelTLSBody(), client->getBody());
+}
+
+class ReusePortServerTest : public ScopedServerTest {
+ protected:
+  HTTPServerOptions createDefaultOpts() override {
+    auto options = ScopedServerTest::createDefaultOpts();
+    options.reusePortPerThread = true;
+    options.reusePortSocketCallback = [this](folly::AsyncServerSocket& socket,
+                                             size_t threadIndex) {
+      EXPECT_TRUE(socket.getEventBase()->isInEventBaseThread());
+      std::lock_guard<std::mutex> g(mutex_);
+      threadIndexes_.insert(threadIndex);
+    };
+    return options;
+  }
+
+  std::mutex mutex_;
+  std::set<size_t> threadIndexes_;
+};
+
+TEST_F(ReusePortServerTest, Start) {
+  auto server = createScopedServer();
+  EXPECT_EQ(threadIndexes_, std::set<size_t>({0, 1, 2, 3}));
+  for (int i = 0; i < 8; i++) {
+    auto client = connectPlainText();
+    auto resp = client->getResponse();
+    ASSERT_NE(nullptr, resp);
+    EXPECT_EQ(200, resp->getStatusCode());
+  }
+}
+
+namespace {
+
+// Heap allocations made by the calling thread, counted by the global
+// operator new below
+FOLLY_TLS uint64_t threadHeapAllocations = 0;
+
+} // namespace
+
+void* operator new(size_t size) {
+  threadHeapAllocations++;
+  if (auto ptr = malloc(size ? size : 1)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+
+class ArenaStatsHandlerFactory : public RequestHandlerFactory {
+ public:
+  // Reports the IO thread's RequestArena counters, which already include
+  // the chain built for this request, and the heap allocations made while
+  // building it: from its factory being called, first, to the transaction
+  // being attached to the finished chain
+  class ArenaStatsHandler : public RequestHandler,
+                            public RequestArenaAllocated {
+   public:
+    explicit ArenaStatsHandler(uint64_t heapAllocationsBefore)
+        : heapAllocationsBefore_(heapAllocationsBefore) {}
+
+    void setResponseHandler(ResponseHandler* handler) noexcept override {
+      chainHeapAllocations_ = threadHeapAllocations - heapAllocationsBefore_;
+      RequestHandler::setResponseHandler(handler);
+    }
+
+    void onRequest(std::unique_ptr<HTTPMessage>) noexcept override {}
+    void onBody(std::unique_ptr<folly::IOBuf>) noexcept override {}
+    void onUpgrade(UpgradeProtocol) noexcept override {}
+
+    void onEOM() noexcept override {
+      auto& stats = RequestArena::getThreadStats();
+      ResponseBuilder(downstream_)
+          .status(200, "OK")
+          .header("X-Arena-Objects", folly::to<std::string>(stats.objects))
+          .header("X-Arena-Overflows",
+                  folly::to<std::string>(stats.overflows))
+          .header("X-Chain-Heap-Allocations",
+                  folly::to<std::string>(chainHeapAllocations_))
+          .sendWithEOM();
+    }
+
+    void requestComplete() noexcept override { delete this; }
+
+    void onError(ProxygenError) noexcept override { delete this; }
+
+   private:
+    const uint64_t heapAllocationsBefore_;
+    uint64_t chainHeapAllocations_{0};
+  };
+
+  RequestHandler* onRequest(RequestHandler*, HTTPMessage*) noexcept override {
+    return new ArenaStatsHandler(threadHeapAllocations);
+  }
+
+  void onServerStart(folly::EventBase*) noexcept override {}
+  void onServerStop() noexcept override {}
+};
+
+class RequestArenaServerTest : public ScopedServerTest {
+ protected:
+  HTTPServerOptions createDefaultOpts() override {
+    HTTPServerOptions options;
+    options.threads = 1;
+    options.handlerFactories = RequestHandlerChain()
+                                   .addThen<DummyFilterFactory>()
+                                   .addThen<DummyFilterFactory>()
+                                   .addThen<ArenaStatsHandlerFactory>()
+                                   .build();
+    return options;
+  }
+};
+
+TEST_F(RequestArenaServerTest, ChainAllocatedFromArena) {
+  // Outside of a RequestArena::Scope every object of a chain is its own
+  // heap allocation
+  auto before = threadHeapAllocations;
+  auto handler = new ArenaStatsHandlerFactory::ArenaStatsHandler(before);
+  auto inner = new DummyFilterFactory::DummyFilter(handler);
+  auto outer = new DummyFilterFactory::DummyFilter(inner);
+  EXPECT_EQ(3u, threadHeapAllocations - before);
+  delete outer;
+  delete inner;
+  delete handler;
+
+  auto server = createScopedServer();
+  auto stat = [](const HTTPMessage* resp, const std::string& name) {
+    return folly::to<uint64_t>(resp->getHeaders().getSingleOrEmpty(name));
+  };
+  uint64_t lastObjects = 0;
+  for (int i = 0; i < 8; i++) {
+    auto client = connectPlainText();
+    auto resp = client->getResponse();
+    ASSERT_NE(nullptr, resp);
+    EXPECT_EQ(200, resp->getStatusCode());
+    auto objects = stat(resp, "X-Arena-Objects");
+    EXPECT_EQ(0u, stat(resp, "X-Arena-Overflows"));
+    if (i > 0) {
+      // RejectConnectFilter, two DummyFilters, the handler and the adaptor
+      EXPECT_EQ(5u, objects - lastObjects);
+      // Each request reuses the slab released by the previous one, so
+      // none of them is a heap allocation any more
+      EXPECT_EQ(0u, stat(resp, "X-Chain-Heap-Allocations"));
+    }
+    lastObjects = objects;
+  }
+}
+
+namespace {
+
+// CPU always past the hard limit, so that every request is shed
+class OverloadedResources : public Resources {
+ public:
+  ResourceData getCurrentData() override {
+    ResourceData data;
+    data.setCpuStats(1.0, 0, {});
+    data.refreshLastUpdateTime();
+    return data;
+  }
+};
+
+// Sends one GET once connected and records how it ended
+class RejectedRequestClient : public HTTPConnector::Callback,
+                              public HTTPTransactionHandler {
+ public:
+  void connectSuccess(HTTPUpstreamSession* session) override {
+    auto txn = session->newTransaction(this);
+    ASSERT_NE(nullptr, txn);
+    HTTPMessage req;
+    req.setMethod(HTTPMethod::GET);
+    req.setURL("/");
+    req.getHeaders().set(HTTP_HEADER_HOST, "localhost");
+    txn->sendHeadersWithEOM(req);
+    session->closeWhenIdle();
+  }
+
+  void connectError(const folly::AsyncSocketException& ex) override {
+    ADD_FAILURE() << "connect failed: " << ex.what();
+  }
+
+  void setTransaction(HTTPTransaction*) noexcept override {}
+  void detachTransaction() noexcept override {}
+  void onHeadersComplete(std::unique_ptr<HTTPMessage> msg) noexcept override {
+    response = std::move(msg);
+  }
+  void onBody(std::unique_ptr<folly::IOBuf>) noexcept override {}
+  void onTrailers(std::unique_ptr<HTTPHeaders>) noexcept override {}
+  void onEOM() noexcept override {}
+  void onUpgrade(UpgradeProtocol) noexcept override {}
+  void onError(const HTTPException& error) noexcept override {
+    if (error.hasCodecStatusCode()) {
+      codecError = error.getCodecStatusCode();
+    }
+  }
+  void onEgressPaused() noexcept override {}
+  void onEgressResumed() noexcept override {}
+
+  std::unique_ptr<HTTPMessage> response;
+  folly::Optional<ErrorCode> codecError;
+};
+
+} // namespace
+
+class AdmissionControllerServerTest : public ScopedServerTest {
+ protected:
+  HTTPServerOptions createDefaultOpts() override {
+    auto options = ScopedServerTest::createDefaultOpts();
+    AdmissionController::Options admissionOptions;
+    admissionOptions.loopTimeSoftLimit = std::chrono::microseconds(0);
+    options.admissionController = std::make_shared<AdmissionController>(
+        std::make_shared<ResourceStats>(
+            std::make_unique<OverloadedResources>()),
+        admissionOptions);
+    return options;
+  }
+
+  void fetch(RejectedRequestClient& client, const std::string& protocol) {
+    HTTPConnector connector(&client, timer_.get());
+    connector.setPlaintextProtocol(protocol);
+    connector.connect(&evb_, address_, std::chrono::milliseconds(1000));
+    evb_.loop();
+  }
+};
+
+TEST_F(AdmissionControllerServerTest, ShedHTTP1) {
+  auto server = createScopedServer();
+  RejectedRequestClient client;
+  fetch(client, "");
+  ASSERT_NE(nullptr, client.response);
+  EXPECT_EQ(503, client.response->getStatusCode());
+  EXPECT_FALSE(client.codecError.hasValue());
+}
+
+TEST_F(AdmissionControllerServerTest, ShedHTTP2) {
+  cfg_.protocol = HTTPServer::Protocol::HTTP2;
+  auto server = createScopedServer();
+  RejectedRequestClient client;
+  fetch(client, http2::kProtocolCleartextString);
+  EXPECT_EQ(nullptr, client.response);
+  ASSERT_TRUE(client.codecError.hasValue());
+  EXPECT_EQ(ErrorCode::REFUSED_STREAM, *client.codecError);
+}
+
+class StaticResponseServerTest : public ScopedServerTest {
+ protected:
+  HTTPServerOptions createDefaultOpts() override {
+    auto options = ScopedServerTest::createDefaultOpts();
+    HTTPMessage resp;
+    resp.setHTTPVersion(1, 1);
+    resp.setStatusCode(200);
+    resp.setStatusMessage("OK");
+    resp.getHeaders().add("X-Static", "yes");
+    options.staticResponses["/"] = std::make_shared<StaticResponse>(
+        std::move(resp), folly::IOBuf::copyBuffer("healthy"));
+    return options;
+  }
+};
+
+TEST_F(StaticResponseServerTest, ServedBeforeHandlers) {
+  auto server = createScopedServer();
+  for (int i = 0; i < 2; i++) {
+    auto client = connectPlainText();
+    auto resp = client->getResponse();
+    ASSERT_NE(nullptr, resp);
+    EXPECT_EQ(200, resp->getStatusCode());
+    EXPECT_EQ("yes", resp->getHeaders().getSingleOrEmpty("X-Static"));
+    EXPECT_EQ("7", resp->getHeaders().getSingleOrEmpty(
+        HTTP_HEADER_CONTENT_LENGTH));
+  }
+}
+
+TEST(UseExistingSocket, TestReusePortPerThread) {
+  AsyncServerSocket::UniquePtr serverSocket(new folly::AsyncServerSocket);
+  serverSocket->setReusePortEnabled(true);
+  serverSocket->bind(folly::SocketAddress("127.0.0.1", 0));
+  folly::SocketAddress boundAddress;
+  serverSocket->getAddress(&boundAddress);
+
+  HTTPServer::IPConfig cfg{folly::SocketAddress("127.0.0.1", 0),
+                           HTTPServer::Protocol::HTTP};
+  HTTPServerOptions options;
+  options.threads = 4;
+  options.reusePortPerThread = true;
+  options.handlerFactories =
+      RequestHandlerChain().addThen<TestHandlerFactory>().build();
+  auto existingFd = serverSocket->getNetworkSocket().toFd();
+  options.useExistingSocket(std::move(serverSocket));
+
+  auto server = std::make_unique<HTTPServer>(std::move(options));
+  auto st = std::make_unique<ServerThread>(server.get());
+  std::vector<HTTPServer::IPConfig> ips{cfg};
+  server->bind(ips);
+
+  EXPECT_TRUE(st->start());
+
+  // The first thread uses the prebound socket, the rest join its port
+  ASSERT_EQ(existingFd, server->getListenSocket());
+  auto sockets = server->getSockets();
+  ASSERT_EQ(4, sockets.size());
+  for (auto socket : sockets) {
+    folly::SocketAddress address;
+    socket->getAddress(&address);
+    EXPECT_EQ(boundAddress, address);
+  }
+}
+
+TEST(UseExistingSocket, TestReusePortPerThreadRequiresReusePort) {
+  AsyncServerSocket::UniquePtr serverSocket(new folly::AsyncServerSocket);
+  serverSocket->bind(folly::SocketAddress("127.0.0.1", 0));
+
+  HTTPServer::IPConfig cfg{folly::SocketAddress("127.0.0.1", 0),
+                           HTTPServer::Protocol::HTTP};
+  HTTPServerOptions options;
+  options.threads = 2;
+  options.reusePortPerThread = true;
+  options.useExistingSocket(std::move(serverSocket));
+
+  auto server = std::make_unique<HTTPServer>(std::move(options));
+  auto st = std::make_unique<ServerThread>(server.get());
+  std::vector<HTTPServer::IPConfig> ips{cfg};
+  server->bind(ips);
+
+  EXPECT_FALSE(st->start());
+}
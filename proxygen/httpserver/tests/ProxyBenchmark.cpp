@@ -0,0 +1,214 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Conv.h>
+#include <folly/FileUtil.h>
+#include <folly/ThreadLocal.h>
+#include <folly/init/Init.h>
+#include <folly/portability/Sockets.h>
+#include <gflags/gflags.h>
+#include <proxygen/httpserver/ScopedHTTPServer.h>
+#include <proxygen/httpserver/samples/proxy/ProxyHandler.h>
+#include <proxygen/httpserver/samples/proxy/ProxyStats.h>
+#include <proxygen/httpserver/samples/proxy/UpstreamSessionPools.h>
+#include <proxygen/lib/utils/Time.h>
+
+#include <algorithm>
+#include <thread>
+#include <unistd.h>
+
+// Requests through the proxy sample to a local origin.  Each client thread
+// sends requests one after another on a keep-alive connection to the
+// proxy, so every upstream request either opens a connection or reuses a
+// pooled session.  Build together with httpserver/samples/proxy/
+// ProxyHandler.cpp and UpstreamSessionPools.cpp.
+//
+// ./proxy_benchmark --clients=64 --threads=4 --duration_ms=5000
+//
+// Prints one line per mode:
+//   mode=connect   req/s=...  p50=...us  p99=...us
+// The modes are
+//   connect   a new upstream connection per request (upstream_max_idle=0)
+//   pool      per-thread HTTP/1.1 session pools
+//   pool-h2   per-thread pools of HTTP/2 sessions, multiplexed
+// ProxyHandler logs every request at INFO, so the default minloglevel is
+// raised to keep that out of the numbers.
+
+DEFINE_int32(clients, 64, "Concurrent client connections to the proxy");
+DEFINE_int32(threads, 4, "Proxy IO threads");
+DEFINE_int32(origin_threads, 4, "Origin IO threads");
+DEFINE_int32(duration_ms, 3000, "Run time per mode");
+DEFINE_int32(response_size, 1024, "Origin response body size");
+
+using namespace ProxyService;
+using namespace proxygen;
+
+namespace {
+
+class ProxyFactory : public RequestHandlerFactory {
+ public:
+  explicit ProxyFactory(UpstreamSessionPools::Options options)
+      : options_(std::move(options)),
+        idleControllers_(FLAGS_threads * options_.maxIdleSessions) {
+  }
+
+  void onServerStart(folly::EventBase* evb) noexcept override {
+    stats_.reset(new ProxyStats);
+    timer_->timer = folly::HHWheelTimer::newTimer(
+      evb,
+      std::chrono::milliseconds(folly::HHWheelTimer::DEFAULT_TICK_INTERVAL),
+      folly::AsyncTimeout::InternalEnum::NORMAL,
+      std::chrono::seconds(60));
+    upstreams_.reset(new UpstreamSessionPools(
+      evb, timer_->timer.get(), options_, &idleControllers_));
+  }
+
+  void onServerStop() noexcept override {
+    idleControllers_.markForDeath();
+    upstreams_.reset();
+    stats_.reset();
+    timer_->timer.reset();
+  }
+
+  RequestHandler* onRequest(RequestHandler*, HTTPMessage*) noexcept override {
+    return new ProxyHandler(stats_.get(), upstreams_.get());
+  }
+
+ private:
+  struct TimerWrapper {
+    folly::HHWheelTimer::UniquePtr timer;
+  };
+  const UpstreamSessionPools::Options options_;
+  IdleSessionControllers idleControllers_;
+  folly::ThreadLocalPtr<ProxyStats> stats_;
+  folly::ThreadLocal<TimerWrapper> timer_;
+  folly::ThreadLocalPtr<UpstreamSessionPools> upstreams_;
+};
+
+std::unique_ptr<ScopedHTTPServer> startOrigin(HTTPServer::Protocol protocol) {
+  HTTPServer::IPConfig cfg{folly::SocketAddress("127.0.0.1", 0), protocol};
+  HTTPServerOptions options;
+  options.threads = FLAGS_origin_threads;
+  options.enableContentCompression = false;
+  auto body = std::string(FLAGS_response_size, 'x');
+  auto handler = [body](const HTTPMessage&,
+                        std::unique_ptr<folly::IOBuf>,
+                        ResponseBuilder& response) {
+    response.status(200, "OK").body(body);
+  };
+  options.handlerFactories.push_back(
+      std::make_unique<ScopedHandlerFactory<decltype(handler)>>(handler));
+  return ScopedHTTPServer::start(cfg, std::move(options));
+}
+
+std::vector<uint32_t> runClient(const folly::SocketAddress& proxy,
+                                const folly::SocketAddress& origin,
+                                TimePoint deadline) {
+  sockaddr_storage ss;
+  auto len = proxy.getAddress(&ss);
+  int fd = socket(proxy.getFamily(), SOCK_STREAM, 0);
+  PCHECK(fd >= 0);
+  PCHECK(connect(fd, (sockaddr*)&ss, len) == 0);
+  auto req = folly::to<std::string>(
+    "GET http://", origin.getAddressStr(), ":", origin.getPort(),
+    "/ HTTP/1.1\r\nHost: localhost\r\n\r\n");
+  std::vector<uint32_t> latenciesUs;
+  std::vector<char> buf(64 * 1024);
+  while (getCurrentTime() < deadline) {
+    auto start = getCurrentTime();
+    CHECK_EQ(folly::writeFull(fd, req.data(), req.size()), req.size());
+    std::string headers;
+    size_t headerEnd = std::string::npos;
+    while (headerEnd == std::string::npos) {
+      auto rc = read(fd, buf.data(), buf.size());
+      CHECK_GT(rc, 0);
+      headers.append(buf.data(), rc);
+      headerEnd = headers.find("\r\n\r\n");
+    }
+    CHECK_EQ(headers.compare(0, 12, "HTTP/1.1 200"), 0) << headers;
+    auto clPos = headers.find("Content-Length: ");
+    CHECK_NE(clPos, std::string::npos);
+    auto remaining = folly::to<size_t>(headers.substr(
+        clPos + 16, headers.find("\r\n", clPos) - clPos - 16));
+    remaining -= headers.size() - headerEnd - 4;
+    while (remaining > 0) {
+      auto rc = read(fd, buf.data(), std::min(buf.size(), remaining));
+      CHECK_GT(rc, 0);
+      remaining -= rc;
+    }
+    latenciesUs.push_back(
+        microsecondsBetween(getCurrentTime(), start).count());
+  }
+  close(fd);
+  return latenciesUs;
+}
+
+void runMode(const char* name,
+             uint32_t maxIdleSessions,
+             HTTPServer::Protocol originProtocol,
+             const std::string& upstreamProtocol) {
+  auto origin = startOrigin(originProtocol);
+  auto originAddr = origin->getAddresses()[0].address;
+
+  UpstreamSessionPools::Options upstreamOptions;
+  upstreamOptions.maxIdleSessions = maxIdleSessions;
+  upstreamOptions.plaintextProtocol = upstreamProtocol;
+  HTTPServer::IPConfig cfg{folly::SocketAddress("127.0.0.1", 0),
+                           HTTPServer::Protocol::HTTP};
+  HTTPServerOptions options;
+  options.threads = FLAGS_threads;
+  options.enableContentCompression = false;
+  options.handlerFactories.push_back(
+      std::make_unique<ProxyFactory>(std::move(upstreamOptions)));
+  auto proxy = ScopedHTTPServer::start(cfg, std::move(options));
+  auto proxyAddr = proxy->getAddresses()[0].address;
+
+  std::vector<std::vector<uint32_t>> results(FLAGS_clients);
+  std::vector<std::thread> clients;
+  auto start = getCurrentTime();
+  auto deadline = start + std::chrono::milliseconds(FLAGS_duration_ms);
+  for (auto& result : results) {
+    clients.emplace_back([&, deadline] {
+      result = runClient(proxyAddr, originAddr, deadline);
+    });
+  }
+  for (auto& client : clients) {
+    client.join();
+  }
+  auto elapsed = microsecondsBetween(getCurrentTime(), start);
+
+  std::vector<uint32_t> latenciesUs;
+  for (auto& result : results) {
+    latenciesUs.insert(latenciesUs.end(), result.begin(), result.end());
+  }
+  std::sort(latenciesUs.begin(), latenciesUs.end());
+  auto pct = [&](double p) -> uint32_t {
+    if (latenciesUs.empty()) {
+      return 0;
+    }
+    return latenciesUs[std::min(latenciesUs.size() - 1,
+                                size_t(latenciesUs.size() * p))];
+  };
+  printf("mode=%-8s req/s=%9.0f  p50=%6uus  p99=%6uus\n",
+         name,
+         latenciesUs.size() / (elapsed.count() / 1e6),
+         pct(0.5),
+         pct(0.99));
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  FLAGS_minloglevel = 1;
+  folly::init(&argc, &argv);
+  runMode("connect", 0, HTTPServer::Protocol::HTTP, "");
+  runMode("pool", 8, HTTPServer::Protocol::HTTP, "");
+  runMode("pool-h2", 8, HTTPServer::Protocol::HTTP2, "h2");
+  return 0;
+}
@@ -0,0 +1,215 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Conv.h>
+#include <folly/FileUtil.h>
+#include <folly/ThreadLocal.h>
+#include <folly/executors/CPUThreadPoolExecutor.h>
+#include <folly/executors/GlobalExecutor.h>
+#include <folly/experimental/TestUtil.h>
+#include <folly/init/Init.h>
+#include <folly/portability/Sockets.h>
+#include <gflags/gflags.h>
+#include <proxygen/httpserver/ScopedHTTPServer.h>
+#include <proxygen/httpserver/samples/static/StaticHandler.h>
+#include <proxygen/lib/utils/IoUringFileReader.h>
+#include <proxygen/lib/utils/Time.h>
+
+#include <sys/resource.h>
+#include <thread>
+#include <unistd.h>
+
+// Large file downloads from the static sample over loopback HTTP/1.1.  Each
+// client thread downloads the file over a keep-alive connection in a loop.
+// Build together with httpserver/samples/static/StaticHandler.cpp.
+//
+// ./static_file_benchmark --file_size_mb=256 --clients=4 --duration_ms=5000
+//
+// Many concurrent downloads, where the readers' queue depth and readahead
+// matter most:
+//
+// ./static_file_benchmark --file_size_mb=64 --clients=256 --threads=8
+//
+// Prints one line per mode:
+//   mode=read      GB/s=...  cpu_s/GB=...
+// The modes are
+//   read      one read(2) at a time on the CPU executor and a hop to the
+//             IO thread per chunk, without an AsyncFileReader
+//   pool      ThreadPoolFileReader, reads kept in flight up to the readahead
+//   uring     IoUringFileReader (skipped without io_uring)
+//   map       mapped and sent from the IO thread
+//   zerocopy  mapped, with MSG_ZEROCOPY writes
+// cpu_s/GB is user plus system time of the whole process, client included,
+// per GB downloaded; the client side costs the same in every mode.
+
+DEFINE_int32(file_size_mb, 256, "Size of the file to serve");
+DEFINE_int32(clients, 4, "Concurrent downloading connections");
+DEFINE_int32(threads, 4, "Server IO threads");
+DEFINE_int32(duration_ms, 5000, "Run time per mode");
+DEFINE_uint64(zero_copy_threshold, 64 * 1024,
+              "MSG_ZEROCOPY threshold for the zerocopy mode");
+
+using namespace proxygen;
+
+namespace {
+
+enum class Reader { NONE, POOL, URING };
+
+class StaticHandlerFactory : public RequestHandlerFactory {
+ public:
+  StaticHandlerFactory(bool mapFiles, Reader reader)
+      : mapFiles_(mapFiles), readerType_(reader) {
+  }
+
+  void onServerStart(folly::EventBase* evb) noexcept override {
+    AsyncFileReader::Options options;
+    if (readerType_ == Reader::POOL) {
+      reader_.reset(new ThreadPoolFileReader(evb, folly::getCPUExecutor(),
+                                             options.maxReadSize));
+    } else if (readerType_ == Reader::URING) {
+      reader_.reset(IoUringFileReader::make(evb, options).release());
+    }
+  }
+
+  void onServerStop() noexcept override {
+    reader_.reset();
+  }
+
+  RequestHandler* onRequest(RequestHandler*, HTTPMessage*) noexcept override {
+    return new StaticService::StaticHandler(
+      nullptr, mapFiles_, reader_.get());
+  }
+
+ private:
+  bool mapFiles_;
+  Reader readerType_;
+  folly::ThreadLocalPtr<AsyncFileReader> reader_;
+};
+
+double getCpuSeconds() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+    usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+// Bytes of body received before deadline
+uint64_t runClient(const folly::SocketAddress& addr,
+                   const std::string& path,
+                   TimePoint deadline) {
+  sockaddr_storage ss;
+  auto len = addr.getAddress(&ss);
+  int fd = socket(addr.getFamily(), SOCK_STREAM, 0);
+  PCHECK(fd >= 0);
+  PCHECK(connect(fd, (sockaddr*)&ss, len) == 0);
+  auto req = folly::to<std::string>("GET /", path, " HTTP/1.1\r\n",
+                                    "Host: localhost\r\n\r\n");
+  std::vector<char> buf(1024 * 1024);
+  uint64_t received = 0;
+  while (getCurrentTime() < deadline) {
+    CHECK_EQ(folly::writeFull(fd, req.data(), req.size()), req.size());
+    // Headers, then Content-Length bytes of body
+    std::string headers;
+    size_t headerEnd = std::string::npos;
+    while (headerEnd == std::string::npos) {
+      auto rc = read(fd, buf.data(), buf.size());
+      CHECK_GT(rc, 0);
+      headers.append(buf.data(), rc);
+      headerEnd = headers.find("\r\n\r\n");
+    }
+    auto clPos = headers.find("Content-Length: ");
+    CHECK_NE(clPos, std::string::npos);
+    auto remaining = folly::to<uint64_t>(headers.substr(
+        clPos + 16, headers.find("\r\n", clPos) - clPos - 16));
+    auto extra = headers.size() - headerEnd - 4;
+    received += extra;
+    remaining -= extra;
+    while (remaining > 0) {
+      auto rc = read(fd, buf.data(), std::min<uint64_t>(buf.size(), remaining));
+      CHECK_GT(rc, 0);
+      received += rc;
+      remaining -= rc;
+    }
+  }
+  close(fd);
+  return received;
+}
+
+void runMode(const char* name,
+             const std::string& path,
+             bool mapFiles,
+             Reader reader,
+             uint64_t zeroCopyThreshold) {
+  HTTPServer::IPConfig cfg{folly::SocketAddress("127.0.0.1", 0),
+                           HTTPServer::Protocol::HTTP};
+  HTTPServerOptions options;
+  options.threads = FLAGS_threads;
+  options.enableContentCompression = false;
+  options.zeroCopyEgressThreshold = zeroCopyThreshold;
+  options.handlerFactories.push_back(
+      std::make_unique<StaticHandlerFactory>(mapFiles, reader));
+  auto server = ScopedHTTPServer::start(cfg, std::move(options));
+  auto addr = server->getAddresses()[0].address;
+
+  std::vector<uint64_t> received(FLAGS_clients);
+  std::vector<std::thread> clients;
+  auto cpuStart = getCpuSeconds();
+  auto start = getCurrentTime();
+  auto deadline = start + std::chrono::milliseconds(FLAGS_duration_ms);
+  for (int i = 0; i < FLAGS_clients; i++) {
+    clients.emplace_back([&, i] {
+      received[i] = runClient(addr, path, deadline);
+    });
+  }
+  for (auto& client : clients) {
+    client.join();
+  }
+  auto elapsed = microsecondsBetween(getCurrentTime(), start);
+  auto cpu = getCpuSeconds() - cpuStart;
+
+  uint64_t total = 0;
+  for (auto bytes : received) {
+    total += bytes;
+  }
+  double gb = total / 1e9;
+  printf("mode=%-9s GB/s=%6.2f  cpu_s/GB=%6.3f\n",
+         name,
+         gb / (elapsed.count() / 1e6),
+         gb > 0 ? cpu / gb : 0.0);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  folly::init(&argc, &argv);
+  folly::setCPUExecutor(std::make_shared<folly::CPUThreadPoolExecutor>(
+      FLAGS_threads));
+
+  folly::test::TemporaryFile file;
+  std::string chunk(1024 * 1024, 'x');
+  for (int i = 0; i < FLAGS_file_size_mb; i++) {
+    CHECK_EQ(folly::writeFull(file.fd(), chunk.data(), chunk.size()),
+             chunk.size());
+  }
+  // Warm the page cache so every mode serves from memory
+  std::string contents;
+  folly::readFile(file.path().string().c_str(), contents);
+  contents.clear();
+
+  auto path = file.path().string();
+  runMode("read", path, false, Reader::NONE, 0);
+  runMode("pool", path, false, Reader::POOL, 0);
+  folly::EventBase evb;
+  if (IoUringFileReader::make(&evb, AsyncFileReader::Options())) {
+    runMode("uring", path, false, Reader::URING, 0);
+  }
+  runMode("map", path, true, Reader::NONE, 0);
+  runMode("zerocopy", path, true, Reader::NONE, FLAGS_zero_copy_threshold);
+  return 0;
+}
@@ -0,0 +1,242 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "proxygen/lib/healthcheck/ActiveHealthChecker.h"
+
+#include <algorithm>
+#include <folly/Random.h>
+
+namespace proxygen {
+
+namespace {
+
+// Doublings before a failing server's interval stops growing; maxBackoff
+// usually caps it long before
+constexpr uint32_t kMaxBackoffShift = 16;
+
+}
+
+ActiveHealthChecker::Server::Server(
+    ActiveHealthChecker& parent,
+    const std::string& name,
+    const folly::SocketAddress& address,
+    std::unique_ptr<Probe> probe,
+    std::shared_ptr<ServerHealthCheckerCallback> callback)
+    : parent_(parent),
+      name_(name),
+      address_(address),
+      probe_(std::move(probe)),
+      callback_(std::move(callback)) {
+  CHECK(probe_);
+  CHECK(callback_);
+}
+
+ActiveHealthChecker::Server::~Server() {
+  stop();
+}
+
+void ActiveHealthChecker::Server::schedule(std::chrono::milliseconds delay) {
+  cancelTimeout();
+  parent_.timer_->scheduleTimeout(this, delay);
+}
+
+void ActiveHealthChecker::Server::stop() {
+  cancelTimeout();
+  if (probing_) {
+    probing_ = false;
+    probe_->cancel();
+  }
+}
+
+void ActiveHealthChecker::Server::timeoutExpired() noexcept {
+  if (probing_) {
+    VLOG(4) << "Health check of " << name_ << " " << address_
+            << " timed out";
+    probing_ = false;
+    probe_->cancel();
+    parent_.timeouts_++;
+    failed(ServerDownInfo::HEALTHCHECK_TIMEOUT, "");
+    return;
+  }
+  runCheck();
+}
+
+void ActiveHealthChecker::Server::runCheck() {
+  const auto interval = parent_.options_.checkInterval;
+  if (timePointInitialized(lastExternalUpdate)) {
+    auto age = millisecondsBetween(getCurrentTime(), lastExternalUpdate);
+    if (age < interval) {
+      parent_.suppressed_++;
+      schedule(parent_.jittered(interval - age));
+      return;
+    }
+  }
+  parent_.probes_++;
+  probing_ = true;
+  // The probe may finish right away, which reschedules the server
+  schedule(parent_.options_.probeTimeout);
+  probe_->start(this);
+}
+
+void ActiveHealthChecker::Server::probeSuccess(
+    LoadType load,
+    const ServerLoadInfo* serverLoadInfo,
+    const ServerHealthCheckerCallback::ExtraInfo* extraInfo) noexcept {
+  if (!probing_) {
+    return;
+  }
+  probing_ = false;
+  consecutiveFailures_ = 0;
+  parent_.successes_++;
+  schedule(parent_.jittered(parent_.options_.checkInterval));
+  callback_->processHealthCheckSuccess(load, serverLoadInfo, extraInfo);
+}
+
+void ActiveHealthChecker::Server::probeError(
+    ServerDownInfo reason,
+    const std::string& extraReasonStr) noexcept {
+  if (!probing_) {
+    return;
+  }
+  probing_ = false;
+  failed(reason, extraReasonStr);
+}
+
+void ActiveHealthChecker::Server::failed(ServerDownInfo reason,
+                                         const std::string& extraReasonStr) {
+  VLOG(4) << "Health check of " << name_ << " " << address_ << " failed: "
+          << serverDownInfoStr(reason) << " " << extraReasonStr;
+  consecutiveFailures_++;
+  parent_.failures_++;
+  schedule(parent_.jittered(getBackoff()));
+  callback_->processHealthCheckFailure(reason, extraReasonStr);
+}
+
+std::chrono::milliseconds ActiveHealthChecker::Server::getBackoff() const {
+  const auto& options = parent_.options_;
+  // The first failure is retried at the normal interval
+  auto shift = std::min(consecutiveFailures_ - 1, kMaxBackoffShift);
+  auto backoff = options.checkInterval * (1 << shift);
+  return std::max(std::min(backoff, options.maxBackoff),
+                  options.checkInterval);
+}
+
+ActiveHealthChecker::ActiveHealthChecker(
+    folly::EventBase* evb,
+    std::unique_ptr<ProbeFactory> probeFactory,
+    Options options)
+    : evb_(CHECK_NOTNULL(evb)),
+      probeFactory_(std::move(probeFactory)),
+      options_(std::move(options)),
+      timer_(folly::HHWheelTimer::newTimer(
+          evb_,
+          options_.timerTick,
+          folly::TimeoutManager::InternalEnum::INTERNAL,
+          options_.probeTimeout)) {
+  CHECK(probeFactory_);
+  CHECK_GT(options_.checkInterval.count(), 0);
+  CHECK_GE(options_.jitter, 0);
+  CHECK_LT(options_.jitter, 1);
+}
+
+ActiveHealthChecker::~ActiveHealthChecker() {
+  evb_->dcheckIsInEventBaseThread();
+  *alive_ = false;
+  // Probes may still hold connections
+  servers_.clear();
+}
+
+void ActiveHealthChecker::start() {
+  runInEventBase([this] {
+    if (started_) {
+      return;
+    }
+    started_ = true;
+    for (auto& server : servers_) {
+      // Spread the first round over a whole interval
+      server.second->schedule(std::chrono::milliseconds(
+          folly::Random::rand64(options_.checkInterval.count())));
+    }
+  });
+}
+
+void ActiveHealthChecker::stop() {
+  runInEventBase([this] {
+    started_ = false;
+    for (auto& server : servers_) {
+      server.second->stop();
+    }
+  });
+}
+
+void ActiveHealthChecker::deleteAllCheckers() {
+  evb_->runImmediatelyOrRunInEventBaseThreadAndWait(
+      [this] { servers_.clear(); });
+}
+
+void ActiveHealthChecker::addServer(
+    const std::string& name,
+    const folly::SocketAddress& address,
+    bool isSecure,
+    std::shared_ptr<ServerHealthCheckerCallback> callback) {
+  runInEventBase([this, name, address, isSecure, cb = std::move(callback)] {
+    auto& server = servers_[address];
+    if (server) {
+      VLOG(2) << "Replacing health checker for " << address;
+      server.reset();
+    }
+    server = std::make_unique<Server>(
+        *this,
+        name,
+        address,
+        probeFactory_->createProbe(name, address, isSecure),
+        std::move(cb));
+    if (started_) {
+      server->schedule(std::chrono::milliseconds(
+          folly::Random::rand64(options_.checkInterval.count())));
+    }
+  });
+}
+
+void ActiveHealthChecker::removeServer(const folly::SocketAddress& address) {
+  runInEventBase([this, address] { servers_.erase(address); });
+}
+
+void ActiveHealthChecker::setLastExternalUpdateTime(
+    const folly::SocketAddress& serverAddress, TimePoint t) {
+  runInEventBase([this, serverAddress, t] {
+    auto it = servers_.find(serverAddress);
+    if (it != servers_.end()) {
+      it->second->lastExternalUpdate =
+          std::max(it->second->lastExternalUpdate, t);
+    }
+  });
+}
+
+ActiveHealthChecker::Stats ActiveHealthChecker::getStats() const {
+  Stats stats;
+  stats.probes = probes_.load(std::memory_order_relaxed);
+  stats.successes = successes_.load(std::memory_order_relaxed);
+  stats.failures = failures_.load(std::memory_order_relaxed);
+  stats.timeouts = timeouts_.load(std::memory_order_relaxed);
+  stats.suppressed = suppressed_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+std::chrono::milliseconds ActiveHealthChecker::jittered(
+    std::chrono::milliseconds delay) const {
+  if (options_.jitter <= 0) {
+    return delay;
+  }
+  return std::chrono::milliseconds(int64_t(
+      delay.count() *
+      (1 + folly::Random::randDouble(-options_.jitter, options_.jitter))));
+}
+
+} // namespace proxygen
@@ -0,0 +1,230 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <folly/io/async/EventBase.h>
+#include <folly/io/async/HHWheelTimer.h>
+#include <unordered_map>
+
+#include "proxygen/lib/healthcheck/PoolHealthChecker.h"
+
+namespace proxygen {
+
+/**
+ * PoolHealthChecker that probes every server from one EventBase thread.
+ *
+ * Each server's next check is a callback on a single HHWheelTimer, so
+ * scheduling costs the same whether there are ten servers or tens of
+ * thousands.  Servers are first checked at a random point within the check
+ * interval and each interval after that is jittered, so checks stay spread
+ * out instead of bunching up behind a start() or a bulk addServer().
+ *
+ * A failing server is checked less and less often, up to maxBackoff, and at
+ * the normal interval again once it passes.  A server whose
+ * setLastExternalUpdateTime() is more recent than one check interval is not
+ * probed at all; passive signals from real traffic are already vouching
+ * for it.
+ *
+ * What a check does is up to the ProbeFactory; see HealthCheckProbes.h for
+ * TCP connect and HTTP probes.  Server callbacks run in the EventBase
+ * thread.
+ */
+class ActiveHealthChecker : public PoolHealthChecker {
+ public:
+  /**
+   * Checks one server.  A Probe lives as long as its server is in the
+   * checker, so it can keep a connection open between checks.
+   */
+  class Probe {
+   public:
+    class Callback {
+     public:
+      virtual ~Callback() {
+      }
+      virtual void probeSuccess(
+          LoadType load,
+          const ServerLoadInfo* serverLoadInfo,
+          const ServerHealthCheckerCallback::ExtraInfo* extraInfo) noexcept = 0;
+      virtual void probeError(ServerDownInfo reason,
+                              const std::string& extraReasonStr) noexcept = 0;
+    };
+
+    /**
+     * Destroying a Probe cancels a check in flight without a callback.
+     */
+    virtual ~Probe() {
+    }
+
+    /**
+     * Start a check.  Exactly one callback follows, possibly before start()
+     * returns, unless cancel() is called first.
+     */
+    virtual void start(Callback* cb) = 0;
+
+    /**
+     * Abandon the check in flight, e.g. because it timed out.
+     */
+    virtual void cancel() = 0;
+  };
+
+  class ProbeFactory {
+   public:
+    virtual ~ProbeFactory() {
+    }
+    /**
+     * Called in the EventBase thread.
+     */
+    virtual std::unique_ptr<Probe> createProbe(
+        const std::string& name,
+        const folly::SocketAddress& address,
+        bool isSecure) = 0;
+  };
+
+  struct Options {
+    std::chrono::milliseconds checkInterval{std::chrono::seconds(5)};
+    // A check not done by then fails with HEALTHCHECK_TIMEOUT
+    std::chrono::milliseconds probeTimeout{std::chrono::seconds(1)};
+    // Fraction of each interval to randomize by, [0, 1)
+    double jitter{0.2};
+    // Longest interval between checks of a failing server
+    std::chrono::milliseconds maxBackoff{std::chrono::seconds(60)};
+    // Granularity of the wheel timer
+    std::chrono::milliseconds timerTick{
+        folly::HHWheelTimer::DEFAULT_TICK_INTERVAL};
+  };
+
+  struct Stats {
+    uint64_t probes{0};
+    uint64_t successes{0};
+    uint64_t failures{0};
+    uint64_t timeouts{0};
+    // Checks skipped because an external update was fresh
+    uint64_t suppressed{0};
+  };
+
+  /**
+   * Must be constructed and destroyed in evb's thread, and evb must outlive
+   * the checker.  Checks don't run until start().
+   */
+  ActiveHealthChecker(folly::EventBase* evb,
+                      std::unique_ptr<ProbeFactory> probeFactory,
+                      Options options);
+
+  ~ActiveHealthChecker() override;
+
+  // PoolHealthChecker
+  void start() override;
+  void stop() override;
+  void deleteAllCheckers() override;
+  void addServer(
+      const std::string& name,
+      const folly::SocketAddress& address,
+      bool isSecure,
+      std::shared_ptr<ServerHealthCheckerCallback> callback) override;
+  void removeServer(const folly::SocketAddress& address) override;
+  std::chrono::milliseconds getCheckInterval() const override {
+    return options_.checkInterval;
+  }
+  void setLastExternalUpdateTime(const folly::SocketAddress& serverAddress,
+                                 TimePoint t) override;
+
+  /**
+   * Can be called from any thread.
+   */
+  Stats getStats() const;
+
+  /**
+   * Servers currently in the checker.  EventBase thread only.
+   */
+  size_t getNumServers() const {
+    return servers_.size();
+  }
+
+ private:
+  class Server
+      : public folly::HHWheelTimer::Callback
+      , public Probe::Callback {
+   public:
+    Server(ActiveHealthChecker& parent,
+           const std::string& name,
+           const folly::SocketAddress& address,
+           std::unique_ptr<Probe> probe,
+           std::shared_ptr<ServerHealthCheckerCallback> callback);
+
+    ~Server() override;
+
+    void schedule(std::chrono::milliseconds delay);
+    void stop();
+
+    // HHWheelTimer::Callback
+    void timeoutExpired() noexcept override;
+    void callbackCanceled() noexcept override {
+    }
+
+    // Probe::Callback
+    void probeSuccess(LoadType load,
+                      const ServerLoadInfo* serverLoadInfo,
+                      const ServerHealthCheckerCallback::ExtraInfo*
+                          extraInfo) noexcept override;
+    void probeError(ServerDownInfo reason,
+                    const std::string& extraReasonStr) noexcept override;
+
+    TimePoint lastExternalUpdate;
+
+   private:
+    void runCheck();
+    void failed(ServerDownInfo reason, const std::string& extraReasonStr);
+    std::chrono::milliseconds getBackoff() const;
+
+    ActiveHealthChecker& parent_;
+    const std::string name_;
+    const folly::SocketAddress address_;
+    std::unique_ptr<Probe> probe_;
+    std::shared_ptr<ServerHealthCheckerCallback> callback_;
+    uint32_t consecutiveFailures_{0};
+    bool probing_{false};
+  };
+
+  std::chrono::milliseconds jittered(std::chrono::milliseconds delay) const;
+
+  /**
+   * Runs fn in the EventBase thread.  Even from that thread it is queued
+   * rather than run inline, so a server callback can remove its own server.
+   * Dropped if the checker is destroyed first.
+   */
+  template <typename F>
+  void runInEventBase(F&& fn) {
+    evb_->runInEventBaseThread(
+        [alive = alive_, fn = std::forward<F>(fn)]() mutable {
+          if (*alive) {
+            fn();
+          }
+        });
+  }
+
+  folly::EventBase* const evb_;
+  const std::unique_ptr<ProbeFactory> probeFactory_;
+  const Options options_;
+  folly::HHWheelTimer::UniquePtr timer_;
+  std::unordered_map<folly::SocketAddress, std::unique_ptr<Server>> servers_;
+  bool started_{false};
+  // Cleared by the destructor, for what runInEventBase() queued
+  const std::shared_ptr<bool> alive_{std::make_shared<bool>(true)};
+
+  std::atomic<uint64_t> probes_{0};
+  std::atomic<uint64_t> successes_{0};
+  std::atomic<uint64_t> failures_{0};
+  std::atomic<uint64_t> timeouts_{0};
+  std::atomic<uint64_t> suppressed_{0};
+};
+
+} // namespace proxygen
@@ -0,0 +1,287 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "proxygen/lib/healthcheck/HealthCheckProbes.h"
+
+#include <folly/Conv.h>
+#include <proxygen/lib/http/HTTPMessage.h>
+#include <proxygen/lib/http/session/HTTPUpstreamSession.h>
+
+namespace proxygen {
+
+namespace {
+
+class TCPConnectProbe
+    : public ActiveHealthChecker::Probe
+    , private folly::AsyncSocket::ConnectCallback {
+ public:
+  TCPConnectProbe(folly::EventBase* evb, const folly::SocketAddress& address)
+      : evb_(evb), address_(address) {
+  }
+
+  ~TCPConnectProbe() override {
+    cancel();
+  }
+
+  void start(Callback* cb) override {
+    CHECK(!cb_);
+    cb_ = cb;
+    socket_.reset(new folly::AsyncSocket(evb_));
+    socket_->connect(this, address_);
+  }
+
+  void cancel() override {
+    cb_ = nullptr;
+    // Closing a connecting socket calls connectErr(), now a no-op
+    socket_.reset();
+  }
+
+ private:
+  void connectSuccess() noexcept override {
+    auto cb = cb_;
+    cancel();
+    if (cb) {
+      cb->probeSuccess(0, nullptr, nullptr);
+    }
+  }
+
+  void connectErr(const folly::AsyncSocketException& ex) noexcept override {
+    auto cb = cb_;
+    cancel();
+    if (cb) {
+      cb->probeError(ServerDownInfo::HEALTHCHECK_CONNECT_ERROR, ex.what());
+    }
+  }
+
+  folly::EventBase* const evb_;
+  const folly::SocketAddress address_;
+  folly::AsyncSocket::UniquePtr socket_;
+  Callback* cb_{nullptr};
+};
+
+ServerDownInfo getServerDownInfo(const HTTPException& error) {
+  switch (error.getProxygenError()) {
+    case kErrorEOF:
+    case kErrorConnectionReset:
+      return ServerDownInfo::HEALTHCHECK_EOF;
+    case kErrorWrite:
+    case kErrorWriteTimeout:
+      return ServerDownInfo::HEALTHCHECK_WRITE_ERROR;
+    case kErrorTimeout:
+      return ServerDownInfo::HEALTHCHECK_TIMEOUT;
+    default:
+      return ServerDownInfo::HEALTHCHECK_MESSAGE_ERROR;
+  }
+}
+
+}
+
+std::unique_ptr<ActiveHealthChecker::Probe>
+TCPConnectProbeFactory::createProbe(const std::string& /*name*/,
+                                    const folly::SocketAddress& address,
+                                    bool /*isSecure*/) {
+  return std::make_unique<TCPConnectProbe>(evb_, address);
+}
+
+class HTTPProbeFactory::HTTPProbe
+    : public ActiveHealthChecker::Probe
+    , private HTTPConnector::Callback
+    , private HTTPTransactionHandler {
+ public:
+  HTTPProbe(HTTPProbeFactory& factory,
+            const std::string& name,
+            const folly::SocketAddress& address,
+            bool isSecure)
+      : factory_(factory),
+        address_(address),
+        host_(factory.options_.host.empty() ? name : factory.options_.host),
+        isSecure_(isSecure),
+        pool_(nullptr, 1, factory.options_.keepAliveTimeout),
+        connector_(this, factory.timer_.get()) {
+  }
+
+  ~HTTPProbe() override {
+    cancel();
+  }
+
+  void start(Callback* cb) override {
+    CHECK(!cb_);
+    cb_ = cb;
+    status_ = 0;
+    load_ = 0;
+    responseStarted_ = false;
+    reused_ = pool_.getTransaction(this);
+    if (reused_) {
+      factory_.stats_.reuses++;
+      sendRequest();
+      return;
+    }
+    connect();
+  }
+
+  void cancel() override {
+    cb_ = nullptr;
+    connector_.reset();
+    if (txn_) {
+      // Whatever is still coming on this connection is of no use to the
+      // next check
+      txn_->sendAbort();
+    }
+  }
+
+ private:
+  void connect() {
+    auto& options = factory_.options_;
+    factory_.stats_.connects++;
+    if (!isSecure_) {
+      connector_.connect(factory_.evb_, address_, options.connectTimeout);
+    } else if (options.sslContext) {
+      connector_.connectSSL(factory_.evb_,
+                            address_,
+                            options.sslContext,
+                            nullptr,
+                            options.connectTimeout,
+                            folly::AsyncSocket::emptyOptionMap,
+                            folly::AsyncSocket::anyAddress(),
+                            host_);
+    } else {
+      fail(ServerDownInfo::HEALTHCHECK_CONNECT_ERROR, "no SSL context");
+    }
+  }
+
+  void sendRequest() {
+    CHECK(txn_);
+    HTTPMessage req;
+    req.setMethod(HTTPMethod::GET);
+    req.setURL(factory_.options_.path);
+    req.setHTTPVersion(1, 1);
+    req.getHeaders().set(HTTP_HEADER_HOST, host_);
+    txn_->sendHeaders(req);
+    txn_->sendEOM();
+  }
+
+  void succeed() {
+    auto cb = cb_;
+    cb_ = nullptr;
+    if (cb) {
+      cb->probeSuccess(load_, nullptr, nullptr);
+    }
+  }
+
+  void fail(ServerDownInfo reason, const std::string& extraReasonStr) {
+    auto cb = cb_;
+    cb_ = nullptr;
+    if (cb) {
+      cb->probeError(reason, extraReasonStr);
+    }
+  }
+
+  // HTTPConnector::Callback
+  void connectSuccess(HTTPUpstreamSession* session) override {
+    pool_.putSession(session);
+    if (!pool_.getTransaction(this)) {
+      fail(ServerDownInfo::HEALTHCHECK_UNKNOWN_ERROR, "no transaction");
+      return;
+    }
+    sendRequest();
+  }
+
+  void connectError(const folly::AsyncSocketException& ex) override {
+    fail(ServerDownInfo::HEALTHCHECK_CONNECT_ERROR, ex.what());
+  }
+
+  // HTTPTransactionHandler
+  void setTransaction(HTTPTransaction* txn) noexcept override {
+    txn_ = txn;
+  }
+
+  void detachTransaction() noexcept override {
+    txn_ = nullptr;
+  }
+
+  void onHeadersComplete(std::unique_ptr<HTTPMessage> msg) noexcept override {
+    responseStarted_ = true;
+    status_ = msg->getStatusCode();
+    const auto& loadHeader = factory_.options_.loadHeader;
+    if (!loadHeader.empty()) {
+      load_ = folly::tryTo<LoadType>(
+        msg->getHeaders().getSingleOrEmpty(loadHeader)).value_or(0);
+    }
+  }
+
+  void onBody(std::unique_ptr<folly::IOBuf>) noexcept override {
+  }
+
+  void onTrailers(std::unique_ptr<HTTPHeaders>) noexcept override {
+  }
+
+  void onEOM() noexcept override {
+    if (status_ == 200) {
+      succeed();
+    } else {
+      fail(ServerDownInfo::HEALTHCHECK_NON200_STATUS,
+           folly::to<std::string>(status_));
+    }
+  }
+
+  void onUpgrade(UpgradeProtocol) noexcept override {
+    fail(ServerDownInfo::HEALTHCHECK_UPGRADE_ERROR, "");
+  }
+
+  void onError(const HTTPException& error) noexcept override {
+    if (cb_ && reused_ && !responseStarted_) {
+      VLOG(4) << "Health check of " << address_ << " failed on a reused "
+              << "connection, retrying on a new one: " << error.what();
+      reused_ = false;
+      factory_.stats_.retries++;
+      connect();
+      return;
+    }
+    fail(getServerDownInfo(error), error.what());
+  }
+
+  void onEgressPaused() noexcept override {
+  }
+
+  void onEgressResumed() noexcept override {
+  }
+
+  HTTPProbeFactory& factory_;
+  const folly::SocketAddress address_;
+  const std::string host_;
+  const bool isSecure_;
+  SessionPool pool_;
+  HTTPConnector connector_;
+  HTTPTransaction* txn_{nullptr};
+  Callback* cb_{nullptr};
+  uint16_t status_{0};
+  LoadType load_{0};
+  // Whether this check went out on a pooled connection
+  bool reused_{false};
+  bool responseStarted_{false};
+};
+
+HTTPProbeFactory::HTTPProbeFactory(folly::EventBase* evb, Options options)
+    : evb_(CHECK_NOTNULL(evb)),
+      options_(std::move(options)),
+      timer_(folly::HHWheelTimer::newTimer(
+          evb_,
+          std::chrono::milliseconds(folly::HHWheelTimer::DEFAULT_TICK_INTERVAL),
+          folly::TimeoutManager::InternalEnum::INTERNAL,
+          options_.keepAliveTimeout)) {
+}
+
+std::unique_ptr<ActiveHealthChecker::Probe> HTTPProbeFactory::createProbe(
+    const std::string& name,
+    const folly::SocketAddress& address,
+    bool isSecure) {
+  return std::make_unique<HTTPProbe>(*this, name, address, isSecure);
+}
+
+} // namespace proxygen
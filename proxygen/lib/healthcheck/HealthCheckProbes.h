@@ -0,0 +1,101 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/io/async/AsyncSocket.h>
+#include <folly/io/async/SSLContext.h>
+#include <proxygen/lib/http/HTTPConnector.h>
+#include <proxygen/lib/http/connpool/SessionPool.h>
+
+#include "proxygen/lib/healthcheck/ActiveHealthChecker.h"
+
+namespace proxygen {
+
+/**
+ * Passes a server that accepts a TCP connection, which is closed again
+ * right away.
+ */
+class TCPConnectProbeFactory : public ActiveHealthChecker::ProbeFactory {
+ public:
+  explicit TCPConnectProbeFactory(folly::EventBase* evb) : evb_(evb) {
+  }
+
+  std::unique_ptr<ActiveHealthChecker::Probe> createProbe(
+      const std::string& name,
+      const folly::SocketAddress& address,
+      bool isSecure) override;
+
+ private:
+  folly::EventBase* const evb_;
+};
+
+/**
+ * Passes a server that answers a GET with a 200.
+ *
+ * Each server's probe keeps its connection in a SessionPool of one, so
+ * checks reuse a keep-alive connection rather than each paying for a
+ * connect and, for secure servers, a handshake.  A check that fails or
+ * times out aborts its transaction and with it the connection; the next
+ * check connects afresh.
+ *
+ * The server may close a keep-alive connection just as a check goes out on
+ * it, which says nothing about its health.  So a check that fails on a
+ * reused connection before any of the response arrives is tried once more
+ * on a new connection, and only that result is reported.
+ */
+class HTTPProbeFactory : public ActiveHealthChecker::ProbeFactory {
+ public:
+  struct Options {
+    std::string path{"/"};
+    // Host header; the server's name if empty
+    std::string host;
+    // How long a probe connection is kept between checks.  Must exceed the
+    // check interval for connections to be reused.
+    std::chrono::milliseconds keepAliveTimeout{std::chrono::seconds(15)};
+    std::chrono::milliseconds connectTimeout{std::chrono::seconds(1)};
+    // Response header holding the server's load, if any
+    std::string loadHeader;
+    // Needed to check secure servers
+    folly::SSLContextPtr sslContext;
+  };
+
+  struct Stats {
+    uint64_t connects{0};
+    // Checks sent on a pooled connection
+    uint64_t reuses{0};
+    // Checks tried again after failing on a pooled connection
+    uint64_t retries{0};
+  };
+
+  HTTPProbeFactory(folly::EventBase* evb, Options options);
+
+  std::unique_ptr<ActiveHealthChecker::Probe> createProbe(
+      const std::string& name,
+      const folly::SocketAddress& address,
+      bool isSecure) override;
+
+  /**
+   * EventBase thread only.
+   */
+  const Stats& getStats() const {
+    return stats_;
+  }
+
+ private:
+  class HTTPProbe;
+
+  folly::EventBase* const evb_;
+  const Options options_;
+  // For the probes' HTTPConnectors and sessions
+  folly::HHWheelTimer::UniquePtr timer_;
+  Stats stats_;
+};
+
+} // namespace proxygen
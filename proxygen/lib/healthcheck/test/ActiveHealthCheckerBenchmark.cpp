@@ -0,0 +1,177 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Conv.h>
+#include <folly/init/Init.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/io/async/ScopedEventBaseThread.h>
+#include <gflags/gflags.h>
+#include <sys/resource.h>
+
+#include "proxygen/lib/healthcheck/ActiveHealthChecker.h"
+#include "proxygen/lib/healthcheck/HealthCheckProbes.h"
+#include "proxygen/lib/healthcheck/test/StandInServer.h"
+
+// Cost of checking many servers from one ActiveHealthChecker thread.
+//
+// --servers distinct addresses, 127.0.x.y on one port, are all answered by a
+// StandInServer on its own thread, so only the checker's side is measured.
+// --probe picks what a check does:
+//   fake  completes at once; the cost of scheduling alone
+//   tcp   connects and closes
+//   http  GET over a pooled keep-alive connection
+// http keeps a connection open per server, so raise `ulimit -n` above twice
+// --servers first.
+//
+// ./active_health_checker_benchmark --servers=10000 --interval_ms=1000 \
+//     --probe=http --seconds=30
+//
+// Prints the checker's totals and CPU use, e.g.
+//   probe=http servers=10000 probes/s=... successes=... failures=...
+//   timeouts=... cpu=...% connects=... reuses=...
+// where cpu is the checker thread's user+system time over wall time.
+
+DEFINE_int32(servers, 1000, "Number of servers to check");
+DEFINE_int32(interval_ms, 1000, "Check interval");
+DEFINE_int32(timeout_ms, 500, "Probe timeout");
+DEFINE_string(probe, "fake", "fake, tcp or http");
+DEFINE_int32(seconds, 10, "How long to run the checks");
+
+using namespace proxygen;
+using namespace std::chrono;
+
+namespace {
+
+class SucceedingProbeFactory : public ActiveHealthChecker::ProbeFactory {
+ public:
+  std::unique_ptr<ActiveHealthChecker::Probe> createProbe(
+      const std::string& /*name*/,
+      const folly::SocketAddress& /*address*/,
+      bool /*isSecure*/) override {
+    return std::make_unique<SucceedingProbe>();
+  }
+
+ private:
+  class SucceedingProbe : public ActiveHealthChecker::Probe {
+   public:
+    void start(Callback* cb) override {
+      cb->probeSuccess(0, nullptr, nullptr);
+    }
+
+    void cancel() override {
+    }
+  };
+};
+
+class NullCallback : public ServerHealthCheckerCallback {
+ public:
+  void processHealthCheckFailure(ServerDownInfo /*reason*/,
+                                 const std::string& /*extraReasonStr*/,
+                                 HealthCheckSource /*source*/) override {
+  }
+
+  void processHealthCheckSuccess(LoadType /*load*/,
+                                 const ServerLoadInfo* /*serverLoadInfo*/,
+                                 const ExtraInfo* /*extraInfo*/,
+                                 HealthCheckSource /*source*/) override {
+  }
+};
+
+microseconds getThreadCPUTime() {
+  struct rusage usage;
+  CHECK_EQ(getrusage(RUSAGE_THREAD, &usage), 0);
+  return seconds(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+         microseconds(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+}
+
+}
+
+int main(int argc, char** argv) {
+  folly::init(&argc, &argv);
+  CHECK_GT(FLAGS_servers, 0);
+  CHECK_LE(FLAGS_servers, 250 * 256);
+
+  folly::ScopedEventBaseThread serverThread;
+  std::unique_ptr<StandInServer> server;
+  uint16_t port = 0;
+  serverThread.getEventBase()->runInEventBaseThreadAndWait([&] {
+    server = std::make_unique<StandInServer>(
+        serverThread.getEventBase(), StandInServer::kOK, "0.0.0.0");
+    port = server->getAddress().getPort();
+  });
+
+  folly::EventBase evb;
+  std::unique_ptr<ActiveHealthChecker::ProbeFactory> factory;
+  HTTPProbeFactory* httpFactory = nullptr;
+  if (FLAGS_probe == "http") {
+    HTTPProbeFactory::Options probeOptions;
+    probeOptions.keepAliveTimeout = milliseconds(FLAGS_interval_ms * 3);
+    probeOptions.connectTimeout = milliseconds(FLAGS_timeout_ms);
+    auto http = std::make_unique<HTTPProbeFactory>(&evb, probeOptions);
+    httpFactory = http.get();
+    factory = std::move(http);
+  } else if (FLAGS_probe == "tcp") {
+    factory = std::make_unique<TCPConnectProbeFactory>(&evb);
+  } else {
+    CHECK_EQ(FLAGS_probe, "fake");
+    factory = std::make_unique<SucceedingProbeFactory>();
+  }
+
+  ActiveHealthChecker::Options options;
+  options.checkInterval = milliseconds(FLAGS_interval_ms);
+  options.probeTimeout = milliseconds(FLAGS_timeout_ms);
+  auto checker = std::make_unique<ActiveHealthChecker>(
+      &evb, std::move(factory), options);
+  auto callback = std::make_shared<NullCallback>();
+  for (int i = 0; i < FLAGS_servers; i++) {
+    auto host = folly::to<std::string>("127.0.", i / 250, ".", i % 250 + 1);
+    checker->addServer(
+        host, folly::SocketAddress(host, port), false, callback);
+  }
+  checker->start();
+
+  // Let the first round, spread over one interval, get going before
+  // measuring
+  ActiveHealthChecker::Stats before;
+  microseconds cpuBefore;
+  auto wallBefore = steady_clock::now();
+  evb.runAfterDelay(
+      [&] {
+        before = checker->getStats();
+        cpuBefore = getThreadCPUTime();
+        wallBefore = steady_clock::now();
+      },
+      FLAGS_interval_ms);
+  evb.runAfterDelay(
+      [&] { evb.terminateLoopSoon(); },
+      FLAGS_interval_ms + FLAGS_seconds * 1000);
+  evb.loopForever();
+
+  auto after = checker->getStats();
+  auto cpu = getThreadCPUTime() - cpuBefore;
+  auto wall = duration_cast<microseconds>(steady_clock::now() - wallBefore);
+
+  LOG(INFO) << "probe=" << FLAGS_probe << " servers=" << FLAGS_servers
+            << " probes/s="
+            << (after.probes - before.probes) * 1e6 / wall.count()
+            << " successes=" << after.successes - before.successes
+            << " failures=" << after.failures - before.failures
+            << " timeouts=" << after.timeouts - before.timeouts
+            << " cpu=" << 100.0 * cpu.count() / wall.count() << "%";
+  if (httpFactory) {
+    LOG(INFO) << "connects=" << httpFactory->getStats().connects
+              << " reuses=" << httpFactory->getStats().reuses;
+  }
+
+  checker.reset();
+  evb.loop();
+  serverThread.getEventBase()->runInEventBaseThreadAndWait(
+      [&] { server.reset(); });
+  return 0;
+}
@@ -0,0 +1,409 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/io/async/EventBase.h>
+#include <folly/portability/GTest.h>
+#include <functional>
+#include <map>
+
+#include "proxygen/lib/healthcheck/ActiveHealthChecker.h"
+#include "proxygen/lib/healthcheck/HealthCheckProbes.h"
+#include "proxygen/lib/healthcheck/test/StandInServer.h"
+
+using namespace proxygen;
+using namespace std::chrono;
+
+namespace {
+
+/**
+ * Completes checks the way the test says, and counts what the checker does
+ * with its probes.
+ */
+class FakeProbeFactory : public ActiveHealthChecker::ProbeFactory {
+ public:
+  enum class Mode { SUCCEED, FAIL, HANG };
+
+  struct Log {
+    uint32_t created{0};
+    uint32_t destroyed{0};
+    uint32_t starts{0};
+    uint32_t cancels{0};
+    std::vector<TimePoint> startTimes;
+  };
+
+  std::unique_ptr<ActiveHealthChecker::Probe> createProbe(
+      const std::string& /*name*/,
+      const folly::SocketAddress& address,
+      bool /*isSecure*/) override {
+    return std::make_unique<FakeProbe>(*this, logs[address]);
+  }
+
+  Mode mode{Mode::SUCCEED};
+  std::map<folly::SocketAddress, Log> logs;
+
+ private:
+  class FakeProbe : public ActiveHealthChecker::Probe {
+   public:
+    FakeProbe(FakeProbeFactory& factory, Log& log)
+        : factory_(factory), log_(log) {
+      log_.created++;
+    }
+
+    ~FakeProbe() override {
+      log_.destroyed++;
+    }
+
+    void start(Callback* cb) override {
+      log_.starts++;
+      log_.startTimes.push_back(getCurrentTime());
+      switch (factory_.mode) {
+        case Mode::SUCCEED:
+          cb->probeSuccess(0, nullptr, nullptr);
+          break;
+        case Mode::FAIL:
+          cb->probeError(ServerDownInfo::HEALTHCHECK_CONNECT_ERROR, "refused");
+          break;
+        case Mode::HANG:
+          break;
+      }
+    }
+
+    void cancel() override {
+      log_.cancels++;
+    }
+
+   private:
+    FakeProbeFactory& factory_;
+    Log& log_;
+  };
+};
+
+class RecordingCallback : public ServerHealthCheckerCallback {
+ public:
+  void processHealthCheckFailure(ServerDownInfo reason,
+                                 const std::string& extraReasonStr,
+                                 HealthCheckSource /*source*/) override {
+    failures++;
+    lastReason = reason;
+    lastReasonStr = extraReasonStr;
+    if (onResult) {
+      onResult();
+    }
+  }
+
+  void processHealthCheckSuccess(LoadType load,
+                                 const ServerLoadInfo* /*serverLoadInfo*/,
+                                 const ExtraInfo* /*extraInfo*/,
+                                 HealthCheckSource /*source*/) override {
+    successes++;
+    lastLoad = load;
+    if (onResult) {
+      onResult();
+    }
+  }
+
+  uint32_t successes{0};
+  uint32_t failures{0};
+  ServerDownInfo lastReason{ServerDownInfo::NONE};
+  std::string lastReasonStr;
+  LoadType lastLoad{0};
+  std::function<void()> onResult;
+};
+
+folly::SocketAddress makeAddress(uint16_t i) {
+  return folly::SocketAddress("10.0.0.1", 8000 + i);
+}
+
+} // namespace
+
+class ActiveHealthCheckerTest : public testing::Test {
+ protected:
+  ActiveHealthChecker::Options makeOptions(milliseconds interval) {
+    ActiveHealthChecker::Options options;
+    options.checkInterval = interval;
+    options.probeTimeout = interval / 2;
+    options.maxBackoff = interval * 8;
+    options.timerTick = milliseconds(1);
+    return options;
+  }
+
+  void makeChecker(ActiveHealthChecker::Options options) {
+    auto factory = std::make_unique<FakeProbeFactory>();
+    factory_ = factory.get();
+    checker_ = std::make_unique<ActiveHealthChecker>(
+        &evb_, std::move(factory), options);
+  }
+
+  std::shared_ptr<RecordingCallback> addServer(
+      const folly::SocketAddress& address) {
+    auto cb = std::make_shared<RecordingCallback>();
+    checker_->addServer("server", address, false, cb);
+    return cb;
+  }
+
+  void runFor(milliseconds duration) {
+    evb_.runAfterDelay([this] { evb_.terminateLoopSoon(); },
+                       duration.count());
+    evb_.loopForever();
+  }
+
+  void TearDown() override {
+    if (checker_) {
+      checker_->deleteAllCheckers();
+      checker_.reset();
+    }
+  }
+
+  folly::EventBase evb_;
+  FakeProbeFactory* factory_{nullptr};
+  std::unique_ptr<ActiveHealthChecker> checker_;
+};
+
+TEST_F(ActiveHealthCheckerTest, ChecksRepeatAtInterval) {
+  makeChecker(makeOptions(milliseconds(40)));
+  std::vector<std::shared_ptr<RecordingCallback>> cbs;
+  for (uint16_t i = 0; i < 10; ++i) {
+    cbs.push_back(addServer(makeAddress(i)));
+  }
+  // Nothing is checked before start()
+  runFor(milliseconds(100));
+  EXPECT_EQ(checker_->getNumServers(), 10);
+  EXPECT_EQ(checker_->getStats().probes, 0);
+
+  checker_->start();
+  runFor(milliseconds(410));
+  uint32_t total = 0;
+  for (auto& cb : cbs) {
+    // About ten each, give or take jitter and a slow test machine
+    EXPECT_GE(cb->successes, 6);
+    EXPECT_LE(cb->successes, 14);
+    EXPECT_EQ(cb->failures, 0);
+    total += cb->successes;
+  }
+  EXPECT_EQ(checker_->getStats().probes, total);
+  EXPECT_EQ(checker_->getStats().successes, total);
+
+  checker_->stop();
+  runFor(milliseconds(10));
+  auto stopped = checker_->getStats().probes;
+  runFor(milliseconds(100));
+  EXPECT_EQ(checker_->getStats().probes, stopped);
+}
+
+TEST_F(ActiveHealthCheckerTest, FirstRoundIsSpreadOut) {
+  makeChecker(makeOptions(milliseconds(200)));
+  for (uint16_t i = 0; i < 50; ++i) {
+    addServer(makeAddress(i));
+  }
+  auto start = getCurrentTime();
+  checker_->start();
+  runFor(milliseconds(150));
+  TimePoint first = TimePoint::max();
+  TimePoint last = start;
+  uint32_t started = 0;
+  for (auto& log : factory_->logs) {
+    for (auto t : log.second.startTimes) {
+      first = std::min(first, t);
+      last = std::max(last, t);
+      started++;
+    }
+  }
+  // Spread over the interval rather than all at once
+  EXPECT_GT(started, 10);
+  EXPECT_LT(started, 50);
+  EXPECT_GT(millisecondsBetween(last, first).count(), 50);
+}
+
+TEST_F(ActiveHealthCheckerTest, FailingServerBacksOff) {
+  auto options = makeOptions(milliseconds(20));
+  options.jitter = 0;
+  makeChecker(options);
+  factory_->mode = FakeProbeFactory::Mode::FAIL;
+  auto cb = addServer(makeAddress(0));
+  checker_->start();
+  // Checks at most 20ms in, then 20, 40, 80, 160 and 160ms apart: about 6,
+  // where a fixed interval would make 25
+  runFor(milliseconds(500));
+  EXPECT_GE(cb->failures, 4);
+  EXPECT_LE(cb->failures, 8);
+  EXPECT_EQ(cb->successes, 0);
+  EXPECT_EQ(cb->lastReason, ServerDownInfo::HEALTHCHECK_CONNECT_ERROR);
+  EXPECT_EQ(cb->lastReasonStr, "refused");
+
+  // One success and it is back to the normal interval
+  factory_->mode = FakeProbeFactory::Mode::SUCCEED;
+  runFor(milliseconds(400));
+  EXPECT_GE(cb->successes, 8);
+}
+
+TEST_F(ActiveHealthCheckerTest, TimeoutCancelsProbe) {
+  makeChecker(makeOptions(milliseconds(40)));
+  factory_->mode = FakeProbeFactory::Mode::HANG;
+  auto cb = addServer(makeAddress(0));
+  checker_->start();
+  runFor(milliseconds(150));
+  auto& log = factory_->logs[makeAddress(0)];
+  ASSERT_GE(cb->failures, 1);
+  EXPECT_EQ(cb->lastReason, ServerDownInfo::HEALTHCHECK_TIMEOUT);
+  EXPECT_EQ(checker_->getStats().timeouts, cb->failures);
+  // Each timed out probe was cancelled; one may still be in flight
+  EXPECT_EQ(log.cancels, cb->failures);
+  EXPECT_LE(log.starts - log.cancels, 1);
+}
+
+TEST_F(ActiveHealthCheckerTest, FreshExternalUpdateSuppressesProbes) {
+  makeChecker(makeOptions(milliseconds(30)));
+  auto address = makeAddress(0);
+  auto cb = addServer(address);
+  bool refresh = true;
+  std::function<void()> update = [&] {
+    if (refresh) {
+      checker_->setLastExternalUpdateTime(address, getCurrentTime());
+      evb_.runAfterDelay(update, 10);
+    }
+  };
+  update();
+  checker_->start();
+  runFor(milliseconds(200));
+  EXPECT_EQ(factory_->logs[address].starts, 0);
+  EXPECT_GT(checker_->getStats().suppressed, 0);
+
+  // Once passive signals go quiet, active checks resume
+  refresh = false;
+  runFor(milliseconds(150));
+  EXPECT_GT(cb->successes, 0);
+}
+
+TEST_F(ActiveHealthCheckerTest, RemoveServer) {
+  makeChecker(makeOptions(milliseconds(20)));
+  auto kept = addServer(makeAddress(0));
+  auto removed = addServer(makeAddress(1));
+  // A server can be removed from its own callback
+  removed->onResult = [this] { checker_->removeServer(makeAddress(1)); };
+  checker_->start();
+  runFor(milliseconds(200));
+  EXPECT_EQ(removed->successes, 1);
+  EXPECT_GT(kept->successes, 1);
+  EXPECT_EQ(checker_->getNumServers(), 1);
+  EXPECT_EQ(factory_->logs[makeAddress(1)].destroyed, 1);
+
+  checker_->deleteAllCheckers();
+  EXPECT_EQ(checker_->getNumServers(), 0);
+  EXPECT_EQ(factory_->logs[makeAddress(0)].destroyed, 1);
+}
+
+TEST_F(ActiveHealthCheckerTest, DestroyedWithQueuedCalls) {
+  makeChecker(makeOptions(milliseconds(20)));
+  auto cb = addServer(makeAddress(0));
+  checker_->start();
+  checker_->setLastExternalUpdateTime(makeAddress(0), getCurrentTime());
+  checker_->removeServer(makeAddress(0));
+  checker_->stop();
+  checker_.reset();
+  // What was queued finds the checker gone, and is dropped without doing
+  // anything
+  runFor(milliseconds(50));
+  EXPECT_EQ(cb->successes, 0);
+  EXPECT_EQ(cb.use_count(), 1);
+}
+
+TEST_F(ActiveHealthCheckerTest, HTTPProbeReusesConnection) {
+  StandInServer server(&evb_);
+  HTTPProbeFactory::Options probeOptions;
+  probeOptions.path = "/status";
+  auto factory = std::make_unique<HTTPProbeFactory>(&evb_, probeOptions);
+  auto httpFactory = factory.get();
+  checker_ = std::make_unique<ActiveHealthChecker>(
+      &evb_, std::move(factory), makeOptions(milliseconds(20)));
+  auto cb = addServer(server.getAddress());
+  checker_->start();
+  runFor(milliseconds(250));
+  EXPECT_GE(cb->successes, 5);
+  EXPECT_EQ(cb->failures, 0);
+  // Every check after the first went out on the same connection
+  EXPECT_EQ(server.getNumConnections(), 1);
+  EXPECT_EQ(httpFactory->getStats().connects, 1);
+  EXPECT_GE(httpFactory->getStats().reuses, 4);
+  EXPECT_GE(server.getNumRequests(), cb->successes);
+}
+
+TEST_F(ActiveHealthCheckerTest, HTTPProbeRetriesClosedConnection) {
+  StandInServer server(&evb_);
+  server.setCloseReusedConnections(true);
+  auto factory =
+      std::make_unique<HTTPProbeFactory>(&evb_, HTTPProbeFactory::Options());
+  auto httpFactory = factory.get();
+  checker_ = std::make_unique<ActiveHealthChecker>(
+      &evb_, std::move(factory), makeOptions(milliseconds(20)));
+  auto cb = addServer(server.getAddress());
+  checker_->start();
+  runFor(milliseconds(250));
+  // Each reused connection is closed on the check, which passes on a new
+  // one
+  EXPECT_GE(cb->successes, 5);
+  EXPECT_EQ(cb->failures, 0);
+  const auto& stats = httpFactory->getStats();
+  EXPECT_GE(stats.retries, 4);
+  // One check may still be waiting on the server
+  EXPECT_LE(stats.reuses - stats.retries, 1);
+  EXPECT_EQ(stats.connects, stats.retries + 1);
+
+  // A server that fails the retry as well is reported down
+  server.setResponse("HTTP/1.1 500 Error\r\nContent-Length: 0\r\n\r\n");
+  runFor(milliseconds(100));
+  EXPECT_GE(cb->failures, 1);
+  EXPECT_EQ(cb->lastReason, ServerDownInfo::HEALTHCHECK_NON200_STATUS);
+}
+
+TEST_F(ActiveHealthCheckerTest, HTTPProbeStatusAndLoad) {
+  StandInServer server(
+      &evb_, "HTTP/1.1 503 Unavailable\r\nContent-Length: 0\r\n\r\n");
+  HTTPProbeFactory::Options probeOptions;
+  probeOptions.loadHeader = "X-Load";
+  checker_ = std::make_unique<ActiveHealthChecker>(
+      &evb_,
+      std::make_unique<HTTPProbeFactory>(&evb_, probeOptions),
+      makeOptions(milliseconds(20)));
+  auto cb = addServer(server.getAddress());
+  checker_->start();
+  runFor(milliseconds(100));
+  ASSERT_GE(cb->failures, 1);
+  EXPECT_EQ(cb->lastReason, ServerDownInfo::HEALTHCHECK_NON200_STATUS);
+  EXPECT_EQ(cb->lastReasonStr, "503");
+
+  server.setResponse(
+      "HTTP/1.1 200 OK\r\nX-Load: 7\r\nContent-Length: 0\r\n\r\n");
+  // Back off from the failures first
+  runFor(milliseconds(400));
+  ASSERT_GE(cb->successes, 1);
+  EXPECT_EQ(cb->lastLoad, 7);
+}
+
+TEST_F(ActiveHealthCheckerTest, TCPProbe) {
+  StandInServer server(&evb_);
+  folly::SocketAddress closed;
+  {
+    StandInServer gone(&evb_);
+    closed = gone.getAddress();
+  }
+  checker_ = std::make_unique<ActiveHealthChecker>(
+      &evb_,
+      std::make_unique<TCPConnectProbeFactory>(&evb_),
+      makeOptions(milliseconds(20)));
+  auto up = addServer(server.getAddress());
+  auto down = addServer(closed);
+  checker_->start();
+  runFor(milliseconds(100));
+  EXPECT_GE(up->successes, 2);
+  EXPECT_EQ(up->failures, 0);
+  EXPECT_GE(server.getNumConnections(), up->successes);
+  EXPECT_GE(down->failures, 1);
+  EXPECT_EQ(down->successes, 0);
+  EXPECT_EQ(down->lastReason, ServerDownInfo::HEALTHCHECK_CONNECT_ERROR);
+}
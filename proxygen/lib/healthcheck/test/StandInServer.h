@@ -0,0 +1,145 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <folly/io/async/AsyncServerSocket.h>
+#include <folly/io/async/AsyncSocket.h>
+#include <folly/io/async/EventBase.h>
+#include <list>
+
+namespace proxygen {
+
+/**
+ * A local server for health checks to probe.  Answers every request it
+ * reads with the same canned response and keeps connections open until the
+ * peer closes them.  Must be created, used and destroyed in evb's thread;
+ * the counters can be read from anywhere.
+ */
+class StandInServer : private folly::AsyncServerSocket::AcceptCallback {
+ public:
+  static constexpr const char* kOK =
+    "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nOK";
+
+  /**
+   * Listens on an ephemeral port of bindAddress.  Bind to 0.0.0.0 to answer
+   * on every 127.x.y.z address.
+   */
+  explicit StandInServer(folly::EventBase* evb,
+                         std::string response = kOK,
+                         const std::string& bindAddress = "127.0.0.1")
+      : evb_(evb),
+        response_(std::move(response)),
+        socket_(folly::AsyncServerSocket::newSocket(evb)) {
+    socket_->bind(folly::SocketAddress(bindAddress, 0));
+    socket_->listen(1024);
+    socket_->addAcceptCallback(this, evb);
+    socket_->startAccepting();
+  }
+
+  ~StandInServer() override {
+    socket_->stopAccepting();
+  }
+
+  folly::SocketAddress getAddress() const {
+    folly::SocketAddress addr;
+    socket_->getAddress(&addr);
+    return addr;
+  }
+
+  void setResponse(std::string response) {
+    response_ = std::move(response);
+  }
+
+  /**
+   * Close connections rather than answer their second and later requests,
+   * as a server would whose idle timeout fires just as a request arrives.
+   */
+  void setCloseReusedConnections(bool close) {
+    closeReused_ = close;
+  }
+
+  uint32_t getNumConnections() const {
+    return numConnections_;
+  }
+
+  uint32_t getNumRequests() const {
+    return numRequests_;
+  }
+
+ private:
+  class Connection : public folly::AsyncReader::ReadCallback {
+   public:
+    Connection(StandInServer& server, folly::AsyncSocket::UniquePtr socket)
+        : server_(server), socket_(std::move(socket)) {
+      socket_->setReadCB(this);
+    }
+
+    void getReadBuffer(void** bufReturn, size_t* lenReturn) override {
+      *bufReturn = buf_;
+      *lenReturn = sizeof(buf_);
+    }
+
+    void readDataAvailable(size_t len) noexcept override {
+      pending_.append(buf_, len);
+      size_t end;
+      while ((end = pending_.find("\r\n\r\n")) != std::string::npos) {
+        pending_.erase(0, end + 4);
+        server_.numRequests_++;
+        if (server_.closeReused_ && answered_ > 0) {
+          server_.connections_.erase(self);
+          return;
+        }
+        answered_++;
+        socket_->write(
+            nullptr, server_.response_.data(), server_.response_.size());
+      }
+    }
+
+    void readEOF() noexcept override {
+      server_.connections_.erase(self);
+    }
+
+    void readErr(const folly::AsyncSocketException&) noexcept override {
+      server_.connections_.erase(self);
+    }
+
+    std::list<std::unique_ptr<Connection>>::iterator self;
+
+   private:
+    StandInServer& server_;
+    folly::AsyncSocket::UniquePtr socket_;
+    char buf_[4096];
+    std::string pending_;
+    uint32_t answered_{0};
+  };
+
+  void connectionAccepted(folly::NetworkSocket fd,
+                          const folly::SocketAddress&) noexcept override {
+    numConnections_++;
+    connections_.push_front(std::make_unique<Connection>(
+        *this,
+        folly::AsyncSocket::UniquePtr(new folly::AsyncSocket(evb_, fd))));
+    connections_.front()->self = connections_.begin();
+  }
+
+  void acceptError(const std::exception&) noexcept override {
+  }
+
+  folly::EventBase* const evb_;
+  std::string response_;
+  bool closeReused_{false};
+  std::shared_ptr<folly::AsyncServerSocket> socket_;
+  std::list<std::unique_ptr<Connection>> connections_;
+  std::atomic<uint32_t> numConnections_{0};
+  std::atomic<uint32_t> numRequests_{0};
+};
+
+} // namespace proxygen
@@ -172,6 +172,7 @@ HTTPMessage& HTTPMessage::operator=(const HTTPMessage& message) {
   trailersAllowed_ = message.trailersAllowed_;
   secure_ = message.secure_;
   upgradeWebsocket_ = message.upgradeWebsocket_;
+  staticResponse_ = nullptr;
 
   if (message.trailers_) {
     trailers_ = std::make_unique<HTTPHeaders>(*message.trailers_);
@@ -211,6 +212,7 @@ HTTPMessage& HTTPMessage::operator=(HTTPMessage&& message) {
   trailersAllowed_ = message.trailersAllowed_;
   secure_ = message.secure_;
   upgradeWebsocket_ = message.upgradeWebsocket_;
+  staticResponse_ = nullptr;
 
   trailers_ = std::move(message.trailers_);
   return *this;
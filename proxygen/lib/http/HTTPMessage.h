@@ -27,6 +27,8 @@
 
 namespace proxygen {
 
+class StaticResponse;
+
 /**
  * An HTTP request or response minus the body.
  *
@@ -727,6 +729,15 @@ class HTTPMessage {
     return partiallyReliable_;
   }
 
+  /**
+   * The StaticResponse this message is the response of, if any.  Codecs use
+   * its pre-rendered headers instead of serializing the message.  Never
+   * carried over by copies or moves, so a copy can be modified freely.
+   */
+  const StaticResponse* getStaticResponse() const {
+    return staticResponse_;
+  }
+
  protected:
   // Message start time, in msec since the epoch.
   TimePoint startTime_;
@@ -859,6 +870,9 @@ class HTTPMessage {
 
   WebSocketUpgrade upgradeWebsocket_;
   std::unique_ptr<std::string> upgradeProtocol_;
+
+  friend class StaticResponse;
+  const StaticResponse* staticResponse_{nullptr};
 };
 
 std::ostream& operator<<(std::ostream& os, const HTTPMessage& msg);
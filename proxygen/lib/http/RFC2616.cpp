@@ -9,8 +9,10 @@
  */
 #include <proxygen/lib/http/RFC2616.h>
 
+#include <algorithm>
 #include <stdlib.h>
 
+#include <folly/Conv.h>
 #include <folly/String.h>
 #include <folly/ThreadLocal.h>
 #include <proxygen/lib/http/HTTPHeaders.h>
@@ -170,4 +172,101 @@ bool parseByteRangeSpec(
   return true;
 }
 
+bool parseRangeHeader(
+    folly::StringPiece value,
+    unsigned long instanceLength,
+    std::vector<ByteRangePair>& output) {
+  value = folly::trimWhitespace(value);
+  if (!value.removePrefix("bytes=")) {
+    return false;
+  }
+
+  std::vector<folly::StringPiece> specs;
+  folly::split(',', value, specs);
+  std::vector<ByteRangePair> ranges;
+  bool found = false;
+  for (auto spec : specs) {
+    spec = folly::trimWhitespace(spec);
+    if (spec.empty()) {
+      // The grammar allows empty list elements
+      continue;
+    }
+    auto dash = spec.find('-');
+    if (dash == std::string::npos) {
+      return false;
+    }
+    auto firstStr = spec.subpiece(0, dash);
+    auto lastStr = spec.subpiece(dash + 1);
+    // Only digits are allowed: to<> would accept signs and whitespace
+    auto isNumber = [] (folly::StringPiece sp) {
+      return !sp.empty() &&
+        std::all_of(sp.begin(), sp.end(), [] (char c) {
+            return c >= '0' && c <= '9';
+          });
+    };
+    if ((!firstStr.empty() && !isNumber(firstStr)) ||
+        (!lastStr.empty() && !isNumber(lastStr)) ||
+        (firstStr.empty() && lastStr.empty())) {
+      return false;
+    }
+    found = true;
+
+    if (firstStr.empty()) {
+      // suffix-byte-range-spec: the final N bytes
+      auto suffix = folly::tryTo<unsigned long>(lastStr);
+      if (!suffix) {
+        return false;
+      }
+      if (*suffix == 0 || instanceLength == 0) {
+        continue;
+      }
+      ranges.emplace_back(instanceLength - std::min(*suffix, instanceLength),
+                          instanceLength - 1);
+      continue;
+    }
+
+    auto firstByte = folly::tryTo<unsigned long>(firstStr);
+    if (!firstByte) {
+      return false;
+    }
+    unsigned long lastByte = ULONG_MAX;
+    if (!lastStr.empty()) {
+      auto parsed = folly::tryTo<unsigned long>(lastStr);
+      if (!parsed) {
+        // Larger than any instance we could serve
+        lastByte = ULONG_MAX;
+      } else if (*parsed < *firstByte) {
+        return false;
+      } else {
+        lastByte = *parsed;
+      }
+    }
+    if (*firstByte >= instanceLength) {
+      continue;
+    }
+    ranges.emplace_back(*firstByte, std::min(lastByte, instanceLength - 1));
+  }
+  if (!found) {
+    return false;
+  }
+  output.insert(output.end(), ranges.begin(), ranges.end());
+  return true;
+}
+
+void coalesceByteRanges(std::vector<ByteRangePair>& ranges) {
+  if (ranges.size() < 2) {
+    return;
+  }
+  std::sort(ranges.begin(), ranges.end());
+  size_t last = 0;
+  for (size_t i = 1; i < ranges.size(); ++i) {
+    if (ranges[i].first <= ranges[last].second + 1) {
+      ranges[last].second = std::max(ranges[last].second, ranges[i].second);
+    } else {
+      ranges[++last] = ranges[i];
+    }
+  }
+  ranges.resize(last + 1);
+}
+
 }}
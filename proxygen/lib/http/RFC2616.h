@@ -90,4 +90,29 @@ bool parseByteRangeSpec(
     unsigned long& lastByte,
     unsigned long& instanceLength);
 
+// First and last byte of a range, inclusive
+using ByteRangePair = std::pair<unsigned long, unsigned long>;
+
+/**
+ * Parse an RFC 7233 section 2.1 "Range: bytes=..." request header against a
+ * representation of instanceLength bytes.  Each satisfiable range ("A-B",
+ * "A-" or the suffix "-N") is appended to output as its first and last byte,
+ * with the last byte clamped to the instance; unsatisfiable ones are dropped.
+ *
+ * Returns false if the header is malformed or uses a unit other than bytes,
+ * in which case the header must be ignored.  Returning true with an empty
+ * output means that no range was satisfiable (416).
+ */
+bool parseRangeHeader(
+    folly::StringPiece value,
+    unsigned long instanceLength,
+    std::vector<ByteRangePair>& output);
+
+/**
+ * Sort ranges and merge those that overlap or are adjacent, as RFC 7233
+ * section 4.1 allows, so that a request repeating a range can not multiply
+ * the size of the response.
+ */
+void coalesceByteRanges(std::vector<ByteRangePair>& ranges);
+
 }}
@@ -0,0 +1,153 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/http/StaticResponse.h>
+
+#include <folly/Conv.h>
+#include <folly/String.h>
+#include <proxygen/lib/http/RFC2616.h>
+#include <proxygen/lib/http/codec/CodecUtil.h>
+#include <proxygen/lib/http/codec/compress/HPACKCodec.h>
+#include <proxygen/lib/http/codec/compress/HPACKEncoder.h>
+#include <proxygen/lib/http/codec/compress/QPACKEncoder.h>
+#include <proxygen/lib/utils/UtilInl.h>
+
+using folly::IOBuf;
+
+namespace {
+
+// Literal header field without indexing, name "date" at static index 33
+// (0x0f, then 33 - 15), followed by the value length; not Huffman coded
+const uint8_t kHPACKDateLiteral[] = {0x0f, 0x12};
+
+// Literal with a static name reference to "date", static index 6
+const uint8_t kQPACKDateLiteral[] = {0x56};
+
+const uint32_t kDateHeaderNameLength = 4;
+
+}
+
+namespace proxygen {
+
+StaticResponse::StaticResponse(HTTPMessage msg, std::unique_ptr<IOBuf> body)
+    : msg_(std::move(msg)), body_(std::move(body)) {
+  CHECK(msg_.isResponse());
+  CHECK(!msg_.is1xxResponse()) << "1xx responses cannot be static";
+  CHECK(!msg_.isEgressWebsocketUpgrade());
+
+  if (body_) {
+    bodyLength_ = body_->computeChainDataLength();
+    if (bodyLength_ == 0) {
+      body_.reset();
+    }
+  }
+
+  auto& headers = msg_.getHeaders();
+  msg_.setIsChunked(false);
+  headers.remove(HTTP_HEADER_TRANSFER_ENCODING);
+  headers.forEachValueOfHeader(HTTP_HEADER_CONNECTION,
+                               [this] (const std::string& value) {
+    std::vector<folly::StringPiece> tokens;
+    folly::split(',', value, tokens);
+    for (auto token : tokens) {
+      if (caseInsensitiveEqual(folly::trimWhitespace(token), "close")) {
+        msg_.setWantsKeepalive(false);
+        return true;
+      }
+    }
+    return false;
+  });
+  headers.remove(HTTP_HEADER_CONNECTION);
+  headers.remove(HTTP_HEADER_CONTENT_LENGTH);
+  if (RFC2616::responseBodyMustBeEmpty(msg_.getStatusCode())) {
+    CHECK_EQ(bodyLength_, 0u) << "status " << msg_.getStatusCode()
+                              << " cannot have a body";
+  } else {
+    headers.add(HTTP_HEADER_CONTENT_LENGTH,
+                folly::to<std::string>(bodyLength_));
+  }
+  hasDateHeader_ = headers.exists(HTTP_HEADER_DATE);
+
+  headers.forEach([this] (const std::string& name, const std::string& value) {
+    http1xHeaderLines_.append(name);
+    http1xHeaderLines_.append(": ");
+    http1xHeaderLines_.append(value);
+    http1xHeaderLines_.append("\r\n");
+  });
+
+  // Zero sized tables: every header is either an exact static table match or
+  // a literal, and neither encoder has anything to put on a control stream
+  std::vector<compress::Header> allHeaders;
+  auto status = folly::to<std::string>(msg_.getStatusCode());
+  allHeaders.emplace_back(HTTP_HEADER_COLON_STATUS, status);
+  CodecUtil::appendHeaders(headers, allHeaders, HTTP_HEADER_NONE);
+  auto prepared = compress::prepareHeaders(allHeaders);
+  uncompressedHeaderSize_ = prepared.second;
+
+  HPACKEncoder hpackEncoder(true, 0);
+  hpackBlock_ = hpackEncoder.encode(prepared.first);
+  hpackBlock_->coalesce();
+
+  QPACKEncoder qpackEncoder(true, 0);
+  auto result = qpackEncoder.encode(prepared.first, 0, 0);
+  DCHECK(!result.control || result.control->computeChainDataLength() == 0);
+  qpackBlock_ = std::move(result.stream);
+  qpackBlock_->coalesce();
+
+  msg_.staticResponse_ = this;
+}
+
+std::unique_ptr<IOBuf> StaticResponse::getHPACKBlock(uint32_t headroom) const {
+  return appendDate(*hpackBlock_,
+                    folly::ByteRange(kHPACKDateLiteral,
+                                     sizeof(kHPACKDateLiteral)),
+                    headroom);
+}
+
+std::unique_ptr<IOBuf> StaticResponse::getQPACKBlock() const {
+  return appendDate(*qpackBlock_,
+                    folly::ByteRange(kQPACKDateLiteral,
+                                     sizeof(kQPACKDateLiteral)),
+                    0);
+}
+
+uint32_t StaticResponse::getUncompressedHeaderSize() const {
+  if (hasDateHeader_) {
+    return uncompressedHeaderSize_;
+  }
+  return uncompressedHeaderSize_ + kDateHeaderNameLength +
+    HTTPMessage::formatDateHeader().size() + 2;
+}
+
+std::unique_ptr<IOBuf> StaticResponse::appendDate(
+    const IOBuf& block,
+    folly::ByteRange literalPrefix,
+    uint32_t headroom) const {
+  if (hasDateHeader_) {
+    return block.clone();
+  }
+  // A copy is one allocation, where chaining a clone and the date would be
+  // two
+  auto date = HTTPMessage::formatDateHeader();
+  DCHECK_LT(date.size(), 0x7f);
+  auto len = block.length() + literalPrefix.size() + 1 + date.size();
+  auto out = IOBuf::create(headroom + len);
+  out->advance(headroom);
+  auto dst = out->writableTail();
+  memcpy(dst, block.data(), block.length());
+  dst += block.length();
+  memcpy(dst, literalPrefix.data(), literalPrefix.size());
+  dst += literalPrefix.size();
+  *dst++ = uint8_t(date.size());
+  memcpy(dst, date.data(), date.size());
+  out->append(len);
+  return out;
+}
+
+}
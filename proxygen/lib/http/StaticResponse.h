@@ -0,0 +1,111 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Range.h>
+#include <folly/io/IOBuf.h>
+#include <proxygen/lib/http/HTTPMessage.h>
+
+namespace proxygen {
+
+/**
+ * An immutable response whose headers are serialized once, when it is
+ * created, instead of by the codec every time it is sent.  Meant for health
+ * checks, redirects, 204s and small constant documents, which are cheap to
+ * produce but still pay for building and serializing a message per request.
+ *
+ * The constructor normalizes the message: Content-Length is set from the
+ * body, Transfer-Encoding is dropped and a Connection header is dropped too
+ * ("close" turns keepalive off instead).  It then renders
+ *  - the HTTP/1.x header lines.  The codec adds the status line, Connection
+ *    and, unless the message has one, Date, as these vary per connection or
+ *    per second.
+ *  - HPACK and QPACK header blocks that only reference the static table, so
+ *    they are valid on any connection whatever its dynamic table holds.  A
+ *    Date literal is appended per send unless the message has one.
+ *
+ * Send getMessage() through HTTPTransaction as usual (or use
+ * ResponseHandler::sendStaticResponse()).  The codecs recognize the message
+ * and copy the pre-rendered headers, falling back to ordinary serialization
+ * when they cannot use them (e.g. a pending HPACK table size update, a
+ * CONNECT upgrade, or an H2 priority set on the message).  Copies of the
+ * message are ordinary messages and take the normal path.
+ *
+ * Immutable once constructed, so one instance can be shared by all threads.
+ */
+class StaticResponse {
+ public:
+  explicit StaticResponse(HTTPMessage msg,
+                          std::unique_ptr<folly::IOBuf> body = nullptr);
+
+  StaticResponse(const StaticResponse&) = delete;
+  StaticResponse& operator=(const StaticResponse&) = delete;
+
+  const HTTPMessage& getMessage() const {
+    return msg_;
+  }
+
+  /**
+   * A clone of the body sharing its buffers, or nullptr if there is no body.
+   */
+  std::unique_ptr<folly::IOBuf> cloneBody() const {
+    return body_ ? body_->clone() : nullptr;
+  }
+
+  size_t getBodyLength() const {
+    return bodyLength_;
+  }
+
+  bool hasDateHeader() const {
+    return hasDateHeader_;
+  }
+
+  /**
+   * "Name: value\r\n" for every header of the normalized message.
+   */
+  folly::StringPiece getHTTP1xHeaderLines() const {
+    return http1xHeaderLines_;
+  }
+
+  /**
+   * The HPACK header block, with headroom bytes available in front.  A clone
+   * when the message has a Date header, otherwise a copy with the current
+   * date appended.
+   */
+  std::unique_ptr<folly::IOBuf> getHPACKBlock(uint32_t headroom) const;
+
+  /**
+   * The QPACK header block, including its prefix; as for getHPACKBlock().
+   */
+  std::unique_ptr<folly::IOBuf> getQPACKBlock() const;
+
+  /**
+   * Uncompressed size of the header list, as HTTPHeaderSize reports it for
+   * H2 and H3.
+   */
+  uint32_t getUncompressedHeaderSize() const;
+
+ private:
+  std::unique_ptr<folly::IOBuf> appendDate(
+      const folly::IOBuf& block,
+      folly::ByteRange literalPrefix,
+      uint32_t headroom) const;
+
+  HTTPMessage msg_;
+  std::unique_ptr<folly::IOBuf> body_;
+  size_t bodyLength_{0};
+  bool hasDateHeader_{false};
+  std::string http1xHeaderLines_;
+  std::unique_ptr<folly::IOBuf> hpackBlock_;
+  std::unique_ptr<folly::IOBuf> qpackBlock_;
+  uint32_t uncompressedHeaderSize_{0};
+};
+
+}
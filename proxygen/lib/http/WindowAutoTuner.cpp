@@ -0,0 +1,75 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/http/WindowAutoTuner.h>
+
+#include <algorithm>
+#include <glog/logging.h>
+#include <limits>
+
+namespace proxygen {
+
+WindowAutoTuner::WindowAutoTuner(const Options& options) : options_(options) {
+  CHECK_LE(options_.minCapacity, options_.maxCapacity);
+  CHECK_LE(options_.maxCapacity,
+           uint32_t(std::numeric_limits<int32_t>::max()));
+}
+
+uint32_t WindowAutoTuner::getTargetCapacity(uint32_t capacity,
+                                            uint32_t bytesConsumed,
+                                            std::chrono::microseconds rtt,
+                                            TimePoint now) {
+  if (!timePointInitialized(lastUpdate_)) {
+    // Nothing to measure against yet
+    lastUpdate_ = now;
+    periodStart_ = now;
+    return capacity;
+  }
+  auto interval = microsecondsBetween(now, lastUpdate_);
+  lastUpdate_ = now;
+  if (rtt.count() <= 0) {
+    return capacity;
+  }
+
+  if (interval.count() > 0) {
+    bdpEstimate_ = uint64_t(bytesConsumed) * rtt.count() / interval.count();
+  }
+  peakBdp_ = std::max(peakBdp_, bdpEstimate_);
+
+  uint32_t target = capacity;
+  bool periodDone = false;
+  if (interval < rtt * options_.growthRtts) {
+    target = clamp(uint64_t(capacity) * 2);
+  } else if (now - periodStart_ >= options_.shrinkInterval) {
+    periodDone = true;
+    if (peakBdp_ * 4 < capacity) {
+      target = clamp(std::max<uint64_t>(capacity / 2, peakBdp_ * 2));
+    }
+  }
+
+  if (target != capacity) {
+    VLOG(4) << "Autotuning window capacity from " << capacity << " to "
+            << target << " bdp=" << bdpEstimate_ << " peakBdp=" << peakBdp_
+            << " rtt=" << rtt.count() << "us interval=" << interval.count()
+            << "us";
+  }
+  if (target != capacity || periodDone) {
+    // Shrinking requires a full period without growth
+    periodStart_ = now;
+    peakBdp_ = 0;
+  }
+  return target;
+}
+
+uint32_t WindowAutoTuner::clamp(uint64_t capacity) const {
+  capacity = std::min<uint64_t>(capacity, options_.maxCapacity);
+  return uint32_t(std::max<uint64_t>(capacity, options_.minCapacity));
+}
+
+}
@@ -0,0 +1,90 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <proxygen/lib/utils/Time.h>
+
+namespace proxygen {
+
+/**
+ * Computes receive window sizes from the observed bandwidth-delay product.
+ *
+ * The owner of a receive Window consults the tuner each time it is about to
+ * send a WINDOW_UPDATE.  The time between consecutive updates and the number
+ * of bytes they acknowledge give the rate at which the peer's data is being
+ * consumed; combined with the round-trip time this yields a BDP estimate.
+ *
+ * - If the peer burned through half of the window in less than growthRtts
+ *   round trips, the window is what limits its throughput, so the capacity
+ *   doubles (up to maxCapacity).
+ * - If the largest BDP seen over a shrinkInterval without growth stays below
+ *   a quarter of the capacity, the window is mostly wasted memory, so it
+ *   halves (never below twice that peak, nor below minCapacity).
+ *
+ * The tuner does not modify any Window itself; the caller applies the
+ * returned capacity in whatever way is safe for data already in flight.
+ */
+class WindowAutoTuner {
+ public:
+  struct Options {
+    Options() {}
+    Options(uint32_t minCap, uint32_t maxCap)
+        : minCapacity(minCap), maxCapacity(maxCap) {
+    }
+
+    uint32_t minCapacity{65536};
+    uint32_t maxCapacity{16 * 1024 * 1024};
+    uint32_t growthRtts{2};
+    std::chrono::milliseconds shrinkInterval{10000};
+  };
+
+  explicit WindowAutoTuner(const Options& options);
+
+  /**
+   * Called when a WINDOW_UPDATE acknowledging bytesConsumed is about to be
+   * sent for a window of the given capacity.
+   *
+   * @param capacity       The current capacity of the receive window
+   * @param bytesConsumed  Bytes consumed since the previous window update
+   * @param rtt            Smoothed round-trip time, or zero if unknown.
+   *                       No growth happens until an RTT is known.
+   * @param now            The current time
+   * @returns the capacity the window should have, within the configured
+   *          bounds.  Equal to capacity when no change is needed.
+   */
+  uint32_t getTargetCapacity(uint32_t capacity,
+                             uint32_t bytesConsumed,
+                             std::chrono::microseconds rtt,
+                             TimePoint now);
+
+  /**
+   * The most recent bandwidth-delay product estimate in bytes.
+   */
+  uint64_t getBdpEstimate() const {
+    return bdpEstimate_;
+  }
+
+  const Options& getOptions() const {
+    return options_;
+  }
+
+ private:
+  uint32_t clamp(uint64_t capacity) const;
+
+  Options options_;
+  TimePoint lastUpdate_{};
+  TimePoint periodStart_{};
+  uint64_t bdpEstimate_{0};
+  uint64_t peakBdp_{0};
+};
+
+}
@@ -9,6 +9,9 @@
  */
 #include <proxygen/lib/http/codec/FlowControlFilter.h>
 
+#include <algorithm>
+#include <proxygen/lib/utils/Time.h>
+
 namespace proxygen {
 
 namespace {
@@ -66,6 +69,11 @@ void FlowControlFilter::setReceiveWindowSize(folly::IOBufQueue& writeBuf,
   }
 }
 
+void FlowControlFilter::setReceiveWindowAutoTuning(
+    const WindowAutoTuner::Options& options) {
+  autoTuner_ = std::make_unique<WindowAutoTuner>(options);
+}
+
 bool FlowControlFilter::ingressBytesProcessed(folly::IOBufQueue& writeBuf,
                                               uint32_t delta) {
   toAck_ += delta;
@@ -75,13 +83,38 @@ bool FlowControlFilter::ingressBytesProcessed(folly::IOBufQueue& writeBuf,
           << " bytes, will ack=" << willAck;
   if (willAck) {
     CHECK(recvWindow_.free(toAck_));
-    call_->generateWindowUpdate(writeBuf, 0, toAck_);
+    int32_t windowUpdate = toAck_;
+    if (autoTuner_) {
+      windowUpdate += autoTuneReceiveWindow();
+    }
+    call_->generateWindowUpdate(writeBuf, 0, windowUpdate);
     toAck_ = 0;
     return true;
   }
   return false;
 }
 
+int32_t FlowControlFilter::autoTuneReceiveWindow() {
+  uint32_t capacity = recvWindow_.getCapacity();
+  uint32_t target = autoTuner_->getTargetCapacity(
+    capacity, toAck_, rtt_, getCurrentTime());
+  int32_t delta = 0;
+  if (target > capacity) {
+    delta = target - capacity;
+  } else if (target < capacity) {
+    // The peer may already be sending into the credit it was given, so the
+    // window can only shrink by withholding part of this acknowledgement.
+    delta = -std::min<int32_t>(capacity - target, toAck_ / 2);
+  }
+  if (delta == 0 || !recvWindow_.setCapacity(capacity + delta)) {
+    return 0;
+  }
+  VLOG(4) << "Autotuned conn-level recv window to "
+          << recvWindow_.getCapacity();
+  notify_.onConnectionReceiveWindowResized(recvWindow_.getCapacity());
+  return delta;
+}
+
 uint32_t FlowControlFilter::getAvailableSend() const {
   return sendWindow_.getNonNegativeSize();
 }
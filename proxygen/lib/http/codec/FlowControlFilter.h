@@ -9,7 +9,9 @@
  */
 #pragma once
 
+#include <memory>
 #include <proxygen/lib/http/Window.h>
+#include <proxygen/lib/http/WindowAutoTuner.h>
 #include <proxygen/lib/http/codec/HTTPCodecFilter.h>
 
 namespace folly {
@@ -34,6 +36,13 @@ class FlowControlFilter:
      */
     virtual void onConnectionSendWindowOpen() = 0;
     virtual void onConnectionSendWindowClosed() = 0;
+
+    /**
+     * Notification that receive window autotuning changed the capacity of
+     * the conn-level recv window.
+     */
+    virtual void onConnectionReceiveWindowResized(uint32_t /*capacity*/) {
+    }
   };
 
   /**
@@ -64,6 +73,28 @@ class FlowControlFilter:
    */
   void setReceiveWindowSize(folly::IOBufQueue& writeBuf, uint32_t capacity);
 
+  /**
+   * Enable receive window autotuning.  Each time a WINDOW_UPDATE is
+   * generated, the conn-level recv window may grow or shrink within the
+   * bounds in options, based on the consumption rate and the RTT last
+   * passed to setSmoothedRtt().
+   */
+  void setReceiveWindowAutoTuning(const WindowAutoTuner::Options& options);
+
+  /**
+   * Update the round-trip time used for receive window autotuning.
+   */
+  void setSmoothedRtt(std::chrono::microseconds rtt) {
+    rtt_ = rtt;
+  }
+
+  /**
+   * @returns the capacity of the conn-level recv window
+   */
+  uint32_t getReceiveWindowCapacity() const {
+    return recvWindow_.getCapacity();
+  }
+
   /**
    * Notify the flow control filter that some ingress bytes were
    * processed. If the number of bytes to acknowledge exceeds half the
@@ -100,10 +131,17 @@ class FlowControlFilter:
                               uint32_t delta) override;
 
  private:
+  /**
+   * Applies the autotuner's target capacity to recvWindow_ and returns the
+   * amount to add to the pending WINDOW_UPDATE (negative when shrinking).
+   */
+  int32_t autoTuneReceiveWindow();
 
   Callback& notify_;
   Window recvWindow_;
   Window sendWindow_;
+  std::unique_ptr<WindowAutoTuner> autoTuner_;
+  std::chrono::microseconds rtt_{0};
   int32_t toAck_{0};
   bool error_:1;
   bool sendsBlocked_:1;
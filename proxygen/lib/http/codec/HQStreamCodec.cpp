@@ -12,6 +12,7 @@
 #include <folly/ScopeGuard.h>
 #include <folly/io/Cursor.h>
 #include <proxygen/lib/http/HTTP3ErrorCode.h>
+#include <proxygen/lib/http/StaticResponse.h>
 #include <proxygen/lib/http/codec/HQUtils.h>
 #include <proxygen/lib/http/codec/compress/QPACKCodec.h>
 
@@ -509,6 +510,25 @@ void HQStreamCodec::generateHeaderImpl(folly::IOBufQueue& writeBuf,
                                        const HTTPMessage& msg,
                                        folly::Optional<StreamID> pushId,
                                        HTTPHeaderSize* size) {
+  const StaticResponse* staticResponse = msg.getStaticResponse();
+  if (staticResponse && !pushId) {
+    // Static table references only (Required Insert Count 0), so nothing
+    // for the encoder stream and no acknowledgement to track
+    auto block = staticResponse->getQPACKBlock();
+    if (size) {
+      *size = HTTPHeaderSize();
+      size->compressed = block->length();
+      size->uncompressed = staticResponse->getUncompressedHeaderSize();
+    }
+    auto res = hq::writeHeaders(writeBuf, std::move(block));
+    if (res.hasValue()) {
+      totalEgressBytes_ += res.value();
+    } else {
+      LOG(ERROR) << __func__ << ": failed to write headers: " << res.error();
+    }
+    return;
+  }
+
   std::vector<std::string> temps;
   auto allHeaders = CodecUtil::prepareMessageForCompression(msg, temps);
   auto result =
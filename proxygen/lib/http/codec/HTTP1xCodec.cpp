@@ -14,6 +14,7 @@
 #include <folly/ssl/OpenSSLHash.h>
 #include <proxygen/lib/http/HTTPHeaderSize.h>
 #include <proxygen/lib/http/RFC2616.h>
+#include <proxygen/lib/http/StaticResponse.h>
 #include <proxygen/lib/http/codec/CodecProtocol.h>
 #include <proxygen/lib/utils/Base64.h>
 
@@ -500,6 +501,30 @@ HTTP1xCodec::generateHeader(IOBufQueue& writeBuf,
     parser_.http_minor = 9;
     return;
   }
+  const StaticResponse* staticResponse = msg.getStaticResponse();
+  if (staticResponse && downstream && !egressUpgrade_) {
+    // Already normalized: it has a Content-Length (or a status that cannot
+    // have a body) and no Connection or Transfer-Encoding headers, so none
+    // of the per-header handling below applies
+    appendString(writeBuf, len, staticResponse->getHTTP1xHeaderLines());
+    if (!staticResponse->hasDateHeader()) {
+      addDateHeader(writeBuf, len);
+    }
+    if (keepalive_) {
+      appendLiteral(writeBuf, len, "Connection: keep-alive\r\n");
+    } else {
+      appendLiteral(writeBuf, len, "Connection: close\r\n");
+    }
+    appendLiteral(writeBuf, len, CRLF);
+    if (eom) {
+      len += generateEOM(writeBuf, txn);
+    }
+    if (size) {
+      size->compressed = 0;
+      size->uncompressed = len;
+    }
+    return;
+  }
   const string* deferredContentLength = nullptr;
   bool hasTransferEncodingChunked = false;
   bool hasDateHeader = false;
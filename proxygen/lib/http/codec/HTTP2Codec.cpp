@@ -10,6 +10,7 @@
 #include <proxygen/lib/http/codec/HTTP2Codec.h>
 #include <proxygen/lib/http/codec/HTTP2Constants.h>
 #include <proxygen/lib/http/codec/CodecUtil.h>
+#include <proxygen/lib/http/StaticResponse.h>
 #include <proxygen/lib/utils/Logging.h>
 #include <proxygen/lib/utils/Base64.h>
 
@@ -1139,9 +1140,24 @@ void HTTP2Codec::generateHeaderImpl(
            exAttributes);
   }
 
-  std::vector<std::string> temps;
-  auto allHeaders = CodecUtil::prepareMessageForCompression(msg, temps);
-  auto out = encodeHeaders(msg.getHeaders(), allHeaders, size);
+  std::unique_ptr<folly::IOBuf> out;
+  const StaticResponse* staticResponse = msg.getStaticResponse();
+  if (staticResponse && !assocStream && !exAttributes &&
+      !headerCodec_.hasPendingTableSizeUpdate()) {
+    // Only references the static table, so it is valid regardless of what
+    // our dynamic table holds; the one thing it cannot carry is an update
+    out = staticResponse->getHPACKBlock(http2::kFrameHeaderSize +
+                                        http2::kFrameHeadersBaseMaxSize);
+    if (size) {
+      *size = HTTPHeaderSize();
+      size->compressed = out->length();
+      size->uncompressed = staticResponse->getUncompressedHeaderSize();
+    }
+  } else {
+    std::vector<std::string> temps;
+    auto allHeaders = CodecUtil::prepareMessageForCompression(msg, temps);
+    out = encodeHeaders(msg.getHeaders(), allHeaders, size);
+  }
   IOBufQueue queue(IOBufQueue::cacheChainLength());
   queue.append(std::move(out));
   auto maxFrameSize = maxSendFrameSize();
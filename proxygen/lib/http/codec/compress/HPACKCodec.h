@@ -55,6 +55,14 @@ class HPACKCodec : public HeaderCodec {
     encoder_.setHeaderTableSize(size);
   }
 
+  /**
+   * A block encoded elsewhere can only be sent in place of encode() while
+   * this is false; see StaticResponse.
+   */
+  bool hasPendingTableSizeUpdate() const {
+    return encoder_.hasPendingContextUpdate();
+  }
+
   void setDecoderHeaderTableMaxSize(uint32_t size) {
     decoder_.setHeaderTableMaxSize(size);
   }
@@ -47,6 +47,13 @@ class HPACKEncoderBase {
     return indexingStrat_;
   }
 
+  /**
+   * True if the next header block must start with a table size update
+   */
+  bool hasPendingContextUpdate() const {
+    return pendingContextUpdate_;
+  }
+
  protected:
 
   uint32_t handlePendingContextUpdate(HPACKEncodeBuffer& buf,
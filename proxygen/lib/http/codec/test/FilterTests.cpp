@@ -29,6 +29,7 @@ class MockFlowControlCallback: public FlowControlFilter::Callback {
  public:
   MOCK_METHOD0(onConnectionSendWindowOpen, void());
   MOCK_METHOD0(onConnectionSendWindowClosed, void());
+  MOCK_METHOD1(onConnectionReceiveWindowResized, void(uint32_t));
 };
 
 class FilterTest : public testing::Test {
@@ -151,6 +152,33 @@ TEST_F(DefaultFlowControl, SendUpdate) {
   filter_->ingressBytesProcessed(writeBuf_, 1);
 }
 
+TEST_F(DefaultFlowControl, AutoTuneGrowsWindow) {
+  InSequence enforceSequence;
+  EXPECT_CALL(callback_, onBody(_, _, _))
+    .WillRepeatedly(Return());
+  filter_->setReceiveWindowAutoTuning(
+    WindowAutoTuner::Options(kInitialCapacity, kInitialCapacity * 4));
+  filter_->setSmoothedRtt(std::chrono::seconds(10));
+
+  // The first update only starts the measurement
+  callbackStart_->onBody(1, makeBuf(kInitialCapacity / 2 + 1), 0);
+  EXPECT_CALL(*codec_,
+              generateWindowUpdate(_, 0, kInitialCapacity / 2 + 1));
+  filter_->ingressBytesProcessed(writeBuf_, kInitialCapacity / 2 + 1);
+
+  // Half the window was consumed again well within two RTTs, so the window
+  // doubles and the growth is advertised along with the ack
+  callbackStart_->onBody(1, makeBuf(kInitialCapacity / 2 + 1), 0);
+  EXPECT_CALL(flowCallback_,
+              onConnectionReceiveWindowResized(kInitialCapacity * 2));
+  EXPECT_CALL(*codec_,
+              generateWindowUpdate(_, 0,
+                                   kInitialCapacity / 2 + 1 +
+                                   kInitialCapacity));
+  filter_->ingressBytesProcessed(writeBuf_, kInitialCapacity / 2 + 1);
+  EXPECT_EQ(filter_->getReceiveWindowCapacity(), kInitialCapacity * 2);
+}
+
 TEST_F(BigWindow, RecvTooMuch) {
   // Constructing the filter with a large capacity causes a WINDOW_UPDATE
   // for stream zero to be generated
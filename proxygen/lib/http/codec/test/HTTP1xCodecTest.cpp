@@ -10,6 +10,7 @@
 #include <folly/portability/GTest.h>
 #include <proxygen/lib/http/HTTPHeaderSize.h>
 #include <proxygen/lib/http/HTTPMessage.h>
+#include <proxygen/lib/http/StaticResponse.h>
 #include <proxygen/lib/http/codec/HTTP1xCodec.h>
 #include <proxygen/lib/http/codec/test/MockHTTPCodec.h>
 #include <proxygen/lib/http/codec/test/TestUtils.h>
@@ -717,6 +718,98 @@ TEST(HTTP1xCodecTest, TestHeaderValueWhiteSpaces) {
   EXPECT_EQ(headers.getSingleOrEmpty("X-FB-HEADER"), "yay");
 }
 
+TEST(HTTP1xCodecTest, TestStaticResponse) {
+  HTTP1xCodec upstream(TransportDirection::UPSTREAM);
+  HTTP1xCodec downstream(TransportDirection::DOWNSTREAM);
+  HTTP1xCodecCallback upCallbacks;
+  HTTP1xCodecCallback downCallbacks;
+  upstream.setCallback(&upCallbacks);
+  downstream.setCallback(&downCallbacks);
+
+  HTTPMessage resp;
+  resp.setHTTPVersion(1, 1);
+  resp.setStatusCode(200);
+  resp.setStatusMessage("OK");
+  resp.getHeaders().add(HTTP_HEADER_CONTENT_TYPE, "application/json");
+  resp.getHeaders().add(HTTP_HEADER_TRANSFER_ENCODING, "chunked");
+  StaticResponse staticResp(std::move(resp),
+                            folly::IOBuf::copyBuffer("{\"ok\":true}"));
+  EXPECT_EQ(staticResp.getMessage().getStaticResponse(), &staticResp);
+  // Copies are ordinary messages
+  HTTPMessage copy(staticResp.getMessage());
+  EXPECT_EQ(copy.getStaticResponse(), nullptr);
+
+  HTTPMessage req;
+  req.setMethod(HTTPMethod::GET);
+  req.setURL("/");
+  req.getHeaders().add(HTTP_HEADER_HOST, "www.facebook.com");
+  for (auto i = 1; i <= 2; i++) {
+    folly::IOBufQueue writeBuf(folly::IOBufQueue::cacheChainLength());
+    upstream.generateHeader(writeBuf, upstream.createStream(), req, true);
+    downstream.onIngress(*writeBuf.move());
+    EXPECT_EQ(downCallbacks.headersComplete, i);
+
+    HTTPHeaderSize size;
+    auto txnID = downstream.createStream();
+    downstream.generateHeader(writeBuf, txnID, staticResp.getMessage(), false,
+                              &size);
+    EXPECT_EQ(size.uncompressed, writeBuf.chainLength());
+    downstream.generateBody(writeBuf, txnID, staticResp.cloneBody(),
+                            HTTPCodec::NoPadding, true);
+    upstream.onIngress(*writeBuf.move());
+
+    EXPECT_EQ(upCallbacks.headersComplete, i);
+    EXPECT_EQ(upCallbacks.messageComplete, i);
+    EXPECT_EQ(upCallbacks.errors, 0);
+    const auto& headers = upCallbacks.msg_->getHeaders();
+    EXPECT_EQ(upCallbacks.msg_->getStatusCode(), 200);
+    EXPECT_EQ(headers.getSingleOrEmpty(HTTP_HEADER_CONTENT_TYPE),
+              "application/json");
+    EXPECT_EQ(headers.getSingleOrEmpty(HTTP_HEADER_CONTENT_LENGTH), "11");
+    EXPECT_EQ(headers.getSingleOrEmpty(HTTP_HEADER_CONNECTION), "keep-alive");
+    EXPECT_TRUE(headers.exists(HTTP_HEADER_DATE));
+    EXPECT_FALSE(headers.exists(HTTP_HEADER_TRANSFER_ENCODING));
+    EXPECT_EQ(upCallbacks.bodyLen, 11 * i);
+  }
+  EXPECT_TRUE(downstream.isReusable());
+}
+
+TEST(HTTP1xCodecTest, TestStaticResponseConnectionClose) {
+  HTTP1xCodec upstream(TransportDirection::UPSTREAM);
+  HTTP1xCodec downstream(TransportDirection::DOWNSTREAM);
+  HTTP1xCodecCallback upCallbacks;
+  HTTP1xCodecCallback downCallbacks;
+  upstream.setCallback(&upCallbacks);
+  downstream.setCallback(&downCallbacks);
+
+  HTTPMessage resp;
+  resp.setHTTPVersion(1, 1);
+  resp.setStatusCode(204);
+  resp.setStatusMessage("No Content");
+  resp.getHeaders().add(HTTP_HEADER_CONNECTION, "foo, close");
+  StaticResponse staticResp(std::move(resp));
+  EXPECT_FALSE(staticResp.getMessage().getHeaders().exists(
+      HTTP_HEADER_CONNECTION));
+
+  HTTPMessage req;
+  req.setMethod(HTTPMethod::GET);
+  req.setURL("/");
+  req.getHeaders().add(HTTP_HEADER_HOST, "www.facebook.com");
+  folly::IOBufQueue writeBuf(folly::IOBufQueue::cacheChainLength());
+  upstream.generateHeader(writeBuf, upstream.createStream(), req, true);
+  downstream.onIngress(*writeBuf.move());
+  downstream.generateHeader(writeBuf, downstream.createStream(),
+                            staticResp.getMessage(), true);
+  upstream.onIngress(*writeBuf.move());
+
+  EXPECT_EQ(upCallbacks.messageComplete, 1);
+  const auto& headers = upCallbacks.msg_->getHeaders();
+  EXPECT_EQ(upCallbacks.msg_->getStatusCode(), 204);
+  EXPECT_EQ(headers.getSingleOrEmpty(HTTP_HEADER_CONNECTION), "close");
+  EXPECT_FALSE(headers.exists(HTTP_HEADER_CONTENT_LENGTH));
+  EXPECT_FALSE(downstream.isReusable());
+}
+
 class ConnectionHeaderTest:
     public TestWithParam<std::pair<std::list<string>, string>> {
  public:
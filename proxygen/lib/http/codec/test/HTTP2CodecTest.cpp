@@ -14,6 +14,7 @@
 #include <proxygen/lib/http/codec/test/HTTP2FramerTest.h>
 #include <proxygen/lib/http/HTTPHeaderSize.h>
 #include <proxygen/lib/http/HTTPMessage.h>
+#include <proxygen/lib/http/StaticResponse.h>
 
 #include <folly/portability/GTest.h>
 #include <folly/portability/GMock.h>
@@ -609,6 +610,63 @@ TEST_F(HTTP2CodecTest, BasicHeaderReply) {
   EXPECT_EQ("x-coolio", headers.getSingleOrEmpty(HTTP_HEADER_CONTENT_TYPE));
 }
 
+TEST_F(HTTP2CodecTest, StaticResponseReply) {
+  SetUpUpstreamTest();
+  HTTPMessage resp;
+  resp.setStatusCode(200);
+  resp.getHeaders().add(HTTP_HEADER_CONTENT_TYPE, "x-coolio");
+  resp.getHeaders().add("X-Custom", "indexed-in-dynamic-table");
+
+  // Fill the dynamic tables first; the static block must not depend on them
+  downstreamCodec_.generateHeader(output_, 1, resp);
+  parseUpstream();
+  callbacks_.reset();
+
+  StaticResponse staticResp(std::move(resp), IOBuf::copyBuffer("hello"));
+  HTTPHeaderSize size;
+  downstreamCodec_.generateHeader(output_, 3, staticResp.getMessage(), false,
+                                  &size);
+  EXPECT_GT(size.compressed, 0);
+  EXPECT_EQ(size.uncompressed, staticResp.getUncompressedHeaderSize());
+  downstreamCodec_.generateBody(output_, 3, staticResp.cloneBody(),
+                                HTTPCodec::NoPadding, true);
+
+  parseUpstream();
+  callbacks_.expectMessage(true, 4, 200);
+  const auto& headers = callbacks_.msg->getHeaders();
+  EXPECT_TRUE(headers.exists(HTTP_HEADER_DATE));
+  EXPECT_EQ("x-coolio", headers.getSingleOrEmpty(HTTP_HEADER_CONTENT_TYPE));
+  EXPECT_EQ("indexed-in-dynamic-table", headers.getSingleOrEmpty("X-Custom"));
+  EXPECT_EQ("5", headers.getSingleOrEmpty(HTTP_HEADER_CONTENT_LENGTH));
+  EXPECT_EQ("hello", callbacks_.data.move()->moveToFbString());
+}
+
+TEST_F(HTTP2CodecTest, StaticResponsePendingTableSizeUpdate) {
+  auto settings = upstreamCodec_.getEgressSettings();
+  settings->setSetting(SettingsId::HEADER_TABLE_SIZE, 8192);
+  upstreamCodec_.generateSettings(output_);
+  parse();
+  downstreamCodec_.generateSettingsAck(output_);
+  parseUpstream();
+  callbacks_.reset();
+
+  // The encoder owes the peer a table size update, which the pre-encoded
+  // block cannot carry, so the codec encodes the message normally
+  HTTPMessage resp;
+  resp.setStatusCode(204);
+  resp.getHeaders().add(HTTP_HEADER_DATE, "Thu, 01 Jan 1970 00:00:00 GMT");
+  StaticResponse staticResp(std::move(resp));
+  SetUpUpstreamTest();
+  downstreamCodec_.generateHeader(output_, 1, staticResp.getMessage(), true);
+
+  parseUpstream();
+  callbacks_.expectMessage(true, 1, 204);
+  EXPECT_EQ("Thu, 01 Jan 1970 00:00:00 GMT",
+            callbacks_.msg->getHeaders().getSingleOrEmpty(HTTP_HEADER_DATE));
+  EXPECT_EQ(upstreamCodec_.getCompressionInfo().ingressHeaderTableSize_,
+            8192);
+}
+
 TEST_F(HTTP2CodecTest, BadHeadersReply) {
   static const std::string v1("200");
   static const vector<proxygen::compress::Header> respHeaders = {
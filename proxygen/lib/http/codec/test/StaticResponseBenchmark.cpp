@@ -0,0 +1,158 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Benchmark.h>
+#include <folly/Conv.h>
+#include <folly/io/IOBufQueue.h>
+#include <proxygen/lib/http/HTTPMessage.h>
+#include <proxygen/lib/http/StaticResponse.h>
+#include <proxygen/lib/http/codec/HTTP1xCodec.h>
+#include <proxygen/lib/http/codec/HTTP2Codec.h>
+
+using namespace folly;
+using namespace proxygen;
+
+// Time to serialize one small response (status, Content-Type, a 16 byte
+// body) into a codec's write buffer, built per request the way
+// ResponseBuilder does versus sent from a StaticResponse.  time/iter is
+// the cost per response.
+//
+// ./static_response_benchmark -bm_min_iters 100000
+//
+// Prints one row per protocol and mode:
+//   HTTP1xDynamic / HTTP1xStatic  - HTTP1xCodec, downstream
+//   HTTP2Dynamic / HTTP2Static    - HTTP2Codec, downstream, fresh stream each
+// with the static rows relative to the dynamic row above them.  The HTTP/1.x
+// requests are parsed before timing starts.
+
+namespace {
+
+const std::string kBody = "{\"status\":\"ok\"}\n";
+
+class NoopCallback : public HTTPCodec::Callback {
+ public:
+  void onMessageBegin(HTTPCodec::StreamID, HTTPMessage*) override {}
+  void onHeadersComplete(HTTPCodec::StreamID,
+                         std::unique_ptr<HTTPMessage>) override {}
+  void onBody(HTTPCodec::StreamID,
+              std::unique_ptr<folly::IOBuf>,
+              uint16_t) override {}
+  void onTrailersComplete(HTTPCodec::StreamID,
+                          std::unique_ptr<HTTPHeaders>) override {}
+  void onMessageComplete(HTTPCodec::StreamID, bool) override {}
+  void onError(HTTPCodec::StreamID, const HTTPException&, bool) override {}
+};
+
+const StaticResponse& getStaticResponse() {
+  static const StaticResponse response([] {
+    HTTPMessage msg;
+    msg.setHTTPVersion(1, 1);
+    msg.setStatusCode(200);
+    msg.setStatusMessage("OK");
+    msg.getHeaders().add(HTTP_HEADER_CONTENT_TYPE, "application/json");
+    return msg;
+  }(), IOBuf::copyBuffer(kBody));
+  return response;
+}
+
+// What ResponseBuilder(...).status(200, "OK").header(...).body(...) sets up
+std::unique_ptr<HTTPMessage> buildResponse() {
+  auto msg = std::make_unique<HTTPMessage>();
+  msg->setHTTPVersion(1, 1);
+  msg->setStatusCode(200);
+  msg->setStatusMessage("OK");
+  msg->getHeaders().add(HTTP_HEADER_CONTENT_TYPE, "application/json");
+  msg->getHeaders().add(HTTP_HEADER_CONTENT_LENGTH,
+                        folly::to<std::string>(kBody.size()));
+  return msg;
+}
+
+void http1xBench(int iters, bool useStatic) {
+  HTTP1xCodec codec(TransportDirection::DOWNSTREAM);
+  NoopCallback callback;
+  codec.setCallback(&callback);
+  {
+    BenchmarkSuspender suspender;
+    std::string requests;
+    for (int i = 0; i < iters; i++) {
+      requests += "GET / HTTP/1.1\r\nHost: www.facebook.com\r\n\r\n";
+    }
+    codec.onIngress(*IOBuf::copyBuffer(requests));
+    getStaticResponse();
+  }
+  IOBufQueue writeBuf(IOBufQueue::cacheChainLength());
+  for (int i = 0; i < iters; i++) {
+    auto txn = codec.createStream();
+    if (useStatic) {
+      const auto& response = getStaticResponse();
+      codec.generateHeader(writeBuf, txn, response.getMessage(), false);
+      codec.generateBody(writeBuf, txn, response.cloneBody(),
+                         HTTPCodec::NoPadding, true);
+    } else {
+      auto msg = buildResponse();
+      codec.generateHeader(writeBuf, txn, *msg, false);
+      codec.generateBody(writeBuf, txn, IOBuf::copyBuffer(kBody),
+                         HTTPCodec::NoPadding, true);
+    }
+    writeBuf.move();
+  }
+}
+
+void http2Bench(int iters, bool useStatic) {
+  HTTP2Codec codec(TransportDirection::DOWNSTREAM);
+  IOBufQueue writeBuf(IOBufQueue::cacheChainLength());
+  {
+    BenchmarkSuspender suspender;
+    codec.generateConnectionPreface(writeBuf);
+    codec.generateSettings(writeBuf);
+    writeBuf.move();
+    getStaticResponse();
+  }
+  HTTPCodec::StreamID stream = 1;
+  for (int i = 0; i < iters; i++, stream += 2) {
+    if (useStatic) {
+      const auto& response = getStaticResponse();
+      codec.generateHeader(writeBuf, stream, response.getMessage(), false);
+      codec.generateBody(writeBuf, stream, response.cloneBody(),
+                         HTTPCodec::NoPadding, true);
+    } else {
+      auto msg = buildResponse();
+      codec.generateHeader(writeBuf, stream, *msg, false);
+      codec.generateBody(writeBuf, stream, IOBuf::copyBuffer(kBody),
+                         HTTPCodec::NoPadding, true);
+    }
+    writeBuf.move();
+  }
+}
+
+}
+
+BENCHMARK(HTTP1xDynamic, iters) {
+  http1xBench(iters, false);
+}
+
+BENCHMARK_RELATIVE(HTTP1xStatic, iters) {
+  http1xBench(iters, true);
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(HTTP2Dynamic, iters) {
+  http2Bench(iters, false);
+}
+
+BENCHMARK_RELATIVE(HTTP2Static, iters) {
+  http2Bench(iters, true);
+}
+
+int main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  folly::runBenchmarks();
+  return 0;
+}
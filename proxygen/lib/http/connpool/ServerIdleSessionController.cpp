@@ -9,81 +9,205 @@
  */
 #include "proxygen/lib/http/connpool/ServerIdleSessionController.h"
 
+#include <folly/Random.h>
+#include <folly/io/async/EventBaseManager.h>
+
 namespace proxygen {
 
+namespace {
+
+// Rescans after losing a CAS race before giving up
+constexpr int kMaxReserveAttempts = 4;
+
+uint32_t generationOf(uint64_t reservations) {
+  return reservations >> 32;
+}
+
+uint32_t reservedOf(uint64_t reservations) {
+  return reservations & 0xffffffff;
+}
+
+uint64_t makeReservations(uint32_t generation, uint32_t reserved) {
+  return (uint64_t(generation) << 32) | reserved;
+}
+
+}
+
+ServerIdleSessionController::ServerIdleSessionController(
+    unsigned int maxIdleCount, uint32_t maxPools)
+    : slots_(maxPools), maxIdleCount_(maxIdleCount) {
+}
+
 folly::Future<HTTPSessionBase*> ServerIdleSessionController::getIdleSession() {
-  folly::Promise<HTTPSessionBase*> promise;
-  folly::Future<HTTPSessionBase*> future = promise.getFuture();
-  SessionPool* maxPool = nullptr;
-
-  {
-    std::lock_guard<std::mutex> lock(lock_);
-    maxPool = popBestIdlePool();
-    if (markedForDeath_ || !maxPool || !maxPool->getEventBase()) {
-      return folly::makeFuture<HTTPSessionBase*>(nullptr);
-    }
-  }
+  return getIdleSessions(1).thenValue(
+      [](std::vector<HTTPSessionBase*> sessions) -> HTTPSessionBase* {
+        return sessions.empty() ? nullptr : sessions.front();
+      });
+}
 
-  if (maxPool->getEventBase()->isInEventBaseThread()) {
-    LOG(ERROR) << "Idle session already belongs to current thread!";
-    return folly::makeFuture<HTTPSessionBase*>(nullptr);
+folly::Future<std::vector<HTTPSessionBase*>>
+ServerIdleSessionController::getIdleSessions(uint32_t max) {
+  if (max == 0 || isMarkedForDeath()) {
+    return folly::makeFuture(std::vector<HTTPSessionBase*>());
+  }
+  // Sessions from the caller's own pools are no help
+  auto r = reserveIdleSessions(
+      max, folly::EventBaseManager::get()->getExistingEventBase());
+  if (!r.sessionPool) {
+    return folly::makeFuture(std::vector<HTTPSessionBase*>());
   }
 
-  maxPool->getEventBase()->runInEventBaseThread(
-      [this, maxPool, promise = std::move(promise)]() mutable {
+  folly::Promise<std::vector<HTTPSessionBase*>> promise;
+  auto future = promise.getFuture();
+  r.evb->runInEventBaseThread(
+      [this, r, promise = std::move(promise)]() mutable {
         // Caller (in this case Server::getTransaction()) needs to guarantee
         // that 'this' still exists.
-        HTTPSessionBase* session =
-            isMarkedForDeath() ? nullptr : maxPool->removeOldestIdleSession();
-        if (session) {
-          session->detachThreadLocals(true);
-        }
-        promise.setValue(session);
+        promise.setValue(takeIdleSessions(r));
       });
   return future;
 }
 
-void ServerIdleSessionController::addIdleSession(const HTTPSessionBase* session,
-                                                 SessionPool* sessionPool) {
-  std::lock_guard<std::mutex> lock(lock_);
-  if (sessionMap_.find(session) != sessionMap_.end()) {
-    // removeIdleSession should've been called before re-adding
-    LOG(ERROR) << "Session " << session << " already exists!";
-    return;
+int32_t ServerIdleSessionController::registerPool(SessionPool* sessionPool) {
+  for (size_t i = 0; i < slots_.size(); ++i) {
+    auto& slot = slots_[i];
+    SessionPool* expected = nullptr;
+    if (!slot.sessionPool.compare_exchange_strong(
+            expected, sessionPool, std::memory_order_acq_rel)) {
+      continue;
+    }
+    slot.evb.store(sessionPool->getEventBase(), std::memory_order_relaxed);
+    slot.numIdle.store(0, std::memory_order_relaxed);
+    // Publishes the pool and evb to thieves that see the new generation
+    auto generation =
+        generationOf(slot.reservations.load(std::memory_order_relaxed));
+    slot.reservations.store(makeReservations(generation + 1, 0),
+                            std::memory_order_release);
+    return i;
   }
-  if (sessionsByIdleAge_.size() < maxIdleCount_) {
-    auto newIt = sessionsByIdleAge_.insert(sessionsByIdleAge_.end(),
-                                           {session, sessionPool});
-    sessionMap_[session] = newIt;
+  VLOG(2) << "No free slot, idle sessions of pool " << sessionPool
+          << " will not be shared";
+  return -1;
+}
+
+void ServerIdleSessionController::unregisterPool(int32_t slotIndex) {
+  if (slotIndex < 0) {
+    return;
   }
+  auto& slot = slots_[slotIndex];
+  slot.numIdle.store(0, std::memory_order_relaxed);
+  // Fail the CAS of any thief that picked this registration, then free the
+  // slot
+  auto generation =
+      generationOf(slot.reservations.load(std::memory_order_relaxed));
+  slot.reservations.store(makeReservations(generation + 1, 0),
+                          std::memory_order_release);
+  slot.evb.store(nullptr, std::memory_order_relaxed);
+  slot.sessionPool.store(nullptr, std::memory_order_release);
 }
 
-void ServerIdleSessionController::removeIdleSession(
-    const HTTPSessionBase* session) {
-  std::lock_guard<std::mutex> lock(lock_);
-  auto it = sessionMap_.find(session);
-  if (it != sessionMap_.end()) {
-    sessionsByIdleAge_.erase(it->second);
-    sessionMap_.erase(it);
+void ServerIdleSessionController::setNumIdleSessions(int32_t slotIndex,
+                                                     uint32_t numIdle) {
+  if (slotIndex >= 0) {
+    slots_[slotIndex].numIdle.store(numIdle, std::memory_order_relaxed);
   }
 }
 
 void ServerIdleSessionController::markForDeath() {
-  std::lock_guard<std::mutex> lock(lock_);
-  markedForDeath_ = true;
-  sessionMap_.clear();
-  sessionsByIdleAge_.clear();
+  markedForDeath_.store(true, std::memory_order_release);
+}
+
+ServerIdleSessionController::Reservation
+ServerIdleSessionController::reserveIdleSessions(uint32_t max,
+                                                 folly::EventBase* skipEvb) {
+  if (slots_.empty()) {
+    return Reservation();
+  }
+  for (int attempt = 0; attempt < kMaxReserveAttempts; ++attempt) {
+    // Start at a random slot so that thieves spread over pools that are
+    // equally idle instead of all racing for the first one
+    uint32_t start = folly::Random::rand32(slots_.size());
+    int32_t best = -1;
+    uint64_t bestReservations = 0;
+    uint32_t bestAvailable = 0;
+    for (size_t i = 0; i < slots_.size(); ++i) {
+      auto index = (start + i) % slots_.size();
+      auto& slot = slots_[index];
+      auto reservations = slot.reservations.load(std::memory_order_acquire);
+      auto evb = slot.evb.load(std::memory_order_relaxed);
+      if (!evb || evb == skipEvb) {
+        continue;
+      }
+      uint32_t idle = std::min<uint32_t>(
+          slot.numIdle.load(std::memory_order_relaxed), maxIdleCount_);
+      uint32_t reserved = reservedOf(reservations);
+      if (idle > reserved && idle - reserved > bestAvailable) {
+        best = index;
+        bestReservations = reservations;
+        bestAvailable = idle - reserved;
+      }
+    }
+    if (best < 0) {
+      return Reservation();
+    }
+
+    auto& slot = slots_[best];
+    Reservation r;
+    r.sessionPool = slot.sessionPool.load(std::memory_order_acquire);
+    r.evb = slot.evb.load(std::memory_order_relaxed);
+    if (!r.sessionPool || !r.evb) {
+      continue;
+    }
+    r.slot = best;
+    r.generation = generationOf(bestReservations);
+    r.count = std::min(max, bestAvailable);
+    // Fails if another thief reserved in the meantime, or the pool left
+    if (slot.reservations.compare_exchange_strong(
+            bestReservations,
+            makeReservations(r.generation,
+                             reservedOf(bestReservations) + r.count),
+            std::memory_order_acq_rel)) {
+      return r;
+    }
+  }
+  return Reservation();
 }
 
-// must be called under lock_
-SessionPool* FOLLY_NULLABLE ServerIdleSessionController::popBestIdlePool() {
-  if (!sessionsByIdleAge_.empty()) {
-    auto ret = *sessionsByIdleAge_.begin();
-    sessionsByIdleAge_.erase(sessionsByIdleAge_.begin());
-    sessionMap_.erase(ret.session);
-    return ret.sessionPool;
+std::vector<HTTPSessionBase*> ServerIdleSessionController::takeIdleSessions(
+    const Reservation& r) {
+  std::vector<HTTPSessionBase*> sessions;
+  auto& slot = slots_[r.slot];
+  // Only this thread unregisters the pool, so it's alive if the
+  // registration still is
+  if (!isMarkedForDeath() &&
+      generationOf(slot.reservations.load(std::memory_order_acquire)) ==
+          r.generation) {
+    sessions.reserve(r.count);
+    while (sessions.size() < r.count) {
+      auto session = r.sessionPool->removeOldestIdleSession();
+      if (!session) {
+        break;
+      }
+      session->detachThreadLocals(true);
+      sessions.push_back(session);
+    }
+  }
+  releaseReservation(r);
+  return sessions;
+}
+
+void ServerIdleSessionController::releaseReservation(const Reservation& r) {
+  auto& slot = slots_[r.slot];
+  auto reservations = slot.reservations.load(std::memory_order_relaxed);
+  while (generationOf(reservations) == r.generation) {
+    auto reserved = reservedOf(reservations);
+    auto released = makeReservations(
+        r.generation, reserved > r.count ? reserved - r.count : 0);
+    if (slot.reservations.compare_exchange_weak(
+            reservations, released, std::memory_order_acq_rel)) {
+      break;
+    }
   }
-  return nullptr;
 }
 
 } // namespace proxygen
@@ -11,7 +11,10 @@
 
 #include "proxygen/lib/http/connpool/SessionPool.h"
 
+#include <atomic>
 #include <folly/futures/Future.h>
+#include <folly/lang/Align.h>
+#include <vector>
 
 namespace proxygen {
 
@@ -21,12 +24,23 @@ namespace proxygen {
  *
  * Server class uses it to move idle transactions between threads, if necessary.
  * All public methods are thread-safe.
+ *
+ * Each SessionPool registers a slot and publishes how many idle sessions it
+ * has there.  A thread that runs dry scans the slots without locking, picks
+ * the pool with the most idle sessions that aren't already promised to
+ * another thread, reserves some with a CAS, and takes them all in a single
+ * hop to the pool's thread.
  */
 class ServerIdleSessionController {
  public:
-  explicit ServerIdleSessionController(unsigned int maxIdleCount = 2)
-      : maxIdleCount_(maxIdleCount) {
-  }
+  /**
+   * @param maxIdleCount The most idle sessions a single pool offers to
+   *                     other threads.
+   * @param maxPools     The number of pools that can register; pools beyond
+   *                     that keep their idle sessions to themselves.
+   */
+  explicit ServerIdleSessionController(unsigned int maxIdleCount = 2,
+                                       uint32_t maxPools = 128);
 
   /**
    * Transfer idle session from another thread, if available.
@@ -35,10 +49,20 @@ class ServerIdleSessionController {
   folly::Future<HTTPSessionBase*> getIdleSession();
 
   /**
-   * Add/remove session info (called by SessionPool when state changes).
+   * Transfer up to max idle sessions from another thread in one hop.  The
+   * sessions all come from the same pool; fewer than max, or none, may be
+   * available.  Sessions are detached from their thread, and the caller
+   * must attach them to its own.
    */
-  void addIdleSession(const HTTPSessionBase* session, SessionPool* sessionPool);
-  void removeIdleSession(const HTTPSessionBase* session);
+  folly::Future<std::vector<HTTPSessionBase*>> getIdleSessions(uint32_t max);
+
+  /**
+   * Called by SessionPool on its own thread.  registerPool() returns the
+   * pool's slot, or -1 if all are taken.
+   */
+  int32_t registerPool(SessionPool* sessionPool);
+  void unregisterPool(int32_t slot);
+  void setNumIdleSessions(int32_t slot, uint32_t numIdle);
 
   /**
    * Stop all session transfers.
@@ -46,38 +70,54 @@ class ServerIdleSessionController {
   void markForDeath();
 
  protected:
-  struct IdleSessionInfo {
-    const HTTPSessionBase* session;
-    SessionPool* sessionPool;
+  struct alignas(folly::hardware_destructive_interference_size) PoolSlot {
+    std::atomic<SessionPool*> sessionPool{nullptr};
+    std::atomic<folly::EventBase*> evb{nullptr};
+    // Written only by the pool's thread
+    std::atomic<uint32_t> numIdle{0};
+    // Registration generation in the high 32 bits, and the number of
+    // sessions promised to other threads but not handed over yet in the low
+    // 32.  A reservation made against one registration can't be released
+    // against the next.
+    std::atomic<uint64_t> reservations{0};
   };
 
-  using IdleSessionList = std::list<IdleSessionInfo>;
-  using IdleSessionListIter = IdleSessionList::iterator;
+  struct Reservation {
+    SessionPool* sessionPool{nullptr};
+    folly::EventBase* evb{nullptr};
+    int32_t slot{-1};
+    uint32_t generation{0};
+    uint32_t count{0};
+  };
 
   /**
-   * Find available session pool (thread) to tranfer an idle session from.
-   * Remove it from the map.
+   * Find the session pool (thread) with the most idle sessions that haven't
+   * been reserved yet, skipping the pools of skipEvb, and reserve up to max
+   * of them.
    */
-  SessionPool* FOLLY_NULLABLE popBestIdlePool();
+  Reservation reserveIdleSessions(uint32_t max, folly::EventBase* skipEvb);
 
-  bool isMarkedForDeath() {
-    std::lock_guard<std::mutex> lock(lock_);
-    return markedForDeath_;
-  }
+  /**
+   * Runs on the pool's thread.  Hand over the reserved sessions still idle
+   * and release the reservation.
+   */
+  std::vector<HTTPSessionBase*> takeIdleSessions(const Reservation& r);
 
-  std::mutex lock_;
-  /*
-   * List of idle sessions. Normally, addIdleSession() adds to the end and
-   * popBestIdlePool() removes from the beginning, thus keeping the list sorted
-   * by idle age.
-   * Additionally, we also support arbitrary removals if some session stops
-   * being idle or dies or gets re-used out of order if many threads attempt
-   * session transfer at the same time.
+  /**
+   * Reserve one idle session from any pool and return its pool.
    */
-  IdleSessionList sessionsByIdleAge_;
-  // Store iterators in sessionsByIdleAge_ to be able to find sessions.
-  std::unordered_map<const HTTPSessionBase*, IdleSessionListIter> sessionMap_;
-  bool markedForDeath_{false};
+  SessionPool* FOLLY_NULLABLE popBestIdlePool() {
+    return reserveIdleSessions(1, nullptr).sessionPool;
+  }
+
+  bool isMarkedForDeath() const {
+    return markedForDeath_.load(std::memory_order_acquire);
+  }
+
+  void releaseReservation(const Reservation& r);
+
+  std::vector<PoolSlot> slots_;
+  std::atomic<bool> markedForDeath_{false};
 
   const unsigned int maxIdleCount_;
 };
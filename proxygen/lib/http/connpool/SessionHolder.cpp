@@ -46,13 +46,14 @@ bool SessionHolder::isPoolable(const HTTPSessionBase* sess) {
          (sess->getNumOutgoingStreams() || sess->isReusable());
 }
 
-bool SessionHolder::shouldAgeOut(std::chrono::milliseconds maxAge) const {
+bool SessionHolder::shouldAgeOut(std::chrono::milliseconds maxAge,
+                                 std::chrono::milliseconds horizon) const {
   if (maxAge.count() <= 0) {
     return false;
   }
   double sessMaxAge = (1 + jitter_) * maxAge.count();
   auto age = millisecondsSince(session_->getSetupTransportInfo().acceptTime);
-  return age >= std::chrono::milliseconds(int64_t(sessMaxAge));
+  return age + horizon >= std::chrono::milliseconds(int64_t(sessMaxAge));
 }
 
 const HTTPSessionBase& SessionHolder::getSession() const {
@@ -101,7 +101,13 @@ class SessionHolder : private HTTPSessionBase::InfoCallback {
    */
   void link();
 
-  bool shouldAgeOut(std::chrono::milliseconds maxAge) const;
+  /**
+   * True if the session is, or within `horizon` will be, older than maxAge
+   * (with this holder's jitter applied).
+   */
+  bool shouldAgeOut(
+      std::chrono::milliseconds maxAge,
+      std::chrono::milliseconds horizon = std::chrono::milliseconds(0)) const;
   void describe(std::ostream& os) const;
 
   Endpoint getEndpoint() {
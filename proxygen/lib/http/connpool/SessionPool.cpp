@@ -31,6 +31,9 @@ SessionPool::SessionPool(
       serverIdleSessionController_(serverIdleSessionController),
       // Here we rely on workers setting evb in EventBaseManager.
       evb_(folly::EventBaseManager::get()->getEventBase()) {
+  if (serverIdleSessionController_) {
+    serverIdleSlot_ = serverIdleSessionController_->registerPool(this);
+  }
 }
 
 SessionPool::~SessionPool() {
@@ -38,6 +41,9 @@ SessionPool::~SessionPool() {
   drainSessionList(unfilledSessionList_);
   drainSessionList(fullSessionList_);
   DCHECK(empty());
+  if (serverIdleSessionController_) {
+    serverIdleSessionController_->unregisterPool(serverIdleSlot_);
+  }
 }
 
 void SessionPool::setMaxIdleSessions(uint32_t num) {
@@ -61,6 +67,18 @@ uint32_t SessionPool::getNumIdleSessions() const {
   return idleSessionList_.size();
 }
 
+uint32_t SessionPool::getNumAvailableSessions(
+    std::chrono::milliseconds horizon) const {
+  uint32_t available = 0;
+  for (const auto& holder : idleSessionList_) {
+    available += !holder.shouldAgeOut(maxAge_, horizon);
+  }
+  for (const auto& holder : unfilledSessionList_) {
+    available += !holder.shouldAgeOut(maxAge_, horizon);
+  }
+  return available;
+}
+
 uint32_t SessionPool::getNumActiveSessions() const {
   return unfilledSessionList_.size() + fullSessionList_.size();
 }
@@ -188,7 +206,8 @@ void SessionPool::detachIdle(SessionHolder* sess) {
     threadIdleSessionController_->onDetachIdle(sess);
   }
   if (serverIdleSessionController_) {
-    serverIdleSessionController_->removeIdleSession(&sess->getSession());
+    serverIdleSessionController_->setNumIdleSessions(serverIdleSlot_,
+                                                     idleSessionList_.size());
   }
 }
 
@@ -213,7 +232,8 @@ void SessionPool::attachIdle(SessionHolder* sess) {
   } else {
     idleSessionList_.push_back(*sess);
     if (serverIdleSessionController_) {
-      serverIdleSessionController_->addIdleSession(&sess->getSession(), this);
+      serverIdleSessionController_->setNumIdleSessions(
+          serverIdleSlot_, idleSessionList_.size());
     }
     if (threadIdleSessionController_) {
       threadIdleSessionController_->onAttachIdle(sess);
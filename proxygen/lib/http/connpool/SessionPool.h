@@ -105,6 +105,13 @@ class SessionPool : private SessionHolder::Callback {
    */
   uint32_t getNumFullSessions() const;
 
+  /**
+   * Returns the number of sessions that can take another transaction (idle
+   * or active but not full) and won't age out within `horizon`.
+   */
+  uint32_t getNumAvailableSessions(
+      std::chrono::milliseconds horizon = std::chrono::milliseconds(0)) const;
+
   /**
    * Returns the number of active sessions (txns > 0).
    */
@@ -229,6 +236,8 @@ class SessionPool : private SessionHolder::Callback {
   ThreadIdleSessionController* threadIdleSessionController_{nullptr};
   // Manages idle sessions for the same server across threads.
   ServerIdleSessionController* serverIdleSessionController_{nullptr};
+  // Where this pool publishes its idle count to serverIdleSessionController_
+  int32_t serverIdleSlot_{-1};
 
   folly::EventBase* const evb_{nullptr};
 };
@@ -0,0 +1,190 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "proxygen/lib/http/connpool/SessionPoolWarmer.h"
+#include "proxygen/lib/http/connpool/ThreadIdleSessionController.h"
+
+#include <algorithm>
+#include <folly/Random.h>
+#include <folly/io/async/AsyncSSLSocket.h>
+#include <proxygen/lib/http/session/HTTPUpstreamSession.h>
+
+namespace proxygen {
+
+namespace {
+
+std::chrono::milliseconds jittered(std::chrono::milliseconds duration,
+                                   double jitter) {
+  if (jitter <= 0) {
+    return duration;
+  }
+  return std::chrono::milliseconds(int64_t(
+    duration.count() * (1 + folly::Random::randDouble(-jitter, jitter))));
+}
+
+}
+
+SessionPoolWarmer::SessionPoolWarmer(
+    SessionPool* pool,
+    std::unique_ptr<Connector> connector,
+    folly::HHWheelTimer* timer,
+    Options options,
+    ThreadIdleSessionController* threadController)
+    : pool_(CHECK_NOTNULL(pool)),
+      connector_(std::move(connector)),
+      timer_(CHECK_NOTNULL(timer)),
+      options_(std::move(options)),
+      threadController_(threadController) {
+  CHECK(connector_);
+  CHECK_GE(options_.jitter, 0);
+  CHECK_LT(options_.jitter, 1);
+}
+
+SessionPoolWarmer::~SessionPoolWarmer() {
+  // Cancels the connects in flight
+  connector_.reset();
+}
+
+void SessionPoolWarmer::start() {
+  started_ = true;
+  refill();
+  scheduleCheck(jittered(options_.checkInterval, options_.jitter));
+}
+
+HTTPTransaction* SessionPoolWarmer::getTransaction(
+    HTTPTransaction::Handler* handler) {
+  auto txn = pool_->getTransaction(handler);
+  if (txn) {
+    stats_.warmHits++;
+  } else {
+    stats_.coldMisses++;
+  }
+  refill();
+  return txn;
+}
+
+void SessionPoolWarmer::timeoutExpired() noexcept {
+  refill();
+  scheduleCheck(jittered(options_.checkInterval, options_.jitter));
+}
+
+void SessionPoolWarmer::connectSuccess(HTTPUpstreamSession* session) {
+  CHECK_GT(connectsInFlight_, 0);
+  connectsInFlight_--;
+  stats_.connects++;
+  backoff_ = std::chrono::milliseconds(0);
+  pool_->putSession(session);
+  refill();
+}
+
+void SessionPoolWarmer::connectError(const folly::AsyncSocketException& ex) {
+  CHECK_GT(connectsInFlight_, 0);
+  connectsInFlight_--;
+  stats_.connectErrors++;
+  backoff_ = std::min(std::max(backoff_ * 2, options_.minBackoff),
+                      options_.maxBackoff);
+  auto delay = jittered(backoff_, options_.jitter);
+  VLOG(3) << "Warm connect failed, retrying in " << delay.count()
+          << "ms: " << folly::exceptionStr(ex);
+  backoffUntil_ = std::chrono::steady_clock::now() + delay;
+  scheduleCheck(delay);
+}
+
+uint32_t SessionPoolWarmer::getTarget() const {
+  // More idle sessions than the pool keeps would just be purged
+  return std::min(options_.minSessions, pool_->getMaxIdleSessions());
+}
+
+void SessionPoolWarmer::refill() {
+  if (!started_ || std::chrono::steady_clock::now() < backoffUntil_) {
+    return;
+  }
+  auto target = getTarget();
+  // A connect can complete synchronously and re-enter, so recount each time
+  while (connectsInFlight_ < options_.maxConnectsInFlight &&
+         pool_->getNumAvailableSessions(options_.refreshAhead) +
+           connectsInFlight_ < target) {
+    if (threadController_ &&
+        threadController_->getTotalIdleSessions() + connectsInFlight_ >=
+          threadController_->getMaxIdleSessions()) {
+      // Would evict another pool's idle session
+      break;
+    }
+    connectsInFlight_++;
+    connector_->connect(this);
+  }
+}
+
+void SessionPoolWarmer::scheduleCheck(std::chrono::milliseconds delay) {
+  timer_->scheduleTimeout(this, delay);
+}
+
+HTTPWarmerConnector::Attempt::Attempt(HTTPWarmerConnector& parent,
+                                      HTTPConnector::Callback* cb)
+    : connector(this, parent.timer_), parent_(parent), cb_(cb) {
+}
+
+void HTTPWarmerConnector::Attempt::connectSuccess(
+    HTTPUpstreamSession* session) {
+  auto sslSocket = session->getTransport()
+    ->getUnderlyingTransport<folly::AsyncSSLSocket>();
+  if (sslSocket) {
+    parent_.sslSession_.reset(sslSocket->getSSLSession());
+  }
+  auto cb = cb_;
+  parent_.attempts_.erase(self);
+  cb->connectSuccess(session);
+}
+
+void HTTPWarmerConnector::Attempt::connectError(
+    const folly::AsyncSocketException& ex) {
+  auto cb = cb_;
+  parent_.attempts_.erase(self);
+  cb->connectError(ex);
+}
+
+HTTPWarmerConnector::HTTPWarmerConnector(
+    folly::EventBase* evb,
+    folly::HHWheelTimer* timer,
+    const folly::SocketAddress& addr,
+    std::chrono::milliseconds connectTimeout,
+    folly::SSLContextPtr sslContext,
+    std::string serverName,
+    std::string plaintextProtocol)
+    : evb_(CHECK_NOTNULL(evb)),
+      timer_(timer),
+      addr_(addr),
+      connectTimeout_(connectTimeout),
+      sslContext_(std::move(sslContext)),
+      serverName_(std::move(serverName)),
+      plaintextProtocol_(std::move(plaintextProtocol)) {
+}
+
+void HTTPWarmerConnector::connect(HTTPConnector::Callback* cb) {
+  attempts_.push_front(std::make_unique<Attempt>(*this, cb));
+  auto attempt = attempts_.front().get();
+  attempt->self = attempts_.begin();
+  if (sslContext_) {
+    attempt->connector.connectSSL(evb_,
+                                  addr_,
+                                  sslContext_,
+                                  sslSession_.get(),
+                                  connectTimeout_,
+                                  folly::AsyncSocket::emptyOptionMap,
+                                  folly::AsyncSocket::anyAddress(),
+                                  serverName_);
+  } else {
+    if (!plaintextProtocol_.empty()) {
+      attempt->connector.setPlaintextProtocol(plaintextProtocol_);
+    }
+    attempt->connector.connect(evb_, addr_, connectTimeout_);
+  }
+}
+
+} // namespace proxygen
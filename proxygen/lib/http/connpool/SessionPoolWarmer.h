@@ -0,0 +1,177 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/SocketAddress.h>
+#include <folly/io/async/HHWheelTimer.h>
+#include <folly/io/async/SSLContext.h>
+#include <list>
+#include <proxygen/lib/http/HTTPConnector.h>
+#include <wangle/client/ssl/SSLSession.h>
+
+#include "proxygen/lib/http/connpool/SessionPool.h"
+
+namespace proxygen {
+
+class ThreadIdleSessionController;
+
+/**
+ * Keeps a SessionPool stocked with a minimum number of sessions that can
+ * take a transaction right away, so that the first requests after a deploy
+ * or a quiet period don't all pay for a connect and handshake at once.
+ *
+ * Sessions about to reach the pool's maxAge are replaced ahead of time.
+ * Checks run on a jittered interval and open a bounded number of
+ * connections at a time, so pools started together don't reconnect in
+ * lockstep.  Failed connects back off exponentially.
+ *
+ * The warmer never fills the pool past its idle session limit or the
+ * ThreadIdleSessionController's, either of which would just purge the
+ * sessions again.
+ *
+ * Must be used from the pool's thread, and destroyed before the pool.
+ */
+class SessionPoolWarmer
+    : private folly::HHWheelTimer::Callback
+    , private HTTPConnector::Callback {
+ public:
+  /**
+   * Opens sessions to the pool's endpoint.  Several connects may be in
+   * flight at once; destroying the Connector cancels them without
+   * callbacks.
+   */
+  class Connector {
+   public:
+    virtual ~Connector() {
+    }
+    virtual void connect(HTTPConnector::Callback* cb) = 0;
+  };
+
+  struct Options {
+    // Idle or unfilled sessions to keep
+    uint32_t minSessions{1};
+    // Sessions that will age out within this long are replaced now
+    std::chrono::milliseconds refreshAhead{std::chrono::seconds(10)};
+    std::chrono::milliseconds checkInterval{std::chrono::seconds(1)};
+    // Fraction of checkInterval and backoff to randomize by, [0, 1)
+    double jitter{0.2};
+    uint32_t maxConnectsInFlight{2};
+    std::chrono::milliseconds minBackoff{std::chrono::seconds(1)};
+    std::chrono::milliseconds maxBackoff{std::chrono::seconds(30)};
+  };
+
+  struct Stats {
+    // getTransaction() found a pooled session
+    uint64_t warmHits{0};
+    // getTransaction() found nothing; the caller has to connect
+    uint64_t coldMisses{0};
+    uint64_t connects{0};
+    uint64_t connectErrors{0};
+  };
+
+  SessionPoolWarmer(SessionPool* pool,
+                    std::unique_ptr<Connector> connector,
+                    folly::HHWheelTimer* timer,
+                    Options options,
+                    ThreadIdleSessionController* threadController = nullptr);
+
+  ~SessionPoolWarmer() override;
+
+  /**
+   * Connect up to the minimum now and start the periodic checks.
+   */
+  void start();
+
+  /**
+   * SessionPool::getTransaction() that keeps the warm-hit stats and tops
+   * the pool back up.  Returns nullptr on a cold miss.
+   */
+  HTTPTransaction* getTransaction(HTTPTransaction::Handler* handler);
+
+  const Stats& getStats() const {
+    return stats_;
+  }
+
+  uint32_t getNumConnectsInFlight() const {
+    return connectsInFlight_;
+  }
+
+ private:
+  // HHWheelTimer::Callback
+  void timeoutExpired() noexcept override;
+
+  // HTTPConnector::Callback
+  void connectSuccess(HTTPUpstreamSession* session) override;
+  void connectError(const folly::AsyncSocketException& ex) override;
+
+  /**
+   * Start connects toward the target, unless backing off.
+   */
+  void refill();
+  uint32_t getTarget() const;
+  void scheduleCheck(std::chrono::milliseconds delay);
+
+  SessionPool* const pool_;
+  std::unique_ptr<Connector> connector_;
+  folly::HHWheelTimer* const timer_;
+  const Options options_;
+  ThreadIdleSessionController* const threadController_;
+  Stats stats_;
+  uint32_t connectsInFlight_{0};
+  std::chrono::milliseconds backoff_{0};
+  std::chrono::steady_clock::time_point backoffUntil_;
+  bool started_{false};
+};
+
+/**
+ * SessionPoolWarmer::Connector over HTTPConnector.  With an SSL context,
+ * each connect offers the TLS session of the last successful one for
+ * resumption.
+ */
+class HTTPWarmerConnector : public SessionPoolWarmer::Connector {
+ public:
+  HTTPWarmerConnector(folly::EventBase* evb,
+                      folly::HHWheelTimer* timer,
+                      const folly::SocketAddress& addr,
+                      std::chrono::milliseconds connectTimeout,
+                      folly::SSLContextPtr sslContext = nullptr,
+                      std::string serverName = "",
+                      std::string plaintextProtocol = "");
+
+  void connect(HTTPConnector::Callback* cb) override;
+
+ private:
+  class Attempt : public HTTPConnector::Callback {
+   public:
+    Attempt(HTTPWarmerConnector& parent, HTTPConnector::Callback* cb);
+
+    void connectSuccess(HTTPUpstreamSession* session) override;
+    void connectError(const folly::AsyncSocketException& ex) override;
+
+    HTTPConnector connector;
+    std::list<std::unique_ptr<Attempt>>::iterator self;
+
+   private:
+    HTTPWarmerConnector& parent_;
+    HTTPConnector::Callback* cb_;
+  };
+
+  folly::EventBase* const evb_;
+  folly::HHWheelTimer* const timer_;
+  const folly::SocketAddress addr_;
+  const std::chrono::milliseconds connectTimeout_;
+  const folly::SSLContextPtr sslContext_;
+  const std::string serverName_;
+  const std::string plaintextProtocol_;
+  wangle::SSLSessionPtr sslSession_;
+  std::list<std::unique_ptr<Attempt>> attempts_;
+};
+
+} // namespace proxygen
@@ -57,6 +57,13 @@ class ThreadIdleSessionController {
    */
   uint32_t getTotalIdleSessions() const;
 
+  /**
+   * Get the limit idle sessions are purged down to.
+   */
+  uint32_t getMaxIdleSessions() const {
+    return totalIdleSessions_;
+  }
+
  private:
   uint32_t totalIdleSessions_;
   SecondarySessionList idleSessionsLRU_;
@@ -0,0 +1,209 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/init/Init.h>
+#include <gflags/gflags.h>
+#include <proxygen/lib/http/connpool/ServerIdleSessionController.h>
+#include <proxygen/lib/http/connpool/SessionPool.h>
+#include <proxygen/lib/utils/Time.h>
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+// Contention on the idle session bookkeeping shared by all threads of a
+// server.  Every thread plays a SessionPool: each iteration one of its
+// sessions goes idle and is reused again, which the pool reports to the
+// controller, and every --steal_every iterations the thread looks for an
+// idle session on another thread.  Thread hops are left out; only the
+// bookkeeping each side does under contention is measured.
+//
+// ./server_idle_session_controller_benchmark --duration_ms=2000
+//
+// Prints one line per implementation and thread count:
+//   impl=mutex      threads=16  Mops/s=...  steals/s=...
+// where
+//   mutex      the previous controller: one list and map under a mutex
+//   lockfree   per-pool idle counts published in atomics, CAS reservations
+
+DEFINE_int32(max_threads, 32, "Largest thread count; runs 1, 2, 4, ...");
+DEFINE_int32(duration_ms, 1000, "Run time per implementation and count");
+DEFINE_int32(steal_every, 16, "Iterations between steal attempts");
+DEFINE_int32(idle_per_thread, 4, "Idle sessions each thread holds");
+
+using namespace proxygen;
+
+namespace {
+
+// The list and map under one lock that ServerIdleSessionController used
+class MutexIdleController {
+ public:
+  void addIdleSession(const HTTPSessionBase* session, SessionPool* pool) {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (sessionMap_.find(session) != sessionMap_.end()) {
+      return;
+    }
+    sessionMap_[session] =
+        sessionsByIdleAge_.insert(sessionsByIdleAge_.end(), {session, pool});
+  }
+
+  void removeIdleSession(const HTTPSessionBase* session) {
+    std::lock_guard<std::mutex> lock(lock_);
+    auto it = sessionMap_.find(session);
+    if (it != sessionMap_.end()) {
+      sessionsByIdleAge_.erase(it->second);
+      sessionMap_.erase(it);
+    }
+  }
+
+  struct IdleSessionInfo {
+    const HTTPSessionBase* session;
+    SessionPool* pool;
+  };
+
+  IdleSessionInfo popOldestIdleSession() {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (sessionsByIdleAge_.empty()) {
+      return {nullptr, nullptr};
+    }
+    auto ret = sessionsByIdleAge_.front();
+    sessionsByIdleAge_.pop_front();
+    sessionMap_.erase(ret.session);
+    return ret;
+  }
+
+ private:
+  std::mutex lock_;
+  std::list<IdleSessionInfo> sessionsByIdleAge_;
+  std::unordered_map<const HTTPSessionBase*,
+                     std::list<IdleSessionInfo>::iterator>
+      sessionMap_;
+};
+
+class LockFreeIdleController : public ServerIdleSessionController {
+ public:
+  LockFreeIdleController()
+      : ServerIdleSessionController(FLAGS_idle_per_thread + 1) {
+  }
+
+  bool steal(folly::EventBase* evb) {
+    auto r = reserveIdleSessions(1, evb);
+    if (r.sessionPool) {
+      // Stands in for the hop to the pool's thread
+      releaseReservation(r);
+      return true;
+    }
+    return false;
+  }
+};
+
+// Only used as map keys
+const HTTPSessionBase* fakeSession(size_t thread, size_t i) {
+  static char sessions[1024 * 64];
+  return reinterpret_cast<const HTTPSessionBase*>(
+      &sessions[(thread * (FLAGS_idle_per_thread + 1) + i) %
+                sizeof(sessions)]);
+}
+
+void runMutex(size_t thread,
+              MutexIdleController& ctrl,
+              std::atomic<bool>& stop,
+              uint64_t& ops,
+              uint64_t& steals) {
+  SessionPool pool;
+  for (int i = 0; i < FLAGS_idle_per_thread; ++i) {
+    ctrl.addIdleSession(fakeSession(thread, i), &pool);
+  }
+  auto churn = fakeSession(thread, FLAGS_idle_per_thread);
+  while (!stop.load(std::memory_order_relaxed)) {
+    ctrl.addIdleSession(churn, &pool);
+    ctrl.removeIdleSession(churn);
+    if (++ops % FLAGS_steal_every == 0) {
+      auto victim = ctrl.popOldestIdleSession();
+      if (victim.pool) {
+        // Stands in for the hop; the session goes idle again elsewhere
+        ctrl.addIdleSession(victim.session, victim.pool);
+        steals++;
+      }
+    }
+  }
+}
+
+void runLockFree(LockFreeIdleController& ctrl,
+                 std::atomic<bool>& stop,
+                 uint64_t& ops,
+                 uint64_t& steals) {
+  SessionPool pool;
+  auto slot = ctrl.registerPool(&pool);
+  CHECK_GE(slot, 0);
+  uint32_t idle = FLAGS_idle_per_thread;
+  ctrl.setNumIdleSessions(slot, idle);
+  while (!stop.load(std::memory_order_relaxed)) {
+    ctrl.setNumIdleSessions(slot, idle + 1);
+    ctrl.setNumIdleSessions(slot, idle);
+    if (++ops % FLAGS_steal_every == 0 && ctrl.steal(pool.getEventBase())) {
+      steals++;
+    }
+  }
+  ctrl.unregisterPool(slot);
+}
+
+template <typename F>
+void runThreads(const char* impl, size_t numThreads, F run) {
+  std::atomic<bool> stop{false};
+  std::vector<uint64_t> ops(numThreads), steals(numThreads);
+  std::vector<std::thread> threads;
+  auto start = getCurrentTime();
+  for (size_t i = 0; i < numThreads; ++i) {
+    threads.emplace_back([&, i] { run(i, stop, ops[i], steals[i]); });
+  }
+  /* sleep override */
+  std::this_thread::sleep_for(std::chrono::milliseconds(FLAGS_duration_ms));
+  stop = true;
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  auto elapsedUs = microsecondsSince(start).count();
+  uint64_t totalOps = 0, totalSteals = 0;
+  for (size_t i = 0; i < numThreads; ++i) {
+    totalOps += ops[i];
+    totalSteals += steals[i];
+  }
+  printf("impl=%-9s threads=%-3zu Mops/s=%8.2f  steals/s=%10.0f\n",
+         impl,
+         numThreads,
+         totalOps / double(elapsedUs),
+         totalSteals / (elapsedUs / 1e6));
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  folly::init(&argc, &argv);
+  for (size_t threads = 1; threads <= size_t(FLAGS_max_threads);
+       threads *= 2) {
+    MutexIdleController mutexCtrl;
+    runThreads("mutex",
+               threads,
+               [&](size_t i, std::atomic<bool>& stop, uint64_t& ops,
+                   uint64_t& steals) {
+                 runMutex(i, mutexCtrl, stop, ops, steals);
+               });
+    LockFreeIdleController lockFreeCtrl;
+    runThreads("lockfree",
+               threads,
+               [&](size_t, std::atomic<bool>& stop, uint64_t& ops,
+                   uint64_t& steals) {
+                 runLockFree(lockFreeCtrl, stop, ops, steals);
+               });
+  }
+  return 0;
+}
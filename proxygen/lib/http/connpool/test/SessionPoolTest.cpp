@@ -15,6 +15,7 @@
 #include "proxygen/lib/http/connpool/ThreadIdleSessionController.h"
 
 #include <folly/io/async/EventBaseManager.h>
+#include <set>
 #include <wangle/acceptor/ConnectionManager.h>
 
 using namespace proxygen;
@@ -491,6 +492,8 @@ TEST_F(SessionPoolFixture, DrainOnShutdown) {
 
 class TestIdleController : public ServerIdleSessionController {
  public:
+  using ServerIdleSessionController::ServerIdleSessionController;
+
   // expose this method as public for tests.
   SessionPool* popBestIdlePool() {
     return ServerIdleSessionController::popBestIdlePool();
@@ -568,31 +571,102 @@ TEST_F(SessionPoolFixture, PurgeAddedSessionTest) {
 TEST_F(SessionPoolFixture, ServerIdleSessionControllerTest) {
   TestIdleController ctrl;
   SessionPool p1, p2;
-  auto s1 = makeParallelSession(), s2 = makeParallelSession(),
-       s3 = makeParallelSession();
+  auto slot1 = ctrl.registerPool(&p1), slot2 = ctrl.registerPool(&p2);
   EXPECT_EQ(ctrl.popBestIdlePool(), nullptr);
 
-  ctrl.addIdleSession(s1, &p1);
+  ctrl.setNumIdleSessions(slot1, 1);
   EXPECT_EQ(ctrl.popBestIdlePool(), &p1);
+  // p1's session is reserved now
   EXPECT_EQ(ctrl.popBestIdlePool(), nullptr);
 
-  ctrl.addIdleSession(s3, &p2);
-  ctrl.addIdleSession(s1, &p1);
+  // The pool with the most unreserved idle sessions goes first
+  ctrl.setNumIdleSessions(slot1, 2);
+  ctrl.setNumIdleSessions(slot2, 2);
   EXPECT_EQ(ctrl.popBestIdlePool(), &p2);
-  EXPECT_EQ(ctrl.popBestIdlePool(), &p1);
+  std::set<SessionPool*> pools{ctrl.popBestIdlePool(), ctrl.popBestIdlePool()};
+  EXPECT_EQ(pools, std::set<SessionPool*>({&p1, &p2}));
   EXPECT_EQ(ctrl.popBestIdlePool(), nullptr);
 
-  ctrl.addIdleSession(s1, &p1);
-  ctrl.addIdleSession(s2, &p1);
-  ctrl.removeIdleSession(s1);
-  ctrl.addIdleSession(s3, &p2);
+  // Unregistered pools are never picked, and the slot is reusable
+  ctrl.unregisterPool(slot1);
+  EXPECT_EQ(ctrl.popBestIdlePool(), nullptr);
+  EXPECT_EQ(ctrl.registerPool(&p1), slot1);
+  ctrl.setNumIdleSessions(slot1, 1);
   EXPECT_EQ(ctrl.popBestIdlePool(), &p1);
-  EXPECT_EQ(ctrl.popBestIdlePool(), &p2);
+  ctrl.unregisterPool(slot1);
+  ctrl.unregisterPool(slot2);
+}
+
+TEST_F(SessionPoolFixture, ServerIdleSessionControllerLimits) {
+  TestIdleController ctrl(/*maxIdleCount=*/2, /*maxPools=*/1);
+  SessionPool p1, p2;
+  auto slot1 = ctrl.registerPool(&p1);
+  EXPECT_EQ(ctrl.registerPool(&p2), -1);
+
+  // Only maxIdleCount of a pool's idle sessions are offered
+  ctrl.setNumIdleSessions(slot1, 5);
+  EXPECT_EQ(ctrl.popBestIdlePool(), &p1);
+  EXPECT_EQ(ctrl.popBestIdlePool(), &p1);
+  EXPECT_EQ(ctrl.popBestIdlePool(), nullptr);
+  ctrl.unregisterPool(slot1);
+}
+
+TEST_F(SessionPoolFixture, MoveIdleSessionBatchBetweenThreadsTest) {
+  TestIdleController ctrl;
+  std::vector<HTTPUpstreamSession*> sessions;
+  SessionPool* pool1 = nullptr;
+
+  folly::Baton<> t1InitBaton, transferBaton;
+  std::thread t1([&] {
+    folly::EventBaseManager::get()->setEventBase(&evb_, false);
+    SessionPool p1(this,
+                   10,
+                   std::chrono::seconds(30),
+                   std::chrono::milliseconds(0),
+                   nullptr,
+                   &ctrl);
+    pool1 = &p1;
+    for (int i = 0; i < 3; ++i) {
+      sessions.push_back(makeParallelSession());
+      p1.putSession(sessions.back());
+    }
+    t1InitBaton.post();
+    evb_.loopForever();
+  });
+
+  folly::EventBase evb2;
+  std::thread t2([&] { evb2.loopForever(); });
+
+  t1InitBaton.wait();
+  std::vector<HTTPSessionBase*> transferred;
+  evb2.runInEventBaseThread([&] {
+    folly::EventBaseManager::get()->setEventBase(&evb2, false);
+    // Two of the three sessions arrive in one hop, oldest first
+    ctrl.getIdleSessions(2).then(
+        &evb2, [&](std::vector<HTTPSessionBase*> idleSessions) {
+          transferred = std::move(idleSessions);
+          transferBaton.post();
+        });
+  });
+  transferBaton.wait();
+  ASSERT_EQ(transferred.size(), 2);
+  EXPECT_EQ(transferred[0], sessions[0]);
+  EXPECT_EQ(transferred[1], sessions[1]);
+
+  // The third is still offered
+  evb_.runInEventBaseThreadAndWait([&] {
+    EXPECT_EQ(pool1->getNumIdleSessions(), 1);
+  });
+  EXPECT_EQ(ctrl.popBestIdlePool(), pool1);
   EXPECT_EQ(ctrl.popBestIdlePool(), nullptr);
 
-  s1->drain();
-  s2->drain();
-  s3->drain();
+  for (auto session : transferred) {
+    session->drain();
+  }
+  evb_.terminateLoopSoon();
+  evb2.terminateLoopSoon();
+  t1.join();
+  t2.join();
 }
 
 TEST_F(SessionPoolFixture, WritePausedSessionNotMarkedAsIdle) {
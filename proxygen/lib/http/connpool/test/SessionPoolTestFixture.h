@@ -21,10 +21,10 @@
 
 namespace proxygen {
 
-folly::SocketAddress local("127.0.0.1", 80);
-folly::SocketAddress peer("127.0.0.1", 12345);
+const folly::SocketAddress local("127.0.0.1", 80);
+const folly::SocketAddress peer("127.0.0.1", 12345);
 
-std::unique_ptr<testing::NiceMock<MockHTTPCodec>> makeCodecCommon() {
+inline std::unique_ptr<testing::NiceMock<MockHTTPCodec>> makeCodecCommon() {
   static int txnIdx = 1;
   auto codec = std::make_unique<testing::NiceMock<MockHTTPCodec>>();
   EXPECT_CALL(*codec, getTransportDirection())
@@ -37,7 +37,7 @@ std::unique_ptr<testing::NiceMock<MockHTTPCodec>> makeCodecCommon() {
   return codec;
 }
 
-std::unique_ptr<testing::NiceMock<MockHTTPCodec>> makeSerialCodec() {
+inline std::unique_ptr<testing::NiceMock<MockHTTPCodec>> makeSerialCodec() {
   auto codec = makeCodecCommon();
   EXPECT_CALL(*codec, supportsParallelRequests())
       .WillRepeatedly(testing::Return(false));
@@ -46,7 +46,7 @@ std::unique_ptr<testing::NiceMock<MockHTTPCodec>> makeSerialCodec() {
   return codec;
 }
 
-std::unique_ptr<testing::NiceMock<MockHTTPCodec>> makeParallelCodec() {
+inline std::unique_ptr<testing::NiceMock<MockHTTPCodec>> makeParallelCodec() {
   auto codec = makeCodecCommon();
   EXPECT_CALL(*codec, supportsParallelRequests())
       .WillRepeatedly(testing::Return(true));
@@ -78,11 +78,12 @@ class SessionPoolFixture
     return makeSession(makeParallelCodec());
   }
 
-  HTTPUpstreamSession* makeSession(std::unique_ptr<HTTPCodec> codec) {
+  HTTPUpstreamSession* makeSession(std::unique_ptr<HTTPCodec> codec,
+                                   TimePoint acceptTime = getCurrentTime()) {
     auto sock =
         folly::AsyncTransportWrapper::UniquePtr(new TestAsyncTransport(&evb_));
     wangle::TransportInfo tinfo;
-    tinfo.acceptTime = getCurrentTime();
+    tinfo.acceptTime = acceptTime;
     return new HTTPUpstreamSession(timeouts_.get(),
                                    std::move(sock),
                                    local,
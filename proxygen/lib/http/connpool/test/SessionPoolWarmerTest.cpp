@@ -0,0 +1,210 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "proxygen/lib/http/connpool/test/SessionPoolTestFixture.h"
+
+#include "proxygen/lib/http/connpool/SessionPool.h"
+#include "proxygen/lib/http/connpool/SessionPoolWarmer.h"
+#include "proxygen/lib/http/connpool/ThreadIdleSessionController.h"
+
+using namespace proxygen;
+using namespace std;
+using namespace testing;
+
+namespace {
+
+/**
+ * Holds on to the connect callbacks so the test decides when and how each
+ * connect completes.
+ */
+class FakeConnector : public SessionPoolWarmer::Connector {
+ public:
+  explicit FakeConnector(std::vector<HTTPConnector::Callback*>& pending)
+      : pending_(pending) {
+  }
+
+  void connect(HTTPConnector::Callback* cb) override {
+    pending_.push_back(cb);
+  }
+
+ private:
+  std::vector<HTTPConnector::Callback*>& pending_;
+};
+
+} // namespace
+
+class SessionPoolWarmerTest : public SessionPoolFixture {
+ protected:
+  std::unique_ptr<SessionPoolWarmer> makeWarmer(
+      SessionPool* pool,
+      SessionPoolWarmer::Options options,
+      ThreadIdleSessionController* threadController = nullptr) {
+    return std::make_unique<SessionPoolWarmer>(
+      pool,
+      std::make_unique<FakeConnector>(pending_),
+      timeouts_.get(),
+      std::move(options),
+      threadController);
+  }
+
+  void succeed(HTTPUpstreamSession* session) {
+    ASSERT_FALSE(pending_.empty());
+    auto cb = pending_.front();
+    pending_.erase(pending_.begin());
+    cb->connectSuccess(session);
+  }
+
+  void fail() {
+    ASSERT_FALSE(pending_.empty());
+    auto cb = pending_.front();
+    pending_.erase(pending_.begin());
+    cb->connectError(folly::AsyncSocketException(
+      folly::AsyncSocketException::NOT_OPEN, "connect failed"));
+  }
+
+  std::vector<HTTPConnector::Callback*> pending_;
+};
+
+TEST_F(SessionPoolWarmerTest, StartFillsToMinimum) {
+  SessionPool p(this, 10);
+  SessionPoolWarmer::Options options;
+  options.minSessions = 3;
+  options.maxConnectsInFlight = 2;
+  auto warmer = makeWarmer(&p, options);
+
+  // Nothing happens until started
+  EXPECT_TRUE(pending_.empty());
+  warmer->start();
+  EXPECT_EQ(pending_.size(), 2);
+  EXPECT_EQ(warmer->getNumConnectsInFlight(), 2);
+
+  // Each completed connect frees a slot for the next one
+  succeed(makeParallelSession());
+  EXPECT_EQ(p.getNumIdleSessions(), 1);
+  EXPECT_EQ(pending_.size(), 2);
+
+  succeed(makeParallelSession());
+  succeed(makeParallelSession());
+  EXPECT_EQ(p.getNumIdleSessions(), 3);
+  EXPECT_TRUE(pending_.empty());
+  EXPECT_EQ(warmer->getNumConnectsInFlight(), 0);
+  EXPECT_EQ(warmer->getStats().connects, 3);
+}
+
+TEST_F(SessionPoolWarmerTest, MinimumCappedByPool) {
+  SessionPool p(this, 1);
+  SessionPoolWarmer::Options options;
+  options.minSessions = 4;
+  auto warmer = makeWarmer(&p, options);
+
+  warmer->start();
+  EXPECT_EQ(pending_.size(), 1);
+  succeed(makeParallelSession());
+  EXPECT_TRUE(pending_.empty());
+}
+
+TEST_F(SessionPoolWarmerTest, WarmHitsAndColdMisses) {
+  SessionPool p(this, 10);
+  SessionPoolWarmer::Options options;
+  options.minSessions = 1;
+  auto warmer = makeWarmer(&p, options);
+
+  warmer->start();
+  EXPECT_EQ(pending_.size(), 1);
+  // The connect hasn't finished; the caller has to make its own
+  EXPECT_EQ(warmer->getTransaction(this), nullptr);
+  EXPECT_EQ(warmer->getStats().coldMisses, 1);
+  EXPECT_EQ(pending_.size(), 1);
+
+  succeed(makeSerialSession());
+  auto txn = warmer->getTransaction(this);
+  ASSERT_NE(txn, nullptr);
+  EXPECT_EQ(warmer->getStats().warmHits, 1);
+
+  // The serial session is busy now, so a replacement is on the way
+  EXPECT_EQ(p.getNumAvailableSessions(), 0);
+  EXPECT_EQ(pending_.size(), 1);
+
+  p.setMaxIdleSessions(0);
+  txn->sendAbort();
+}
+
+TEST_F(SessionPoolWarmerTest, ConnectErrorBacksOff) {
+  SessionPool p(this, 10);
+  SessionPoolWarmer::Options options;
+  options.minSessions = 2;
+  options.maxConnectsInFlight = 1;
+  options.minBackoff = std::chrono::seconds(10);
+  options.jitter = 0;
+  auto warmer = makeWarmer(&p, options);
+
+  warmer->start();
+  EXPECT_EQ(pending_.size(), 1);
+  fail();
+  EXPECT_EQ(warmer->getStats().connectErrors, 1);
+  EXPECT_EQ(warmer->getNumConnectsInFlight(), 0);
+
+  // No retry until the backoff has passed, even on demand
+  EXPECT_TRUE(pending_.empty());
+  EXPECT_EQ(warmer->getTransaction(this), nullptr);
+  EXPECT_TRUE(pending_.empty());
+}
+
+TEST_F(SessionPoolWarmerTest, ThreadIdleSessionLimit) {
+  ThreadIdleSessionController threadController(2);
+  SessionPool other(this,
+                    10,
+                    std::chrono::seconds(30),
+                    std::chrono::milliseconds(0),
+                    &threadController);
+  SessionPool p(this,
+                10,
+                std::chrono::seconds(30),
+                std::chrono::milliseconds(0),
+                &threadController);
+  other.putSession(makeParallelSession());
+  EXPECT_EQ(threadController.getTotalIdleSessions(), 1);
+
+  SessionPoolWarmer::Options options;
+  options.minSessions = 3;
+  options.maxConnectsInFlight = 3;
+  auto warmer = makeWarmer(&p, options, &threadController);
+
+  // Only one more idle session fits on this thread
+  warmer->start();
+  EXPECT_EQ(pending_.size(), 1);
+  succeed(makeParallelSession());
+  EXPECT_EQ(threadController.getTotalIdleSessions(), 2);
+  EXPECT_EQ(other.getNumIdleSessions(), 1);
+  EXPECT_TRUE(pending_.empty());
+}
+
+TEST_F(SessionPoolWarmerTest, RefreshAheadOfMaxAge) {
+  // Max age is jittered to [5.6s, 10.4s]
+  SessionPool p(
+      this, 10, std::chrono::seconds(30), std::chrono::seconds(8));
+  p.putSession(makeSession(makeParallelCodec(),
+                           getCurrentTime() - std::chrono::seconds(5)));
+  ASSERT_EQ(p.getNumIdleSessions(), 1);
+  EXPECT_EQ(p.getNumAvailableSessions(), 1);
+  EXPECT_EQ(p.getNumAvailableSessions(std::chrono::seconds(6)), 0);
+
+  SessionPoolWarmer::Options options;
+  options.minSessions = 1;
+  options.refreshAhead = std::chrono::seconds(6);
+  auto warmer = makeWarmer(&p, options);
+
+  // The pooled session ages out within refreshAhead, so replace it now
+  warmer->start();
+  EXPECT_EQ(pending_.size(), 1);
+  succeed(makeParallelSession());
+  EXPECT_EQ(p.getNumIdleSessions(), 2);
+  EXPECT_EQ(p.getNumAvailableSessions(std::chrono::seconds(6)), 1);
+  EXPECT_TRUE(pending_.empty());
+}
@@ -0,0 +1,175 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/http/session/EgressPacer.h>
+
+#include <algorithm>
+#include <cmath>
+#include <folly/Optional.h>
+#include <glog/logging.h>
+#include <limits>
+#include <proxygen/lib/http/session/HTTPTransaction.h>
+
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+
+namespace proxygen {
+
+const uint64_t EgressPacer::kWriteQuantum = 8192;
+
+EgressPacer::EgressPacer(const WheelTimerInstance& timer) : timer_(timer) {
+}
+
+EgressPacer::~EgressPacer() {
+  if (isScheduled()) {
+    cancelTimeout();
+  }
+}
+
+void EgressPacer::detachTimer() {
+  if (isScheduled()) {
+    cancelTimeout();
+  }
+  timer_ = WheelTimerInstance();
+}
+
+void EgressPacer::attachTimer(const WheelTimerInstance& timer) {
+  DCHECK(!isScheduled());
+  timer_ = timer;
+  scheduleNextWakeup();
+}
+
+void EgressPacer::setRate(uint64_t bitsPerSecond, uint64_t burstBytes) {
+  bytesPerSecond_ = bitsPerSecond / 8;
+  if (bitsPerSecond > 0 && bytesPerSecond_ == 0) {
+    VLOG(4) << "pacer: rate too low (" << bitsPerSecond << "), ignoring";
+  }
+  if (burstBytes == 0) {
+    burstBytes = std::max(bytesPerSecond_ / 100, kWriteQuantum);
+  }
+  burstBytes_ = burstBytes;
+  tokens_ = burstBytes_;
+  lastRefill_ = getCurrentTime();
+  if (sessionWaiting_) {
+    // Tokens are available (or pacing is off); let the session retry
+    sessionWaiting_ = false;
+    if (callback_) {
+      callback_->onEgressPacerResume();
+    }
+  }
+}
+
+void EgressPacer::refill(TimePoint now) {
+  auto elapsed = microsecondsBetween(now, lastRefill_);
+  lastRefill_ = now;
+  tokens_ = std::min(
+      burstBytes_, tokens_ + double(elapsed.count()) * bytesPerSecond_ / 1e6);
+}
+
+uint64_t EgressPacer::getAvailable(TimePoint now) {
+  if (!isPacing()) {
+    return std::numeric_limits<uint64_t>::max();
+  }
+  refill(now);
+  double threshold = std::min(burstBytes_, double(kWriteQuantum));
+  if (tokens_ >= threshold) {
+    return uint64_t(tokens_);
+  }
+  auto waitUs = std::ceil((threshold - tokens_) * 1e6 / bytesPerSecond_);
+  sessionDeadline_ = now + microseconds(int64_t(waitUs));
+  sessionWaiting_ = true;
+  VLOG(4) << "pacer: session blocked for " << int64_t(waitUs) << "us";
+  scheduleWakeup(sessionDeadline_);
+  return 0;
+}
+
+void EgressPacer::consume(uint64_t bytes) {
+  if (isPacing()) {
+    tokens_ -= bytes;
+  }
+}
+
+void EgressPacer::delayTransaction(HTTPTransaction* txn, milliseconds delay) {
+  auto deadline = getCurrentTime() + delay;
+  delayedTxns_[txn] = deadline;
+  scheduleWakeup(deadline);
+}
+
+void EgressPacer::cancelTransaction(HTTPTransaction* txn) {
+  delayedTxns_.erase(txn);
+  if (delayedTxns_.empty() && !sessionWaiting_ && isScheduled()) {
+    cancelTimeout();
+  }
+}
+
+void EgressPacer::scheduleWakeup(TimePoint deadline) {
+  if (isScheduled()) {
+    if (nextWakeup_ <= deadline) {
+      return;
+    }
+    cancelTimeout();
+  }
+  // The wheel timer has millisecond granularity; round up so waiters are
+  // never woken before their deadline.
+  auto delay = microsecondsBetween(deadline, getCurrentTime());
+  milliseconds delayMs(std::max<int64_t>((delay.count() + 999) / 1000, 1));
+  nextWakeup_ = deadline;
+  timer_.scheduleTimeout(this, delayMs);
+}
+
+void EgressPacer::timeoutExpired() noexcept {
+  auto now = getCurrentTime();
+  // Resuming a transaction may run handler code that delays, detaches or
+  // aborts other waiters, so look the next one up after every callback
+  // instead of iterating over a snapshot.
+  for (;;) {
+    auto it = std::find_if(
+        delayedTxns_.begin(),
+        delayedTxns_.end(),
+        [now](const std::pair<HTTPTransaction* const, TimePoint>& waiter) {
+          return waiter.second <= now;
+        });
+    if (it == delayedTxns_.end()) {
+      break;
+    }
+    auto txn = it->first;
+    delayedTxns_.erase(it);
+    txn->rateLimitTimeoutExpired();
+  }
+
+  if (sessionWaiting_ && sessionDeadline_ <= now) {
+    sessionWaiting_ = false;
+    if (callback_) {
+      callback_->onEgressPacerResume();
+    }
+  }
+
+  if (isScheduled()) {
+    // A callback already rescheduled us
+    return;
+  }
+  scheduleNextWakeup();
+}
+
+void EgressPacer::scheduleNextWakeup() {
+  folly::Optional<TimePoint> next;
+  if (sessionWaiting_) {
+    next = sessionDeadline_;
+  }
+  for (const auto& waiter : delayedTxns_) {
+    if (!next || waiter.second < *next) {
+      next = waiter.second;
+    }
+  }
+  if (next) {
+    scheduleWakeup(*next);
+  }
+}
+
+} // namespace proxygen
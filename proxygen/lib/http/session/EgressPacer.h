@@ -0,0 +1,134 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/io/async/HHWheelTimer.h>
+#include <proxygen/lib/utils/Time.h>
+#include <proxygen/lib/utils/WheelTimerInstance.h>
+#include <unordered_map>
+
+namespace proxygen {
+
+class HTTPTransaction;
+
+/**
+ * Paces egress for a whole session with a token bucket, and owns the single
+ * timer used to resume rate limited transactions of that session.
+ *
+ * The session asks getAvailable() how many bytes it may generate before each
+ * round of HTTP2PriorityQueue::nextEgress, and reports what it generated with
+ * consume().  The bytes are split among transactions by priority weight, so
+ * the session rate is shared fairly.  When no tokens are left the pacer arms
+ * its timer and invokes Callback::onEgressPacerResume() once enough tokens
+ * have accumulated.
+ *
+ * Transactions with their own rate limit (HTTPTransaction::setEgressRateLimit)
+ * register their delay with delayTransaction() instead of scheduling their
+ * own timer; all deadlines are served by the same wheel timer callback.
+ */
+class EgressPacer : private folly::HHWheelTimer::Callback {
+ public:
+  class Callback {
+   public:
+    virtual ~Callback() {
+    }
+    virtual void onEgressPacerResume() noexcept = 0;
+  };
+
+  explicit EgressPacer(const WheelTimerInstance& timer);
+
+  ~EgressPacer() override;
+
+  void setCallback(Callback* callback) {
+    callback_ = callback;
+  }
+
+  /**
+   * Stop using the current timer, eg: before the session moves to another
+   * EventBase.  A pending wakeup is rescheduled by attachTimer().
+   */
+  void detachTimer();
+
+  void attachTimer(const WheelTimerInstance& timer);
+
+  /**
+   * Limit the session egress rate.  A rate of 0 disables session pacing.
+   *
+   * @param bitsPerSecond  The sustained rate
+   * @param burstBytes     The bucket depth. 0 means 10ms worth of the rate,
+   *                       and never less than one write quantum.
+   */
+  void setRate(uint64_t bitsPerSecond, uint64_t burstBytes = 0);
+
+  bool isPacing() const {
+    return bytesPerSecond_ > 0;
+  }
+
+  /**
+   * True while the session waits for tokens after getAvailable() returned 0.
+   */
+  bool isBlocked() const {
+    return sessionWaiting_;
+  }
+
+  /**
+   * Returns the number of bytes the session may generate now.  Returns 0
+   * when fewer than one write quantum of tokens is available; the pacer then
+   * schedules a resume callback.
+   */
+  uint64_t getAvailable(TimePoint now = getCurrentTime());
+
+  /**
+   * Deduct bytes that were generated.  The bucket may go into debt when a
+   * write overshoots the grant (eg: frame headers).
+   */
+  void consume(uint64_t bytes);
+
+  /**
+   * Resume txn (via HTTPTransaction::rateLimitTimeoutExpired) after delay.
+   * A transaction has at most one pending delay; a new one replaces it.
+   */
+  void delayTransaction(HTTPTransaction* txn, std::chrono::milliseconds delay);
+
+  void cancelTransaction(HTTPTransaction* txn);
+
+  size_t getNumDelayedTransactions() const {
+    return delayedTxns_.size();
+  }
+
+  /**
+   * Smallest grant worth waking up for: fewer bytes than this would be split
+   * into tiny DATA frames when several transactions share the session.
+   */
+  static const uint64_t kWriteQuantum;
+
+ private:
+  void refill(TimePoint now);
+  void scheduleWakeup(TimePoint deadline);
+  void scheduleNextWakeup();
+
+  // HHWheelTimer::Callback
+  void timeoutExpired() noexcept override;
+  void callbackCanceled() noexcept override {
+  }
+
+  WheelTimerInstance timer_;
+  Callback* callback_{nullptr};
+  uint64_t bytesPerSecond_{0};
+  double burstBytes_{0};
+  double tokens_{0};
+  TimePoint lastRefill_{};
+  TimePoint nextWakeup_{};
+  bool sessionWaiting_{false};
+  TimePoint sessionDeadline_{};
+  std::unordered_map<HTTPTransaction*, TimePoint> delayedTxns_;
+};
+
+} // namespace proxygen
@@ -1454,6 +1454,10 @@ class HQSession
       return nullptr;
     }
 
+    folly::EventBase* getEventBase() const override {
+      return session_.getEventBase();
+    }
+
     bool isReplaySafe() const override {
       return session_.isReplaySafe();
     }
@@ -22,6 +22,7 @@
 #include <proxygen/lib/http/codec/HTTPChecks.h>
 #include <proxygen/lib/http/session/HTTPSessionController.h>
 #include <proxygen/lib/http/session/HTTPSessionStats.h>
+#include <proxygen/lib/http/session/SocketTimestampByteEventTracker.h>
 #include <wangle/acceptor/ConnectionManager.h>
 #include <wangle/acceptor/SocketOptions.h>
 
@@ -52,6 +53,9 @@ static const uint32_t kWriteReadyMax = 65536;
 // Higher = lower latency, less prioritization
 static const uint32_t kMaxWritesPerLoop = 32;
 
+// How often to refresh the RTT used for receive window autotuning
+static const std::chrono::seconds kRttSampleInterval{5};
+
 static constexpr folly::StringPiece kClientLabel =
     "EXPORTER HTTP CERTIFICATE client";
 static constexpr folly::StringPiece kServerLabel =
@@ -154,6 +158,7 @@ HTTPSession::HTTPSession(const WheelTimerInstance& timeout,
       resetSocketOnShutdown_(false),
       inLoopCallback_(false) {
   byteEventTracker_ = std::make_shared<ByteEventTracker>(this);
+  egressPacer_.setCallback(this);
   initialReceiveWindow_ = receiveStreamWindowSize_ = receiveSessionWindowSize_ =
       codec_->getDefaultWindowSize();
 
@@ -265,6 +270,9 @@ void HTTPSession::setupCodec() {
   if (codec_->supportsSessionFlowControl() && !connFlowControl_) {
     connFlowControl_ = new FlowControlFilter(*this, writeBuf_, codec_.call());
     codec_.addFilters(std::unique_ptr<FlowControlFilter>(connFlowControl_));
+    if (sessionAutoTuning_) {
+      connFlowControl_->setReceiveWindowAutoTuning(*sessionAutoTuning_);
+    }
     // if we really support switching from spdy <-> h2, we need to update
     // existing flow control filter
   }
@@ -288,6 +296,12 @@ HTTPSession::~HTTPSession() {
     flowControlTimeout_.cancelTimeout();
   }
 
+  if (byteEventTracker_) {
+    // The tracker may outlive sock_
+    byteEventTracker_->disableSocketTimestampEvents();
+  }
+  notSentBacklogWatcher_.reset();
+
   runDestroyCallbacks();
 }
 
@@ -322,6 +336,49 @@ void HTTPSession::setByteEventTracker(
   }
 }
 
+bool HTTPSession::enableSocketTimestampByteEvents(
+    std::chrono::milliseconds timeout) {
+  auto tracker = std::make_shared<SocketTimestampByteEventTracker>(
+      this, sock_->getEventBase(), timeout);
+  if (!tracker->enableSocketTimestamps(sock_.get())) {
+    VLOG(3) << *this << " socket timestamps are not supported";
+    return false;
+  }
+  setByteEventTracker(std::move(tracker));
+  return true;
+}
+
+bool HTTPSession::setEgressNotSentLowWatermark(uint32_t lowWatermark) {
+  auto asyncSocket = sock_->getUnderlyingTransport<folly::AsyncSocket>();
+  if (!asyncSocket || lowWatermark == 0) {
+    return false;
+  }
+  auto watcher =
+      std::make_unique<NotSentBacklogWatcher>(asyncSocket, lowWatermark, this);
+  if (!watcher->init()) {
+    VLOG(3) << *this << " TCP_NOTSENT_LOWAT is not supported";
+    return false;
+  }
+  notSentBacklogWatcher_ = std::move(watcher);
+  return true;
+}
+
+bool HTTPSession::setZeroCopyEgressThreshold(uint64_t minBytes) {
+  // TLS encrypts into fresh buffers, so there is nothing to save there
+  auto asyncSocket = dynamic_cast<folly::AsyncSocket*>(sock_.get());
+  if (!asyncSocket || sock_->getUnderlyingTransport<folly::AsyncSSLSocket>() ||
+      minBytes == 0) {
+    return false;
+  }
+  if (!asyncSocket->setZeroCopy(true)) {
+    VLOG(3) << *this << " MSG_ZEROCOPY is not supported";
+    return false;
+  }
+  zeroCopySocket_ = asyncSocket;
+  zeroCopyThreshold_ = minBytes;
+  return true;
+}
+
 void HTTPSession::setSessionStats(HTTPSessionStats* stats) {
   HTTPSessionBase::setSessionStats(stats);
   if (byteEventTracker_) {
@@ -344,6 +401,22 @@ void HTTPSession::setFlowControl(size_t initialReceiveWindow,
   }
 }
 
+void HTTPSession::setFlowControlAutoTuning(
+    size_t maxReceiveStreamWindowSize,
+    size_t maxReceiveSessionWindowSize) {
+  CHECK(!started_);
+  streamAutoTuning_ = WindowAutoTuner::Options(
+      uint32_t(receiveStreamWindowSize_),
+      uint32_t(std::max(receiveStreamWindowSize_, maxReceiveStreamWindowSize)));
+  sessionAutoTuning_ = WindowAutoTuner::Options(
+      uint32_t(receiveSessionWindowSize_),
+      uint32_t(
+          std::max(receiveSessionWindowSize_, maxReceiveSessionWindowSize)));
+  if (connFlowControl_) {
+    connFlowControl_->setReceiveWindowAutoTuning(*sessionAutoTuning_);
+  }
+}
+
 void HTTPSession::setEgressSettings(const SettingsList& inSettings) {
   VLOG_IF(4, started_) << "Must flush egress settings to peer";
   HTTPSettings* settings = codec_->getEgressSettings();
@@ -1230,6 +1303,12 @@ void HTTPSession::onPingRequest(uint64_t uniqueID) {
 
 void HTTPSession::onPingReply(uint64_t uniqueID) {
   VLOG(4) << *this << " got ping reply with id=" << uniqueID;
+  if (pingSentTime_) {
+    // Only one PING is timed at a time, so this reply may belong to an
+    // earlier untimed PING; that can only make the sample larger.
+    onRttSample(microsecondsBetween(getCurrentTime(), *pingSentTime_));
+    pingSentTime_ = folly::none;
+  }
   if (infoCallback_) {
     infoCallback_->onPingReplyReceived();
   }
@@ -1927,6 +2006,7 @@ void HTTPSession::notifyIngressBodyProcessed(uint32_t bytes) noexcept {
       connFlowControl_->ingressBytesProcessed(writeBuf_, bytes)) {
     scheduleWrite();
   }
+  maybeSendRttPing();
 }
 
 void HTTPSession::notifyEgressBodyBuffered(int64_t bytes) noexcept {
@@ -1985,7 +2065,17 @@ unique_ptr<IOBuf> HTTPSession::getNextToSend(bool* cork, bool* som, bool* eom) {
 
   // We always tack on at least one body packet to the current write buf
   // This ensures that a short HTTPS response will go out in a single SSL record
-  while (!txnEgressQueue_.empty()) {
+  bool paceLimited = false;
+  auto pacedStart = writeBuf_.chainLength();
+  // Don't pick body bytes while the kernel still has plenty to send; they are
+  // chosen from the priority queue once it drains (onNotSentBacklogDrained)
+  bool backlogged = !txnEgressQueue_.empty() && notSentBacklogWatcher_ &&
+                    notSentBacklogWatcher_->isBacklogged();
+  if (backlogged) {
+    VLOG(4) << *this << " kernel send backlog above low watermark, deferring "
+            << "body writes";
+  }
+  while (!backlogged && !txnEgressQueue_.empty()) {
     uint32_t toSend = kWriteReadyMax;
     if (connFlowControl_) {
       if (connFlowControl_->getAvailableSend() == 0) {
@@ -1995,6 +2085,17 @@ unique_ptr<IOBuf> HTTPSession::getNextToSend(bool* cork, bool* som, bool* eom) {
       }
       toSend = std::min(toSend, connFlowControl_->getAvailableSend());
     }
+    if (egressPacer_.isPacing()) {
+      // The pacer calls onEgressPacerResume once tokens are available again
+      auto available = egressPacer_.getAvailable();
+      if (available == 0) {
+        VLOG(4) << *this << " session egress rate limited, skipping remaining "
+                << "body writes this loop";
+        paceLimited = true;
+        break;
+      }
+      toSend = uint32_t(std::min<uint64_t>(toSend, available));
+    }
     txnEgressQueue_.nextEgress(nextEgressResults_,
                                isSpdyCodecProtocol(codec_->getProtocol()));
     CHECK(!nextEgressResults_.empty()); // Queue was non empty, so this must be
@@ -2039,6 +2140,9 @@ unique_ptr<IOBuf> HTTPSession::getNextToSend(bool* cork, bool* som, bool* eom) {
       break;
     }
   }
+  if (egressPacer_.isPacing()) {
+    egressPacer_.consume(writeBuf_.chainLength() - pacedStart);
+  }
   *som = false;
   *eom = false;
   if (byteEventTracker_) {
@@ -2068,7 +2172,8 @@ unique_ptr<IOBuf> HTTPSession::getNextToSend(bool* cork, bool* som, bool* eom) {
   }
 
   // cork if there are txns with pending egress and room to send them
-  *cork = !txnEgressQueue_.empty() && !isConnWindowFull();
+  *cork = !txnEgressQueue_.empty() && !isConnWindowFull() && !paceLimited &&
+          !backlogged;
   return writeBuf_.move();
 }
 
@@ -2119,6 +2224,17 @@ void HTTPSession::runLoopCallback() noexcept {
     segment->setCork(cork);
     segment->setEOR(eom);
     segment->setTimestampTX(som || eom); // timestamp for buffers w/ som or eom
+    // The socket turns zerocopy off for a while if the kernel runs out of
+    // optmem, in which case the write is copied
+    if (zeroCopySocket_ && len >= zeroCopyThreshold_ &&
+        zeroCopySocket_->getZeroCopy()) {
+      segment->setZeroCopy(true);
+      zeroCopyWrites_++;
+      zeroCopyBytes_ += len;
+      if (sessionStats_) {
+        sessionStats_->recordZeroCopyWrite(len);
+      }
+    }
 
     pendingWrites_.push_back(*segment);
     if (!writeTimeout_.isScheduled()) {
@@ -2140,7 +2256,9 @@ void HTTPSession::runLoopCallback() noexcept {
     // writeChain can result in a writeError and trigger the shutdown code path
   }
   if (numActiveWrites_ == 0 && !writesShutdown() && hasMoreWrites() &&
-      (!connFlowControl_ || connFlowControl_->getAvailableSend())) {
+      (!connFlowControl_ || connFlowControl_->getAvailableSend()) &&
+      !egressPacer_.isBlocked() &&
+      !(notSentBacklogWatcher_ && notSentBacklogWatcher_->isWaiting())) {
     scheduleWrite();
   }
 
@@ -2230,6 +2348,7 @@ void HTTPSession::shutdownTransport(bool shutdownReads,
     if (!hasMoreWrites() &&
         (transactions_.empty() || codec_->closeOnEgressComplete())) {
       writes_ = SocketState::SHUTDOWN;
+      notSentBacklogWatcher_.reset();
       if (byteEventTracker_) {
         byteEventTracker_->drainByteEvents();
       }
@@ -2299,6 +2418,7 @@ void HTTPSession::shutdownTransportWithReset(ProxygenError errorCode,
 
   if (!writesShutdown()) {
     writes_ = SocketState::SHUTDOWN;
+    notSentBacklogWatcher_.reset();
     IOBuf::destroy(writeBuf_.move());
     while (!pendingWrites_.empty()) {
       pendingWrites_.front().detach();
@@ -2411,11 +2531,41 @@ bool HTTPSession::shouldShutdown() const {
 size_t HTTPSession::sendPing() {
   const size_t bytes = codec_->generatePingRequest(writeBuf_);
   if (bytes) {
+    if (!pingSentTime_) {
+      pingSentTime_ = getCurrentTime();
+    }
     scheduleWrite();
   }
   return bytes;
 }
 
+void HTTPSession::maybeSendRttPing() {
+  if ((!streamAutoTuning_ && !sessionAutoTuning_) || pingSentTime_ ||
+      !codec_->supportsParallelRequests() || draining_) {
+    return;
+  }
+  if (srtt_.count() > 0 &&
+      getCurrentTime() - lastRttSample_ < kRttSampleInterval) {
+    return;
+  }
+  sendPing();
+}
+
+void HTTPSession::onRttSample(std::chrono::microseconds rtt) {
+  // Same smoothing as the TCP SRTT (RFC 6298)
+  if (srtt_.count() == 0) {
+    srtt_ = rtt;
+  } else {
+    srtt_ = (srtt_ * 7 + rtt) / 8;
+  }
+  lastRttSample_ = getCurrentTime();
+  VLOG(4) << *this << " rtt sample=" << rtt.count()
+          << "us srtt=" << srtt_.count() << "us";
+  if (connFlowControl_) {
+    connFlowControl_->setSmoothedRtt(srtt_);
+  }
+}
+
 HTTPCodec::StreamID HTTPSession::sendPriority(http2::PriorityUpdate pri) {
   if (!codec_->supportsParallelRequests()) {
     // For HTTP/1.1, don't call createStream()
@@ -2516,6 +2666,9 @@ HTTPTransaction* HTTPSession::createTransaction(
   ++liveTransactions_;
   incrementSeqNo();
   txn->setReceiveWindow(receiveStreamWindowSize_);
+  if (streamAutoTuning_) {
+    txn->setReceiveWindowAutoTuning(*streamAutoTuning_);
+  }
 
   if (isUpstream() && !txn->isPushed()) {
     incrementOutgoingStreams();
@@ -2766,6 +2919,33 @@ void HTTPSession::onConnectionSendWindowClosed() {
   }
 }
 
+void HTTPSession::onConnectionReceiveWindowResized(uint32_t capacity) {
+  // The read buffer limit tracks the session window so that reads are not
+  // paused while the peer still holds credit to send.
+  HTTPSessionBase::setReadBufferLimit(
+      std::max<uint32_t>(receiveSessionWindowSize_, capacity));
+}
+
+void HTTPSession::onEgressPacerResume() noexcept {
+  VLOG(4) << *this << " session egress rate limit lifted";
+  scheduleWrite();
+}
+
+void HTTPSession::onNotSentBacklogDrained() noexcept {
+  VLOG(4) << *this << " kernel send backlog drained";
+  scheduleWrite();
+}
+
+bool HTTPSession::delayEgress(HTTPTransaction* txn,
+                              std::chrono::milliseconds delay) noexcept {
+  egressPacer_.delayTransaction(txn, delay);
+  return true;
+}
+
+void HTTPSession::cancelEgressDelay(HTTPTransaction* txn) noexcept {
+  egressPacer_.cancelTransaction(txn);
+}
+
 HTTPCodec::StreamID HTTPSession::getGracefulGoawayAck() const {
   if (!codec_->isReusable() || codec_->isWaitingToDrain()) {
     // TODO: just track last stream ID inside HTTPSession since this logic
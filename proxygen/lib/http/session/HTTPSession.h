@@ -27,6 +27,7 @@
 #include <proxygen/lib/http/session/HTTPEvent.h>
 #include <proxygen/lib/http/session/HTTPSessionBase.h>
 #include <proxygen/lib/http/session/HTTPTransaction.h>
+#include <proxygen/lib/http/session/NotSentBacklogWatcher.h>
 #include <proxygen/lib/http/session/SecondaryAuthManagerBase.h>
 #include <proxygen/lib/utils/WheelTimerInstance.h>
 #include <queue>
@@ -49,6 +50,8 @@ class HTTPSession
     , protected folly::AsyncTransport::BufferCallback
     , protected HTTPPriorityMapFactoryProvider
     , private FlowControlFilter::Callback
+    , private EgressPacer::Callback
+    , private NotSentBacklogWatcher::Callback
     , private HTTPCodec::Callback
     , private folly::EventBase::LoopCallback
     , private folly::AsyncTransportWrapper::ReadCallback
@@ -93,6 +96,41 @@ class HTTPSession
 
   void setByteEventTracker(std::shared_ptr<ByteEventTracker> byteEventTracker);
 
+  /**
+   * Track byte events with kernel timestamps: transactions are notified when
+   * their first and last body bytes are transmitted, and when the last byte
+   * is acknowledged (lastByteAcked).  Events without a timestamp are dropped
+   * after timeout.  Returns false if the transport does not support it.
+   */
+  bool enableSocketTimestampByteEvents(std::chrono::milliseconds timeout);
+
+  /**
+   * Generate body egress just in time: sets TCP_NOTSENT_LOWAT on the socket
+   * and holds back transaction egress while at least lowWatermark bytes are
+   * still unsent in the kernel, resuming when the socket becomes writable.
+   * Keeping the kernel backlog small lets newly arrived high priority
+   * streams go out ahead of queued bulk data.  Returns false if the
+   * transport does not support it.
+   */
+  bool setEgressNotSentLowWatermark(uint32_t lowWatermark);
+
+  /**
+   * Send writes of at least minBytes with MSG_ZEROCOPY, so large bodies are
+   * not copied into the kernel.  The socket holds each buffer until the
+   * kernel reports the send complete.  Returns false if the transport is not
+   * a plaintext AsyncSocket or the kernel does not support SO_ZEROCOPY, in
+   * which case writes are copied as usual.
+   */
+  bool setZeroCopyEgressThreshold(uint64_t minBytes);
+
+  uint64_t getNumZeroCopyWrites() const {
+    return zeroCopyWrites_;
+  }
+
+  uint64_t getZeroCopyBytes() const {
+    return zeroCopyBytes_;
+  }
+
   void setSessionStats(HTTPSessionStats* stats) override;
   /**
    * Set flow control properties on the session.
@@ -109,6 +147,20 @@ class HTTPSession
                       size_t receiveStreamWindowSize,
                       size_t receiveSessionWindowSize) override;
 
+  /**
+   * Enable receive window autotuning.  The session and stream receive
+   * windows start at the sizes given to setFlowControl and grow toward the
+   * measured bandwidth-delay product, up to the maximums below.  They shrink
+   * back toward the configured sizes when the peer sends slowly.  The RTT
+   * is measured with PING frames.  Must be called after setFlowControl and
+   * before startNow.
+   *
+   * @param maxReceiveStreamWindowSize   upper bound for per-stream windows
+   * @param maxReceiveSessionWindowSize  upper bound for the session window
+   */
+  void setFlowControlAutoTuning(size_t maxReceiveStreamWindowSize,
+                                size_t maxReceiveSessionWindowSize);
+
   /**
    * Set outgoing settings for this session
    */
@@ -136,6 +188,15 @@ class HTTPSession
 
   bool getCurrentTransportInfo(wangle::TransportInfo* tinfo) override;
 
+  std::chrono::microseconds getSmoothedRtt() const noexcept override {
+    return srtt_;
+  }
+
+  bool delayEgress(HTTPTransaction* txn,
+                   std::chrono::milliseconds delay) noexcept override;
+
+  void cancelEgressDelay(HTTPTransaction* txn) noexcept override;
+
   /**
    * Set the maximum number of transactions the remote can open at once.
    */
@@ -761,6 +822,24 @@ class HTTPSession
    */
   void onConnectionSendWindowOpen() override;
   void onConnectionSendWindowClosed() override;
+  void onConnectionReceiveWindowResized(uint32_t capacity) override;
+
+  // EgressPacer::Callback
+  void onEgressPacerResume() noexcept override;
+
+  // NotSentBacklogWatcher::Callback
+  void onNotSentBacklogDrained() noexcept override;
+
+  /**
+   * Update the smoothed RTT from a PING round trip.
+   */
+  void onRttSample(std::chrono::microseconds rtt);
+
+  /**
+   * Sends a PING to refresh the RTT used for receive window autotuning,
+   * unless a sample is recent enough or a PING is already outstanding.
+   */
+  void maybeSendRttPing();
 
   /**
    * Get the id of the stream we should ack in a graceful GOAWAY
@@ -894,6 +973,14 @@ class HTTPSession
       }
     }
 
+    void setZeroCopy(bool zeroCopy) {
+      if (zeroCopy) {
+        flags_ = flags_ | folly::WriteFlags::WRITE_MSG_ZEROCOPY;
+      } else {
+        unSet(flags_, folly::WriteFlags::WRITE_MSG_ZEROCOPY);
+      }
+    }
+
     /**
      * Clear the session. This is used if the session
      * does not want to receive future notification about this segment.
@@ -982,6 +1069,15 @@ class HTTPSession
 
   std::shared_ptr<ByteEventTracker> byteEventTracker_{nullptr};
 
+  // Set if body egress is held back while the kernel has unsent data
+  std::unique_ptr<NotSentBacklogWatcher> notSentBacklogWatcher_;
+
+  // Set if writes of at least zeroCopyThreshold_ bytes are sent zerocopy
+  folly::AsyncSocket* zeroCopySocket_{nullptr};
+  uint64_t zeroCopyThreshold_{0};
+  uint64_t zeroCopyWrites_{0};
+  uint64_t zeroCopyBytes_{0};
+
   /**
    * Max number of bytes to egress per session
    */
@@ -992,6 +1088,13 @@ class HTTPSession
   size_t receiveStreamWindowSize_{0};
   size_t receiveSessionWindowSize_{0};
 
+  // Receive window autotuning, see setFlowControlAutoTuning
+  folly::Optional<WindowAutoTuner::Options> streamAutoTuning_;
+  folly::Optional<WindowAutoTuner::Options> sessionAutoTuning_;
+  folly::Optional<TimePoint> pingSentTime_;
+  TimePoint lastRttSample_;
+  std::chrono::microseconds srtt_{0};
+
   class ShutdownTransportCallback : public folly::EventBase::LoopCallback {
    public:
     explicit ShutdownTransportCallback(HTTPSession* session)
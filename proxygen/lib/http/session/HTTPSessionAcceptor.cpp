@@ -12,6 +12,7 @@
 #include <proxygen/lib/http/codec/HTTP2Codec.h>
 #include <proxygen/lib/http/session/HTTPDefaultSessionCodecFactory.h>
 #include <proxygen/lib/http/session/HTTPDirectResponseHandler.h>
+#include <proxygen/lib/transport/KTLSAsyncSSLSocket.h>
 
 using folly::AsyncSocket;
 using folly::SocketAddress;
@@ -56,6 +57,17 @@ const HTTPErrorPage* HTTPSessionAcceptor::getErrorPage(
   return errorPage;
 }
 
+folly::AsyncSSLSocket::UniquePtr HTTPSessionAcceptor::makeNewAsyncSSLSocket(
+    const std::shared_ptr<folly::SSLContext>& ctx,
+    folly::EventBase* base,
+    int fd) {
+  if (!accConfig_.kernelTLSEgress) {
+    return HTTPAcceptor::makeNewAsyncSSLSocket(ctx, base, fd);
+  }
+  return folly::AsyncSSLSocket::UniquePtr(
+      new KTLSAsyncSSLSocket(ctx, base, folly::NetworkSocket::fromFd(fd)));
+}
+
 void HTTPSessionAcceptor::onNewConnection(
     folly::AsyncTransportWrapper::UniquePtr sock,
     const SocketAddress* peerAddress,
@@ -75,6 +87,15 @@ void HTTPSessionAcceptor::onNewConnection(
     return;
   }
 
+  if (accConfig_.kernelTLSEgress) {
+    // Must happen before the session writes anything
+    auto ktlsSock = sock->getUnderlyingTransport<KTLSAsyncSSLSocket>();
+    if (ktlsSock && !ktlsSock->enableKernelTLSEgress()) {
+      VLOG(4) << "kTLS not enabled for " << ktlsSock->getSSLVersion()
+              << " " << ktlsSock->getNegotiatedCipherName();
+    }
+  }
+
   auto controller = getController();
   SocketAddress localAddress;
   try {
@@ -120,9 +141,24 @@ void HTTPSessionAcceptor::onNewConnection(
   session->setFlowControl(accConfig_.initialReceiveWindow,
                           accConfig_.receiveStreamWindowSize,
                           accConfig_.receiveSessionWindowSize);
+  if (accConfig_.flowControlAutoTuning) {
+    session->setFlowControlAutoTuning(accConfig_.maxReceiveStreamWindowSize,
+                                      accConfig_.maxReceiveSessionWindowSize);
+  }
   if (accConfig_.writeBufferLimit > 0) {
     session->setWriteBufferLimit(accConfig_.writeBufferLimit);
   }
+  if (accConfig_.socketTimestampByteEvents) {
+    session->enableSocketTimestampByteEvents(
+        accConfig_.socketTimestampTimeout);
+  }
+  if (accConfig_.egressNotSentLowWatermark > 0) {
+    session->setEgressNotSentLowWatermark(
+        accConfig_.egressNotSentLowWatermark);
+  }
+  if (accConfig_.zeroCopyEgressThreshold > 0) {
+    session->setZeroCopyEgressThreshold(accConfig_.zeroCopyEgressThreshold);
+  }
   session->setSessionStats(downstreamSessionStats_);
   Acceptor::addConnection(session);
   session->startNow();
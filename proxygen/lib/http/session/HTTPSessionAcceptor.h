@@ -139,6 +139,11 @@ class HTTPSessionAcceptor
         new folly::AsyncSocket(base, folly::NetworkSocket::fromFd(fd)));
   }
 
+  folly::AsyncSSLSocket::UniquePtr makeNewAsyncSSLSocket(
+      const std::shared_ptr<folly::SSLContext>& ctx,
+      folly::EventBase* base,
+      int fd) override;
+
   virtual size_t dropIdleConnections(size_t num);
 
   virtual void onSessionCreationError(ProxygenError /*error*/) {
@@ -38,6 +38,7 @@ HTTPSessionBase::HTTPSessionBase(const SocketAddress& localAddr,
                           ? WheelTimerInstance(timeout)
                           : WheelTimerInstance(),
                       rootNodeId),
+      egressPacer_(timeout),
       localAddr_(localAddr),
       peerAddr_(peerAddr),
       prioritySample_(false),
@@ -13,6 +13,7 @@
 #include <folly/io/IOBuf.h>
 #include <folly/io/async/SSLContext.h>
 #include <proxygen/lib/http/codec/HTTPCodecFilter.h>
+#include <proxygen/lib/http/session/EgressPacer.h>
 #include <proxygen/lib/http/session/HTTPTransaction.h>
 #include <proxygen/lib/utils/Time.h>
 #include <wangle/acceptor/ManagedConnection.h>
@@ -281,6 +282,19 @@ class HTTPSessionBase : public wangle::ManagedConnection {
     readBufLimit_ = limit;
   }
 
+  /**
+   * Limit the egress rate of the whole session.  The allowed bytes are
+   * shared among transactions according to their priority, and transaction
+   * level limits (HTTPTransaction::setEgressRateLimit) still apply within
+   * it.  A rate of 0 removes the limit.  See EgressPacer for burstBytes.
+   *
+   * Only HTTPSession currently paces its egress loop; other session types
+   * just share the pacer timer among rate limited transactions.
+   */
+  void setEgressRateLimit(uint64_t bitsPerSecond, uint64_t burstBytes = 0) {
+    egressPacer_.setRate(bitsPerSecond, burstBytes);
+  }
+
   /**
    * Start reading from the transport and send any introductory messages
    * to the remote side. This function must be called once per session to
@@ -571,6 +585,12 @@ class HTTPSessionBase : public wangle::ManagedConnection {
 
   HTTP2PriorityQueue txnEgressQueue_;
 
+  /**
+   * Session rate limit, and the single timer shared by rate limited
+   * transactions.
+   */
+  EgressPacer egressPacer_;
+
   /**
    * Maximum number of ingress body bytes that can be buffered across all
    * transactions for this single session/connection.
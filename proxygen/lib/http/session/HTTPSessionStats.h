@@ -29,6 +29,8 @@ class HTTPSessionStats : public TTLBAStats {
   }
   virtual void recordTransactionStalled() noexcept = 0;
   virtual void recordSessionStalled() noexcept = 0;
+  virtual void recordZeroCopyWrite(uint64_t /*bytes*/) noexcept {
+  }
 };
 
 } // namespace proxygen
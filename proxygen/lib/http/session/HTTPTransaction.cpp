@@ -140,6 +140,9 @@ HTTPTransaction::~HTTPTransaction() {
   if (isEnqueued()) {
     dequeue();
   }
+  if (egressRateLimited_) {
+    transport_.cancelEgressDelay(this);
+  }
   // TODO: handle the case where the priority node hangs out longer than
   // the transaction
   egressQueue_.removeTransaction(queueHandle_);
@@ -309,6 +312,9 @@ void HTTPTransaction::processIngressBody(unique_ptr<IOBuf> chain, size_t len) {
           divisor = 1;
         }
         if (uint32_t(recvToAck_) >= (recvWindow_.getCapacity() / divisor)) {
+          if (recvWindowTuner_) {
+            autoTuneReceiveWindow();
+          }
           flushWindowUpdate();
         }
       }
@@ -1050,7 +1056,7 @@ bool HTTPTransaction::maybeDelayForRateLimit() {
 
   egressRateLimited_ = true;
 
-  if (timer_) {
+  if (!transport_.delayEgress(this, requiredDelay) && timer_) {
     timer_->scheduleTimeout(&rateLimitCallback_, requiredDelay);
   }
 
@@ -1553,6 +1559,32 @@ void HTTPTransaction::setReceiveWindow(uint32_t capacity) {
   flushWindowUpdate();
 }
 
+void HTTPTransaction::setReceiveWindowAutoTuning(
+    const WindowAutoTuner::Options& options) {
+  if (!useFlowControl_) {
+    return;
+  }
+  recvWindowTuner_ = std::make_unique<WindowAutoTuner>(options);
+}
+
+void HTTPTransaction::autoTuneReceiveWindow() {
+  uint32_t capacity = recvWindow_.getCapacity();
+  uint32_t target = recvWindowTuner_->getTargetCapacity(
+      capacity, recvToAck_, transport_.getSmoothedRtt(), getCurrentTime());
+  if (target > capacity) {
+    if (recvWindow_.setCapacity(target)) {
+      recvToAck_ += target - capacity;
+    }
+  } else if (target < capacity) {
+    // The peer may already be sending into the credit it was given, so the
+    // window can only shrink by withholding part of this acknowledgement.
+    int32_t shrink = std::min<int32_t>(capacity - target, recvToAck_ / 2);
+    if (shrink > 0 && recvWindow_.setCapacity(capacity - shrink)) {
+      recvToAck_ -= shrink;
+    }
+  }
+}
+
 void HTTPTransaction::flushWindowUpdate() {
   if (recvToAck_ > 0 && useFlowControl_ && !isIngressEOMSeen() &&
       (direction_ == TransportDirection::DOWNSTREAM ||
@@ -21,6 +21,7 @@
 #include <proxygen/lib/http/HTTPMessage.h>
 #include <proxygen/lib/http/ProxygenErrorEnum.h>
 #include <proxygen/lib/http/Window.h>
+#include <proxygen/lib/http/WindowAutoTuner.h>
 #include <proxygen/lib/http/codec/HTTPCodec.h>
 #include <proxygen/lib/http/session/HTTP2PriorityQueue.h>
 #include <proxygen/lib/http/session/HTTPEvent.h>
@@ -456,6 +457,28 @@ class HTTPTransaction
 
     virtual bool getCurrentTransportInfo(wangle::TransportInfo* tinfo) = 0;
 
+    /**
+     * Returns the smoothed round-trip time measured by the transport, or
+     * zero if none is available.  Used for receive window autotuning.
+     */
+    virtual std::chrono::microseconds getSmoothedRtt() const noexcept {
+      return std::chrono::microseconds(0);
+    }
+
+    /**
+     * Ask the transport to call txn->rateLimitTimeoutExpired() after delay,
+     * so that all rate limited transactions of a session share one timer.
+     * Returns false if the transport does not support this, in which case
+     * the transaction schedules its own timeout.
+     */
+    virtual bool delayEgress(HTTPTransaction* /*txn*/,
+                             std::chrono::milliseconds /*delay*/) noexcept {
+      return false;
+    }
+
+    virtual void cancelEgressDelay(HTTPTransaction* /*txn*/) noexcept {
+    }
+
     virtual const HTTPCodec& getCodec() const noexcept = 0;
 
     /*
@@ -488,6 +511,14 @@ class HTTPTransaction
     virtual const folly::AsyncTransportWrapper* getUnderlyingTransport() const
         noexcept = 0;
 
+    /**
+     * The EventBase the transaction runs in, nullptr if unknown.
+     */
+    virtual folly::EventBase* getEventBase() const {
+      auto transport = getUnderlyingTransport();
+      return transport ? transport->getEventBase() : nullptr;
+    }
+
     /**
      * Returns true if the underlying transport has completed full handshake.
      */
@@ -583,6 +614,14 @@ class HTTPTransaction
     return seqNo_;
   }
 
+  /**
+   * The EventBase this transaction runs in, nullptr if the transport does
+   * not know it.
+   */
+  folly::EventBase* getEventBase() const {
+    return transport_.getEventBase();
+  }
+
   const Transport& getTransport() const {
     return transport_;
   }
@@ -681,6 +720,13 @@ class HTTPTransaction
    */
   virtual void setReceiveWindow(uint32_t capacity);
 
+  /**
+   * Enable receive window autotuning.  Each time a window update is sent,
+   * the receive window may grow or shrink within the bounds in options,
+   * based on how fast the handler consumes the body and the transport RTT.
+   */
+  void setReceiveWindowAutoTuning(const WindowAutoTuner::Options& options);
+
   /**
    * Get the receive window of the transaction
    */
@@ -1065,6 +1111,15 @@ class HTTPTransaction
    */
   virtual void sendAbort();
 
+  /**
+   * As sendAbort(), with the error code to send where the protocol has one,
+   * e.g. REFUSED_STREAM to tell an HTTP/2 client that the request was not
+   * processed and can safely be retried.
+   */
+  void sendAbortWithCode(ErrorCode statusCode) {
+    sendAbort(statusCode);
+  }
+
   /**
    * Pause ingress processing.  Upon pause, the HTTPTransaction
    * will call its Transport's pauseIngress() method.  The Transport
@@ -1119,6 +1174,11 @@ class HTTPTransaction
    */
   void setEgressRateLimit(uint64_t bitsPerSecond);
 
+  /**
+   * Invoked when the delay imposed by the egress rate limit has elapsed.
+   */
+  void rateLimitTimeoutExpired();
+
   /**
    * @return true iff egress processing is paused for the handler
    */
@@ -1134,6 +1194,14 @@ class HTTPTransaction
     return flowControlPaused_;
   }
 
+  /**
+   * Get the send window of the transaction.  Only maintained if the codec
+   * supports stream flow control.
+   */
+  const Window& getSendWindow() const {
+    return sendWindow_;
+  }
+
   /**
    * @return true iff this transaction can be used to push resources to
    * the remote side.
@@ -1600,9 +1668,13 @@ class HTTPTransaction
    */
   void flushWindowUpdate();
 
-  bool updateContentLengthRemaining(size_t len);
+  /**
+   * Applies the autotuner's target capacity to recvWindow_, adjusting
+   * recvToAck_ so that the credit already granted to the peer is honored.
+   */
+  void autoTuneReceiveWindow();
 
-  void rateLimitTimeoutExpired();
+  bool updateContentLengthRemaining(size_t len);
 
   void trimDeferredEgressBody(uint64_t bodyOffset);
 
@@ -1658,6 +1730,11 @@ class HTTPTransaction
    */
   Window recvWindow_;
 
+  /**
+   * Optional receive window autotuning, see setReceiveWindowAutoTuning.
+   */
+  std::unique_ptr<WindowAutoTuner> recvWindowTuner_;
+
   /**
    * The send window and associated data. This keeps track of how many
    * bytes we are allowed to send and have outstanding.
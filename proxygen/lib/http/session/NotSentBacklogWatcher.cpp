@@ -0,0 +1,78 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/http/session/NotSentBacklogWatcher.h>
+
+#include <glog/logging.h>
+
+#ifdef __linux__
+#include <linux/sockios.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#endif
+
+namespace proxygen {
+
+NotSentBacklogWatcher::NotSentBacklogWatcher(folly::AsyncSocket* sock,
+                                             uint32_t lowWatermark,
+                                             Callback* callback)
+    : folly::EventHandler(sock->getEventBase(), sock->getNetworkSocket()),
+      sock_(sock),
+      lowWatermark_(lowWatermark),
+      callback_(callback) {
+}
+
+NotSentBacklogWatcher::~NotSentBacklogWatcher() {
+  unregisterHandler();
+}
+
+bool NotSentBacklogWatcher::init() {
+#if defined(__linux__) && defined(TCP_NOTSENT_LOWAT)
+  int lowat = lowWatermark_;
+  if (sock_->setSockOpt(IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat) != 0) {
+    VLOG(2) << "failed to set TCP_NOTSENT_LOWAT, errno=" << errno;
+    return false;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+uint32_t NotSentBacklogWatcher::getNotSentBytes() const {
+#if defined(__linux__) && defined(SIOCOUTQNSD)
+  int notSent = 0;
+  if (ioctl(sock_->getNetworkSocket().toFd(), SIOCOUTQNSD, &notSent) == 0 &&
+      notSent > 0) {
+    return notSent;
+  }
+#endif
+  return 0;
+}
+
+bool NotSentBacklogWatcher::isBacklogged() {
+  if (isHandlerRegistered()) {
+    return true;
+  }
+  auto notSent = getNotSentBytes();
+  if (notSent < lowWatermark_) {
+    return false;
+  }
+  VLOG(5) << "waiting for " << notSent << " unsent bytes to drain below "
+          << lowWatermark_;
+  registerHandler(folly::EventHandler::WRITE);
+  return true;
+}
+
+void NotSentBacklogWatcher::handlerReady(uint16_t /*events*/) noexcept {
+  // Not persistent, so the handler is already unregistered
+  callback_->onNotSentBacklogDrained();
+}
+
+} // namespace proxygen
@@ -0,0 +1,80 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/io/async/AsyncSocket.h>
+#include <folly/io/async/EventHandler.h>
+
+namespace proxygen {
+
+/**
+ * Keeps the amount of data sitting unsent in a TCP socket's kernel buffer
+ * small, so that the sender can decide what to write as late as possible.
+ *
+ * init() sets TCP_NOTSENT_LOWAT on the socket.  Before generating more
+ * egress, the owner calls isBacklogged(): if at least lowWatermark bytes are
+ * still unsent in the kernel, it returns true and arms a one-shot write
+ * readiness event.  The kernel reports the socket writable once the unsent
+ * backlog drops below the watermark, at which point
+ * Callback::onNotSentBacklogDrained() is invoked.
+ *
+ * The watcher registers its own event on the socket's fd, so it must be
+ * destroyed before the socket is closed.  Linux only; init() returns false
+ * elsewhere.
+ */
+class NotSentBacklogWatcher : private folly::EventHandler {
+ public:
+  class Callback {
+   public:
+    virtual ~Callback() {
+    }
+    virtual void onNotSentBacklogDrained() noexcept = 0;
+  };
+
+  NotSentBacklogWatcher(folly::AsyncSocket* sock,
+                        uint32_t lowWatermark,
+                        Callback* callback);
+
+  ~NotSentBacklogWatcher() override;
+
+  /**
+   * Set TCP_NOTSENT_LOWAT on the socket.  Returns false if that fails.
+   */
+  bool init();
+
+  /**
+   * Returns true if the unsent kernel backlog is at or above the watermark,
+   * in which case the callback fires once it drains.
+   */
+  bool isBacklogged();
+
+  bool isWaiting() const {
+    return isHandlerRegistered();
+  }
+
+  /**
+   * Number of bytes queued in the kernel that have not been sent yet, or 0
+   * if unknown.
+   */
+  uint32_t getNotSentBytes() const;
+
+  uint32_t getLowWatermark() const {
+    return lowWatermark_;
+  }
+
+ private:
+  void handlerReady(uint16_t events) noexcept override;
+
+  folly::AsyncSocket* sock_;
+  uint32_t lowWatermark_;
+  Callback* callback_;
+};
+
+} // namespace proxygen
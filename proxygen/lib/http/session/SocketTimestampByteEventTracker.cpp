@@ -0,0 +1,420 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/http/session/SocketTimestampByteEventTracker.h>
+
+#include <proxygen/lib/http/session/TTLBAStats.h>
+
+#ifdef __linux__
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <linux/sockios.h>
+#include <sys/ioctl.h>
+#endif
+
+using std::chrono::milliseconds;
+
+namespace {
+
+void disposeEvent(proxygen::ByteEvent* event) {
+  delete event;
+}
+
+} // namespace
+
+namespace proxygen {
+
+const size_t SocketTimestampByteEventTracker::kMaxPendingEvents = 100;
+
+SocketTimestampByteEventTracker::SocketTimestampByteEventTracker(
+    Callback* callback,
+    folly::TimeoutManager* timeoutManager,
+    milliseconds timeout)
+    : ByteEventTracker(callback),
+      timeouts_(new AsyncTimeoutSet(timeoutManager, timeout)) {
+}
+
+SocketTimestampByteEventTracker::~SocketTimestampByteEventTracker() {
+  disableSocketTimestampEvents();
+  // Unlink our cached pointers before the base class drains byteEvents_
+  nextSomEvent_ = nullptr;
+  nextEomEvent_ = nullptr;
+}
+
+bool SocketTimestampByteEventTracker::enableSocketTimestamps(
+    folly::AsyncTransportWrapper* transport) {
+#ifdef __linux__
+  CHECK(!sock_);
+  auto sock = transport->getUnderlyingTransport<folly::AsyncSocket>();
+  if (!sock) {
+    VLOG(2) << "socket timestamps require an AsyncSocket";
+    return false;
+  }
+  // Report software timestamps without the payload, keyed by byte offset.
+  // Timestamp generation is requested per write in getAncillaryData.
+  uint32_t tsFlags = SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_OPT_ID |
+                     SOF_TIMESTAMPING_OPT_TSONLY;
+  if (sock->setSockOpt(SOL_SOCKET, SO_TIMESTAMPING, &tsFlags) != 0) {
+    VLOG(2) << "failed to enable SO_TIMESTAMPING, errno=" << errno;
+    return false;
+  }
+  // The kernel keys timestamps from the oldest unacknowledged byte
+  int unacked = 0;
+  if (ioctl(sock->getNetworkSocket().toFd(), SIOCOUTQ, &unacked) != 0) {
+    unacked = 0;
+  }
+  rawOffsetBase_ = transport->getRawBytesWritten() - unacked;
+  lastTimestampId_ = 0;
+  sock->setErrMessageCB(this);
+  sock->setSendMsgParamCB(this);
+  transport->setEorTracking(true);
+  sock_ = sock;
+  updateNextMessageEvents();
+  return true;
+#else
+  (void)transport;
+  return false;
+#endif
+}
+
+size_t SocketTimestampByteEventTracker::disableSocketTimestampEvents() {
+  if (sock_) {
+    sock_->setErrMessageCB(nullptr);
+    sock_->setSendMsgParamCB(nullptr);
+#ifdef __linux__
+    uint32_t tsFlags = 0;
+    sock_->setSockOpt(SOL_SOCKET, SO_TIMESTAMPING, &tsFlags);
+#endif
+    sock_ = nullptr;
+  }
+  pendingTimestamp_.clear();
+  return drainTimestampEvents();
+}
+
+size_t SocketTimestampByteEventTracker::drainTimestampEvents() {
+  size_t numEvents = txEvents_.size() + ackEvents_.size();
+  // TransactionByteEvent destructors may release the last reference to a
+  // transaction, so unlink each event before deleting it
+  while (!txEvents_.empty()) {
+    txEvents_.pop_front_and_dispose(disposeEvent);
+  }
+  while (!ackEvents_.empty()) {
+    ackEvents_.pop_front_and_dispose(disposeEvent);
+  }
+  return numEvents;
+}
+
+void SocketTimestampByteEventTracker::absorb(ByteEventTracker&& other) {
+  ByteEventTracker::absorb(std::move(other));
+  updateNextMessageEvents();
+}
+
+size_t SocketTimestampByteEventTracker::drainByteEvents() {
+  nextSomEvent_ = nullptr;
+  nextEomEvent_ = nullptr;
+  return ByteEventTracker::drainByteEvents() + drainTimestampEvents();
+}
+
+void SocketTimestampByteEventTracker::addFirstBodyByteEvent(
+    uint64_t offset, HTTPTransaction* txn) {
+  ByteEventTracker::addFirstBodyByteEvent(offset, txn);
+  if (!nextSomEvent_) {
+    nextSomEvent_ = &byteEvents_.back();
+  }
+}
+
+void SocketTimestampByteEventTracker::addLastByteEvent(
+    HTTPTransaction* txn, uint64_t byteNo) noexcept {
+  ByteEventTracker::addLastByteEvent(txn, byteNo);
+  if (!nextEomEvent_) {
+    nextEomEvent_ = &byteEvents_.back();
+  }
+}
+
+void SocketTimestampByteEventTracker::somEventProcessed() {
+  updateNextMessageEvents();
+}
+
+void SocketTimestampByteEventTracker::eomEventProcessed() {
+  updateNextMessageEvents();
+}
+
+void SocketTimestampByteEventTracker::updateNextMessageEvents() {
+  nextSomEvent_ = nullptr;
+  nextEomEvent_ = nullptr;
+  for (auto& event : byteEvents_) {
+    if (!nextSomEvent_ && event.eventType_ == ByteEvent::FIRST_BYTE) {
+      nextSomEvent_ = &event;
+    } else if (!nextEomEvent_ && event.eventType_ == ByteEvent::LAST_BYTE) {
+      nextEomEvent_ = &event;
+    }
+    if (nextSomEvent_ && nextEomEvent_) {
+      break;
+    }
+  }
+}
+
+uint64_t SocketTimestampByteEventTracker::preSend(bool* /*cork*/,
+                                                  bool* som,
+                                                  bool* eom,
+                                                  uint64_t bytesWritten) {
+  if (!sock_) {
+    return 0;
+  }
+  ByteEvent* somEvent = nextSomEvent_;
+  if (somEvent && (somEvent->byteOffset_ <= bytesWritten ||
+                   somEvent->bufferWriteTracked_)) {
+    somEvent = nullptr;
+  }
+  ByteEvent* eomEvent = nextEomEvent_;
+  if (eomEvent && (eomEvent->byteOffset_ <= bytesWritten ||
+                   eomEvent->bufferWriteTracked_)) {
+    eomEvent = nullptr;
+  }
+  // Only split at the closer of the two boundaries
+  if (somEvent && eomEvent) {
+    if (somEvent->byteOffset_ < eomEvent->byteOffset_) {
+      eomEvent = nullptr;
+    } else if (eomEvent->byteOffset_ < somEvent->byteOffset_) {
+      somEvent = nullptr;
+    }
+  }
+
+  if (somEvent && txEvents_.size() >= kMaxPendingEvents) {
+    if (ttlbaStats_) {
+      ttlbaStats_->recordTTBTXExceedLimit();
+    }
+    somEvent = nullptr;
+  }
+  if (eomEvent && (txEvents_.size() >= kMaxPendingEvents ||
+                   ackEvents_.size() >= kMaxPendingEvents)) {
+    if (ttlbaStats_) {
+      ttlbaStats_->recordTTLBAExceedLimit();
+    }
+    eomEvent = nullptr;
+  }
+
+  uint64_t needed = 0;
+  if (somEvent) {
+    somEvent->bufferWriteTracked_ = 1;
+    *som = true;
+    needed = somEvent->byteOffset_ - bytesWritten;
+  }
+  if (eomEvent) {
+    eomEvent->bufferWriteTracked_ = 1;
+    *eom = true;
+    needed = eomEvent->byteOffset_ - bytesWritten;
+  }
+  return needed;
+}
+
+void SocketTimestampByteEventTracker::addTxByteEvent(
+    uint64_t offset, ByteEvent::EventType eventType, HTTPTransaction* txn) {
+  if (!sock_) {
+    return;
+  }
+  VLOG(5) << "tracking TX of raw byte " << offset;
+  auto event = new TxByteEvent(this, offset, eventType, txn);
+  txEvents_.push_back(*event);
+  timeouts_->scheduleTimeout(event);
+  if (ttlbaStats_) {
+    ttlbaStats_->recordTTBTXTracked();
+  }
+}
+
+void SocketTimestampByteEventTracker::addAckByteEvent(uint64_t offset,
+                                                      HTTPTransaction* txn) {
+  if (!sock_) {
+    return;
+  }
+  VLOG(5) << "tracking ACK of raw byte " << offset;
+  auto event =
+      new TrackedAckByteEvent(this, offset, txn, SystemClock::now());
+  ackEvents_.push_back(*event);
+  timeouts_->scheduleTimeout(&event->timeout);
+  if (ttlbaStats_) {
+    ttlbaStats_->recordTTLBATracked();
+  }
+}
+
+void SocketTimestampByteEventTracker::onTxTimestamp(
+    uint64_t rawOffset, SystemTimePoint timestamp) {
+  // Sends complete in order, so every event up to rawOffset has left
+  bool found = false;
+  while (!txEvents_.empty() && txEvents_.front().byteOffset_ <= rawOffset) {
+    auto& event = txEvents_.front();
+    auto txn = event.getTransaction();
+    found = true;
+    if (ttlbaStats_) {
+      ttlbaStats_->recordTTBTXReceived();
+    }
+    auto eventType = event.eventType_;
+    // The event holds a reference on txn; keep it alive for the callback
+    HTTPTransaction::DestructorGuard g(txn);
+    txEvents_.pop_front_and_dispose(disposeEvent);
+    if (eventType == ByteEvent::FIRST_BYTE) {
+      txn->onEgressBodyFirstByteTX();
+    } else {
+      txn->onEgressBodyLastByteTX();
+    }
+  }
+  for (auto& event : ackEvents_) {
+    if (event.byteOffset_ > rawOffset) {
+      break;
+    }
+    auto& ackEvent = static_cast<TrackedAckByteEvent&>(event);
+    if (!ackEvent.transmitted) {
+      ackEvent.sendTime = timestamp;
+      ackEvent.transmitted = true;
+    }
+  }
+  if (!found && ttlbaStats_) {
+    ttlbaStats_->recordTTBTXNotFound();
+  }
+}
+
+void SocketTimestampByteEventTracker::onAckTimestamp(
+    uint64_t rawOffset, SystemTimePoint timestamp) {
+  bool found = false;
+  while (!ackEvents_.empty() && ackEvents_.front().byteOffset_ <= rawOffset) {
+    auto& event = static_cast<TrackedAckByteEvent&>(ackEvents_.front());
+    auto txn = event.getTransaction();
+    found = true;
+    auto latency = std::chrono::duration_cast<milliseconds>(
+        std::max(timestamp - event.sendTime, SystemClock::duration::zero()));
+    if (ttlbaStats_) {
+      ttlbaStats_->recordTTLBAReceived();
+    }
+    HTTPTransaction::DestructorGuard g(txn);
+    ackEvents_.pop_front_and_dispose(disposeEvent);
+    txn->onEgressLastByteAck(latency);
+  }
+  if (!found && ttlbaStats_) {
+    ttlbaStats_->recordTTLBANotFound();
+  }
+}
+
+void SocketTimestampByteEventTracker::txTimeoutExpired(
+    TxByteEvent* event) noexcept {
+  VLOG(4) << "no TX timestamp for raw byte " << event->byteOffset_;
+  if (ttlbaStats_) {
+    ttlbaStats_->recordTTBTXTimeout();
+  }
+  txEvents_.erase_and_dispose(txEvents_.iterator_to(*event), disposeEvent);
+}
+
+void SocketTimestampByteEventTracker::ackTimeoutExpired(
+    uint64_t byteNo) noexcept {
+  VLOG(4) << "no ACK timestamp for raw byte " << byteNo;
+  // Events time out in order, so this is at the front
+  while (!ackEvents_.empty() && ackEvents_.front().byteOffset_ <= byteNo) {
+    if (ttlbaStats_) {
+      ttlbaStats_->recordTTLBATimeout();
+    }
+    ackEvents_.pop_front_and_dispose(disposeEvent);
+  }
+}
+
+uint64_t SocketTimestampByteEventTracker::toRawOffset(uint32_t timestampId) {
+  // The id is a 32 bit byte offset; unwrap it around the last one seen
+  const uint64_t kWrap = uint64_t(1) << 32;
+  uint64_t id = (lastTimestampId_ & ~(kWrap - 1)) | timestampId;
+  if (id + kWrap / 2 < lastTimestampId_) {
+    id += kWrap;
+  } else if (id > lastTimestampId_ + kWrap / 2 && id >= kWrap) {
+    id -= kWrap;
+  }
+  lastTimestampId_ = std::max(lastTimestampId_, id);
+  // The id is that of the last byte of the send; offsets are exclusive
+  return rawOffsetBase_ + id + 1;
+}
+
+void SocketTimestampByteEventTracker::errMessage(
+    const cmsghdr& cmsg) noexcept {
+#ifdef __linux__
+  if (cmsg.cmsg_level == SOL_SOCKET && cmsg.cmsg_type == SCM_TIMESTAMPING) {
+    // The timestamp precedes the extended error identifying it
+    auto tss = reinterpret_cast<const struct scm_timestamping*>(
+        CMSG_DATA(&cmsg));
+    pendingTimestamp_ = SystemTimePoint(
+        std::chrono::duration_cast<SystemClock::duration>(
+            std::chrono::seconds(tss->ts[0].tv_sec) +
+            std::chrono::nanoseconds(tss->ts[0].tv_nsec)));
+    return;
+  }
+  if (!((cmsg.cmsg_level == SOL_IP && cmsg.cmsg_type == IP_RECVERR) ||
+        (cmsg.cmsg_level == SOL_IPV6 && cmsg.cmsg_type == IPV6_RECVERR))) {
+    return;
+  }
+  auto serr =
+      reinterpret_cast<const struct sock_extended_err*>(CMSG_DATA(&cmsg));
+  if (serr->ee_errno != ENOMSG ||
+      serr->ee_origin != SO_EE_ORIGIN_TIMESTAMPING || !pendingTimestamp_) {
+    return;
+  }
+  auto timestamp = *pendingTimestamp_;
+  pendingTimestamp_.clear();
+  auto rawOffset = toRawOffset(serr->ee_data);
+  VLOG(5) << "timestamp type=" << serr->ee_info << " for raw byte "
+          << rawOffset;
+  switch (serr->ee_info) {
+    case SCM_TSTAMP_SND:
+      onTxTimestamp(rawOffset, timestamp);
+      break;
+    case SCM_TSTAMP_ACK:
+      onAckTimestamp(rawOffset, timestamp);
+      break;
+    default:
+      break;
+  }
+#else
+  (void)cmsg;
+#endif
+}
+
+void SocketTimestampByteEventTracker::errMessageError(
+    const folly::AsyncSocketException& ex) noexcept {
+  VLOG(3) << "error reading socket timestamps: " << ex.what();
+  disableSocketTimestampEvents();
+}
+
+uint32_t SocketTimestampByteEventTracker::getAncillaryDataSize(
+    folly::WriteFlags flags) noexcept {
+#ifdef __linux__
+  if (isSet(flags, folly::WriteFlags::TIMESTAMP_TX)) {
+    return CMSG_SPACE(sizeof(uint32_t));
+  }
+#else
+  (void)flags;
+#endif
+  return 0;
+}
+
+void SocketTimestampByteEventTracker::getAncillaryData(folly::WriteFlags flags,
+                                                       void* data) noexcept {
+#ifdef __linux__
+  if (!isSet(flags, folly::WriteFlags::TIMESTAMP_TX)) {
+    return;
+  }
+  uint32_t tsFlags = SOF_TIMESTAMPING_TX_SOFTWARE;
+  if (isSet(flags, folly::WriteFlags::EOR)) {
+    tsFlags |= SOF_TIMESTAMPING_TX_ACK;
+  }
+  auto cmsg = reinterpret_cast<struct cmsghdr*>(data);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SO_TIMESTAMPING;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(uint32_t));
+  memcpy(CMSG_DATA(cmsg), &tsFlags, sizeof(tsFlags));
+#else
+  (void)flags;
+  (void)data;
+#endif
+}
+
+} // namespace proxygen
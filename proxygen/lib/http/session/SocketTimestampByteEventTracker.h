@@ -0,0 +1,169 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Optional.h>
+#include <folly/io/async/AsyncSocket.h>
+#include <proxygen/lib/http/session/ByteEventTracker.h>
+#include <proxygen/lib/utils/AsyncTimeoutSet.h>
+
+namespace proxygen {
+
+/**
+ * ByteEventTracker that reports when the first and last body bytes of a
+ * message leave the host, and when the last byte is acknowledged by the peer,
+ * using Linux SO_TIMESTAMPING.
+ *
+ * preSend() splits writes at message boundaries and marks the FIRST_BYTE and
+ * LAST_BYTE events it splits on as bufferWriteTracked_.  HTTPSession writes
+ * those buffers with WriteFlags::TIMESTAMP_TX (and EOR for the last byte),
+ * which this tracker turns into a per-sendmsg SO_TIMESTAMPING control
+ * message, so only those writes pay for timestamping.  Once the write is
+ * accepted, HTTPSession registers TX and ACK events via addTxByteEvent and
+ * addAckByteEvent at the raw socket offset.
+ *
+ * Timestamps are read from the socket error queue.  With
+ * SOF_TIMESTAMPING_OPT_ID the kernel identifies each timestamp by the offset
+ * of the last byte of the timestamped send, which is mapped back to the raw
+ * byte offset of pending events:
+ *  - SCM_TSTAMP_SND fires HTTPTransaction::onEgressBodyFirstByteTX /
+ *    onEgressBodyLastByteTX
+ *  - SCM_TSTAMP_ACK fires HTTPTransaction::onEgressLastByteAck with the time
+ *    between the last byte being sent and acknowledged (TTLBA).
+ *
+ * Events without a timestamp after the configured timeout are dropped, so
+ * that they never pin transactions.  The tracker must be disabled
+ * (disableSocketTimestampEvents) before the socket it is attached to is
+ * destroyed; HTTPSession does this when it shuts down reads.
+ *
+ * Only supported on Linux; enableSocketTimestamps returns false elsewhere.
+ */
+class SocketTimestampByteEventTracker
+    : public ByteEventTracker
+    , private TxByteEvent::Callback
+    , private AckTimeout::Callback
+    , private folly::AsyncSocket::ErrMessageCallback
+    , private folly::AsyncSocket::SendMsgParamsCallback {
+ public:
+  /**
+   * Maximum number of TX or ACK events awaiting a timestamp.  Writes beyond
+   * this are not timestamped.
+   */
+  static const size_t kMaxPendingEvents;
+
+  SocketTimestampByteEventTracker(Callback* callback,
+                                  folly::TimeoutManager* timeoutManager,
+                                  std::chrono::milliseconds timeout);
+
+  ~SocketTimestampByteEventTracker() override;
+
+  /**
+   * Turn on timestamp reporting on the socket underlying transport, and
+   * enable EOR tracking on transport.  Returns false if the transport is not
+   * an AsyncSocket or the platform does not support it.
+   */
+  bool enableSocketTimestamps(folly::AsyncTransportWrapper* transport);
+
+  bool isEnabled() const {
+    return sock_ != nullptr;
+  }
+
+  size_t getNumPendingTxEvents() const {
+    return txEvents_.size();
+  }
+
+  size_t getNumPendingAckEvents() const {
+    return ackEvents_.size();
+  }
+
+  // ByteEventTracker
+  void absorb(ByteEventTracker&& other) override;
+  size_t drainByteEvents() override;
+  void addFirstBodyByteEvent(uint64_t offset, HTTPTransaction* txn) override;
+  void addLastByteEvent(HTTPTransaction* txn, uint64_t byteNo) noexcept override;
+  size_t disableSocketTimestampEvents() override;
+  void addTxByteEvent(uint64_t offset,
+                      ByteEvent::EventType eventType,
+                      HTTPTransaction* txn) override;
+  void addAckByteEvent(uint64_t offset, HTTPTransaction* txn) override;
+  uint64_t preSend(bool* cork,
+                   bool* som,
+                   bool* eom,
+                   uint64_t bytesWritten) override;
+  void setTTLBAStats(TTLBAStats* stats) override {
+    ttlbaStats_ = stats;
+  }
+
+  /**
+   * Process a timestamp for the send ending at raw offset rawOffset.
+   * Exposed for testing; normally driven by the socket error queue.
+   */
+  void onTxTimestamp(uint64_t rawOffset, SystemTimePoint timestamp);
+  void onAckTimestamp(uint64_t rawOffset, SystemTimePoint timestamp);
+
+ protected:
+  void somEventProcessed() override;
+  void eomEventProcessed() override;
+
+ private:
+  class TrackedAckByteEvent : public AckByteEvent {
+   public:
+    TrackedAckByteEvent(AckTimeout::Callback* callback,
+                        uint64_t byteNo,
+                        HTTPTransaction* txn,
+                        SystemTimePoint sent)
+        : AckByteEvent(callback, byteNo, ByteEvent::LAST_BYTE, txn),
+          sendTime(sent) {
+    }
+
+    // When the byte was written, replaced by its TX timestamp if one arrives
+    SystemTimePoint sendTime;
+    bool transmitted{false};
+  };
+
+  void updateNextMessageEvents();
+  uint64_t toRawOffset(uint32_t timestampId);
+  size_t drainTimestampEvents();
+
+  // TxByteEvent::Callback
+  void txTimeoutExpired(TxByteEvent* event) noexcept override;
+
+  // AckTimeout::Callback
+  void ackTimeoutExpired(uint64_t byteNo) noexcept override;
+
+  // AsyncSocket::ErrMessageCallback
+  void errMessage(const cmsghdr& cmsg) noexcept override;
+  void errMessageError(const folly::AsyncSocketException& ex) noexcept override;
+
+  // AsyncSocket::SendMsgParamsCallback
+  void getAncillaryData(folly::WriteFlags flags, void* data) noexcept override;
+  uint32_t getAncillaryDataSize(folly::WriteFlags flags) noexcept override;
+
+  AsyncTimeoutSet::UniquePtr timeouts_;
+  folly::AsyncSocket* sock_{nullptr};
+  TTLBAStats* ttlbaStats_{nullptr};
+
+  // The next unwritten FIRST_BYTE and LAST_BYTE events in byteEvents_, kept
+  // so that preSend does not have to scan the list on every write
+  ByteEvent* nextSomEvent_{nullptr};
+  ByteEvent* nextEomEvent_{nullptr};
+
+  // Raw offset of the timestamp key base, and the highest timestamp id seen,
+  // unwrapped to 64 bits
+  uint64_t rawOffsetBase_{0};
+  uint64_t lastTimestampId_{0};
+  folly::Optional<SystemTimePoint> pendingTimestamp_;
+
+  // Ordered by raw byteOffset_
+  folly::CountedIntrusiveList<ByteEvent, &ByteEvent::listHook> txEvents_;
+  folly::CountedIntrusiveList<ByteEvent, &ByteEvent::listHook> ackEvents_;
+};
+
+} // namespace proxygen
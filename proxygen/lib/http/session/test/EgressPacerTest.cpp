@@ -0,0 +1,150 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/portability/GMock.h>
+#include <folly/portability/GTest.h>
+
+#include <proxygen/lib/http/session/EgressPacer.h>
+#include <proxygen/lib/http/session/test/HTTPTransactionMocks.h>
+
+#include <chrono>
+#include <limits>
+
+using namespace testing;
+using namespace proxygen;
+using std::chrono::milliseconds;
+
+class MockEgressPacerCallback : public EgressPacer::Callback {
+ public:
+  GMOCK_METHOD0_(, noexcept, , onEgressPacerResume, void());
+};
+
+class EgressPacerTest : public Test {
+ public:
+  void SetUp() override {
+    pacer_.setCallback(&callback_);
+  }
+
+ protected:
+  folly::EventBase eventBase_;
+  WheelTimerInstance timer_{milliseconds(500), &eventBase_};
+  NiceMock<MockHTTPTransactionTransport> transport_;
+  HTTP2PriorityQueue txnEgressQueue_;
+  HTTPTransaction txn_{TransportDirection::DOWNSTREAM,
+                       HTTPCodec::StreamID(1),
+                       1,
+                       transport_,
+                       txnEgressQueue_,
+                       timer_.getWheelTimer(),
+                       timer_.getDefaultTimeout()};
+  StrictMock<MockEgressPacerCallback> callback_;
+  EgressPacer pacer_{timer_};
+};
+
+TEST_F(EgressPacerTest, Unlimited) {
+  EXPECT_FALSE(pacer_.isPacing());
+  EXPECT_EQ(pacer_.getAvailable(), std::numeric_limits<uint64_t>::max());
+  pacer_.consume(1000000);
+  EXPECT_EQ(pacer_.getAvailable(), std::numeric_limits<uint64_t>::max());
+  EXPECT_FALSE(pacer_.isBlocked());
+}
+
+TEST_F(EgressPacerTest, TokensRefill) {
+  // 100KB/s with a 20KB bucket
+  pacer_.setRate(800000, 20000);
+  auto now = getCurrentTime();
+  EXPECT_EQ(pacer_.getAvailable(now), 20000);
+  pacer_.consume(15000);
+  EXPECT_EQ(pacer_.getAvailable(now), 0);
+  EXPECT_TRUE(pacer_.isBlocked());
+
+  // 30ms refills 3000 bytes, not yet a full write quantum
+  now += milliseconds(30);
+  EXPECT_EQ(pacer_.getAvailable(now), 0);
+  now += milliseconds(10);
+  EXPECT_EQ(pacer_.getAvailable(now), 9000);
+
+  // Never more than the bucket
+  now += milliseconds(1000);
+  EXPECT_EQ(pacer_.getAvailable(now), 20000);
+}
+
+TEST_F(EgressPacerTest, OvershootIsRepaid) {
+  pacer_.setRate(800000, 10000);
+  auto now = getCurrentTime();
+  pacer_.consume(30000);
+  // 20000 bytes of debt plus one quantum take just over 280ms to repay
+  now += milliseconds(280);
+  EXPECT_EQ(pacer_.getAvailable(now), 0);
+  now += milliseconds(2);
+  EXPECT_GE(pacer_.getAvailable(now), EgressPacer::kWriteQuantum);
+}
+
+TEST_F(EgressPacerTest, ResumeAfterWait) {
+  pacer_.setRate(800000, 10000);
+  pacer_.consume(10000);
+  auto start = getCurrentTime();
+  EXPECT_EQ(pacer_.getAvailable(start), 0);
+  EXPECT_CALL(callback_, onEgressPacerResume());
+  eventBase_.loop();
+  EXPECT_GE(millisecondsBetween(getCurrentTime(), start).count(), 80);
+  EXPECT_FALSE(pacer_.isBlocked());
+  EXPECT_GE(pacer_.getAvailable(), EgressPacer::kWriteQuantum);
+}
+
+TEST_F(EgressPacerTest, DisableWhileBlocked) {
+  pacer_.setRate(800000, 10000);
+  pacer_.consume(10000);
+  EXPECT_EQ(pacer_.getAvailable(), 0);
+  EXPECT_CALL(callback_, onEgressPacerResume());
+  pacer_.setRate(0);
+  EXPECT_FALSE(pacer_.isBlocked());
+  EXPECT_EQ(pacer_.getAvailable(), std::numeric_limits<uint64_t>::max());
+}
+
+TEST_F(EgressPacerTest, DelayedTransactions) {
+  HTTPTransaction txn2{TransportDirection::DOWNSTREAM,
+                       HTTPCodec::StreamID(3),
+                       1,
+                       transport_,
+                       txnEgressQueue_,
+                       timer_.getWheelTimer(),
+                       timer_.getDefaultTimeout()};
+  pacer_.delayTransaction(&txn_, milliseconds(20));
+  pacer_.delayTransaction(&txn2, milliseconds(10));
+  EXPECT_EQ(pacer_.getNumDelayedTransactions(), 2);
+  eventBase_.loop();
+  EXPECT_EQ(pacer_.getNumDelayedTransactions(), 0);
+
+  pacer_.delayTransaction(&txn_, milliseconds(10));
+  pacer_.cancelTransaction(&txn_);
+  EXPECT_EQ(pacer_.getNumDelayedTransactions(), 0);
+  // Nothing left to wait for
+  auto start = getCurrentTime();
+  eventBase_.loop();
+  EXPECT_LT(millisecondsBetween(getCurrentTime(), start).count(), 10);
+}
+
+// The pacer follows its session to another EventBase
+TEST_F(EgressPacerTest, MoveTimer) {
+  pacer_.setRate(800000, 10000);
+  pacer_.consume(10000);
+  EXPECT_EQ(pacer_.getAvailable(), 0);
+  pacer_.detachTimer();
+  // Nothing left on the old timer
+  EXPECT_EQ(timer_.getWheelTimer()->count(), 0);
+
+  folly::EventBase eventBase2;
+  WheelTimerInstance timer2{milliseconds(500), &eventBase2};
+  pacer_.attachTimer(timer2);
+  EXPECT_EQ(timer2.getWheelTimer()->count(), 1);
+  EXPECT_CALL(callback_, onEgressPacerResume());
+  eventBase2.loop();
+  EXPECT_FALSE(pacer_.isBlocked());
+}
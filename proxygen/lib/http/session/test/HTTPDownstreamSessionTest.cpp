@@ -7,6 +7,7 @@
  *  of patent rights can be found in the PATENTS file in the same directory.
  *
  */
+#include <map>
 #include <string>
 #include <vector>
 
@@ -1801,6 +1802,87 @@ TEST_F(SPDY3DownstreamSessionTest, SpdyRateLimitRst) {
   });
 }
 
+TEST_F(HTTP2DownstreamSessionTest, SessionRateLimitShared) {
+  folly::EventBaseManager::get()->setEventBase(&eventBase_, false);
+
+  // 640kbps shared by both transactions
+  httpSession_->setEgressRateLimit(640 * 1024);
+  sendRequest();
+  sendRequest();
+
+  auto handler1 = addSimpleNiceHandler();
+  handler1->expectHeaders();
+  handler1->expectEOM([&handler1] {
+    handler1->sendReplyWithBody(200, 30000);
+  });
+  auto handler2 = addSimpleNiceHandler();
+  handler2->expectHeaders();
+  handler2->expectEOM([&handler2] {
+    handler2->sendReplyWithBody(200, 30000);
+  });
+  handler1->expectDetachTransaction();
+  handler2->expectDetachTransaction();
+
+  HTTPSession::DestructorGuard g(httpSession_);
+  flushRequestsAndLoop();
+
+  // 60KB at 80KB/s, less the initial burst, takes well over 500ms
+  proxygen::TimePoint timeFirstWrite =
+      transport_->getWriteEvents()->front()->getTime();
+  proxygen::TimePoint timeLastWrite =
+      transport_->getWriteEvents()->back()->getTime();
+  int64_t writeDuration =
+      (int64_t)millisecondsBetween(timeLastWrite, timeFirstWrite).count();
+  EXPECT_GE(writeDuration, 500);
+
+  // The rate is split evenly: when one response completes, the other is at
+  // most one write quantum behind
+  std::map<HTTPCodec::StreamID, uint64_t> bodyBytes;
+  folly::Optional<uint64_t> behind;
+  clientCodec_->setCallback(&callbacks_);
+  EXPECT_CALL(callbacks_, onBody(_, _, _))
+      .WillRepeatedly(Invoke([&](HTTPCodec::StreamID id,
+                                 std::shared_ptr<IOBuf> body,
+                                 uint8_t) {
+        bodyBytes[id] += body->computeChainDataLength();
+      }));
+  EXPECT_CALL(callbacks_, onMessageComplete(_, _))
+      .WillRepeatedly(Invoke([&](HTTPCodec::StreamID id, bool) {
+        if (behind) {
+          return;
+        }
+        uint64_t other = 0;
+        for (const auto& streamBytes : bodyBytes) {
+          if (streamBytes.first != id) {
+            other = streamBytes.second;
+          }
+        }
+        EXPECT_EQ(bodyBytes[id], 30000u);
+        behind = bodyBytes[id] - other;
+      }));
+  parseOutput(*clientCodec_);
+  ASSERT_TRUE(behind.hasValue());
+  EXPECT_LE(*behind, EgressPacer::kWriteQuantum);
+
+  cleanup();
+}
+
+TEST_F(HTTP2DownstreamSessionTest, ZeroCopyFallsBack) {
+  // The test transport is not a socket, so writes are copied as usual
+  EXPECT_FALSE(httpSession_->setZeroCopyEgressThreshold(1024));
+  sendRequest();
+
+  auto handler = addSimpleNiceHandler();
+  handler->expectHeaders();
+  handler->expectEOM([&handler] { handler->sendReplyWithBody(200, 4096); });
+  handler->expectDetachTransaction();
+
+  flushRequestsAndLoop();
+  EXPECT_EQ(httpSession_->getNumZeroCopyWrites(), 0);
+  EXPECT_EQ(httpSession_->getZeroCopyBytes(), 0);
+  cleanup();
+}
+
 // Send a 1.0 request, egress the EOM with the last body chunk on a paused
 // socket, and let it timeout.  dropConnection()
 // to removeTransaction with writesDraining_=true
@@ -503,6 +503,7 @@ class MockHTTPSessionStats : public DummyHTTPSessionStats {
   GMOCK_NOEXCEPT_METHOD1(recordSessionIdleTime, void(std::chrono::seconds));
   GMOCK_NOEXCEPT_METHOD0(recordTransactionStalled, void());
   GMOCK_NOEXCEPT_METHOD0(recordSessionStalled, void());
+  GMOCK_NOEXCEPT_METHOD1(recordZeroCopyWrite, void(uint64_t));
 };
 
 } // namespace proxygen
@@ -0,0 +1,321 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/init/Init.h>
+#include <folly/io/async/ScopedEventBaseThread.h>
+#include <gflags/gflags.h>
+#include <proxygen/lib/http/codec/HTTP2Codec.h>
+#include <proxygen/lib/http/session/HTTPDownstreamSession.h>
+#include <proxygen/lib/http/session/HTTPSessionController.h>
+#include <proxygen/lib/utils/Time.h>
+
+#include <algorithm>
+#include <cstring>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+// Time to first byte of a high priority response that is requested while
+// several low priority bulk responses are already streaming over loopback.
+// The client reads at a fixed rate through a small receive buffer, emulating
+// a bottleneck link.  Without a low watermark the server fills the kernel
+// send buffer with bulk data, which the high priority response queues
+// behind.  With TCP_NOTSENT_LOWAT the session picks the next frame from the
+// priority queue only when the kernel backlog is small.
+//
+// ./late_binding_egress_benchmark --read_rate_mbps=80 --bulk_streams=4
+//
+// Prints the p50 and p90 TTFB for notsent_lowat=0 (disabled) and for
+// --notsent_lowat.  Without the watermark TTFB grows with the kernel send
+// buffer (roughly sndbuf / read rate); with it TTFB stays close to the time
+// to drain the watermark plus the client receive buffer.
+
+DEFINE_int32(bulk_streams, 4, "Number of competing low priority streams");
+DEFINE_int32(bulk_bytes, 64 * 1024 * 1024, "Body size of each bulk response");
+DEFINE_int32(read_rate_mbps, 80, "Client read rate in megabits per second");
+DEFINE_int32(rcvbuf, 64 * 1024, "Client SO_RCVBUF");
+DEFINE_int32(warmup_ms, 500, "Time bulk streams run before the request");
+DEFINE_int32(notsent_lowat, 16 * 1024, "TCP_NOTSENT_LOWAT for the second run");
+DEFINE_int32(iterations, 10, "Connections per configuration");
+
+using namespace proxygen;
+using std::chrono::microseconds;
+
+namespace {
+
+class ResponseHandler : public HTTPTransactionHandler {
+ public:
+  void setTransaction(HTTPTransaction* txn) noexcept override {
+    txn_ = txn;
+  }
+  void detachTransaction() noexcept override {
+    delete this;
+  }
+  void onHeadersComplete(std::unique_ptr<HTTPMessage> msg) noexcept override {
+    bulk_ = msg->getPath() == "/bulk";
+  }
+  void onBody(std::unique_ptr<folly::IOBuf> /*chain*/) noexcept override {
+  }
+  void onTrailers(std::unique_ptr<HTTPHeaders> /*trailers*/) noexcept override {
+  }
+  void onEOM() noexcept override {
+    HTTPMessage resp;
+    resp.setStatusCode(200);
+    resp.setStatusMessage("OK");
+    if (!bulk_) {
+      txn_->sendHeadersWithEOM(resp);
+      return;
+    }
+    // The transaction holds the body until the session asks for it, so the
+    // priority queue decides what is written
+    auto body = folly::IOBuf::create(FLAGS_bulk_bytes);
+    memset(body->writableData(), 'a', FLAGS_bulk_bytes);
+    body->append(FLAGS_bulk_bytes);
+    txn_->sendHeaders(resp);
+    txn_->sendBody(std::move(body));
+    txn_->sendEOM();
+  }
+  void onUpgrade(UpgradeProtocol /*protocol*/) noexcept override {
+  }
+  void onError(const HTTPException& /*error*/) noexcept override {
+  }
+  void onEgressPaused() noexcept override {
+  }
+  void onEgressResumed() noexcept override {
+  }
+
+ private:
+  HTTPTransaction* txn_{nullptr};
+  bool bulk_{false};
+};
+
+class Controller : public HTTPSessionController {
+ public:
+  HTTPTransactionHandler* getRequestHandler(HTTPTransaction& /*txn*/,
+                                            HTTPMessage* /*msg*/) override {
+    return new ResponseHandler();
+  }
+  HTTPTransactionHandler* getParseErrorHandler(
+      HTTPTransaction* /*txn*/,
+      const HTTPException& /*error*/,
+      const folly::SocketAddress& /*localAddress*/) override {
+    return nullptr;
+  }
+  HTTPTransactionHandler* getTransactionTimeoutHandler(
+      HTTPTransaction* /*txn*/,
+      const folly::SocketAddress& /*localAddress*/) override {
+    return nullptr;
+  }
+  void attachSession(HTTPSessionBase* /*session*/) override {
+  }
+  void detachSession(const HTTPSessionBase* /*session*/) override {
+  }
+};
+
+class ClientCallback : public HTTPCodec::Callback {
+ public:
+  explicit ClientCallback(HTTPCodec::StreamID watched) : watched_(watched) {
+  }
+  void onMessageBegin(HTTPCodec::StreamID /*stream*/,
+                      HTTPMessage* /*msg*/) override {
+  }
+  void onHeadersComplete(HTTPCodec::StreamID stream,
+                         std::unique_ptr<HTTPMessage> /*msg*/) override {
+    if (stream == watched_) {
+      done = true;
+    }
+  }
+  void onBody(HTTPCodec::StreamID /*stream*/,
+              std::unique_ptr<folly::IOBuf> /*chain*/,
+              uint16_t /*padding*/) override {
+  }
+  void onTrailersComplete(HTTPCodec::StreamID /*stream*/,
+                          std::unique_ptr<HTTPHeaders> /*trailers*/) override {
+  }
+  void onMessageComplete(HTTPCodec::StreamID /*stream*/,
+                         bool /*upgrade*/) override {
+  }
+  void onError(HTTPCodec::StreamID /*stream*/,
+               const HTTPException& error,
+               bool /*newTxn*/) override {
+    LOG(FATAL) << "client parse error: " << error.what();
+  }
+
+  bool done{false};
+
+ private:
+  HTTPCodec::StreamID watched_;
+};
+
+void writeAll(int fd, folly::IOBufQueue& queue) {
+  auto buf = queue.move();
+  for (auto& range : *buf) {
+    size_t off = 0;
+    while (off < range.size()) {
+      auto n = ::write(fd, range.data() + off, range.size() - off);
+      PCHECK(n > 0);
+      off += n;
+    }
+  }
+}
+
+HTTPMessage getRequest(const std::string& path, uint8_t weight) {
+  HTTPMessage req;
+  req.setMethod(HTTPMethod::GET);
+  req.setURL(path);
+  req.getHeaders().set(HTTP_HEADER_HOST, "localhost");
+  req.setHTTP2Priority(std::make_tuple(0, false, weight));
+  return req;
+}
+
+class Server {
+ public:
+  Server() {
+    listenFd_ = socket(AF_INET, SOCK_STREAM, 0);
+    PCHECK(listenFd_ >= 0);
+    addr_.sin_family = AF_INET;
+    addr_.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr_);
+    PCHECK(bind(listenFd_, (sockaddr*)&addr_, len) == 0);
+    PCHECK(listen(listenFd_, 16) == 0);
+    PCHECK(getsockname(listenFd_, (sockaddr*)&addr_, &len) == 0);
+  }
+
+  ~Server() {
+    close(listenFd_);
+  }
+
+  int connect(uint32_t lowWatermark) {
+    int clientFd = socket(AF_INET, SOCK_STREAM, 0);
+    int rcvbuf = FLAGS_rcvbuf;
+    setsockopt(clientFd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    PCHECK(::connect(clientFd, (sockaddr*)&addr_, sizeof(addr_)) == 0);
+    int serverFd = accept(listenFd_, nullptr, nullptr);
+    PCHECK(serverFd >= 0);
+
+    auto evb = thread_.getEventBase();
+    evb->runInEventBaseThreadAndWait([&] {
+      folly::AsyncSocket::UniquePtr sock(
+          new folly::AsyncSocket(evb, folly::NetworkSocket::fromFd(serverFd)));
+      folly::SocketAddress local, peer;
+      sock->getLocalAddress(&local);
+      sock->getPeerAddress(&peer);
+      auto session = new HTTPDownstreamSession(
+          timer_,
+          std::move(sock),
+          local,
+          peer,
+          &controller_,
+          std::make_unique<HTTP2Codec>(TransportDirection::DOWNSTREAM),
+          wangle::TransportInfo(),
+          nullptr);
+      if (lowWatermark > 0) {
+        CHECK(session->setEgressNotSentLowWatermark(lowWatermark));
+      }
+      session->startNow();
+    });
+    return clientFd;
+  }
+
+ private:
+  folly::ScopedEventBaseThread thread_;
+  WheelTimerInstance timer_{std::chrono::milliseconds(60000),
+                            thread_.getEventBase()};
+  Controller controller_;
+  int listenFd_{-1};
+  sockaddr_in addr_{};
+};
+
+// Read at most FLAGS_read_rate_mbps until cb.done or deadline
+void readAtRate(int fd,
+                HTTP2Codec& codec,
+                folly::IOBufQueue& readBuf,
+                ClientCallback& cb,
+                TimePoint deadline) {
+  constexpr size_t kChunk = 16 * 1024;
+  const double bytesPerUs = FLAGS_read_rate_mbps / 8.0;
+  while (!cb.done && getCurrentTime() < deadline) {
+    auto start = getCurrentTime();
+    auto space = readBuf.preallocate(kChunk, kChunk);
+    auto n = ::recv(fd, space.first, kChunk, 0);
+    PCHECK(n > 0);
+    readBuf.postallocate(n);
+    readBuf.trimStart(codec.onIngress(*readBuf.front()));
+    auto budget = microseconds(int64_t(n / bytesPerUs));
+    auto elapsed = getCurrentTime() - start;
+    if (elapsed < budget) {
+      std::this_thread::sleep_for(budget - elapsed);
+    }
+  }
+}
+
+microseconds runOnce(Server& server, uint32_t lowWatermark) {
+  int fd = server.connect(lowWatermark);
+  HTTP2Codec codec(TransportDirection::UPSTREAM);
+  folly::IOBufQueue writeBuf{folly::IOBufQueue::cacheChainLength()};
+  folly::IOBufQueue readBuf{folly::IOBufQueue::cacheChainLength()};
+  // Open the windows far enough that only the reader limits bulk egress
+  constexpr uint32_t kWindow = 1 << 30;
+  codec.getEgressSettings()->setSetting(SettingsId::INITIAL_WINDOW_SIZE,
+                                        kWindow);
+  codec.generateConnectionPreface(writeBuf);
+  codec.generateSettings(writeBuf);
+  codec.generateWindowUpdate(writeBuf, 0, kWindow - 65535);
+  for (int i = 0; i < FLAGS_bulk_streams; i++) {
+    codec.generateHeader(
+        writeBuf, codec.createStream(), getRequest("/bulk", 1), true);
+  }
+  auto watched = codec.createStream();
+  ClientCallback cb(watched);
+  codec.setCallback(&cb);
+  writeAll(fd, writeBuf);
+
+  readAtRate(fd,
+             codec,
+             readBuf,
+             cb,
+             getCurrentTime() + std::chrono::milliseconds(FLAGS_warmup_ms));
+
+  codec.generateHeader(writeBuf, watched, getRequest("/hi", 255), true);
+  auto start = getCurrentTime();
+  writeAll(fd, writeBuf);
+  readAtRate(fd, codec, readBuf, cb, start + std::chrono::seconds(60));
+  CHECK(cb.done) << "high priority response did not arrive";
+  auto ttfb = microsecondsBetween(getCurrentTime(), start);
+  close(fd);
+  return ttfb;
+}
+
+void report(Server& server, uint32_t lowWatermark) {
+  std::vector<microseconds> samples;
+  for (int i = 0; i < FLAGS_iterations; i++) {
+    samples.push_back(runOnce(server, lowWatermark));
+  }
+  std::sort(samples.begin(), samples.end());
+  auto pct = [&](double p) {
+    return samples[std::min(samples.size() - 1, size_t(samples.size() * p))]
+               .count() /
+           1000.0;
+  };
+  printf("notsent_lowat=%-8u p50 ttfb=%10.2fms  p90 ttfb=%10.2fms\n",
+         lowWatermark,
+         pct(0.5),
+         pct(0.9));
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  folly::init(&argc, &argv);
+  Server server;
+  report(server, 0);
+  report(server, FLAGS_notsent_lowat);
+  return 0;
+}
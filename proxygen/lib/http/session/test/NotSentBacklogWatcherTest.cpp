@@ -0,0 +1,136 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/portability/GMock.h>
+#include <folly/portability/GTest.h>
+
+#include <proxygen/lib/http/session/NotSentBacklogWatcher.h>
+
+#ifdef __linux__
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace testing;
+using namespace proxygen;
+
+namespace {
+
+class MockNotSentBacklogCallback : public NotSentBacklogWatcher::Callback {
+ public:
+  GMOCK_METHOD0_(, noexcept, , onNotSentBacklogDrained, void());
+};
+
+} // namespace
+
+class NotSentBacklogWatcherTest : public Test {
+ public:
+  void SetUp() override {
+    int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_GE(listenFd, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addrLen = sizeof(addr);
+    ASSERT_EQ(bind(listenFd, (sockaddr*)&addr, addrLen), 0);
+    ASSERT_EQ(listen(listenFd, 1), 0);
+    ASSERT_EQ(getsockname(listenFd, (sockaddr*)&addr, &addrLen), 0);
+    int clientFd = socket(AF_INET, SOCK_STREAM, 0);
+    int sndbuf = 1024 * 1024;
+    setsockopt(clientFd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    ASSERT_EQ(connect(clientFd, (sockaddr*)&addr, addrLen), 0);
+    peerFd_ = accept(listenFd, nullptr, nullptr);
+    ASSERT_GE(peerFd_, 0);
+    close(listenFd);
+    // Keep the peer window small so that data backs up in the sender
+    int rcvbuf = 4096;
+    setsockopt(peerFd_, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    sock_.reset(new folly::AsyncSocket(
+        &eventBase_, folly::NetworkSocket::fromFd(clientFd)));
+    watcher_ =
+        std::make_unique<NotSentBacklogWatcher>(sock_.get(), 8192, &callback_);
+  }
+
+  void TearDown() override {
+    watcher_.reset();
+    sock_->closeNow();
+    close(peerFd_);
+  }
+
+ protected:
+  // Write until the unsent backlog reaches the watermark
+  void fillBacklog() {
+    std::vector<uint8_t> data(4096, 'a');
+    int fd = sock_->getNetworkSocket().toFd();
+    while (watcher_->getNotSentBytes() < watcher_->getLowWatermark()) {
+      ASSERT_GT(::send(fd, data.data(), data.size(), MSG_DONTWAIT), 0);
+    }
+  }
+
+  // Read from the peer every millisecond until drained_ is set
+  void drainPeer() {
+    std::vector<uint8_t> buf(64 * 1024);
+    while (::recv(peerFd_, buf.data(), buf.size(), MSG_DONTWAIT) > 0) {
+    }
+    if (!drained_) {
+      eventBase_.runAfterDelay([this] { drainPeer(); }, 1);
+    }
+  }
+
+  folly::EventBase eventBase_;
+  StrictMock<MockNotSentBacklogCallback> callback_;
+  folly::AsyncSocket::UniquePtr sock_;
+  int peerFd_{-1};
+  bool drained_{false};
+  std::unique_ptr<NotSentBacklogWatcher> watcher_;
+};
+
+TEST_F(NotSentBacklogWatcherTest, IdleSocketIsNotBacklogged) {
+  ASSERT_TRUE(watcher_->init());
+  EXPECT_EQ(watcher_->getNotSentBytes(), 0);
+  EXPECT_FALSE(watcher_->isBacklogged());
+  EXPECT_FALSE(watcher_->isWaiting());
+}
+
+TEST_F(NotSentBacklogWatcherTest, DrainResumes) {
+  ASSERT_TRUE(watcher_->init());
+  fillBacklog();
+  EXPECT_TRUE(watcher_->isBacklogged());
+  EXPECT_TRUE(watcher_->isWaiting());
+  // Only one event is armed
+  EXPECT_TRUE(watcher_->isBacklogged());
+
+  eventBase_.runAfterDelay([this] { drainPeer(); }, 10);
+  EXPECT_CALL(callback_, onNotSentBacklogDrained())
+      .WillOnce(InvokeWithoutArgs([this] {
+        EXPECT_FALSE(watcher_->isWaiting());
+        EXPECT_LT(watcher_->getNotSentBytes(), watcher_->getLowWatermark());
+        drained_ = true;
+        eventBase_.terminateLoopSoon();
+      }));
+  eventBase_.runAfterDelay([this] { eventBase_.terminateLoopSoon(); }, 2000);
+  eventBase_.loopForever();
+  EXPECT_TRUE(drained_);
+}
+
+TEST_F(NotSentBacklogWatcherTest, DestroyWhileWaiting) {
+  ASSERT_TRUE(watcher_->init());
+  fillBacklog();
+  EXPECT_TRUE(watcher_->isBacklogged());
+  watcher_.reset();
+  EXPECT_CALL(callback_, onNotSentBacklogDrained()).Times(0);
+  std::vector<uint8_t> buf(64 * 1024);
+  while (::recv(peerFd_, buf.data(), buf.size(), MSG_DONTWAIT) > 0) {
+  }
+  eventBase_.loopOnce(EVLOOP_NONBLOCK);
+}
+
+#endif
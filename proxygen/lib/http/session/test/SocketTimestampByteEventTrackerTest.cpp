@@ -0,0 +1,234 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/portability/GMock.h>
+#include <folly/portability/GTest.h>
+
+#include <proxygen/lib/http/session/SocketTimestampByteEventTracker.h>
+#include <proxygen/lib/http/session/test/HTTPSessionMocks.h>
+#include <proxygen/lib/http/session/test/HTTPTransactionMocks.h>
+
+#include <chrono>
+
+#ifdef __linux__
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace testing;
+using namespace proxygen;
+using std::chrono::milliseconds;
+
+namespace {
+
+class MockByteEventTrackerCallback : public ByteEventTracker::Callback {
+ public:
+  GMOCK_METHOD1_(, noexcept, , onPingReplyLatency, void(int64_t));
+  GMOCK_METHOD3_(
+      , noexcept, , onFirstByteEvent, void(HTTPTransaction*, uint64_t, bool));
+  GMOCK_METHOD3_(
+      , noexcept, , onLastByteEvent, void(HTTPTransaction*, uint64_t, bool));
+  GMOCK_METHOD0_(, noexcept, , onDeleteTxnByteEvent, void());
+};
+
+// Socket timestamps are only delivered while reads are installed
+class DiscardReadCallback : public folly::AsyncTransportWrapper::ReadCallback {
+ public:
+  void getReadBuffer(void** bufReturn, size_t* lenReturn) override {
+    *bufReturn = buf_;
+    *lenReturn = sizeof(buf_);
+  }
+  void readDataAvailable(size_t /*len*/) noexcept override {
+  }
+  void readEOF() noexcept override {
+  }
+  void readErr(const folly::AsyncSocketException& /*ex*/) noexcept override {
+  }
+
+ private:
+  char buf_[1024];
+};
+
+} // namespace
+
+class SocketTimestampByteEventTrackerTest : public Test {
+ public:
+  void SetUp() override {
+    // A connected loopback TCP pair
+    int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_GE(listenFd, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addrLen = sizeof(addr);
+    ASSERT_EQ(bind(listenFd, (sockaddr*)&addr, addrLen), 0);
+    ASSERT_EQ(listen(listenFd, 1), 0);
+    ASSERT_EQ(getsockname(listenFd, (sockaddr*)&addr, &addrLen), 0);
+    int clientFd = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_EQ(connect(clientFd, (sockaddr*)&addr, addrLen), 0);
+    peerFd_ = accept(listenFd, nullptr, nullptr);
+    ASSERT_GE(peerFd_, 0);
+    close(listenFd);
+
+    sock_.reset(new folly::AsyncSocket(
+        &eventBase_, folly::NetworkSocket::fromFd(clientFd)));
+    sock_->setReadCB(&readCallback_);
+    txn_.setTransportCallback(&transportCallback_);
+    tracker_ = std::make_shared<SocketTimestampByteEventTracker>(
+        &callback_, &eventBase_, milliseconds(1000));
+  }
+
+  void TearDown() override {
+    tracker_->disableSocketTimestampEvents();
+    sock_->setReadCB(nullptr);
+    sock_->closeNow();
+    close(peerFd_);
+  }
+
+ protected:
+  void write(size_t len, folly::WriteFlags flags) {
+    std::vector<uint8_t> data(len, 'a');
+    sock_->write(nullptr, data.data(), data.size(), flags);
+    ASSERT_EQ(sock_->getRawBytesWritten(), bytesWritten_ + len);
+    bytesWritten_ += len;
+  }
+
+  // Register TX/ACK events the way HTTPSession does
+  void trackRawBytes(ByteEvent::EventType type, bool ack) {
+    tracker_->addTxByteEvent(sock_->getRawBytesWritten(), type, &txn_);
+    if (ack) {
+      tracker_->addAckByteEvent(sock_->getRawBytesWritten(), &txn_);
+    }
+  }
+
+  void loopUntilDone() {
+    eventBase_.runAfterDelay([this] { eventBase_.terminateLoopSoon(); },
+                             2000);
+    eventBase_.loopForever();
+  }
+
+  folly::EventBase eventBase_;
+  WheelTimerInstance transactionTimeouts_{milliseconds(500), &eventBase_};
+  NiceMock<MockHTTPTransactionTransport> transport_;
+  HTTP2PriorityQueue txnEgressQueue_;
+  HTTPTransaction txn_{TransportDirection::DOWNSTREAM,
+                       HTTPCodec::StreamID(1),
+                       1,
+                       transport_,
+                       txnEgressQueue_,
+                       transactionTimeouts_.getWheelTimer(),
+                       transactionTimeouts_.getDefaultTimeout()};
+  NiceMock<MockHTTPTransactionTransportCallback> transportCallback_;
+  StrictMock<MockByteEventTrackerCallback> callback_;
+  DiscardReadCallback readCallback_;
+  folly::AsyncSocket::UniquePtr sock_;
+  int peerFd_{-1};
+  uint64_t bytesWritten_{0};
+  std::shared_ptr<SocketTimestampByteEventTracker> tracker_;
+};
+
+TEST_F(SocketTimestampByteEventTrackerTest, DisabledByDefault) {
+  tracker_->addLastByteEvent(&txn_, 100);
+  bool cork = false, som = false, eom = false;
+  EXPECT_EQ(tracker_->preSend(&cork, &som, &eom, 0), 0);
+  EXPECT_FALSE(eom);
+  trackRawBytes(ByteEvent::LAST_BYTE, true);
+  EXPECT_EQ(tracker_->getNumPendingTxEvents(), 0);
+  EXPECT_EQ(tracker_->getNumPendingAckEvents(), 0);
+}
+
+TEST_F(SocketTimestampByteEventTrackerTest, PreSendSplitsAtMessageBoundary) {
+  ASSERT_TRUE(tracker_->enableSocketTimestamps(sock_.get()));
+  EXPECT_TRUE(sock_->isEorTrackingEnabled());
+  tracker_->addFirstBodyByteEvent(10, &txn_);
+  tracker_->addLastByteEvent(&txn_, 100);
+
+  bool cork = false, som = false, eom = false;
+  EXPECT_EQ(tracker_->preSend(&cork, &som, &eom, 0), 10);
+  EXPECT_TRUE(som);
+  EXPECT_FALSE(eom);
+
+  write(10, folly::WriteFlags::TIMESTAMP_TX);
+  EXPECT_CALL(callback_, onFirstByteEvent(&txn_, 10, true));
+  tracker_->processByteEvents(tracker_, 10);
+
+  som = false;
+  EXPECT_EQ(tracker_->preSend(&cork, &som, &eom, 10), 90);
+  EXPECT_FALSE(som);
+  EXPECT_TRUE(eom);
+}
+
+TEST_F(SocketTimestampByteEventTrackerTest, FirstByteTx) {
+  ASSERT_TRUE(tracker_->enableSocketTimestamps(sock_.get()));
+  tracker_->addFirstBodyByteEvent(50, &txn_);
+  bool cork = false, som = false, eom = false;
+  EXPECT_EQ(tracker_->preSend(&cork, &som, &eom, 0), 50);
+  write(50, folly::WriteFlags::TIMESTAMP_TX);
+  EXPECT_CALL(callback_, onFirstByteEvent(&txn_, 50, true))
+      .WillOnce(InvokeWithoutArgs(
+          [this] { trackRawBytes(ByteEvent::FIRST_BYTE, false); }));
+  tracker_->processByteEvents(tracker_, 50);
+  EXPECT_EQ(tracker_->getNumPendingTxEvents(), 1);
+
+  EXPECT_CALL(transportCallback_, firstByteTX()).WillOnce(InvokeWithoutArgs(
+      [this] { eventBase_.terminateLoopSoon(); }));
+  loopUntilDone();
+  EXPECT_EQ(tracker_->getNumPendingTxEvents(), 0);
+}
+
+TEST_F(SocketTimestampByteEventTrackerTest, LastByteTxAndAck) {
+  ASSERT_TRUE(tracker_->enableSocketTimestamps(sock_.get()));
+  // Some untracked traffic first, so that offsets are not trivially zero
+  write(1000, folly::WriteFlags::NONE);
+  tracker_->addLastByteEvent(&txn_, 1100);
+  bool cork = false, som = false, eom = false;
+  EXPECT_EQ(tracker_->preSend(&cork, &som, &eom, 1000), 100);
+  EXPECT_TRUE(eom);
+  write(100, folly::WriteFlags::EOR | folly::WriteFlags::TIMESTAMP_TX);
+  EXPECT_CALL(callback_, onLastByteEvent(&txn_, 1100, true))
+      .WillOnce(InvokeWithoutArgs(
+          [this] { trackRawBytes(ByteEvent::LAST_BYTE, true); }));
+  tracker_->processByteEvents(tracker_, 1100);
+
+  EXPECT_CALL(transportCallback_, lastByteTX());
+  EXPECT_CALL(transportCallback_, lastByteAcked(_))
+      .WillOnce(Invoke([this](milliseconds latency) {
+        EXPECT_GE(latency.count(), 0);
+        EXPECT_LT(latency.count(), 1000);
+        eventBase_.terminateLoopSoon();
+      }));
+  loopUntilDone();
+  EXPECT_EQ(tracker_->getNumPendingTxEvents(), 0);
+  EXPECT_EQ(tracker_->getNumPendingAckEvents(), 0);
+}
+
+TEST_F(SocketTimestampByteEventTrackerTest, MissingTimestampsTimeOut) {
+  tracker_ = std::make_shared<SocketTimestampByteEventTracker>(
+      &callback_, &eventBase_, milliseconds(50));
+  ASSERT_TRUE(tracker_->enableSocketTimestamps(sock_.get()));
+  // Nothing is written, so these never get a timestamp
+  tracker_->addTxByteEvent(1000, ByteEvent::LAST_BYTE, &txn_);
+  tracker_->addAckByteEvent(1000, &txn_);
+  EXPECT_CALL(transportCallback_, lastByteAcked(_)).Times(0);
+  eventBase_.runAfterDelay([this] { eventBase_.terminateLoopSoon(); }, 200);
+  eventBase_.loopForever();
+  EXPECT_EQ(tracker_->getNumPendingTxEvents(), 0);
+  EXPECT_EQ(tracker_->getNumPendingAckEvents(), 0);
+}
+
+TEST_F(SocketTimestampByteEventTrackerTest, DisableDrainsEvents) {
+  ASSERT_TRUE(tracker_->enableSocketTimestamps(sock_.get()));
+  tracker_->addTxByteEvent(1000, ByteEvent::FIRST_BYTE, &txn_);
+  tracker_->addAckByteEvent(2000, &txn_);
+  EXPECT_EQ(tracker_->disableSocketTimestampEvents(), 2);
+  EXPECT_FALSE(tracker_->isEnabled());
+}
+
+#endif
@@ -0,0 +1,252 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Conv.h>
+#include <folly/init/Init.h>
+#include <folly/io/async/ScopedEventBaseThread.h>
+#include <gflags/gflags.h>
+#include <proxygen/lib/http/codec/HTTP1xCodec.h>
+#include <proxygen/lib/http/session/HTTPDownstreamSession.h>
+#include <proxygen/lib/http/session/HTTPSessionController.h>
+#include <proxygen/lib/utils/Time.h>
+
+#include <cstring>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Loopback throughput and server CPU for a large HTTP/1.1 response, with
+// writes copied and with MSG_ZEROCOPY.  The client drains the socket as fast
+// as it can; server CPU is measured on the session's event base thread.
+//
+// ./zero_copy_egress_benchmark --body_mb=4096
+//
+// Prints one line per mode with Gbps and server CPU ms per GB.  Note that
+// loopback delivers zerocopy sends by copying on the receive path, so the
+// CPU saving here is smaller than on a NIC; the benchmark mostly shows the
+// cost of completion handling and the fallback path.
+
+DEFINE_int32(body_mb, 2048, "Response body size in MB");
+DEFINE_int32(chunk_kb, 64, "Size of each body IOBuf sent by the handler");
+DEFINE_int32(zerocopy_threshold, 32 * 1024, "Minimum zerocopy write size");
+DEFINE_int32(iterations, 3, "Responses per mode");
+
+using namespace proxygen;
+
+namespace {
+
+class BulkHandler : public HTTPTransactionHandler {
+ public:
+  explicit BulkHandler(const folly::IOBuf& chunk) : chunk_(chunk) {
+  }
+  void setTransaction(HTTPTransaction* txn) noexcept override {
+    txn_ = txn;
+  }
+  void detachTransaction() noexcept override {
+    delete this;
+  }
+  void onHeadersComplete(std::unique_ptr<HTTPMessage> /*msg*/) noexcept
+      override {
+  }
+  void onBody(std::unique_ptr<folly::IOBuf> /*chain*/) noexcept override {
+  }
+  void onTrailers(std::unique_ptr<HTTPHeaders> /*trailers*/) noexcept override {
+  }
+  void onEOM() noexcept override {
+    HTTPMessage resp;
+    resp.setStatusCode(200);
+    resp.setStatusMessage("OK");
+    resp.getHeaders().set(
+        HTTP_HEADER_CONTENT_LENGTH,
+        folly::to<std::string>(uint64_t(FLAGS_body_mb) * 1024 * 1024));
+    txn_->sendHeaders(resp);
+    remaining_ = uint64_t(FLAGS_body_mb) * 1024 * 1024;
+    onEgressResumed();
+  }
+  void onUpgrade(UpgradeProtocol /*protocol*/) noexcept override {
+  }
+  void onError(const HTTPException& /*error*/) noexcept override {
+  }
+  void onEgressPaused() noexcept override {
+  }
+  void onEgressResumed() noexcept override {
+    // The chunks are clones of one immutable buffer, as a cache would send
+    while (remaining_ > 0 && !txn_->isEgressPaused()) {
+      auto len = std::min<uint64_t>(remaining_, chunk_.length());
+      auto body = chunk_.cloneOne();
+      body->trimEnd(chunk_.length() - len);
+      remaining_ -= len;
+      txn_->sendBody(std::move(body));
+    }
+    if (remaining_ == 0 && !txn_->isEgressEOMQueued()) {
+      txn_->sendEOM();
+    }
+  }
+
+ private:
+  const folly::IOBuf& chunk_;
+  HTTPTransaction* txn_{nullptr};
+  uint64_t remaining_{0};
+};
+
+class Controller : public HTTPSessionController {
+ public:
+  Controller() {
+    size_t len = size_t(FLAGS_chunk_kb) * 1024;
+    chunk_ = folly::IOBuf::create(len);
+    memset(chunk_->writableData(), 'a', len);
+    chunk_->append(len);
+  }
+  HTTPTransactionHandler* getRequestHandler(HTTPTransaction& /*txn*/,
+                                            HTTPMessage* /*msg*/) override {
+    return new BulkHandler(*chunk_);
+  }
+  HTTPTransactionHandler* getParseErrorHandler(
+      HTTPTransaction* /*txn*/,
+      const HTTPException& /*error*/,
+      const folly::SocketAddress& /*localAddress*/) override {
+    return nullptr;
+  }
+  HTTPTransactionHandler* getTransactionTimeoutHandler(
+      HTTPTransaction* /*txn*/,
+      const folly::SocketAddress& /*localAddress*/) override {
+    return nullptr;
+  }
+  void attachSession(HTTPSessionBase* /*session*/) override {
+  }
+  void detachSession(const HTTPSessionBase* /*session*/) override {
+  }
+
+ private:
+  std::unique_ptr<folly::IOBuf> chunk_;
+};
+
+std::chrono::microseconds threadCpuTime() {
+  rusage usage;
+  PCHECK(getrusage(RUSAGE_THREAD, &usage) == 0);
+  return std::chrono::seconds(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+         std::chrono::microseconds(usage.ru_utime.tv_usec +
+                                   usage.ru_stime.tv_usec);
+}
+
+class Server {
+ public:
+  Server() {
+    listenFd_ = socket(AF_INET, SOCK_STREAM, 0);
+    PCHECK(listenFd_ >= 0);
+    addr_.sin_family = AF_INET;
+    addr_.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr_);
+    PCHECK(bind(listenFd_, (sockaddr*)&addr_, len) == 0);
+    PCHECK(listen(listenFd_, 16) == 0);
+    PCHECK(getsockname(listenFd_, (sockaddr*)&addr_, &len) == 0);
+  }
+
+  ~Server() {
+    close(listenFd_);
+  }
+
+  // Returns the client fd
+  int connect(bool zeroCopy) {
+    int clientFd = socket(AF_INET, SOCK_STREAM, 0);
+    PCHECK(::connect(clientFd, (sockaddr*)&addr_, sizeof(addr_)) == 0);
+    int serverFd = accept(listenFd_, nullptr, nullptr);
+    PCHECK(serverFd >= 0);
+
+    auto evb = thread_.getEventBase();
+    evb->runInEventBaseThreadAndWait([&] {
+      folly::AsyncSocket::UniquePtr sock(
+          new folly::AsyncSocket(evb, folly::NetworkSocket::fromFd(serverFd)));
+      folly::SocketAddress local, peer;
+      sock->getLocalAddress(&local);
+      sock->getPeerAddress(&peer);
+      session_ = new HTTPDownstreamSession(
+          timer_,
+          std::move(sock),
+          local,
+          peer,
+          &controller_,
+          std::make_unique<HTTP1xCodec>(TransportDirection::DOWNSTREAM),
+          wangle::TransportInfo(),
+          nullptr);
+      if (zeroCopy &&
+          !session_->setZeroCopyEgressThreshold(FLAGS_zerocopy_threshold)) {
+        LOG(WARNING) << "MSG_ZEROCOPY not supported, writes are copied";
+      }
+      session_->startNow();
+    });
+    return clientFd;
+  }
+
+  std::chrono::microseconds cpuTime() {
+    std::chrono::microseconds cpu;
+    thread_.getEventBase()->runInEventBaseThreadAndWait(
+        [&] { cpu = threadCpuTime(); });
+    return cpu;
+  }
+
+  // Zerocopy writes on the last session; only valid while it is open
+  uint64_t zeroCopyWrites() {
+    uint64_t writes = 0;
+    thread_.getEventBase()->runInEventBaseThreadAndWait(
+        [&] { writes = session_->getNumZeroCopyWrites(); });
+    return writes;
+  }
+
+ private:
+  folly::ScopedEventBaseThread thread_;
+  WheelTimerInstance timer_{std::chrono::milliseconds(60000),
+                            thread_.getEventBase()};
+  Controller controller_;
+  HTTPDownstreamSession* session_{nullptr};
+  int listenFd_{-1};
+  sockaddr_in addr_{};
+};
+
+void runOnce(Server& server, bool zeroCopy) {
+  int fd = server.connect(zeroCopy);
+  const char req[] = "GET /bulk HTTP/1.1\r\nHost: localhost\r\n\r\n";
+  PCHECK(::write(fd, req, sizeof(req) - 1) == sizeof(req) - 1);
+
+  // Headers are small; count everything and stop once the body is in
+  const uint64_t bodyBytes = uint64_t(FLAGS_body_mb) * 1024 * 1024;
+  std::vector<char> buf(1024 * 1024);
+  uint64_t total = 0;
+  auto startCpu = server.cpuTime();
+  auto start = getCurrentTime();
+  while (total < bodyBytes) {
+    auto n = ::recv(fd, buf.data(), buf.size(), 0);
+    PCHECK(n > 0);
+    total += n;
+  }
+  auto elapsed = microsecondsBetween(getCurrentTime(), start);
+  auto cpu = server.cpuTime() - startCpu;
+  auto zeroCopyWrites = server.zeroCopyWrites();
+  close(fd);
+
+  double gb = bodyBytes / double(1 << 30);
+  printf("%-9s %8.2f Gbps  server cpu %8.2f ms/GB  zerocopy writes %lu\n",
+         zeroCopy ? "zerocopy" : "copy",
+         gb * 8 / (elapsed.count() / 1e6),
+         cpu.count() / 1000.0 / gb,
+         (unsigned long)zeroCopyWrites);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  folly::init(&argc, &argv);
+  Server server;
+  for (int i = 0; i < FLAGS_iterations; i++) {
+    runOnce(server, false);
+    runOnce(server, true);
+  }
+  return 0;
+}
@@ -200,3 +200,97 @@ TEST(ByteRangeSpecTest, Invalids) {
   EXPECT_FALSE(parseByteRangeSpec(sp, dummy, dummy, dummy)) <<
     "Spec StringPiece ends before first byte in initial byte range";
 }
+
+TEST(RangeHeaderTest, Valids) {
+  using RFC2616::ByteRangePair;
+  std::vector<ByteRangePair> ranges;
+
+  ASSERT_TRUE(RFC2616::parseRangeHeader("bytes=0-99", 1000, ranges));
+  EXPECT_EQ(std::vector<ByteRangePair>({{0, 99}}), ranges);
+
+  ranges.clear();
+  ASSERT_TRUE(RFC2616::parseRangeHeader("bytes=900-", 1000, ranges));
+  EXPECT_EQ(std::vector<ByteRangePair>({{900, 999}}), ranges);
+
+  ranges.clear();
+  ASSERT_TRUE(RFC2616::parseRangeHeader("bytes=-100", 1000, ranges));
+  EXPECT_EQ(std::vector<ByteRangePair>({{900, 999}}), ranges);
+
+  ranges.clear();
+  ASSERT_TRUE(RFC2616::parseRangeHeader("bytes=-5000", 1000, ranges));
+  EXPECT_EQ(std::vector<ByteRangePair>({{0, 999}}), ranges) <<
+    "Suffix longer than the instance selects all of it";
+
+  ranges.clear();
+  ASSERT_TRUE(RFC2616::parseRangeHeader("bytes=500-5000", 1000, ranges));
+  EXPECT_EQ(std::vector<ByteRangePair>({{500, 999}}), ranges) <<
+    "Last byte is clamped to the instance";
+
+  ranges.clear();
+  ASSERT_TRUE(
+    RFC2616::parseRangeHeader(" bytes=0-0, 10-19 ,,-1", 1000, ranges));
+  EXPECT_EQ(std::vector<ByteRangePair>({{0, 0}, {10, 19}, {999, 999}}),
+            ranges);
+}
+
+TEST(RangeHeaderTest, Unsatisfiable) {
+  std::vector<RFC2616::ByteRangePair> ranges;
+
+  EXPECT_TRUE(RFC2616::parseRangeHeader("bytes=1000-", 1000, ranges));
+  EXPECT_TRUE(ranges.empty());
+  EXPECT_TRUE(RFC2616::parseRangeHeader("bytes=-0", 1000, ranges));
+  EXPECT_TRUE(ranges.empty());
+  EXPECT_TRUE(RFC2616::parseRangeHeader("bytes=0-10", 0, ranges));
+  EXPECT_TRUE(ranges.empty());
+
+  ASSERT_TRUE(RFC2616::parseRangeHeader("bytes=2000-,5-9", 1000, ranges));
+  EXPECT_EQ(1, ranges.size()) << "Only satisfiable ranges are returned";
+}
+
+TEST(RangeHeaderTest, Coalesce) {
+  using RFC2616::ByteRangePair;
+  std::vector<ByteRangePair> ranges;
+
+  ASSERT_TRUE(RFC2616::parseRangeHeader(
+    "bytes=0-,0-,0-,0-,0-,0-,0-,0-,0-,0-,0-,0-,0-,0-,0-,0-", 1000, ranges));
+  EXPECT_EQ(16, ranges.size());
+  RFC2616::coalesceByteRanges(ranges);
+  EXPECT_EQ(std::vector<ByteRangePair>({{0, 999}}), ranges) <<
+    "Repeating a range does not repeat the bytes";
+
+  ranges.clear();
+  ASSERT_TRUE(RFC2616::parseRangeHeader(
+    "bytes=500-599,-100,0-9,10-19,550-650,30-39", 1000, ranges));
+  RFC2616::coalesceByteRanges(ranges);
+  EXPECT_EQ(std::vector<ByteRangePair>(
+              {{0, 19}, {30, 39}, {500, 650}, {900, 999}}),
+            ranges) << "Overlapping and adjacent ranges are merged, in order";
+
+  ranges.clear();
+  RFC2616::coalesceByteRanges(ranges);
+  EXPECT_TRUE(ranges.empty());
+}
+
+TEST(RangeHeaderTest, Invalids) {
+  std::vector<RFC2616::ByteRangePair> ranges;
+
+  EXPECT_FALSE(RFC2616::parseRangeHeader("0-10", 1000, ranges)) <<
+    "Header must start with 'bytes='";
+  EXPECT_FALSE(RFC2616::parseRangeHeader("items=0-10", 1000, ranges)) <<
+    "Only the bytes unit is supported";
+  EXPECT_FALSE(RFC2616::parseRangeHeader("bytes=", 1000, ranges)) <<
+    "At least one range is required";
+  EXPECT_FALSE(RFC2616::parseRangeHeader("bytes=10", 1000, ranges)) <<
+    "Range missing '-'";
+  EXPECT_FALSE(RFC2616::parseRangeHeader("bytes=-", 1000, ranges)) <<
+    "Range missing both ends";
+  EXPECT_FALSE(RFC2616::parseRangeHeader("bytes=10-5", 1000, ranges)) <<
+    "Last byte before first byte";
+  EXPECT_FALSE(RFC2616::parseRangeHeader("bytes=+1-5", 1000, ranges)) <<
+    "Signs are not allowed";
+  EXPECT_FALSE(RFC2616::parseRangeHeader("bytes=0-5x", 1000, ranges)) <<
+    "Range has trailing garbage";
+  EXPECT_FALSE(RFC2616::parseRangeHeader("bytes=0-5,x", 1000, ranges)) <<
+    "Any malformed range invalidates the header";
+  EXPECT_TRUE(ranges.empty());
+}
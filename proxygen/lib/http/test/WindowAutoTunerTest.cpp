@@ -0,0 +1,222 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <deque>
+#include <folly/portability/GTest.h>
+#include <memory>
+#include <proxygen/lib/http/WindowAutoTuner.h>
+
+using namespace proxygen;
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+
+namespace {
+
+const TimePoint kStart = TimePoint() + seconds(1);
+
+/**
+ * Simulates an upload over a link with a fixed RTT and bandwidth, one
+ * millisecond at a time.  The sender transmits as much as the link and its
+ * flow control credit allow.  The receiver consumes data as soon as it
+ * arrives and sends a WINDOW_UPDATE once half the window is consumed,
+ * applying the tuner's target the same way FlowControlFilter does.
+ */
+class SimulatedUpload {
+ public:
+  SimulatedUpload(milliseconds rtt,
+                  uint64_t bytesPerMs,
+                  uint32_t capacity,
+                  const WindowAutoTuner::Options* options)
+      : rtt_(rtt),
+        bytesPerMs_(bytesPerMs),
+        capacity_(capacity),
+        credit_(capacity) {
+    if (options) {
+      tuner_ = std::make_unique<WindowAutoTuner>(*options);
+    }
+  }
+
+  // Returns the number of bytes delivered to the receiver
+  uint64_t run(milliseconds duration) {
+    uint64_t delivered = 0;
+    for (auto i = 0; i < duration.count(); i++) {
+      delivered += step();
+    }
+    return delivered;
+  }
+
+  uint32_t getCapacity() const {
+    return capacity_;
+  }
+
+ private:
+  uint64_t step() {
+    now_ += milliseconds(1);
+    while (!updates_.empty() && updates_.front().first <= now_) {
+      credit_ += updates_.front().second;
+      updates_.pop_front();
+    }
+    uint64_t send = std::min(credit_, bytesPerMs_);
+    if (send > 0) {
+      credit_ -= send;
+      data_.emplace_back(now_ + rtt_ / 2, send);
+    }
+
+    uint64_t delivered = 0;
+    while (!data_.empty() && data_.front().first <= now_) {
+      delivered += data_.front().second;
+      toAck_ += data_.front().second;
+      data_.pop_front();
+      if (toAck_ > capacity_ / 2) {
+        sendWindowUpdate();
+      }
+    }
+    return delivered;
+  }
+
+  void sendWindowUpdate() {
+    int64_t update = toAck_;
+    if (tuner_) {
+      auto target = tuner_->getTargetCapacity(
+          capacity_, toAck_, rtt_, now_);
+      if (target > capacity_) {
+        update += target - capacity_;
+        capacity_ = target;
+      } else if (target < capacity_) {
+        auto shrink = std::min<uint64_t>(capacity_ - target, toAck_ / 2);
+        update -= shrink;
+        capacity_ -= shrink;
+      }
+    }
+    updates_.emplace_back(now_ + rtt_ / 2, update);
+    toAck_ = 0;
+  }
+
+  milliseconds rtt_;
+  uint64_t bytesPerMs_;
+  uint32_t capacity_;
+  uint64_t credit_;
+  uint64_t toAck_{0};
+  TimePoint now_{kStart};
+  std::deque<std::pair<TimePoint, uint64_t>> data_;
+  std::deque<std::pair<TimePoint, uint64_t>> updates_;
+  std::unique_ptr<WindowAutoTuner> tuner_;
+};
+
+}
+
+TEST(WindowAutoTunerTest, NoRtt) {
+  WindowAutoTuner tuner(WindowAutoTuner::Options(1000, 100000));
+  EXPECT_EQ(tuner.getTargetCapacity(1000, 500, milliseconds(0), kStart),
+            1000);
+  EXPECT_EQ(tuner.getTargetCapacity(
+                1000, 500, milliseconds(0), kStart + milliseconds(1)),
+            1000);
+}
+
+TEST(WindowAutoTunerTest, GrowWhenWindowLimited) {
+  WindowAutoTuner tuner(WindowAutoTuner::Options(1000, 100000));
+  auto now = kStart;
+  EXPECT_EQ(tuner.getTargetCapacity(1000, 500, milliseconds(100), now), 1000);
+  // Half the window in 10ms with a 100ms RTT
+  now += milliseconds(10);
+  EXPECT_EQ(tuner.getTargetCapacity(1000, 500, milliseconds(100), now), 2000);
+  EXPECT_EQ(tuner.getBdpEstimate(), 5000);
+}
+
+TEST(WindowAutoTunerTest, GrowthIsBounded) {
+  WindowAutoTuner tuner(WindowAutoTuner::Options(1000, 100000));
+  uint32_t capacity = 1000;
+  auto now = kStart;
+  for (auto i = 0; i < 20; i++) {
+    capacity = tuner.getTargetCapacity(
+        capacity, capacity / 2, milliseconds(100), now);
+    now += milliseconds(10);
+  }
+  EXPECT_EQ(capacity, 100000);
+}
+
+TEST(WindowAutoTunerTest, NoGrowthForSlowPeer) {
+  WindowAutoTuner tuner(WindowAutoTuner::Options(1000, 100000));
+  auto now = kStart;
+  for (auto i = 0; i < 5; i++) {
+    // Half the window every second with a 100ms RTT
+    EXPECT_EQ(tuner.getTargetCapacity(1000, 500, milliseconds(100), now),
+              1000);
+    now += seconds(1);
+  }
+}
+
+TEST(WindowAutoTunerTest, ShrinkAfterBurst) {
+  WindowAutoTuner::Options options(1000, 1000000);
+  options.shrinkInterval = seconds(10);
+  WindowAutoTuner tuner(options);
+  uint32_t capacity = 1000000;
+  auto now = kStart;
+  tuner.getTargetCapacity(capacity, capacity / 2, milliseconds(100), now);
+
+  // Within the first interval nothing happens
+  now += seconds(5);
+  EXPECT_EQ(tuner.getTargetCapacity(capacity, 1000, milliseconds(100), now),
+            capacity);
+
+  // Then the window halves once per slow update, down to the minimum
+  for (auto i = 0; i < 20; i++) {
+    now += seconds(20);
+    auto target = tuner.getTargetCapacity(
+        capacity, 1000, milliseconds(100), now);
+    EXPECT_EQ(target, std::max<uint32_t>(capacity / 2, 1000));
+    capacity = target;
+  }
+  EXPECT_EQ(capacity, 1000);
+}
+
+TEST(WindowAutoTunerTest, HighLatencyUploadConverges) {
+  // 200ms RTT at 50MB/s gives a 10MB bandwidth-delay product, far more than
+  // the 64KB default window
+  const milliseconds kRtt(200);
+  const uint64_t kBytesPerMs = 50000;
+  const uint64_t kBdp = kBytesPerMs * kRtt.count();
+  WindowAutoTuner::Options options(65536, 32 * 1024 * 1024);
+
+  SimulatedUpload fixed(kRtt, kBytesPerMs, 65536, nullptr);
+  SimulatedUpload tuned(kRtt, kBytesPerMs, 65536, &options);
+  fixed.run(seconds(10));
+  tuned.run(seconds(10));
+
+  // A fixed window delivers one window per RTT
+  auto fixedBytes = fixed.run(seconds(1));
+  EXPECT_LE(fixedBytes, 65536 * (1000 / kRtt.count()));
+
+  // The tuned window reaches the link rate, within the configured bound
+  auto tunedBytes = tuned.run(seconds(1));
+  EXPECT_GE(tunedBytes, kBytesPerMs * 1000 * 9 / 10);
+  EXPECT_GE(tuned.getCapacity(), kBdp);
+  EXPECT_LE(tuned.getCapacity(), options.maxCapacity);
+}
+
+TEST(WindowAutoTunerTest, ManySlowStreamsStayBounded) {
+  // Streams consuming 1-10KB/s on a 100ms RTT never need more than the
+  // minimum window, so the total memory they can pin stays bounded.
+  const uint32_t kMinWindow = 65536;
+  const size_t kNumStreams = 100;
+  WindowAutoTuner::Options options(kMinWindow, 16 * 1024 * 1024);
+  std::vector<std::unique_ptr<SimulatedUpload>> streams;
+  for (size_t i = 0; i < kNumStreams; i++) {
+    streams.push_back(std::make_unique<SimulatedUpload>(
+        milliseconds(100), i % 10 + 1, kMinWindow, &options));
+  }
+  uint64_t totalCapacity = 0;
+  for (auto& stream : streams) {
+    stream->run(seconds(60));
+    EXPECT_EQ(stream->getCapacity(), kMinWindow);
+    totalCapacity += stream->getCapacity();
+  }
+  EXPECT_EQ(totalCapacity, kNumStreams * kMinWindow);
+}
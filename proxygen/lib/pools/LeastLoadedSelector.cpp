@@ -0,0 +1,217 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/pools/LeastLoadedSelector.h>
+
+#include <folly/ExceptionString.h>
+#include <proxygen/lib/http/connpool/SessionPool.h>
+#include <unordered_map>
+#include <math.h>
+
+namespace proxygen {
+
+uint32_t LeastLoadedSelector::Endpoint::getLoad() const {
+  if (!sessionPool_) {
+    return outstanding_;
+  }
+  // Each active session carries at least one transaction, so this catches
+  // traffic sent through the pool by callers that bypass the selector.
+  return std::max(outstanding_, sessionPool_->getNumActiveSessions());
+}
+
+LeastLoadedSelector::Request::Request(EndpointPtr endpoint,
+                                      std::weak_ptr<const Options> options)
+    : endpoint_(std::move(endpoint)),
+      options_(std::move(options)),
+      sentTime_(getCurrentTime()) {
+  endpoint_->outstanding_++;
+}
+
+LeastLoadedSelector::Request::~Request() {
+  DCHECK_GT(endpoint_->outstanding_, 0);
+  endpoint_->outstanding_--;
+}
+
+void LeastLoadedSelector::Request::markFailed() {
+  auto options = options_.lock();
+  if (sampled_ || !options) {
+    return;
+  }
+  sampled_ = true;
+  addSample(*endpoint_,
+            options->failurePenalty,
+            *options,
+            getCurrentTime());
+}
+
+void LeastLoadedSelector::Request::lastByteFlushed() noexcept {
+  // Time spent sending a large body is not the server's doing
+  sentTime_ = getCurrentTime();
+}
+
+void LeastLoadedSelector::Request::headerBytesReceived(
+    const HTTPHeaderSize&) noexcept {
+  auto options = options_.lock();
+  // Only the first header block counts; 1xx responses and trailers follow
+  // the same path
+  if (sampled_ || !options) {
+    return;
+  }
+  sampled_ = true;
+  auto now = getCurrentTime();
+  addSample(*endpoint_, microsecondsBetween(now, sentTime_), *options, now);
+}
+
+LeastLoadedSelector::LeastLoadedSelector()
+    : LeastLoadedSelector(Options()) {
+}
+
+LeastLoadedSelector::LeastLoadedSelector(Options options, uint64_t seed)
+    : options_(std::make_shared<const Options>(options)), rng_(seed) {
+  CHECK_GT(options.decayTime.count(), 0);
+  CHECK(options.slowStartMinWeight > 0 && options.slowStartMinWeight <= 1)
+    << options.slowStartMinWeight;
+}
+
+void LeastLoadedSelector::updateServers(
+    const std::vector<ServerListGenerator::ServerConfig>& servers,
+    TimePoint now) {
+  auto defaultLatency = getDefaultLatencyMs();
+  std::unordered_map<folly::SocketAddress, EndpointPtr> existing;
+  for (auto& endpoint : endpoints_) {
+    existing.emplace(endpoint->getAddress(), std::move(endpoint));
+  }
+  std::vector<EndpointPtr> endpoints;
+  endpoints.reserve(servers.size());
+  for (const auto& server : servers) {
+    auto it = existing.find(server.address);
+    if (it != existing.end()) {
+      if (!it->second) {
+        VLOG(4) << "Duplicate server " << server.address.describe();
+        continue;
+      }
+      it->second->config_ = server;
+      endpoints.push_back(std::move(it->second));
+      continue;
+    }
+    // The first list is everything there is; there is nothing to ease in
+    // next to
+    endpoints.push_back(std::make_shared<Endpoint>(
+        server, defaultLatency, now, haveServerList_));
+    existing.emplace(server.address, nullptr);
+  }
+  VLOG(4) << "Server list updated: " << endpoints_.size() << " -> "
+          << endpoints.size() << " endpoints";
+  endpoints_ = std::move(endpoints);
+  haveServerList_ = true;
+}
+
+void LeastLoadedSelector::onServerListAvailable(
+    std::vector<ServerListGenerator::ServerConfig>&& results) noexcept {
+  updateServers(results);
+}
+
+void LeastLoadedSelector::onServerListError(
+    std::exception_ptr error) noexcept {
+  // Keep using the endpoints we have
+  LOG(ERROR) << "Failed to update server list: "
+             << folly::exceptionStr(error);
+}
+
+LeastLoadedSelector::EndpointPtr LeastLoadedSelector::select(TimePoint now) {
+  if (endpoints_.empty()) {
+    return nullptr;
+  }
+  if (endpoints_.size() == 1) {
+    return endpoints_[0];
+  }
+  // Two distinct endpoints, uniformly
+  std::uniform_int_distribution<size_t> first(0, endpoints_.size() - 1);
+  std::uniform_int_distribution<size_t> second(0, endpoints_.size() - 2);
+  size_t a = first(rng_);
+  size_t b = second(rng_);
+  if (b >= a) {
+    b++;
+  }
+  auto costA = getCost(*endpoints_[a], now);
+  auto costB = getCost(*endpoints_[b], now);
+  return costA <= costB ? endpoints_[a] : endpoints_[b];
+}
+
+std::unique_ptr<LeastLoadedSelector::Request>
+LeastLoadedSelector::startRequest(TimePoint now) {
+  auto endpoint = select(now);
+  if (!endpoint) {
+    return nullptr;
+  }
+  return startRequest(std::move(endpoint));
+}
+
+std::unique_ptr<LeastLoadedSelector::Request>
+LeastLoadedSelector::startRequest(EndpointPtr endpoint) {
+  CHECK(endpoint);
+  return std::unique_ptr<Request>(
+      new Request(std::move(endpoint), options_));
+}
+
+void LeastLoadedSelector::addSample(Endpoint& endpoint,
+                                    std::chrono::microseconds latency,
+                                    const Options& options,
+                                    TimePoint now) {
+  double sampleMs = latency.count() / 1000.0;
+  if (sampleMs > endpoint.latencyMs_ || endpoint.numSamples_ == 0) {
+    endpoint.latencyMs_ = sampleMs;
+  } else {
+    // The longer since the last sample, the less the old average is worth
+    double elapsedUs = std::max<int64_t>(
+        microsecondsBetween(now, endpoint.lastSampleTime_).count(), 0);
+    double keep = exp(-elapsedUs / 1000 / options.decayTime.count());
+    endpoint.latencyMs_ = endpoint.latencyMs_ * keep + sampleMs * (1 - keep);
+  }
+  endpoint.lastSampleTime_ = std::max(endpoint.lastSampleTime_, now);
+  endpoint.numSamples_++;
+}
+
+double LeastLoadedSelector::getCost(const Endpoint& endpoint,
+                                    TimePoint now) const {
+  const auto& options = *options_;
+  double latencyMs = endpoint.latencyMs_;
+  auto load = endpoint.getLoad();
+  if (load == 0 && now > endpoint.lastSampleTime_) {
+    double idleUs = microsecondsBetween(now, endpoint.lastSampleTime_).count();
+    latencyMs *= exp(-idleUs / 1000 / options.decayTime.count());
+  }
+  double cost = latencyMs * (load + 1);
+  if (endpoint.slowStart_) {
+    auto age = millisecondsBetween(now, endpoint.addedTime_);
+    if (age < options.slowStart) {
+      double ramp = double(age.count()) / options.slowStart.count();
+      cost /= options.slowStartMinWeight +
+          (1 - options.slowStartMinWeight) * std::max(ramp, 0.0);
+    }
+  }
+  return cost;
+}
+
+double LeastLoadedSelector::getDefaultLatencyMs() const {
+  double total = 0;
+  size_t sampled = 0;
+  for (const auto& endpoint : endpoints_) {
+    if (endpoint->numSamples_ > 0) {
+      total += endpoint->latencyMs_;
+      sampled++;
+    }
+  }
+  if (sampled == 0) {
+    return options_->initialLatency.count();
+  }
+  return total / sampled;
+}
+
+} // namespace proxygen
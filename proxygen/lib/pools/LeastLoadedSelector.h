@@ -0,0 +1,258 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <proxygen/lib/http/session/HTTPTransaction.h>
+#include <proxygen/lib/pools/generators/ServerListGenerator.h>
+#include <proxygen/lib/utils/Time.h>
+
+namespace proxygen {
+
+class SessionPool;
+
+/**
+ * LeastLoadedSelector picks an upstream for each request by the power of two
+ * choices: it samples two endpoints at random and takes the one with the
+ * lower cost, where
+ *
+ *   cost = latency * (outstanding + 1)
+ *
+ * latency is a moving average of the time from the request being flushed to
+ * the first response header byte, and outstanding is the number of requests
+ * in flight to the endpoint.  Comparing two random endpoints rather than
+ * taking the global minimum keeps a burst of requests from all piling onto
+ * whichever endpoint looked best a moment ago.
+ *
+ * Samples are weighted by the time since the previous one rather than
+ * counted, so an endpoint that is rarely picked does not keep a stale
+ * estimate forever.  A sample above the average replaces it outright, so a
+ * backend that slows down is avoided at once and only trusted again
+ * gradually.  While an endpoint has nothing outstanding its estimate fades
+ * towards zero, so one that was slow gets tried again after a while instead
+ * of being starved of the samples that would show it has recovered.
+ *
+ * Endpoints come from a ServerListGenerator: pass the selector as the
+ * Callback to listServers().  Endpoints that appear after the first list are
+ * eased in over Options::slowStart, so a fresh backend with cold caches is
+ * not flooded just because it has nothing outstanding yet.
+ *
+ * Like SessionPool, a selector is not thread-safe; keep one per thread.
+ */
+class LeastLoadedSelector : public ServerListGenerator::Callback {
+ public:
+  struct Options {
+    // Time constant of the latency average
+    std::chrono::milliseconds decayTime{10000};
+    // How long endpoints added to a running selector take to ramp up
+    std::chrono::milliseconds slowStart{30000};
+    // The share of its normal load an endpoint takes when just added
+    double slowStartMinWeight{0.1};
+    // Latency assumed when no endpoint has been sampled yet
+    std::chrono::milliseconds initialLatency{10};
+    // Latency recorded for a request that failed without a response
+    std::chrono::milliseconds failurePenalty{1000};
+  };
+
+  class Endpoint {
+   public:
+    Endpoint(const ServerListGenerator::ServerConfig& config,
+             double latencyMs,
+             TimePoint addedTime,
+             bool slowStart)
+        : config_(config),
+          latencyMs_(latencyMs),
+          lastSampleTime_(addedTime),
+          addedTime_(addedTime),
+          slowStart_(slowStart) {
+    }
+
+    const ServerListGenerator::ServerConfig& getConfig() const {
+      return config_;
+    }
+
+    const folly::SocketAddress& getAddress() const {
+      return config_.address;
+    }
+
+    /**
+     * Requests in flight that were started through this selector.
+     */
+    uint32_t getNumOutstanding() const {
+      return outstanding_;
+    }
+
+    /**
+     * The load used for selection.  With a SessionPool attached this also
+     * counts sessions busy with transactions the selector did not start.
+     */
+    uint32_t getLoad() const;
+
+    double getLatencyMs() const {
+      return latencyMs_;
+    }
+
+    uint64_t getNumSamples() const {
+      return numSamples_;
+    }
+
+    /**
+     * Use the pool's active session count as a load signal too.  The pool
+     * must outlive the endpoint or be detached with nullptr.
+     */
+    void setSessionPool(SessionPool* pool) {
+      sessionPool_ = pool;
+    }
+
+   private:
+    friend class LeastLoadedSelector;
+
+    ServerListGenerator::ServerConfig config_;
+    SessionPool* sessionPool_{nullptr};
+    uint32_t outstanding_{0};
+    double latencyMs_;
+    uint64_t numSamples_{0};
+    TimePoint lastSampleTime_;
+    TimePoint addedTime_;
+    bool slowStart_;
+  };
+  using EndpointPtr = std::shared_ptr<Endpoint>;
+
+  /**
+   * Tracks one request to an endpoint: it counts as outstanding for as long
+   * as the Request is alive.  Attach it to the transaction with
+   * HTTPTransaction::setTransportCallback() and the latency is sampled from
+   * the transaction's byte events; destroy it when the transaction detaches.
+   *
+   * A Request may outlive both the selector and the endpoint's removal from
+   * the server list.
+   */
+  class Request : public HTTPTransactionTransportCallback {
+   public:
+    ~Request() override;
+
+    const EndpointPtr& getEndpoint() const {
+      return endpoint_;
+    }
+
+    /**
+     * The request failed before any response arrived, e.g. it could not
+     * connect or timed out.  Records Options::failurePenalty as the latency.
+     */
+    void markFailed();
+
+    // HTTPTransactionTransportCallback
+    void firstHeaderByteFlushed() noexcept override {
+    }
+    void firstByteFlushed() noexcept override {
+    }
+    void lastByteFlushed() noexcept override;
+    void lastByteAcked(std::chrono::milliseconds) noexcept override {
+    }
+    void headerBytesGenerated(HTTPHeaderSize&) noexcept override {
+    }
+    void headerBytesReceived(const HTTPHeaderSize&) noexcept override;
+    void bodyBytesGenerated(size_t) noexcept override {
+    }
+    void bodyBytesReceived(size_t) noexcept override {
+    }
+
+   private:
+    friend class LeastLoadedSelector;
+
+    Request(EndpointPtr endpoint, std::weak_ptr<const Options> options);
+
+    EndpointPtr endpoint_;
+    std::weak_ptr<const Options> options_;
+    TimePoint sentTime_;
+    bool sampled_{false};
+  };
+
+  LeastLoadedSelector();
+
+  /**
+   * The seed is for picking endpoints; tests and simulations fix it.
+   */
+  explicit LeastLoadedSelector(Options options,
+                               uint64_t seed = std::random_device()());
+
+  /**
+   * Replaces the endpoints.  Endpoints are matched by address, so those that
+   * stay keep their load and latency.
+   */
+  void updateServers(const std::vector<ServerListGenerator::ServerConfig>&
+                         servers,
+                     TimePoint now = getCurrentTime());
+
+  // ServerListGenerator::Callback
+  void onServerListAvailable(
+      std::vector<ServerListGenerator::ServerConfig>&& results) noexcept
+      override;
+  void onServerListError(std::exception_ptr error) noexcept override;
+
+  /**
+   * Picks an endpoint.  Returns nullptr if there are none.
+   */
+  EndpointPtr select(TimePoint now = getCurrentTime());
+
+  /**
+   * select() and start tracking a request to the chosen endpoint.  Returns
+   * nullptr if there are no endpoints.
+   */
+  std::unique_ptr<Request> startRequest(TimePoint now = getCurrentTime());
+
+  /**
+   * Start tracking a request to an endpoint picked some other way, e.g. a
+   * retry that must go to the same server.
+   */
+  std::unique_ptr<Request> startRequest(EndpointPtr endpoint);
+
+  /**
+   * Folds a latency sample into the endpoint's average.  Request does this
+   * from byte events; callers that measure latency their own way can call it
+   * directly.
+   */
+  void recordLatency(Endpoint& endpoint,
+                     std::chrono::microseconds latency,
+                     TimePoint now = getCurrentTime()) {
+    addSample(endpoint, latency, *options_, now);
+  }
+
+  const std::vector<EndpointPtr>& getEndpoints() const {
+    return endpoints_;
+  }
+
+  size_t size() const {
+    return endpoints_.size();
+  }
+
+ private:
+  static void addSample(Endpoint& endpoint,
+                        std::chrono::microseconds latency,
+                        const Options& options,
+                        TimePoint now);
+
+  double getCost(const Endpoint& endpoint, TimePoint now) const;
+
+  // Latency given to new endpoints: the mean of the sampled ones
+  double getDefaultLatencyMs() const;
+
+  // Shared with outstanding Requests so they can record samples
+  std::shared_ptr<const Options> options_;
+  std::vector<EndpointPtr> endpoints_;
+  std::mt19937_64 rng_;
+  bool haveServerList_{false};
+};
+
+} // namespace proxygen
@@ -8,12 +8,20 @@
  *
  */
 #include "proxygen/lib/pools/generators/FileServerListGenerator.h"
+#include <folly/Exception.h>
 #include <folly/FileUtil.h>
+#include <folly/IPAddress.h>
 #include <folly/SocketAddress.h>
 #include <folly/dynamic.h>
+#include <folly/io/async/EventHandler.h>
 #include <folly/json.h>
 #include <sstream>
 
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
 using folly::dynamic;
 using folly::parseJson;
 using folly::SocketAddress;
@@ -22,8 +30,131 @@ using std::chrono::milliseconds;
 
 namespace proxygen {
 
-void FileServerListGenerator::FileGenerator::readFile(std::string& filePath,
-                                                      std::string& content) {
+namespace {
+
+// Whether the host of a "host:port" entry is an address rather than a
+// name to resolve
+bool isIPLiteral(folly::StringPiece hostPort) {
+  auto colon = hostPort.rfind(':');
+  auto host = colon == folly::StringPiece::npos
+      ? hostPort
+      : hostPort.subpiece(0, colon);
+  host.removePrefix('[');
+  host.removeSuffix(']');
+  return folly::IPAddress::validate(host);
+}
+
+}
+
+#ifdef __linux__
+
+namespace {
+
+// Events on the directory that concern the file: written and closed,
+// renamed into place, or gone
+constexpr uint32_t kWatchMask =
+    IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM;
+
+}
+
+class FileServerListGenerator::Watcher : private folly::EventHandler {
+ public:
+  Watcher(FileServerListGenerator& parent,
+          folly::EventBase* evb,
+          Observer* observer,
+          int fd,
+          const string& fileName)
+      : folly::EventHandler(evb, folly::NetworkSocket::fromFd(fd)),
+        parent_(parent),
+        observer_(observer),
+        fd_(fd),
+        fileName_(fileName) {
+    registerHandler(folly::EventHandler::READ | folly::EventHandler::PERSIST);
+  }
+
+  ~Watcher() override {
+    unregisterHandler();
+    ::close(fd_);
+  }
+
+  // Reload and report what changed since the last report.  Must be the
+  // last thing the watcher does, the observer may unwatch().
+  void reload() {
+    ServerListSnapshotPtr snapshot;
+    try {
+      snapshot = parent_.reload();
+    } catch (const std::exception&) {
+      observer_->onServerListError(std::current_exception());
+      return;
+    }
+    if (snapshot == reported_) {
+      return;
+    }
+    ServerListDiff diff = reported_ ? diffServerLists(*reported_, *snapshot)
+                                    : diffServerLists({}, *snapshot);
+    bool initial = !reported_;
+    reported_ = snapshot;
+    if (initial || !diff.empty()) {
+      observer_->onServerListChanged(std::move(snapshot), diff);
+    }
+  }
+
+ private:
+  void handlerReady(uint16_t /*events*/) noexcept override {
+    // Take in everything queued so a burst of events is one reload
+    bool changed = false;
+    bool removed = false;
+    bool lost = false;
+    alignas(struct inotify_event) char buf[4096];
+    ssize_t len;
+    while ((len = ::read(fd_, buf, sizeof(buf))) > 0) {
+      for (char* p = buf; p < buf + len;) {
+        auto event = reinterpret_cast<const struct inotify_event*>(p);
+        p += sizeof(struct inotify_event) + event->len;
+        if (event->mask & IN_Q_OVERFLOW) {
+          changed = true;
+        } else if (event->mask & IN_IGNORED) {
+          // The directory itself went away
+          lost = true;
+        } else if (event->len > 0 && fileName_ == event->name) {
+          changed = event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO);
+          removed = !changed;
+        }
+      }
+    }
+
+    if (lost) {
+      LOG(ERROR) << "Stopped watching " << parent_.params_.fileName
+                 << ", its directory is gone";
+      parent_.watching_ = false;
+      unregisterHandler();
+    }
+    if (changed) {
+      VLOG(4) << "Server list file " << parent_.params_.fileName
+              << " changed";
+      reload();
+    } else if (removed || lost) {
+      observer_->onServerListError(std::make_exception_ptr(Exception(
+          "Server list file ", parent_.params_.fileName, " was removed")));
+    }
+  }
+
+  FileServerListGenerator& parent_;
+  Observer* const observer_;
+  const int fd_;
+  const string fileName_;
+  // What the observer was last told about
+  ServerListSnapshotPtr reported_;
+};
+
+#else
+
+class FileServerListGenerator::Watcher {};
+
+#endif
+
+void FileServerListGenerator::readFile(const std::string& filePath,
+                                       std::string& content) {
   if (!folly::readFile(filePath.c_str(), content)) {
     folly::throw_exception<Exception>("Error reading file %s", filePath);
   }
@@ -31,62 +162,25 @@ void FileServerListGenerator::FileGenerator::readFile(std::string& filePath,
 void FileServerListGenerator::FileGenerator::cancelServerListRequest(){};
 
 void FileServerListGenerator::FileGenerator::run(milliseconds /*timeout*/) {
-  // Read the file
-
-  VLOG(4) << "Looking up server list from File Handle " << params_->fileName;
+  VLOG(4) << "Looking up server list from File Handle "
+          << parent_->params_.fileName;
 
-  std::string content;
+  ServerListSnapshotPtr snapshot;
   try {
-    readFile(params_->fileName, content);
-  } catch (const std::exception& ex) {
-    callback_->serverListError(std::make_exception_ptr(ex));
-    delete this;
-    return;
-  }
-
-  // process the content and get the server list
-  std::vector<ServerConfig> servers;
-
-  if (params_->fileType == FileType::PLAIN_TEXT) {
-    std::stringstream sstream(content);
-    string line;
-    while (std::getline(sstream, line)) {
-      SocketAddress address;
-      address.setFromHostPort(line);
-      servers.push_back(ServerConfig(address.getAddressStr(), address));
+    // The watcher keeps the snapshot current, no need to read the file
+    if (parent_->watching_) {
+      snapshot = parent_->getSnapshot();
     }
-  } else if (params_->fileType == FileType::JSON) {
-    try {
-      dynamic parsedJson = parseJson(content);
-      dynamic poolMembers = parsedJson.getDefault(params_->poolName, -1);
-      // If we cannot parse out an arrray out of that.
-      if (!poolMembers.isArray()) {
-        callback_->serverListError(std::make_exception_ptr(
-            std::invalid_argument("Cannot find a valid pool " +
-                                  params_->poolName + " in file " +
-                                  params_->fileName)));
-        delete this;
-        return;
-      }
-      // Now we have an array.
-      for (const auto& e : poolMembers) {
-        SocketAddress address;
-        address.setFromHostPort(e.asString());
-        servers.emplace_back(ServerConfig(address.getAddressStr(), address));
-      }
-    } catch (const std::exception& ex) {
-      callback_->serverListError(std::make_exception_ptr(ex));
-      delete this;
-      return;
+    if (!snapshot) {
+      snapshot = parent_->reload();
     }
-  } else {
-    // Unsupported FileType yet.
-    LOG(FATAL) << "Unsupported FileServerListGenerator::FileType!";
+  } catch (const std::exception&) {
+    callback_->serverListError(std::current_exception());
+    delete this;
+    return;
   }
 
-  VLOG(4) << "Found " << servers.size() << " usable servers from File "
-          << params_->fileName;
-  callback_->serverListAvailable(std::move(servers));
+  callback_->serverListAvailable(snapshot->toServerConfigList());
   delete this;
 }
 
@@ -106,11 +200,164 @@ FileServerListGenerator::FileServerListGenerator(const string& fileName,
   }
 }
 
+FileServerListGenerator::~FileServerListGenerator() {
+  unwatch();
+}
+
 void FileServerListGenerator::listServers(Callback* callback,
                                           milliseconds timeout) {
-  auto gen = new FileGenerator(&params_, callback);
+  auto gen = new FileGenerator(this, callback);
   callback->resetGenerator(gen);
   gen->run(timeout);
 }
 
+ServerListSnapshotPtr FileServerListGenerator::reload() {
+  // One at a time, so the last reload to read the file is the last to
+  // install what it read
+  std::lock_guard<std::mutex> reloadGuard(reloadMutex_);
+  string content;
+  readFile(params_.fileName, content);
+
+  auto current = getSnapshot();
+  if (current && content == content_ && !resolvesNames_) {
+    return current;
+  }
+  auto snapshot = parse(content);
+  content_ = std::move(content);
+  if (current && snapshot->servers == current->servers) {
+    // Names resolved to the same addresses as before
+    return current;
+  }
+  VLOG(4) << "Found " << snapshot->servers.size()
+          << " usable servers from File " << params_.fileName;
+  std::lock_guard<std::mutex> guard(mutex_);
+  snapshot_ = snapshot;
+  return snapshot;
+}
+
+ServerListSnapshotPtr FileServerListGenerator::getSnapshot() const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  return snapshot_;
+}
+
+folly::SocketAddress FileServerListGenerator::resolve(const string& hostPort) {
+  SocketAddress address;
+  address.setFromHostPort(hostPort);
+  return address;
+}
+
+ServerListSnapshotPtr FileServerListGenerator::parse(const string& content) {
+  auto snapshot = std::make_shared<ServerListSnapshot>();
+  std::unordered_map<string, ServerConfigPtr> entries;
+  bool resolvesNames = false;
+  // Only entries whose text is new get parsed, unless they name a host: its
+  // address may have changed since, so those are resolved every time and
+  // reused only if it has not
+  auto addEntry = [&](const string& key, const string& hostPort,
+                      auto parseEntry) {
+    auto& server = entries[key];
+    if (!server) {
+      auto it = entries_.find(key);
+      if (isIPLiteral(hostPort)) {
+        server = it != entries_.end() ? it->second : parseEntry();
+      } else {
+        resolvesNames = true;
+        server = parseEntry();
+        if (it != entries_.end() && it->second->address == server->address) {
+          server = it->second;
+        }
+      }
+    }
+    snapshot->servers.push_back(server);
+  };
+
+  if (params_.fileType == FileType::PLAIN_TEXT) {
+    std::stringstream sstream(content);
+    string line;
+    while (std::getline(sstream, line)) {
+      addEntry(line, line, [&] {
+        auto address = resolve(line);
+        return std::make_shared<const ServerConfig>(address.getAddressStr(),
+                                                    address);
+      });
+    }
+  } else if (params_.fileType == FileType::JSON) {
+    dynamic parsedJson = parseJson(content);
+    dynamic poolMembers = parsedJson.getDefault(params_.poolName, -1);
+    // If we cannot parse out an arrray out of that.
+    if (!poolMembers.isArray()) {
+      throw std::invalid_argument("Cannot find a valid pool " +
+                                  params_.poolName + " in file " +
+                                  params_.fileName);
+    }
+    folly::json::serialization_opts opts;
+    opts.sort_keys = true;
+    // Now we have an array.
+    for (const auto& e : poolMembers) {
+      if (!e.isObject()) {
+        addEntry(e.asString(), e.asString(), [&] {
+          auto address = resolve(e.asString());
+          return std::make_shared<const ServerConfig>(address.getAddressStr(),
+                                                      address);
+        });
+        continue;
+      }
+      const auto& hostPort = e.at("address").asString();
+      addEntry(folly::json::serialize(e, opts), hostPort, [&] {
+        auto address = resolve(hostPort);
+        std::map<string, string> properties;
+        if (auto props = e.get_ptr("properties")) {
+          for (const auto& prop : props->items()) {
+            properties.emplace(prop.first.asString(), prop.second.asString());
+          }
+        }
+        auto name = e.getDefault("name", address.getAddressStr()).asString();
+        return std::make_shared<const ServerConfig>(name, address, properties);
+      });
+    }
+  } else {
+    // Unsupported FileType yet.
+    LOG(FATAL) << "Unsupported FileServerListGenerator::FileType!";
+  }
+
+  entries_.swap(entries);
+  resolvesNames_ = resolvesNames;
+  return snapshot;
+}
+
+void FileServerListGenerator::watch(folly::EventBase* evb,
+                                    Observer* observer) {
+  CHECK(!watcher_);
+  CHECK(observer);
+  evb->dcheckIsInEventBaseThread();
+#ifdef __linux__
+  // Watch the directory rather than the file, which is often replaced by
+  // renaming a new one over it
+  const auto& fileName = params_.fileName;
+  auto slash = fileName.rfind('/');
+  string dir = slash == string::npos ? "." : fileName.substr(0, slash + 1);
+  string base = slash == string::npos ? fileName : fileName.substr(slash + 1);
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0) {
+    folly::throwSystemError("inotify_init1 failed");
+  }
+  if (inotify_add_watch(fd, dir.c_str(), kWatchMask) < 0) {
+    int err = errno;
+    ::close(fd);
+    folly::throwSystemErrorExplicit(err, "Cannot watch ", dir);
+  }
+  watcher_ = std::make_unique<Watcher>(*this, evb, observer, fd, base);
+  watching_ = true;
+  // Only now, so that no change after the first load is missed
+  watcher_->reload();
+#else
+  throw std::runtime_error("FileServerListGenerator::watch() needs inotify");
+#endif
+}
+
+void FileServerListGenerator::unwatch() {
+  watching_ = false;
+  watcher_.reset();
+}
+
 } // namespace proxygen
@@ -10,29 +10,95 @@
 #pragma once
 
 #include "proxygen/lib/pools/generators/ServerListGenerator.h"
+#include "proxygen/lib/pools/generators/ServerListSnapshot.h"
+#include <atomic>
+#include <mutex>
 #include <proxygen/lib/utils/Exception.h>
 #include <sys/stat.h>
+#include <unordered_map>
 
 namespace proxygen {
 
 /*
  * A ServerListGenerator implementation that gets the server list from
  * a file.
+ *
+ * The list is kept as a ServerListSnapshot.  A reload that finds the file
+ * unchanged returns the same snapshot, and one that finds it changed only
+ * parses the entries that are new; the rest are shared with the previous
+ * snapshot.  Entries that name a host rather than an IP address are
+ * resolved again on every reload, and the snapshot only changes if one of
+ * them resolves to a different address.
+ *
+ * With watch(), the file's directory is watched with inotify and the list
+ * is reloaded only when the file is written or replaced, e.g. by a rename
+ * over it.  Observers are told what changed; listServers() then hands out
+ * the current snapshot without touching the file.
  */
 class FileServerListGenerator : public ServerListGenerator {
  public:
   enum class FileType { PLAIN_TEXT, JSON };
+
+  class Observer {
+   public:
+    virtual ~Observer() {
+    }
+
+    /**
+     * The file changed.  snapshot is the whole new list and diff what
+     * changed since the last call.  Rewrites that change nothing are not
+     * reported.
+     */
+    virtual void onServerListChanged(ServerListSnapshotPtr snapshot,
+                                     const ServerListDiff& diff) noexcept = 0;
+
+    /**
+     * The file could not be read or parsed, or was removed.  The last list
+     * loaded stays current.
+     */
+    virtual void onServerListError(std::exception_ptr error) noexcept = 0;
+  };
+
   // If FileType is specified as PLAIN_TEXT, we will read the file line by line.
   // If FileType is specified as JSON, we will parse it as a json and take the
-  // entry that's named poolName.
+  // entry that's named poolName.  Its members are either "host:port" strings
+  // or objects with an "address", and optionally a "name" and string
+  // "properties".
   explicit FileServerListGenerator(
       const std::string& fileName,
       const FileType fileType = FileType::PLAIN_TEXT,
       const std::string& poolName = "");
 
+  ~FileServerListGenerator() override;
+
   void listServers(Callback* callback,
                    std::chrono::milliseconds timeout) override;
 
+  /**
+   * Read the file and return the list in it, reusing the current snapshot
+   * if the file did not change.  Throws if the file cannot be read or
+   * parsed.  Can be called from any thread.
+   */
+  ServerListSnapshotPtr reload();
+
+  /**
+   * The list as of the last load, nullptr before the first.  Can be called
+   * from any thread.
+   */
+  ServerListSnapshotPtr getSnapshot() const;
+
+  /**
+   * Reload whenever the file changes, and tell observer.  The initial load
+   * is reported, as every server added, before watch() returns.
+   *
+   * Must be called in evb's thread, as must unwatch() and the destructor
+   * while watching.  The observer may call unwatch() from its callbacks.
+   * Throws if inotify is unavailable or the file's directory cannot be
+   * watched.
+   */
+  void watch(folly::EventBase* evb, Observer* observer);
+  void unwatch();
+
  protected:
   struct Params {
     explicit Params(const std::string& file,
@@ -47,23 +113,58 @@ class FileServerListGenerator : public ServerListGenerator {
 
   class FileGenerator : public ServerListGenerator::Generator {
    public:
-    FileGenerator(Params* params, Callback* callback)
-        : params_(params), callback_(callback) {
+    FileGenerator(FileServerListGenerator* parent, Callback* callback)
+        : parent_(parent), callback_(callback) {
     }
     virtual ~FileGenerator() override {
     }
-    virtual void readFile(std::string& filePath, std::string& content);
     void run(std::chrono::milliseconds ms);
     void cancelServerListRequest() override;
 
    private:
-    Params* params_;
+    FileServerListGenerator* parent_;
     Callback* callback_;
   };
 
+  /**
+   * Reads the file for every load, whether from listServers(), reload() or
+   * the watcher.  Override to get the content elsewhere; throw if it cannot
+   * be read.  This replaces FileGenerator::readFile().
+   */
+  virtual void readFile(const std::string& filePath, std::string& content);
+
+  /**
+   * Resolves the "host:port" of an entry.  Override to resolve names
+   * elsewhere; throw if it cannot be.
+   */
+  virtual folly::SocketAddress resolve(const std::string& hostPort);
+
   Params params_;
 
  private:
+  class Watcher;
+
+  // Parse content into a snapshot, reusing entries_ where the text of an
+  // entry is unchanged.  Requires reloadMutex_.
+  ServerListSnapshotPtr parse(const std::string& content);
+
+  // Held for the whole of a reload, and guards the members below it
+  std::mutex reloadMutex_;
+  // The file content snapshot_ was parsed from
+  std::string content_;
+  // snapshot_'s servers, by the text of their entry in the file
+  std::unordered_map<std::string, ServerConfigPtr> entries_;
+  // Whether any entry names a host to resolve
+  bool resolvesNames_{false};
+
+  // Guards snapshot_ alone, so getSnapshot() never waits for a reload
+  mutable std::mutex mutex_;
+  ServerListSnapshotPtr snapshot_;
+
+  std::unique_ptr<Watcher> watcher_;
+  // Whether snapshot_ is kept current by the watcher
+  std::atomic<bool> watching_{false};
+
   // Forbidden copy constructor and assignment operator
   FileServerListGenerator(FileServerListGenerator const&) = delete;
   FileServerListGenerator& operator=(FileServerListGenerator const&) = delete;
@@ -0,0 +1,78 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "proxygen/lib/pools/generators/ServerListSnapshot.h"
+
+#include <unordered_map>
+#include <unordered_set>
+
+namespace proxygen {
+
+namespace {
+
+using ServerMap = std::unordered_map<folly::SocketAddress, ServerConfigPtr>;
+
+ServerMap indexByAddress(const ServerListSnapshot& snapshot) {
+  ServerMap servers;
+  servers.reserve(snapshot.servers.size());
+  for (const auto& server : snapshot.servers) {
+    servers.emplace(server->address, server);
+  }
+  return servers;
+}
+
+bool sameConfig(const ServerListGenerator::ServerConfig& a,
+                const ServerListGenerator::ServerConfig& b) {
+  return a.name == b.name && a.properties == b.properties &&
+         a.groupId_ == b.groupId_;
+}
+
+}
+
+ServerConfigList ServerListSnapshot::toServerConfigList() const {
+  ServerConfigList list;
+  list.reserve(servers.size());
+  for (const auto& server : servers) {
+    list.push_back(*server);
+  }
+  return list;
+}
+
+ServerListDiff diffServerLists(const ServerListSnapshot& before,
+                               const ServerListSnapshot& after) {
+  ServerListDiff diff;
+  auto previous = indexByAddress(before);
+  std::unordered_set<folly::SocketAddress> seen;
+  seen.reserve(after.servers.size());
+  for (const auto& server : after.servers) {
+    if (!seen.insert(server->address).second) {
+      continue;
+    }
+    auto it = previous.find(server->address);
+    if (it == previous.end()) {
+      diff.added.push_back(server);
+    } else if (it->second != server && !sameConfig(*it->second, *server)) {
+      diff.changed.push_back(server);
+    }
+  }
+  for (const auto& server : before.servers) {
+    auto it = previous.find(server->address);
+    if (it == previous.end()) {
+      // A duplicate, already handled
+      continue;
+    }
+    if (!seen.count(server->address)) {
+      diff.removed.push_back(it->second);
+    }
+    previous.erase(it);
+  }
+  return diff;
+}
+
+} // namespace proxygen
@@ -0,0 +1,61 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <memory>
+
+#include "proxygen/lib/pools/generators/ServerListGenerator.h"
+
+namespace proxygen {
+
+using ServerConfigPtr = std::shared_ptr<const ServerListGenerator::ServerConfig>;
+
+/**
+ * An immutable server list.  Entries are shared between snapshots: a
+ * server whose configuration did not change between two loads is the same
+ * ServerConfigPtr in both, so holding on to a snapshot or passing one to
+ * every IO thread copies no ServerConfig.
+ */
+struct ServerListSnapshot {
+  std::vector<ServerConfigPtr> servers;
+
+  /**
+   * A copy in the form ServerListGenerator::Callback takes.
+   */
+  ServerConfigList toServerConfigList() const;
+};
+
+using ServerListSnapshotPtr = std::shared_ptr<const ServerListSnapshot>;
+
+/**
+ * What changed between two snapshots, by server address.  A server whose
+ * name, properties or group changed is in changed, as its new
+ * configuration.
+ */
+struct ServerListDiff {
+  std::vector<ServerConfigPtr> added;
+  std::vector<ServerConfigPtr> removed;
+  std::vector<ServerConfigPtr> changed;
+
+  bool empty() const {
+    return added.empty() && removed.empty() && changed.empty();
+  }
+};
+
+/**
+ * Servers that appear more than once in a snapshot are compared by their
+ * first entry.  Entries shared between the snapshots are not compared
+ * field by field, so diffing two loads that reused most entries is a hash
+ * lookup per server.
+ */
+ServerListDiff diffServerLists(const ServerListSnapshot& before,
+                               const ServerListSnapshot& after);
+
+} // namespace proxygen
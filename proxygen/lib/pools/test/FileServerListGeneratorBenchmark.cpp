@@ -0,0 +1,166 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Benchmark.h>
+#include <folly/Conv.h>
+#include <folly/FileUtil.h>
+#include <folly/experimental/TestUtil.h>
+#include <folly/portability/GFlags.h>
+#include <glog/logging.h>
+#include <proxygen/lib/pools/generators/FileServerListGenerator.h>
+
+using namespace folly;
+using namespace proxygen;
+
+// Cost of getting a 50k server list out of FileServerListGenerator.
+//
+// ./file_server_list_generator_benchmark
+//
+// Each iteration of
+//   coldLoad           parses the whole file, as every listServers() call
+//                      used to
+//   reloadUnchanged    reads the file and finds it unchanged
+//   reloadChanged      reads the file after 1% of its entries changed,
+//                      parsing only those
+//   diff               diffs the snapshots before and after that change
+//   listServers        hands a callback its own copy of the list
+//   getSnapshot        hands out the current snapshot, as a watcher does
+
+namespace {
+
+constexpr size_t kNumServers = 50000;
+constexpr size_t kNumChanged = kNumServers / 100;
+
+std::string makeList(size_t firstChanged) {
+  std::string list;
+  for (size_t i = 0; i < kNumServers; ++i) {
+    uint16_t port = i >= firstChanged && i < firstChanged + kNumChanged
+        ? 8080 : 80;
+    list += to<std::string>(
+        "10.", i >> 16, ".", (i >> 8) & 0xff, ".", i & 0xff, ":", port, "\n");
+  }
+  return list;
+}
+
+struct Fixture {
+  Fixture() : path((dir.path() / "servers").string()) {
+    lists.push_back(makeList(kNumServers));
+    lists.push_back(makeList(0));
+    write(0);
+  }
+
+  void write(size_t list) {
+    CHECK(writeFile(lists[list], path.c_str()));
+  }
+
+  folly::test::TemporaryDirectory dir;
+  std::string path;
+  std::vector<std::string> lists;
+};
+
+Fixture& getFixture() {
+  static Fixture fixture;
+  return fixture;
+}
+
+class NullCallback : public ServerListGenerator::Callback {
+ public:
+  void onServerListAvailable(ServerConfigList&& results) noexcept override {
+    doNotOptimizeAway(results.size());
+  }
+  void onServerListError(std::exception_ptr /*error*/) noexcept override {
+  }
+};
+
+}
+
+BENCHMARK(coldLoad, iters) {
+  auto& fixture = getFixture();
+  for (size_t i = 0; i < iters; ++i) {
+    FileServerListGenerator generator(fixture.path);
+    doNotOptimizeAway(generator.reload());
+  }
+}
+
+BENCHMARK(reloadUnchanged, iters) {
+  std::unique_ptr<FileServerListGenerator> generator;
+  BENCHMARK_SUSPEND {
+    generator = std::make_unique<FileServerListGenerator>(getFixture().path);
+    generator->reload();
+  }
+  for (size_t i = 0; i < iters; ++i) {
+    doNotOptimizeAway(generator->reload());
+  }
+}
+
+BENCHMARK(reloadChanged, iters) {
+  auto& fixture = getFixture();
+  std::unique_ptr<FileServerListGenerator> generator;
+  BENCHMARK_SUSPEND {
+    generator = std::make_unique<FileServerListGenerator>(fixture.path);
+    generator->reload();
+  }
+  for (size_t i = 0; i < iters; ++i) {
+    BENCHMARK_SUSPEND {
+      fixture.write((i + 1) % 2);
+    }
+    doNotOptimizeAway(generator->reload());
+  }
+  BENCHMARK_SUSPEND {
+    fixture.write(0);
+  }
+}
+
+BENCHMARK(diff, iters) {
+  auto& fixture = getFixture();
+  ServerListSnapshotPtr before;
+  ServerListSnapshotPtr after;
+  BENCHMARK_SUSPEND {
+    FileServerListGenerator generator(fixture.path);
+    before = generator.reload();
+    fixture.write(1);
+    after = generator.reload();
+    fixture.write(0);
+  }
+  for (size_t i = 0; i < iters; ++i) {
+    auto diff = diffServerLists(*before, *after);
+    CHECK_EQ(diff.changed.size() + diff.added.size(), kNumChanged);
+  }
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(listServers, iters) {
+  std::unique_ptr<FileServerListGenerator> generator;
+  BENCHMARK_SUSPEND {
+    generator = std::make_unique<FileServerListGenerator>(getFixture().path);
+    generator->reload();
+  }
+  NullCallback callback;
+  for (size_t i = 0; i < iters; ++i) {
+    generator->listServers(&callback, std::chrono::milliseconds(0));
+  }
+}
+
+BENCHMARK(getSnapshot, iters) {
+  std::unique_ptr<FileServerListGenerator> generator;
+  BENCHMARK_SUSPEND {
+    generator = std::make_unique<FileServerListGenerator>(getFixture().path);
+    generator->reload();
+  }
+  for (size_t i = 0; i < iters; ++i) {
+    doNotOptimizeAway(generator->getSnapshot());
+  }
+}
+
+int main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  folly::runBenchmarks();
+  return 0;
+}
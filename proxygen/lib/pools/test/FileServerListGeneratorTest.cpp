@@ -0,0 +1,250 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <algorithm>
+#include <folly/Conv.h>
+#include <folly/FileUtil.h>
+#include <folly/experimental/TestUtil.h>
+#include <folly/io/async/AsyncTimeout.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/portability/GTest.h>
+#include <map>
+#include <proxygen/lib/pools/generators/FileServerListGenerator.h>
+
+using namespace proxygen;
+using namespace std::chrono;
+
+namespace {
+
+class RecordingObserver : public FileServerListGenerator::Observer {
+ public:
+  void onServerListChanged(ServerListSnapshotPtr snapshot,
+                           const ServerListDiff& diff) noexcept override {
+    changes++;
+    lastSnapshot = std::move(snapshot);
+    lastDiff = diff;
+  }
+
+  void onServerListError(std::exception_ptr /*error*/) noexcept override {
+    errors++;
+  }
+
+  uint32_t changes{0};
+  uint32_t errors{0};
+  ServerListSnapshotPtr lastSnapshot;
+  ServerListDiff lastDiff;
+};
+
+std::vector<std::string> getNames(const std::vector<ServerConfigPtr>& servers) {
+  std::vector<std::string> names;
+  for (const auto& server : servers) {
+    names.push_back(server->name);
+  }
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+// Resolves names from a table instead of DNS
+class FakeResolverGenerator : public FileServerListGenerator {
+ public:
+  using FileServerListGenerator::FileServerListGenerator;
+
+  folly::SocketAddress resolve(const std::string& hostPort) override {
+    auto colon = hostPort.rfind(':');
+    auto it = hosts.find(hostPort.substr(0, colon));
+    if (it == hosts.end()) {
+      return FileServerListGenerator::resolve(hostPort);
+    }
+    resolved++;
+    return folly::SocketAddress(
+        it->second, folly::to<uint16_t>(hostPort.substr(colon + 1)));
+  }
+
+  std::map<std::string, std::string> hosts;
+  uint32_t resolved{0};
+};
+
+}
+
+class FileServerListGeneratorTest : public testing::Test {
+ protected:
+  void writeList(const std::string& content) {
+    ASSERT_TRUE(folly::writeFile(content, path_.c_str()));
+  }
+
+  // Write elsewhere and rename over the list, as config deployment does
+  void replaceList(const std::string& content) {
+    auto tmp = (dir_.path() / "servers.tmp").string();
+    ASSERT_TRUE(folly::writeFile(content, tmp.c_str()));
+    ASSERT_EQ(::rename(tmp.c_str(), path_.c_str()), 0);
+  }
+
+  // Run the loop until the observer hears something, or give up
+  void waitForObserver() {
+    auto before = observer_.changes + observer_.errors;
+    bool timedOut = false;
+    auto timeout = folly::AsyncTimeout::schedule(
+        seconds(5), evb_, [&]() noexcept { timedOut = true; });
+    while (observer_.changes + observer_.errors == before && !timedOut) {
+      evb_.loopOnce();
+    }
+  }
+
+  folly::test::TemporaryDirectory dir_;
+  std::string path_{(dir_.path() / "servers").string()};
+  folly::EventBase evb_;
+  RecordingObserver observer_;
+};
+
+TEST_F(FileServerListGeneratorTest, PlainText) {
+  writeList("10.0.0.1:80\n10.0.0.2:80\n");
+  FileServerListGenerator generator(path_);
+  std::vector<ServerListGenerator::ServerConfig> servers;
+  generator.listServersBlocking(&servers, milliseconds(100));
+  ASSERT_EQ(servers.size(), 2);
+  EXPECT_EQ(servers[0].name, "10.0.0.1");
+  EXPECT_EQ(servers[1].address, folly::SocketAddress("10.0.0.2", 80));
+}
+
+TEST_F(FileServerListGeneratorTest, Json) {
+  writeList(R"({"pool": ["10.0.0.1:80",
+      {"address": "10.0.0.2:80", "name": "b", "properties": {"dc": "x"}}]})");
+  FileServerListGenerator generator(
+      path_, FileServerListGenerator::FileType::JSON, "pool");
+  auto snapshot = generator.reload();
+  ASSERT_EQ(snapshot->servers.size(), 2);
+  EXPECT_EQ(snapshot->servers[0]->name, "10.0.0.1");
+  EXPECT_EQ(snapshot->servers[1]->name, "b");
+  EXPECT_EQ(snapshot->servers[1]->properties.at("dc"), "x");
+
+  FileServerListGenerator missing(
+      path_, FileServerListGenerator::FileType::JSON, "other");
+  std::vector<ServerListGenerator::ServerConfig> servers;
+  EXPECT_THROW(missing.listServersBlocking(&servers, milliseconds(100)),
+               std::invalid_argument);
+}
+
+TEST_F(FileServerListGeneratorTest, ReloadSharesUnchangedEntries) {
+  writeList("10.0.0.1:80\n10.0.0.2:80\n");
+  FileServerListGenerator generator(path_);
+  auto first = generator.reload();
+  EXPECT_EQ(generator.reload(), first);
+  EXPECT_EQ(generator.getSnapshot(), first);
+
+  writeList("10.0.0.2:80\n10.0.0.3:80\n");
+  auto second = generator.reload();
+  ASSERT_NE(second, first);
+  ASSERT_EQ(second->servers.size(), 2);
+  EXPECT_EQ(second->servers[0], first->servers[1]);
+  // A snapshot stays as it was after a reload
+  EXPECT_EQ(first->servers[0]->name, "10.0.0.1");
+
+  auto diff = diffServerLists(*first, *second);
+  EXPECT_EQ(getNames(diff.added), std::vector<std::string>{"10.0.0.3"});
+  EXPECT_EQ(getNames(diff.removed), std::vector<std::string>{"10.0.0.1"});
+  EXPECT_TRUE(diff.changed.empty());
+}
+
+TEST_F(FileServerListGeneratorTest, DiffReportsChangedProperties) {
+  writeList(R"({"pool": [
+      {"address": "10.0.0.1:80", "properties": {"weight": "1"}},
+      {"address": "10.0.0.2:80", "properties": {"weight": "1"}}]})");
+  FileServerListGenerator generator(
+      path_, FileServerListGenerator::FileType::JSON, "pool");
+  auto first = generator.reload();
+  writeList(R"({"pool": [
+      {"properties": {"weight": "2"}, "address": "10.0.0.1:80"},
+      {"properties": {"weight": "1"}, "address": "10.0.0.2:80"},
+      "10.0.0.2:80"]})");
+  auto second = generator.reload();
+  auto diff = diffServerLists(*first, *second);
+  EXPECT_TRUE(diff.added.empty());
+  EXPECT_TRUE(diff.removed.empty());
+  ASSERT_EQ(diff.changed.size(), 1);
+  EXPECT_EQ(diff.changed[0]->properties.at("weight"), "2");
+  // Key order doesn't make an entry new
+  EXPECT_EQ(second->servers[1], first->servers[1]);
+}
+
+TEST_F(FileServerListGeneratorTest, ReloadResolvesNamesAgain) {
+  writeList("10.0.0.1:80\nbackend:80\n");
+  FakeResolverGenerator generator(path_);
+  generator.hosts["backend"] = "10.0.0.2";
+  auto first = generator.reload();
+  ASSERT_EQ(first->servers.size(), 2);
+  EXPECT_EQ(first->servers[1]->address, folly::SocketAddress("10.0.0.2", 80));
+  EXPECT_EQ(generator.resolved, 1);
+
+  // Same file, same addresses: same snapshot
+  EXPECT_EQ(generator.reload(), first);
+  EXPECT_EQ(generator.resolved, 2);
+
+  generator.hosts["backend"] = "10.0.0.3";
+  auto second = generator.reload();
+  ASSERT_NE(second, first);
+  EXPECT_EQ(generator.resolved, 3);
+  EXPECT_EQ(second->servers[0], first->servers[0]);
+  EXPECT_EQ(second->servers[1]->address, folly::SocketAddress("10.0.0.3", 80));
+  EXPECT_EQ(generator.getSnapshot(), second);
+}
+
+TEST_F(FileServerListGeneratorTest, WatchReportsChanges) {
+  writeList("10.0.0.1:80\n");
+  FileServerListGenerator generator(path_);
+  generator.watch(&evb_, &observer_);
+  ASSERT_EQ(observer_.changes, 1);
+  EXPECT_EQ(getNames(observer_.lastDiff.added),
+            std::vector<std::string>{"10.0.0.1"});
+
+  replaceList("10.0.0.1:80\n10.0.0.2:80\n");
+  waitForObserver();
+  ASSERT_EQ(observer_.changes, 2);
+  EXPECT_EQ(getNames(observer_.lastDiff.added),
+            std::vector<std::string>{"10.0.0.2"});
+  EXPECT_TRUE(observer_.lastDiff.removed.empty());
+  EXPECT_EQ(observer_.lastSnapshot, generator.getSnapshot());
+
+  writeList("10.0.0.2:80\n");
+  waitForObserver();
+  ASSERT_EQ(observer_.changes, 3);
+  EXPECT_EQ(getNames(observer_.lastDiff.removed),
+            std::vector<std::string>{"10.0.0.1"});
+
+  // Served from the snapshot, not the file
+  std::vector<ServerListGenerator::ServerConfig> servers;
+  generator.listServersBlocking(&servers, milliseconds(100));
+  ASSERT_EQ(servers.size(), 1);
+  EXPECT_EQ(servers[0].name, "10.0.0.2");
+
+  // Rewriting the same list is not a change
+  writeList("10.0.0.2:80\n");
+  writeList("garbage\n");
+  waitForObserver();
+  EXPECT_EQ(observer_.changes, 3);
+  EXPECT_EQ(observer_.errors, 1);
+  EXPECT_EQ(generator.getSnapshot(), observer_.lastSnapshot);
+
+  ASSERT_EQ(::unlink(path_.c_str()), 0);
+  waitForObserver();
+  EXPECT_EQ(observer_.errors, 2);
+  generator.unwatch();
+}
+
+TEST_F(FileServerListGeneratorTest, WatchIgnoresOtherFiles) {
+  writeList("10.0.0.1:80\n");
+  FileServerListGenerator generator(path_);
+  generator.watch(&evb_, &observer_);
+  ASSERT_TRUE(folly::writeFile(std::string("10.0.0.9:80\n"),
+                               (dir_.path() / "other").string().c_str()));
+  writeList("10.0.0.1:80\n10.0.0.2:80\n");
+  waitForObserver();
+  EXPECT_EQ(observer_.changes, 2);
+  EXPECT_EQ(observer_.errors, 0);
+  EXPECT_EQ(observer_.lastSnapshot->servers.size(), 2);
+}
@@ -0,0 +1,280 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Conv.h>
+#include <folly/init/Init.h>
+#include <gflags/gflags.h>
+#include <proxygen/lib/pools/LeastLoadedSelector.h>
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <queue>
+#include <random>
+
+// Tail latency of upstream selection policies against simulated backends of
+// uneven speed.  Each backend serves --workers requests at a time with
+// exponentially distributed service times and queues the rest; requests
+// arrive as a Poisson process at --load of the total capacity.  Time is
+// simulated, so a run takes as long as the event loop does, not the
+// simulated duration.
+//
+// Three phases of --requests each:
+//   steady    half the backends are 2x slower than the rest
+//   slowdown  one fast backend turns 10x slower
+//   added     a fresh backend joins; the selector eases it in
+//
+// ./least_loaded_selector_benchmark --backends=20 --load=0.6
+//
+// Prints one line per phase and policy:
+//   phase=steady   policy=random     p50=...ms p99=...ms p999=...ms
+// where
+//   random     uniform choice
+//   roundrobin next backend in turn
+//   p2c        LeastLoadedSelector
+
+DEFINE_int32(backends, 20, "Number of simulated backends");
+DEFINE_int32(workers, 4, "Requests each backend serves concurrently");
+DEFINE_int32(requests, 200000, "Requests per phase");
+DEFINE_double(load, 0.6, "Offered load as a fraction of total capacity");
+DEFINE_double(fast_service_ms, 5, "Mean service time of a fast backend");
+DEFINE_int32(seed, 1, "Seed for arrivals, service times and selection");
+
+using namespace proxygen;
+
+namespace {
+
+using Micros = std::chrono::microseconds;
+
+struct Backend {
+  explicit Backend(double serviceMs) : meanServiceMs(serviceMs) {
+  }
+
+  double meanServiceMs;
+  uint32_t busy{0};
+  // Arrival times of requests waiting for a worker
+  std::deque<std::pair<uint64_t, Micros>> waiting;
+};
+
+class Policy {
+ public:
+  virtual ~Policy() {
+  }
+  virtual void setBackends(size_t num, TimePoint now) = 0;
+  virtual size_t pick(uint64_t id, TimePoint now) = 0;
+  virtual void done(uint64_t id, Micros latency, TimePoint now) = 0;
+};
+
+class RandomPolicy : public Policy {
+ public:
+  explicit RandomPolicy(uint32_t seed) : rng_(seed) {
+  }
+  void setBackends(size_t num, TimePoint) override {
+    num_ = num;
+  }
+  size_t pick(uint64_t, TimePoint) override {
+    return std::uniform_int_distribution<size_t>(0, num_ - 1)(rng_);
+  }
+  void done(uint64_t, Micros, TimePoint) override {
+  }
+
+ private:
+  std::mt19937_64 rng_;
+  size_t num_{0};
+};
+
+class RoundRobinPolicy : public Policy {
+ public:
+  void setBackends(size_t num, TimePoint) override {
+    num_ = num;
+  }
+  size_t pick(uint64_t, TimePoint) override {
+    return next_++ % num_;
+  }
+  void done(uint64_t, Micros, TimePoint) override {
+  }
+
+ private:
+  size_t num_{0};
+  size_t next_{0};
+};
+
+class P2CPolicy : public Policy {
+ public:
+  explicit P2CPolicy(uint32_t seed)
+      : selector_(LeastLoadedSelector::Options(), seed) {
+  }
+
+  void setBackends(size_t num, TimePoint now) override {
+    std::vector<ServerListGenerator::ServerConfig> servers;
+    for (size_t i = 0; i < num; ++i) {
+      servers.emplace_back(folly::to<std::string>("backend", i),
+                           folly::SocketAddress("10.0.0.1", 1000 + i));
+    }
+    selector_.updateServers(servers, now);
+  }
+
+  size_t pick(uint64_t id, TimePoint now) override {
+    auto request = selector_.startRequest(now);
+    size_t backend = request->getEndpoint()->getAddress().getPort() - 1000;
+    requests_.emplace(id, std::move(request));
+    return backend;
+  }
+
+  void done(uint64_t id, Micros latency, TimePoint now) override {
+    auto it = requests_.find(id);
+    // The simulated response arrives all at once
+    selector_.recordLatency(*it->second->getEndpoint(), latency, now);
+    requests_.erase(it);
+  }
+
+ private:
+  LeastLoadedSelector selector_;
+  std::map<uint64_t, std::unique_ptr<LeastLoadedSelector::Request>>
+      requests_;
+};
+
+class Simulation {
+ public:
+  Simulation(Policy& policy, uint32_t seed) : policy_(policy), rng_(seed) {
+    size_t num = FLAGS_backends;
+    for (size_t i = 0; i < num; ++i) {
+      double slowdown = i % 2 ? 2 : 1;
+      backends_.emplace_back(FLAGS_fast_service_ms * slowdown);
+    }
+    policy_.setBackends(backends_.size(), toTime(now_));
+  }
+
+  void runPhase(const char* phase, const char* policyName) {
+    double capacityPerMs = 0;
+    for (auto& backend : backends_) {
+      capacityPerMs += FLAGS_workers / backend.meanServiceMs;
+    }
+    std::exponential_distribution<double> interArrivalMs(
+        capacityPerMs * FLAGS_load);
+    std::vector<Micros> latencies;
+    latencies.reserve(FLAGS_requests);
+    auto nextArrival = now_;
+    for (int i = 0; i < FLAGS_requests;) {
+      if (completions_.empty() || nextArrival < completions_.top().time) {
+        now_ = nextArrival;
+        arrive(nextId_++);
+        nextArrival = now_ + Micros(uint64_t(interArrivalMs(rng_) * 1000));
+        continue;
+      }
+      auto completion = completions_.top();
+      completions_.pop();
+      now_ = completion.time;
+      auto latency = now_ - completion.arrival;
+      policy_.done(completion.id, latency, toTime(now_));
+      latencies.push_back(latency);
+      ++i;
+      finish(completion.backend);
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto pct = [&](double p) {
+      return latencies[size_t(p * (latencies.size() - 1))].count() / 1000.0;
+    };
+    printf("phase=%-9s policy=%-10s p50=%8.2fms p99=%8.2fms p999=%8.2fms\n",
+           phase,
+           policyName,
+           pct(0.5),
+           pct(0.99),
+           pct(0.999));
+  }
+
+  void slowDown(size_t backend, double factor) {
+    backends_[backend].meanServiceMs *= factor;
+  }
+
+  void addBackend() {
+    backends_.emplace_back(FLAGS_fast_service_ms);
+    policy_.setBackends(backends_.size(), toTime(now_));
+  }
+
+ private:
+  struct Completion {
+    Micros time;
+    Micros arrival;
+    uint64_t id;
+    size_t backend;
+
+    bool operator>(const Completion& other) const {
+      return time > other.time;
+    }
+  };
+
+  static TimePoint toTime(Micros t) {
+    // Well clear of the epoch, like a real steady clock
+    return TimePoint(std::chrono::hours(1) + t);
+  }
+
+  void arrive(uint64_t id) {
+    auto index = policy_.pick(id, toTime(now_));
+    auto& backend = backends_[index];
+    if (backend.busy < uint32_t(FLAGS_workers)) {
+      start(index, id, now_);
+    } else {
+      backend.waiting.emplace_back(id, now_);
+    }
+  }
+
+  void start(size_t index, uint64_t id, Micros arrival) {
+    auto& backend = backends_[index];
+    backend.busy++;
+    std::exponential_distribution<double> serviceMs(1 / backend.meanServiceMs);
+    completions_.push(
+        {now_ + Micros(uint64_t(serviceMs(rng_) * 1000)), arrival, id, index});
+  }
+
+  void finish(size_t index) {
+    auto& backend = backends_[index];
+    backend.busy--;
+    if (!backend.waiting.empty()) {
+      auto next = backend.waiting.front();
+      backend.waiting.pop_front();
+      start(index, next.first, next.second);
+    }
+  }
+
+  Policy& policy_;
+  std::mt19937_64 rng_;
+  std::vector<Backend> backends_;
+  std::priority_queue<Completion,
+                      std::vector<Completion>,
+                      std::greater<Completion>>
+      completions_;
+  Micros now_{0};
+  uint64_t nextId_{0};
+};
+
+void run(const char* name, Policy& policy) {
+  Simulation sim(policy, FLAGS_seed);
+  sim.runPhase("steady", name);
+  // Backend 0 is one of the fast ones
+  sim.slowDown(0, 10);
+  sim.runPhase("slowdown", name);
+  sim.addBackend();
+  sim.runPhase("added", name);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  folly::init(&argc, &argv);
+  CHECK_GE(FLAGS_backends, 2);
+  CHECK(FLAGS_load > 0 && FLAGS_load < 1) << FLAGS_load;
+  RandomPolicy random(FLAGS_seed);
+  run("random", random);
+  RoundRobinPolicy roundRobin;
+  run("roundrobin", roundRobin);
+  P2CPolicy p2c(FLAGS_seed);
+  run("p2c", p2c);
+  return 0;
+}
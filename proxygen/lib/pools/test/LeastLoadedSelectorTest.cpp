@@ -0,0 +1,222 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Conv.h>
+#include <folly/portability/GTest.h>
+#include <proxygen/lib/pools/LeastLoadedSelector.h>
+
+using namespace proxygen;
+using namespace std::chrono;
+
+namespace {
+
+std::vector<ServerListGenerator::ServerConfig> makeServers(int first,
+                                                           int last) {
+  std::vector<ServerListGenerator::ServerConfig> servers;
+  for (int i = first; i < last; ++i) {
+    servers.emplace_back(folly::to<std::string>("server", i),
+                         folly::SocketAddress("127.0.0.1", 8000 + i));
+  }
+  return servers;
+}
+
+size_t countPicks(LeastLoadedSelector& selector,
+                  const LeastLoadedSelector::EndpointPtr& endpoint,
+                  TimePoint now,
+                  size_t picks = 1000) {
+  size_t count = 0;
+  for (size_t i = 0; i < picks; ++i) {
+    if (selector.select(now) == endpoint) {
+      count++;
+    }
+  }
+  return count;
+}
+
+class LeastLoadedSelectorTest : public testing::Test {
+ public:
+  LeastLoadedSelectorTest() : selector_(LeastLoadedSelector::Options(), 42) {
+  }
+
+ protected:
+  LeastLoadedSelector selector_;
+  // Time is driven by hand
+  TimePoint now_{getCurrentTime()};
+};
+
+} // namespace
+
+TEST_F(LeastLoadedSelectorTest, Empty) {
+  EXPECT_EQ(selector_.select(now_), nullptr);
+  EXPECT_EQ(selector_.startRequest(now_), nullptr);
+}
+
+TEST_F(LeastLoadedSelectorTest, UpdateKeepsEndpoints) {
+  selector_.updateServers(makeServers(0, 3), now_);
+  ASSERT_EQ(selector_.size(), 3);
+  auto kept = selector_.getEndpoints()[1];
+  auto removed = selector_.getEndpoints()[0];
+  auto request = selector_.startRequest(kept);
+  selector_.recordLatency(*kept, milliseconds(7), now_);
+
+  auto servers = makeServers(1, 5);
+  // Duplicates are dropped
+  servers.push_back(servers[0]);
+  selector_.onServerListAvailable(std::move(servers));
+  ASSERT_EQ(selector_.size(), 4);
+  EXPECT_EQ(selector_.getEndpoints()[0], kept);
+  EXPECT_EQ(kept->getNumOutstanding(), 1);
+  EXPECT_DOUBLE_EQ(kept->getLatencyMs(), 7);
+  for (const auto& endpoint : selector_.getEndpoints()) {
+    EXPECT_NE(endpoint, removed);
+  }
+
+  // An error keeps the current list
+  selector_.onServerListError(
+      std::make_exception_ptr(std::runtime_error("oops")));
+  EXPECT_EQ(selector_.size(), 4);
+}
+
+TEST_F(LeastLoadedSelectorTest, PrefersLessLoaded) {
+  selector_.updateServers(makeServers(0, 2), now_);
+  auto busy = selector_.getEndpoints()[0];
+  auto idle = selector_.getEndpoints()[1];
+  std::vector<std::unique_ptr<LeastLoadedSelector::Request>> requests;
+  for (int i = 0; i < 3; ++i) {
+    requests.push_back(selector_.startRequest(busy));
+  }
+  EXPECT_EQ(busy->getNumOutstanding(), 3);
+  EXPECT_EQ(busy->getLoad(), 3);
+  // With two endpoints every pick compares both
+  EXPECT_EQ(countPicks(selector_, idle, now_), 1000);
+
+  requests.clear();
+  EXPECT_EQ(busy->getNumOutstanding(), 0);
+  requests.push_back(selector_.startRequest(idle));
+  EXPECT_EQ(countPicks(selector_, busy, now_), 1000);
+}
+
+TEST_F(LeastLoadedSelectorTest, PrefersFaster) {
+  selector_.updateServers(makeServers(0, 2), now_);
+  auto fast = selector_.getEndpoints()[0];
+  auto slow = selector_.getEndpoints()[1];
+  selector_.recordLatency(*fast, milliseconds(10), now_);
+  selector_.recordLatency(*slow, milliseconds(50), now_);
+  EXPECT_EQ(countPicks(selector_, fast, now_), 1000);
+
+  // Latency and load trade off: 10ms with 5 in flight costs more than 50ms
+  // with none
+  std::vector<std::unique_ptr<LeastLoadedSelector::Request>> requests;
+  for (int i = 0; i < 5; ++i) {
+    requests.push_back(selector_.startRequest(fast));
+  }
+  EXPECT_EQ(countPicks(selector_, slow, now_), 1000);
+}
+
+TEST_F(LeastLoadedSelectorTest, PeakReplacesAverage) {
+  selector_.updateServers(makeServers(0, 1), now_);
+  auto endpoint = selector_.getEndpoints()[0];
+  selector_.recordLatency(*endpoint, milliseconds(10), now_);
+  EXPECT_EQ(endpoint->getNumSamples(), 1);
+  EXPECT_DOUBLE_EQ(endpoint->getLatencyMs(), 10);
+  selector_.recordLatency(*endpoint, milliseconds(100), now_);
+  EXPECT_DOUBLE_EQ(endpoint->getLatencyMs(), 100);
+
+  // Faster samples only pull the average down over time
+  selector_.recordLatency(*endpoint, milliseconds(10), now_);
+  EXPECT_DOUBLE_EQ(endpoint->getLatencyMs(), 100);
+  now_ += milliseconds(10000);
+  selector_.recordLatency(*endpoint, milliseconds(10), now_);
+  EXPECT_NEAR(endpoint->getLatencyMs(), 10 + 90 * exp(-1), 0.01);
+  now_ += milliseconds(100000);
+  selector_.recordLatency(*endpoint, milliseconds(10), now_);
+  EXPECT_NEAR(endpoint->getLatencyMs(), 10, 0.01);
+}
+
+TEST_F(LeastLoadedSelectorTest, SlowEndpointRetriedWhenIdle) {
+  selector_.updateServers(makeServers(0, 2), now_);
+  auto fast = selector_.getEndpoints()[0];
+  auto slow = selector_.getEndpoints()[1];
+  selector_.recordLatency(*fast, milliseconds(10), now_);
+  selector_.recordLatency(*slow, milliseconds(1000), now_);
+  auto request = selector_.startRequest(fast);
+  EXPECT_EQ(countPicks(selector_, fast, now_), 1000);
+
+  // The fast endpoint stays busy, and the idle one's estimate fades until it
+  // is worth another try
+  for (int i = 0; i < 10; ++i) {
+    now_ += milliseconds(10000);
+    selector_.recordLatency(*fast, milliseconds(10), now_);
+  }
+  EXPECT_EQ(countPicks(selector_, slow, now_), 1000);
+}
+
+TEST_F(LeastLoadedSelectorTest, SlowStart) {
+  selector_.updateServers(makeServers(0, 1), now_);
+  auto old = selector_.getEndpoints()[0];
+  selector_.recordLatency(*old, milliseconds(10), now_);
+
+  selector_.updateServers(makeServers(0, 2), now_);
+  auto added = selector_.getEndpoints()[1];
+  // A new endpoint starts from the average of the sampled ones
+  EXPECT_DOUBLE_EQ(added->getLatencyMs(), 10);
+  EXPECT_EQ(added->getNumSamples(), 0);
+
+  // At a tenth of its weight, it loses to an endpoint with 3 in flight...
+  std::vector<std::unique_ptr<LeastLoadedSelector::Request>> requests;
+  for (int i = 0; i < 3; ++i) {
+    requests.push_back(selector_.startRequest(old));
+  }
+  EXPECT_EQ(countPicks(selector_, old, now_), 1000);
+  // ...and wins once it has ramped up
+  now_ += milliseconds(30000);
+  selector_.recordLatency(*old, milliseconds(10), now_);
+  EXPECT_EQ(countPicks(selector_, added, now_), 1000);
+}
+
+TEST_F(LeastLoadedSelectorTest, RequestSamplesByteEvents) {
+  selector_.updateServers(makeServers(0, 1), now_);
+  auto endpoint = selector_.getEndpoints()[0];
+  auto request = selector_.startRequest(now_);
+  ASSERT_NE(request, nullptr);
+  EXPECT_EQ(request->getEndpoint(), endpoint);
+  EXPECT_EQ(endpoint->getNumOutstanding(), 1);
+
+  HTTPHeaderSize size;
+  request->lastByteFlushed();
+  request->headerBytesReceived(size);
+  EXPECT_EQ(endpoint->getNumSamples(), 1);
+  // Only the first header block is a sample
+  request->headerBytesReceived(size);
+  request->markFailed();
+  EXPECT_EQ(endpoint->getNumSamples(), 1);
+  request.reset();
+  EXPECT_EQ(endpoint->getNumOutstanding(), 0);
+
+  request = selector_.startRequest(now_);
+  request->markFailed();
+  EXPECT_EQ(endpoint->getNumSamples(), 2);
+  EXPECT_DOUBLE_EQ(endpoint->getLatencyMs(), 1000);
+}
+
+TEST(LeastLoadedSelector, RequestOutlivesSelector) {
+  std::unique_ptr<LeastLoadedSelector::Request> request;
+  LeastLoadedSelector::EndpointPtr endpoint;
+  {
+    LeastLoadedSelector selector;
+    selector.updateServers(makeServers(0, 1));
+    request = selector.startRequest();
+    endpoint = request->getEndpoint();
+  }
+  HTTPHeaderSize size;
+  request->headerBytesReceived(size);
+  EXPECT_EQ(endpoint->getNumSamples(), 0);
+  request.reset();
+  EXPECT_EQ(endpoint->getNumOutstanding(), 0);
+}
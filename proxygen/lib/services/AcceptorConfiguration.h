@@ -90,12 +90,46 @@ struct AcceptorConfiguration : public wangle::ServerSocketConfig {
   size_t receiveStreamWindowSize{65536};
   size_t receiveSessionWindowSize{65536};
 
+  /**
+   * Receive window autotuning.  When enabled, the stream and session windows
+   * above are the minimums, and grow toward the measured bandwidth-delay
+   * product up to these maximums.
+   */
+  bool flowControlAutoTuning{false};
+  size_t maxReceiveStreamWindowSize{16 * 1024 * 1024};
+  size_t maxReceiveSessionWindowSize{64 * 1024 * 1024};
+
   /**
    * These parameters control how many bytes HTTPSession's will buffer in user
    * space before applying backpressure to handlers.  -1 means use the
    * built-in HTTPSession default (64kb)
    */
   int64_t writeBufferLimit{-1};
+
+  /**
+   * Track first/last byte TX and last byte ACK with kernel socket timestamps
+   * (Linux only).  Events without a timestamp are dropped after the timeout.
+   */
+  bool socketTimestampByteEvents{false};
+  std::chrono::milliseconds socketTimestampTimeout{5000};
+
+  /**
+   * If non-zero, hold back body egress while at least this many bytes are
+   * unsent in the kernel (TCP_NOTSENT_LOWAT, Linux only).
+   */
+  uint32_t egressNotSentLowWatermark{0};
+
+  /**
+   * If non-zero, send writes of at least this many bytes with MSG_ZEROCOPY
+   * on plaintext connections.
+   */
+  uint64_t zeroCopyEgressThreshold{0};
+
+  /**
+   * Hand TLS 1.2 AES-GCM egress encryption to the kernel (kTLS, Linux only)
+   * on connections accepted with OpenSSL.
+   */
+  bool kernelTLSEgress{false};
 };
 
 } // proxygen
@@ -13,6 +13,7 @@
 #include <folly/String.h>
 #include <folly/io/async/EventBaseManager.h>
 #include <glog/logging.h>
+#include <proxygen/lib/utils/ThreadAffinity.h>
 #include <signal.h>
 
 namespace proxygen {
@@ -122,6 +123,17 @@ void WorkerThread::setup() {
   if (eventBaseManager_) {
     eventBaseManager_->setEventBase(&eventBase_, false);
   }
+
+  if (!cpuAffinity_.empty()) {
+    if (!pinCurrentThread(cpuAffinity_)) {
+      LOG(WARNING) << "WorkerThread " << this << " failed to set CPU affinity";
+    } else if (numaLocalMemory_ && !preferLocalNumaMemory()) {
+      LOG(WARNING) << "WorkerThread " << this << " failed to set NUMA policy";
+    }
+  }
+  if (cpuMigrationObserver_) {
+    eventBase_.setObserver(cpuMigrationObserver_);
+  }
 }
 
 void WorkerThread::cleanup() {
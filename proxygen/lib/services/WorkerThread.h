@@ -13,8 +13,11 @@
 #include <cstdint>
 #include <folly/Portability.h>
 #include <folly/io/async/EventBase.h>
+#include <glog/logging.h>
+#include <memory>
 #include <mutex>
 #include <thread>
+#include <vector>
 
 namespace folly {
 class EventBaseManager;
@@ -22,6 +25,8 @@ class EventBaseManager;
 
 namespace proxygen {
 
+class CpuMigrationObserver;
+
 /**
  * A WorkerThread represents an independent event loop that runs in its own
  * thread.
@@ -32,6 +37,37 @@ class WorkerThread {
     folly::EventBaseManager* ebm, const std::string& evbName = std::string());
   virtual ~WorkerThread();
 
+  /**
+   * Pin the worker thread to cpus once it starts.  Must be called before
+   * start().  Failure to pin is logged and otherwise ignored.
+   */
+  void setCpuAffinity(std::vector<int> cpus) {
+    CHECK(state_ == State::IDLE);
+    cpuAffinity_ = std::move(cpus);
+  }
+
+  /**
+   * Once the worker thread starts, prefer memory on the NUMA node of the CPU
+   * it runs on.  This covers what the thread allocates from then on, such as
+   * the sessions and buffers its event base handles; the EventBase itself
+   * is a member of WorkerThread and was allocated by the constructing
+   * thread.  Only useful together with setCpuAffinity().  Must be called
+   * before start().
+   */
+  void setNumaLocalMemory(bool numaLocal) {
+    CHECK(state_ == State::IDLE);
+    numaLocalMemory_ = numaLocal;
+  }
+
+  /**
+   * Install observer on the worker's event base to count how often the
+   * thread migrated between CPUs.  Must be called before start().
+   */
+  void setCpuMigrationObserver(std::shared_ptr<CpuMigrationObserver> observer) {
+    CHECK(state_ == State::IDLE);
+    cpuMigrationObserver_ = std::move(observer);
+  }
+
   /**
    * Begin execution of the worker.
    *
@@ -136,6 +172,9 @@ class WorkerThread {
   std::mutex joinLock_;
   folly::EventBase eventBase_;
   folly::EventBaseManager* eventBaseManager_{nullptr};
+  std::vector<int> cpuAffinity_;
+  bool numaLocalMemory_{false};
+  std::shared_ptr<CpuMigrationObserver> cpuMigrationObserver_;
 
   // A thread-local pointer to the current WorkerThread for this thread
   static FOLLY_TLS WorkerThread* currentWorker_;
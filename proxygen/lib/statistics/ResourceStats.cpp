@@ -9,9 +9,43 @@
  */
 #include "proxygen/lib/statistics/ResourceStats.h"
 
+#include <cstring>
 #include <glog/logging.h>
 
 namespace {
+
+// Word offsets of the ResourceData fields in ResourceStats::snapshot_
+enum SnapshotField : size_t {
+  kCpuRatioUtil = 0,
+  kCpuSoftIrqRatioUtil,
+  kUsedMemBytes,
+  kTotalMemBytes,
+  kTcpMemPages,
+  kMinTcpMemLimit,
+  kPressureTcpMemLimit,
+  kMaxTcpMemLimit,
+  kUdpMemPages,
+  kMinUdpMemLimit,
+  kPressureUdpMemLimit,
+  kMaxUdpMemLimit,
+  kLastUpdateTime,
+  kUpdateInterval,
+  kNumFields
+};
+
+uint64_t toWord(double value) {
+  uint64_t word;
+  static_assert(sizeof(word) == sizeof(value), "double is not 64 bits");
+  std::memcpy(&word, &value, sizeof(word));
+  return word;
+}
+
+double fromWord(uint64_t word) {
+  double value;
+  std::memcpy(&value, &word, sizeof(value));
+  return value;
+}
+
 // tries to acquire a read lock on a given mutex
 // consider contributing it to folly
 class ReadTryGuard {
@@ -48,6 +82,9 @@ namespace proxygen {
 
 ResourceStats::ResourceStats(std::unique_ptr<Resources> resources)
     : resources_(std::move(resources)), data_(resources_->getCurrentData()) {
+  static_assert(kNumFields == kNumSnapshotFields,
+                "snapshot field count mismatch");
+  publishSnapshot(data_);
 }
 
 ResourceStats::~ResourceStats() {
@@ -125,6 +162,68 @@ void ResourceStats::updateCachedData() {
 
     data_ = data;
   }
+  publishSnapshot(data);
+}
+
+ResourceData ResourceStats::getLoadSnapshot() const {
+  std::array<uint64_t, kNumSnapshotFields> words;
+  while (true) {
+    auto seq = snapshotSeq_.load(std::memory_order_acquire);
+    if (seq & 1) {
+      continue;
+    }
+    for (size_t i = 0; i < kNumSnapshotFields; ++i) {
+      words[i] = snapshot_[i].load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (snapshotSeq_.load(std::memory_order_relaxed) == seq) {
+      break;
+    }
+  }
+
+  ResourceData data;
+  data.setCpuStats(fromWord(words[kCpuRatioUtil]),
+                   fromWord(words[kCpuSoftIrqRatioUtil]),
+                   {});
+  data.setMemStats(words[kUsedMemBytes], words[kTotalMemBytes]);
+  data.setTcpMemStats(words[kTcpMemPages],
+                      words[kMinTcpMemLimit],
+                      words[kPressureTcpMemLimit],
+                      words[kMaxTcpMemLimit]);
+  data.setUdpMemStats(words[kUdpMemPages],
+                      words[kMinUdpMemLimit],
+                      words[kPressureUdpMemLimit],
+                      words[kMaxUdpMemLimit]);
+  data.setLastUpdateTime(std::chrono::milliseconds(words[kLastUpdateTime]));
+  data.setUpdateInterval(std::chrono::milliseconds(words[kUpdateInterval]));
+  return data;
+}
+
+void ResourceStats::publishSnapshot(const ResourceData& data) {
+  std::array<uint64_t, kNumSnapshotFields> words;
+  words[kCpuRatioUtil] = toWord(data.getCpuRatioUtil());
+  words[kCpuSoftIrqRatioUtil] = toWord(data.getSoftIrqCpuRatioUtil());
+  words[kUsedMemBytes] = data.getUsedMemBytes();
+  words[kTotalMemBytes] = data.getTotalMemBytes();
+  words[kTcpMemPages] = data.getTcpMemPages();
+  words[kMinTcpMemLimit] = data.getLowTcpMemLimitPages();
+  words[kPressureTcpMemLimit] = data.getPressureTcpMemLimitPages();
+  words[kMaxTcpMemLimit] = data.getMaxTcpMemLimitPages();
+  words[kUdpMemPages] = data.getUdpMemPages();
+  words[kMinUdpMemLimit] = data.getLowUdpMemLimitPages();
+  words[kPressureUdpMemLimit] = data.getPressureUdpMemLimitPages();
+  words[kMaxUdpMemLimit] = data.getMaxUdpMemLimitPages();
+  words[kLastUpdateTime] = data.getLastUpdateTime().count();
+  words[kUpdateInterval] = data.getUpdateInterval().count();
+
+  // Single writer, so a relaxed read of our own last store is enough
+  auto seq = snapshotSeq_.load(std::memory_order_relaxed);
+  snapshotSeq_.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  for (size_t i = 0; i < kNumSnapshotFields; ++i) {
+    snapshot_[i].store(words[i], std::memory_order_relaxed);
+  }
+  snapshotSeq_.store(seq + 2, std::memory_order_release);
 }
 
 } // namespace proxygen
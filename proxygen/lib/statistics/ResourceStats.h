@@ -10,6 +10,7 @@
 #pragma once
 
 #include "proxygen/lib/statistics/ResourceData.h"
+#include <array>
 #include <atomic>
 #include <chrono>
 #include <folly/SharedMutex.h>
@@ -87,9 +88,29 @@ class ResourceStats {
    * Method is virtual for testing reasons.
    */
   virtual const ResourceData& getCurrentLoadData() const;
+
+  /**
+   * Lock free alternative to getCurrentLoadData() for callers on the request
+   * path, such as admission control.  Returns a copy of the most recently
+   * published data, minus the per core soft IRQ utilizations (which would
+   * need an allocation); everything else is the same, including the update
+   * time.
+   *
+   * The scalar fields are published under a seqlock, so readers never block
+   * the refresh thread or each other, and a read that races with a refresh
+   * retries rather than observing a mix of old and new values.
+   */
+  ResourceData getLoadSnapshot() const;
+
  protected:
   virtual void updateCachedData();
 
+  /**
+   * Publishes data for getLoadSnapshot().  Only one thread may publish at a
+   * time: the constructor and then the refresh thread.
+   */
+  void publishSnapshot(const ResourceData& data);
+
   /**
    * Abstraction that enables callers to provide their own implementations
    * of the entity that actually queries various metrics.
@@ -104,6 +125,15 @@ class ResourceStats {
   ResourceData data_;
   mutable folly::SharedMutex dataMutex_;
 
+  /**
+   * Seqlock guarding the snapshot fields; odd while a publish is in
+   * progress.  Fields are stored as raw 64 bit words so that a torn read is
+   * merely discarded instead of being undefined behavior.
+   */
+  static constexpr size_t kNumSnapshotFields = 14;
+  std::atomic<uint64_t> snapshotSeq_{0};
+  std::array<std::atomic<uint64_t>, kNumSnapshotFields> snapshot_{};
+
   // Refresh management fields
 
   /**
@@ -0,0 +1,75 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/portability/GTest.h>
+#include <proxygen/lib/statistics/ResourceStats.h>
+
+using namespace proxygen;
+
+namespace {
+
+class FakeResources : public Resources {
+ public:
+  explicit FakeResources(ResourceData* data) : data_(data) {
+  }
+
+  ResourceData getCurrentData() override {
+    return *data_;
+  }
+
+ private:
+  ResourceData* data_;
+};
+
+class TestResourceStats : public ResourceStats {
+ public:
+  explicit TestResourceStats(ResourceData* data)
+      : ResourceStats(std::make_unique<FakeResources>(data)) {
+  }
+
+  using ResourceStats::updateCachedData;
+};
+
+ResourceData makeData(double cpu) {
+  ResourceData data;
+  data.setCpuStats(cpu, 0.1, {0.1, 0.1});
+  data.setMemStats(40, 100);
+  data.setTcpMemStats(10, 50, 100, 200);
+  data.setUdpMemStats(1, 5, 10, 20);
+  data.refreshLastUpdateTime();
+  return data;
+}
+
+}
+
+TEST(ResourceStatsTest, LoadSnapshot) {
+  auto data = makeData(0.25);
+  TestResourceStats stats(&data);
+
+  auto snapshot = stats.getLoadSnapshot();
+  EXPECT_EQ(snapshot.getCpuRatioUtil(), 0.25);
+  EXPECT_EQ(snapshot.getSoftIrqCpuRatioUtil(), 0.1);
+  EXPECT_TRUE(snapshot.getSoftIrqCpuCoreRatioUtils().empty());
+  EXPECT_EQ(snapshot.getUsedMemBytes(), 40);
+  EXPECT_EQ(snapshot.getTotalMemBytes(), 100);
+  EXPECT_EQ(snapshot.getTcpMemPages(), 10);
+  EXPECT_EQ(snapshot.getLowTcpMemLimitPages(), 50);
+  EXPECT_EQ(snapshot.getPressureTcpMemLimitPages(), 100);
+  EXPECT_EQ(snapshot.getMaxTcpMemLimitPages(), 200);
+  EXPECT_EQ(snapshot.getUdpMemPages(), 1);
+  EXPECT_EQ(snapshot.getMaxUdpMemLimitPages(), 20);
+  EXPECT_EQ(snapshot.getLastUpdateTime(), data.getLastUpdateTime());
+
+  data = makeData(0.75);
+  stats.updateCachedData();
+  snapshot = stats.getLoadSnapshot();
+  EXPECT_EQ(snapshot.getCpuRatioUtil(), 0.75);
+  EXPECT_EQ(snapshot.getCpuRatioUtil(),
+            stats.getCurrentLoadData().getCpuRatioUtil());
+}
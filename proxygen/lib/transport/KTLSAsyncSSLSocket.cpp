@@ -0,0 +1,214 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/transport/KTLSAsyncSSLSocket.h>
+
+#include <cstring>
+#include <folly/portability/Sockets.h>
+#include <glog/logging.h>
+
+#if defined(__linux__) && defined(__has_include) && \
+  OPENSSL_VERSION_NUMBER >= 0x10101000L && !defined(OPENSSL_IS_BORINGSSL)
+#if __has_include(<linux/tls.h>)
+#define PROXYGEN_HAVE_KTLS 1
+#endif
+#endif
+
+#ifdef PROXYGEN_HAVE_KTLS
+#include <linux/tls.h>
+#include <netinet/tcp.h>
+#include <openssl/kdf.h>
+
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+#endif
+
+namespace proxygen {
+
+#ifdef PROXYGEN_HAVE_KTLS
+namespace {
+
+/**
+ * The TLS 1.2 key block (RFC 5246 section 6.3): client write key, server
+ * write key, then the 4 byte implicit GCM nonces (RFC 5288), client first.
+ */
+bool deriveKeyBlock(SSL* ssl,
+                    const SSL_CIPHER* cipher,
+                    unsigned char* out,
+                    size_t outLen) {
+  unsigned char master[SSL_MAX_MASTER_KEY_LENGTH];
+  unsigned char clientRandom[SSL3_RANDOM_SIZE];
+  unsigned char serverRandom[SSL3_RANDOM_SIZE];
+  auto masterLen = SSL_SESSION_get_master_key(
+    SSL_get_session(ssl), master, sizeof(master));
+  SSL_get_client_random(ssl, clientRandom, sizeof(clientRandom));
+  SSL_get_server_random(ssl, serverRandom, sizeof(serverRandom));
+
+  static const char kLabel[] = "key expansion";
+  std::unique_ptr<EVP_PKEY_CTX, decltype(&EVP_PKEY_CTX_free)> ctx(
+    EVP_PKEY_CTX_new_id(EVP_PKEY_TLS1_PRF, nullptr), EVP_PKEY_CTX_free);
+  bool ok = ctx && masterLen > 0 &&
+    EVP_PKEY_derive_init(ctx.get()) == 1 &&
+    EVP_PKEY_CTX_set_tls1_prf_md(
+      ctx.get(), SSL_CIPHER_get_handshake_digest(cipher)) == 1 &&
+    EVP_PKEY_CTX_set1_tls1_prf_secret(ctx.get(), master, masterLen) == 1 &&
+    EVP_PKEY_CTX_add1_tls1_prf_seed(
+      ctx.get(), (const unsigned char*)kLabel, sizeof(kLabel) - 1) == 1 &&
+    EVP_PKEY_CTX_add1_tls1_prf_seed(
+      ctx.get(), serverRandom, sizeof(serverRandom)) == 1 &&
+    EVP_PKEY_CTX_add1_tls1_prf_seed(
+      ctx.get(), clientRandom, sizeof(clientRandom)) == 1 &&
+    EVP_PKEY_derive(ctx.get(), out, &outLen) == 1;
+  OPENSSL_cleanse(master, sizeof(master));
+  return ok;
+}
+
+template <typename CryptoInfo>
+void fillCryptoInfo(CryptoInfo& info,
+                    uint16_t cipherType,
+                    const unsigned char* key,
+                    const unsigned char* salt) {
+  static_assert(sizeof(info.iv) == 8 && sizeof(info.rec_seq) == 8,
+                "explicit nonce and sequence number are 64 bits");
+  // The server's Finished was record 0 of this epoch
+  const unsigned char seq[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+  info.info.version = TLS_1_2_VERSION;
+  info.info.cipher_type = cipherType;
+  memcpy(info.key, key, sizeof(info.key));
+  memcpy(info.salt, salt, sizeof(info.salt));
+  memcpy(info.iv, seq, sizeof(info.iv));
+  memcpy(info.rec_seq, seq, sizeof(info.rec_seq));
+}
+
+} // namespace
+#endif
+
+KTLSAsyncSSLSocket::KTLSAsyncSSLSocket(
+    const std::shared_ptr<folly::SSLContext>& ctx,
+    folly::EventBase* evb,
+    folly::NetworkSocket fd)
+    : folly::AsyncSSLSocket(ctx,
+                            evb,
+                            fd,
+                            true /* server */,
+                            true /* deferSecurityNegotiation */) {
+}
+
+bool KTLSAsyncSSLSocket::enableKernelTLSEgress() {
+  if (kernelTLSEgress_) {
+    return true;
+  }
+#ifdef PROXYGEN_HAVE_KTLS
+  // The record sequence is only known while nothing has been sent since
+  // the handshake.
+  auto ssl = const_cast<SSL*>(getSSL());
+  if (!ssl || getSSLState() != STATE_ESTABLISHED ||
+      getAppBytesWritten() != 0 || BIO_wpending(SSL_get_wbio(ssl)) != 0) {
+    return false;
+  }
+  if (SSL_version(ssl) != TLS1_2_VERSION) {
+    VLOG(4) << "kTLS needs TLS 1.2, negotiated " << SSL_get_version(ssl);
+    return false;
+  }
+  auto cipher = SSL_get_current_cipher(ssl);
+  auto nid = cipher ? SSL_CIPHER_get_cipher_nid(cipher) : NID_undef;
+  size_t keyLen;
+  if (nid == NID_aes_128_gcm) {
+    keyLen = TLS_CIPHER_AES_GCM_128_KEY_SIZE;
+  } else if (nid == NID_aes_256_gcm) {
+    keyLen = TLS_CIPHER_AES_GCM_256_KEY_SIZE;
+  } else {
+    VLOG(4) << "kTLS unsupported cipher " << SSL_get_cipher_name(ssl);
+    return false;
+  }
+
+  unsigned char keyBlock[2 * TLS_CIPHER_AES_GCM_256_KEY_SIZE + 2 * 4];
+  size_t keyBlockLen = 2 * keyLen + 2 * 4;
+  union {
+    tls12_crypto_info_aes_gcm_128 gcm128;
+    tls12_crypto_info_aes_gcm_256 gcm256;
+  } info;
+  memset(&info, 0, sizeof(info));
+  bool ok = deriveKeyBlock(ssl, cipher, keyBlock, keyBlockLen);
+  socklen_t infoLen = 0;
+  if (ok) {
+    auto serverKey = keyBlock + keyLen;
+    auto serverSalt = keyBlock + 2 * keyLen + 4;
+    if (keyLen == TLS_CIPHER_AES_GCM_128_KEY_SIZE) {
+      fillCryptoInfo(
+        info.gcm128, TLS_CIPHER_AES_GCM_128, serverKey, serverSalt);
+      infoLen = sizeof(info.gcm128);
+    } else {
+      fillCryptoInfo(
+        info.gcm256, TLS_CIPHER_AES_GCM_256, serverKey, serverSalt);
+      infoLen = sizeof(info.gcm256);
+    }
+  }
+  OPENSSL_cleanse(keyBlock, sizeof(keyBlock));
+  if (!ok) {
+    VLOG(2) << "kTLS key derivation failed";
+    return false;
+  }
+
+  auto fd = getNetworkSocket().toFd();
+  // Attaching the ULP alone doesn't change what goes on the wire, so the
+  // socket is still usable as is if either call fails.
+  ok = setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) == 0 &&
+    setsockopt(fd, SOL_TLS, TLS_TX, &info, infoLen) == 0;
+  auto errnum = errno;
+  OPENSSL_cleanse(&info, sizeof(info));
+  if (!ok) {
+    VLOG(3) << "kTLS unavailable errno=" << errnum;
+    return false;
+  }
+
+  rawBytesBeforeKernelTLS_ = folly::AsyncSSLSocket::getRawBytesWritten();
+  appBytesBeforeKernelTLS_ = getAppBytesWritten();
+  SSL_set_quiet_shutdown(ssl, 1);
+#ifdef SSL_OP_NO_RENEGOTIATION
+  SSL_set_options(ssl, SSL_OP_NO_RENEGOTIATION);
+#endif
+  SSL_set0_wbio(ssl, BIO_new(BIO_s_null()));
+  kernelTLSEgress_ = true;
+  VLOG(4) << "kTLS egress enabled fd=" << fd << " cipher="
+          << SSL_get_cipher_name(ssl);
+  return true;
+#else
+  return false;
+#endif
+}
+
+size_t KTLSAsyncSSLSocket::getRawBytesWritten() const {
+  if (!kernelTLSEgress_) {
+    return folly::AsyncSSLSocket::getRawBytesWritten();
+  }
+  return rawBytesBeforeKernelTLS_ +
+    (getAppBytesWritten() - appBytesBeforeKernelTLS_);
+}
+
+folly::AsyncSocket::WriteResult KTLSAsyncSSLSocket::performWrite(
+    const iovec* vec,
+    uint32_t count,
+    folly::WriteFlags flags,
+    uint32_t* countWritten,
+    uint32_t* partialWritten) {
+  if (kernelTLSEgress_) {
+    // Plaintext straight to the socket, the kernel frames and encrypts
+    return folly::AsyncSocket::performWrite(
+      vec, count, flags, countWritten, partialWritten);
+  }
+  return folly::AsyncSSLSocket::performWrite(
+    vec, count, flags, countWritten, partialWritten);
+}
+
+} // namespace proxygen
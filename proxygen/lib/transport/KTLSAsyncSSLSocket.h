@@ -0,0 +1,70 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/io/async/AsyncSSLSocket.h>
+
+namespace proxygen {
+
+/**
+ * Server side AsyncSSLSocket that can hand egress encryption to the Linux
+ * kernel (kTLS, 4.13+) once the handshake is done.  Writes then go to the
+ * socket as plaintext, so bodies are copied once, into the kernel, instead
+ * of through OpenSSL's encryption buffers, and mapped file bodies can be
+ * sent as on plaintext connections.  Ingress is still decrypted by OpenSSL.
+ *
+ * Only TLS 1.2 with AES-128-GCM or AES-256-GCM is supported.  TLS 1.3
+ * sends session tickets and key updates after the handshake, which OpenSSL
+ * would then encrypt with keys it no longer owns.
+ *
+ * Once enabled, OpenSSL's own writes (alerts, close_notify) are discarded:
+ * letting it encrypt with the stale record sequence would reuse GCM
+ * nonces.  Clients see a TCP close without close_notify.
+ */
+class KTLSAsyncSSLSocket : public folly::AsyncSSLSocket {
+ public:
+  using UniquePtr = std::unique_ptr<KTLSAsyncSSLSocket, Destructor>;
+
+  KTLSAsyncSSLSocket(const std::shared_ptr<folly::SSLContext>& ctx,
+                     folly::EventBase* evb,
+                     folly::NetworkSocket fd);
+
+  /**
+   * Move egress encryption to the kernel.  Call after the handshake, before
+   * anything is written.  Returns false, leaving the socket as it was, if
+   * the negotiated version or cipher is unsupported or the kernel lacks the
+   * tls module.
+   */
+  bool enableKernelTLSEgress();
+
+  bool isKernelTLSEgressEnabled() const {
+    return kernelTLSEgress_;
+  }
+
+  /**
+   * The kernel adds the TLS framing, so this counts plaintext bytes since
+   * kTLS was enabled.
+   */
+  size_t getRawBytesWritten() const override;
+
+ protected:
+  WriteResult performWrite(const iovec* vec,
+                           uint32_t count,
+                           folly::WriteFlags flags,
+                           uint32_t* countWritten,
+                           uint32_t* partialWritten) override;
+
+ private:
+  bool kernelTLSEgress_{false};
+  size_t rawBytesBeforeKernelTLS_{0};
+  size_t appBytesBeforeKernelTLS_{0};
+};
+
+} // namespace proxygen
@@ -0,0 +1,61 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/utils/AsyncFileReader.h>
+
+#include <glog/logging.h>
+#include <proxygen/lib/utils/IoUringFileReader.h>
+
+namespace proxygen {
+
+std::unique_ptr<AsyncFileReader> AsyncFileReader::make(
+    folly::EventBase* evb,
+    std::shared_ptr<folly::Executor> fallbackExecutor,
+    const Options& options) {
+  auto reader = IoUringFileReader::make(evb, options);
+  if (reader) {
+    return std::move(reader);
+  }
+  VLOG(2) << "io_uring unavailable, reading files on an executor";
+  return std::make_unique<ThreadPoolFileReader>(
+    evb, std::move(fallbackExecutor), options.maxReadSize);
+}
+
+ThreadPoolFileReader::ThreadPoolFileReader(
+    folly::EventBase* evb,
+    std::shared_ptr<folly::Executor> executor,
+    size_t maxReadSize)
+    : AsyncFileReader(evb),
+      executor_(std::move(executor)),
+      maxReadSize_(maxReadSize) {
+  CHECK(executor_);
+}
+
+void ThreadPoolFileReader::read(const FileRegion& region,
+                                Callback* callback) {
+  evb_->dcheckIsInEventBaseThread();
+  CHECK_LE(region.getLength(), maxReadSize_);
+  inFlight_++;
+  executor_->add([this, region, callback] {
+      errno = 0;
+      auto data = region.read();
+      auto errnum = data ? 0 : (errno ? errno : EIO);
+      evb_->runInEventBaseThread(
+        [this, callback, errnum, data = std::move(data)] () mutable {
+          inFlight_--;
+          if (data) {
+            callback->readSuccess(std::move(data));
+          } else {
+            callback->readError(errnum);
+          }
+        });
+    });
+}
+
+} // namespace proxygen
@@ -0,0 +1,109 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Executor.h>
+#include <folly/io/IOBuf.h>
+#include <folly/io/async/EventBase.h>
+#include <memory>
+#include <proxygen/lib/utils/FileRegion.h>
+
+namespace proxygen {
+
+/**
+ * Reads file regions without blocking the event base it belongs to.
+ * read() and all callbacks happen in the EventBase thread.  Reads may
+ * complete in any order; callers that need the data in order keep several
+ * reads in flight and reorder them.
+ *
+ * A reader must outlive the reads issued through it.
+ */
+class AsyncFileReader {
+ public:
+  class Callback {
+   public:
+    virtual ~Callback() {}
+
+    /**
+     * data holds the whole region.
+     */
+    virtual void readSuccess(std::unique_ptr<folly::IOBuf> data) noexcept = 0;
+
+    /**
+     * errnum is an errno value; EIO if the file ends before the region.
+     */
+    virtual void readError(int errnum) noexcept = 0;
+  };
+
+  struct Options {
+    // Reads in flight at once; more are queued
+    uint32_t queueDepth{64};
+    // Largest region a single read() accepts
+    size_t maxReadSize{128 * 1024};
+  };
+
+  /**
+   * An io_uring reader on kernels that support it (Linux 5.1+), otherwise a
+   * reader doing pread(2) on fallbackExecutor.
+   */
+  static std::unique_ptr<AsyncFileReader> make(
+      folly::EventBase* evb,
+      std::shared_ptr<folly::Executor> fallbackExecutor,
+      const Options& options);
+
+  virtual ~AsyncFileReader() {}
+
+  /**
+   * Read region, which must not be longer than getMaxReadSize().
+   */
+  virtual void read(const FileRegion& region, Callback* callback) = 0;
+
+  virtual size_t getMaxReadSize() const = 0;
+
+  virtual uint32_t getNumReadsInFlight() const = 0;
+
+  folly::EventBase* getEventBase() const {
+    return evb_;
+  }
+
+ protected:
+  explicit AsyncFileReader(folly::EventBase* evb) : evb_(evb) {
+  }
+
+  folly::EventBase* evb_;
+};
+
+/**
+ * Reads with pread(2) on an executor and hops back to the EventBase with
+ * the result.
+ */
+class ThreadPoolFileReader : public AsyncFileReader {
+ public:
+  ThreadPoolFileReader(folly::EventBase* evb,
+                       std::shared_ptr<folly::Executor> executor,
+                       size_t maxReadSize);
+
+  void read(const FileRegion& region, Callback* callback) override;
+
+  size_t getMaxReadSize() const override {
+    return maxReadSize_;
+  }
+
+  uint32_t getNumReadsInFlight() const override {
+    return inFlight_;
+  }
+
+ private:
+  std::shared_ptr<folly::Executor> executor_;
+  size_t maxReadSize_;
+  uint32_t inFlight_{0};
+};
+
+} // namespace proxygen
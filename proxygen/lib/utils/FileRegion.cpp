@@ -0,0 +1,87 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/utils/FileRegion.h>
+
+#include <algorithm>
+#include <folly/FileUtil.h>
+#include <folly/portability/SysMman.h>
+#include <folly/portability/Unistd.h>
+#include <glog/logging.h>
+
+namespace {
+
+size_t getPageSize() {
+  static const size_t pageSize = sysconf(_SC_PAGESIZE);
+  return pageSize;
+}
+
+void unmap(void* addr, void* length) {
+  munmap(addr, reinterpret_cast<size_t>(length));
+}
+
+}
+
+namespace proxygen {
+
+FileRegion::FileRegion(std::shared_ptr<folly::File> file,
+                       off_t offset,
+                       size_t length)
+    : file_(std::move(file)), offset_(offset), length_(length) {
+  CHECK(file_);
+  CHECK_GE(offset_, 0);
+}
+
+FileRegion FileRegion::subRegion(size_t offset, size_t length) const {
+  offset = std::min(offset, length_);
+  return FileRegion(file_, offset_ + offset,
+                    std::min(length, length_ - offset));
+}
+
+void FileRegion::advance(size_t n) {
+  n = std::min(n, length_);
+  offset_ += n;
+  length_ -= n;
+}
+
+std::unique_ptr<folly::IOBuf> FileRegion::map() const {
+  if (length_ == 0) {
+    return folly::IOBuf::create(0);
+  }
+  // mmap(2) offsets must be page aligned
+  auto delta = static_cast<size_t>(offset_ % getPageSize());
+  auto mapLength = length_ + delta;
+  void* addr = mmap(nullptr, mapLength, PROT_READ, MAP_SHARED,
+                    file_->fd(), offset_ - delta);
+  if (addr == MAP_FAILED) {
+    VLOG(4) << "mmap failed errno=" << errno << " fd=" << file_->fd();
+    return nullptr;
+  }
+  madvise(addr, mapLength, MADV_SEQUENTIAL);
+  madvise(addr, mapLength, MADV_WILLNEED);
+  auto buf = folly::IOBuf::takeOwnership(
+    addr, mapLength, unmap, reinterpret_cast<void*>(mapLength));
+  buf->trimStart(delta);
+  return buf;
+}
+
+std::unique_ptr<folly::IOBuf> FileRegion::read() const {
+  auto buf = folly::IOBuf::create(length_);
+  auto rc = folly::preadFull(file_->fd(), buf->writableData(), length_,
+                             offset_);
+  if (rc < 0 || static_cast<size_t>(rc) != length_) {
+    VLOG(4) << "pread failed rc=" << rc << " errno=" << errno
+            << " fd=" << file_->fd();
+    return nullptr;
+  }
+  buf->append(length_);
+  return buf;
+}
+
+} // namespace proxygen
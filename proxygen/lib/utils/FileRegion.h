@@ -0,0 +1,90 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/File.h>
+#include <folly/io/IOBuf.h>
+#include <memory>
+#include <sys/types.h>
+
+namespace proxygen {
+
+/**
+ * A byte range of an open file, used as a response body source that is
+ * turned into IOBufs only when it is about to be sent.
+ *
+ * map() wraps the page cache pages of the region in an IOBuf without
+ * copying them into userspace.  Written to a plaintext socket with
+ * MSG_ZEROCOPY (HTTPServerOptions::zeroCopyEgressThreshold) the kernel
+ * transmits straight from the page cache, as sendfile(2) would; without it
+ * the only copy left is the one into the socket buffer.  read() is the
+ * buffered alternative for bodies that are transformed before they hit the
+ * wire, such as TLS or HTTP/2 framing.
+ *
+ * A mapping of a file that is truncated while it is being sent raises
+ * SIGBUS on access.  Only map files that are replaced atomically (rename)
+ * rather than rewritten in place.
+ */
+class FileRegion {
+ public:
+  FileRegion(std::shared_ptr<folly::File> file, off_t offset, size_t length);
+
+  const std::shared_ptr<folly::File>& getFile() const {
+    return file_;
+  }
+
+  off_t getOffset() const {
+    return offset_;
+  }
+
+  size_t getLength() const {
+    return length_;
+  }
+
+  bool empty() const {
+    return length_ == 0;
+  }
+
+  /**
+   * The length bytes of this region starting offset bytes into it.  Both
+   * are clamped to the region.
+   */
+  FileRegion subRegion(size_t offset, size_t length) const;
+
+  /**
+   * Drop the first n bytes of the region.
+   */
+  void advance(size_t n);
+
+  /**
+   * Map the region read-only.  The mapping is released when the returned
+   * buffer and all its clones are freed.  Pages not yet in the page cache
+   * are read in when the buffer is first touched, typically by the kernel
+   * while writing it out; readahead is requested for the whole region.
+   *
+   * Returns nullptr if the file cannot be mapped, e.g. pipes or files of
+   * procfs.
+   */
+  std::unique_ptr<folly::IOBuf> map() const;
+
+  /**
+   * Read the region into a new buffer with pread(2).  This blocks, so
+   * call it off the IO thread.  Returns nullptr on error or if the file
+   * ends before the region does.
+   */
+  std::unique_ptr<folly::IOBuf> read() const;
+
+ private:
+  std::shared_ptr<folly::File> file_;
+  off_t offset_;
+  size_t length_;
+};
+
+} // namespace proxygen
@@ -0,0 +1,496 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/utils/IoUringFileReader.h>
+
+#include <algorithm>
+#include <cstring>
+#include <folly/portability/SysMman.h>
+#include <folly/portability/Unistd.h>
+#include <glog/logging.h>
+#include <mutex>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define PROXYGEN_HAVE_IO_URING 1
+#endif
+#endif
+
+#ifdef PROXYGEN_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+namespace proxygen {
+
+#ifdef PROXYGEN_HAVE_IO_URING
+
+/**
+ * The submission and completion queues shared with the kernel.  There is
+ * no liburing dependency; this is the small part of it the reader needs.
+ */
+struct IoUringFileReader::Ring {
+  static std::unique_ptr<Ring> create(uint32_t entries) {
+    std::unique_ptr<Ring> ring(new Ring());
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) {
+      VLOG(2) << "io_uring_setup failed errno=" << errno;
+      return nullptr;
+    }
+
+    ring->sqMapSize =
+      params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqMapSize =
+      params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMap) {
+      ring->sqMapSize = ring->cqMapSize =
+        std::max(ring->sqMapSize, ring->cqMapSize);
+    }
+    ring->sqMap = mmap(nullptr, ring->sqMapSize, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring->fd,
+                       IORING_OFF_SQ_RING);
+    if (ring->sqMap == MAP_FAILED) {
+      ring->sqMap = nullptr;
+      return nullptr;
+    }
+    if (singleMap) {
+      ring->cqMap = ring->sqMap;
+    } else {
+      ring->cqMap = mmap(nullptr, ring->cqMapSize, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring->fd,
+                         IORING_OFF_CQ_RING);
+      if (ring->cqMap == MAP_FAILED) {
+        ring->cqMap = nullptr;
+        return nullptr;
+      }
+    }
+    ring->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    auto sqes = mmap(nullptr, ring->sqesSize, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+      return nullptr;
+    }
+    ring->sqes = static_cast<io_uring_sqe*>(sqes);
+
+    auto sq = static_cast<char*>(ring->sqMap);
+    ring->sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    ring->sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    ring->sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    ring->sqEntries = params.sq_entries;
+    ring->sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    auto cq = static_cast<char*>(ring->cqMap);
+    ring->cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    ring->cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    ring->cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    ring->cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    ring->localTail = *ring->sqTail;
+    return ring;
+  }
+
+  ~Ring() {
+    if (sqes) {
+      munmap(sqes, sqesSize);
+    }
+    if (cqMap && cqMap != sqMap) {
+      munmap(cqMap, cqMapSize);
+    }
+    if (sqMap) {
+      munmap(sqMap, sqMapSize);
+    }
+    if (fd >= 0) {
+      // Waits for reads still in flight
+      close(fd);
+    }
+  }
+
+  bool registerBuffers(void* memory, size_t bufferSize, uint32_t count) {
+    std::vector<iovec> iovs(count);
+    for (uint32_t i = 0; i < count; i++) {
+      iovs[i].iov_base = static_cast<char*>(memory) + i * bufferSize;
+      iovs[i].iov_len = bufferSize;
+    }
+    if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS,
+                iovs.data(), count) != 0) {
+      VLOG(2) << "IORING_REGISTER_BUFFERS failed errno=" << errno;
+      return false;
+    }
+    return true;
+  }
+
+  bool registerEventFd(int eventFd) {
+    if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_EVENTFD,
+                &eventFd, 1) != 0) {
+      VLOG(2) << "IORING_REGISTER_EVENTFD failed errno=" << errno;
+      return false;
+    }
+    return true;
+  }
+
+  // Queue a read into registered buffer bufIndex.  Returns false if the
+  // submission queue is full.
+  bool prepareRead(int fileFd, off_t offset, void* addr, uint32_t len,
+                   uint16_t bufIndex) {
+    auto head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+    if (localTail - head >= sqEntries) {
+      return false;
+    }
+    auto index = localTail & sqMask;
+    auto sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ_FIXED;
+    sqe->fd = fileFd;
+    sqe->off = offset;
+    sqe->addr = reinterpret_cast<uint64_t>(addr);
+    sqe->len = len;
+    sqe->buf_index = bufIndex;
+    sqe->user_data = bufIndex;
+    sqArray[index] = index;
+    localTail++;
+    __atomic_store_n(sqTail, localTail, __ATOMIC_RELEASE);
+    return true;
+  }
+
+  // Returns the number of entries submitted, or -errno
+  int submit(uint32_t count) {
+    auto rc = syscall(__NR_io_uring_enter, fd, count, 0, 0, nullptr, 0);
+    return rc < 0 ? -errno : rc;
+  }
+
+  // Take back the last count reads queued but not yet submitted, appending
+  // their buffer indices to out in the order they were queued.  The kernel
+  // only looks at the submission queue in io_uring_enter(2).
+  void unprepare(uint32_t count, std::vector<uint16_t>& out) {
+    auto first = out.size();
+    for (; count > 0; count--) {
+      localTail--;
+      const auto& sqe = sqes[sqArray[localTail & sqMask]];
+      out.push_back(static_cast<uint16_t>(sqe.user_data));
+    }
+    __atomic_store_n(sqTail, localTail, __ATOMIC_RELEASE);
+    std::reverse(out.begin() + first, out.end());
+  }
+
+  // Appends (buffer index, result) of all completions to out
+  void reap(std::vector<std::pair<uint16_t, int32_t>>& out) {
+    auto head = *cqHead;
+    auto tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+      const auto& cqe = cqes[head & cqMask];
+      out.emplace_back(static_cast<uint16_t>(cqe.user_data), cqe.res);
+    }
+    __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+  }
+
+  int fd{-1};
+  void* sqMap{nullptr};
+  size_t sqMapSize{0};
+  void* cqMap{nullptr};
+  size_t cqMapSize{0};
+  io_uring_sqe* sqes{nullptr};
+  size_t sqesSize{0};
+  unsigned* sqHead{nullptr};
+  unsigned* sqTail{nullptr};
+  unsigned sqMask{0};
+  unsigned sqEntries{0};
+  unsigned* sqArray{nullptr};
+  unsigned localTail{0};
+  unsigned* cqHead{nullptr};
+  unsigned* cqTail{nullptr};
+  unsigned cqMask{0};
+  io_uring_cqe* cqes{nullptr};
+};
+
+#else
+
+struct IoUringFileReader::Ring {
+  bool prepareRead(int, off_t, void*, uint32_t, uint16_t) {
+    return false;
+  }
+  int submit(uint32_t) {
+    return -ENOSYS;
+  }
+  void unprepare(uint32_t, std::vector<uint16_t>&) {
+  }
+  void reap(std::vector<std::pair<uint16_t, int32_t>>&) {
+  }
+};
+
+#endif
+
+/**
+ * The registered buffers.  Shared with the IOBufs handed out, which can
+ * outlive the reader.
+ */
+struct IoUringFileReader::BufferPool {
+  BufferPool(void* mem, size_t size, uint32_t num, folly::EventBase* base)
+      : memory(mem),
+        bufferSize(size),
+        count(num),
+        reserve(std::max<uint32_t>(num / 4, 1)),
+        evb(base) {
+    for (uint32_t i = count; i > 0; i--) {
+      freeList.push_back(i - 1);
+    }
+  }
+
+  ~BufferPool() {
+    munmap(memory, bufferSize * count);
+  }
+
+  char* getBuffer(uint32_t index) const {
+    return static_cast<char*>(memory) + index * bufferSize;
+  }
+
+  folly::Optional<uint32_t> acquire() {
+    std::lock_guard<std::mutex> guard(mutex);
+    if (freeList.empty()) {
+      return folly::none;
+    }
+    auto index = freeList.back();
+    freeList.pop_back();
+    return index;
+  }
+
+  void release(uint32_t index) {
+    std::lock_guard<std::mutex> guard(mutex);
+    freeList.push_back(index);
+  }
+
+  // Whether a completed read may be handed out in its buffer, rather than
+  // copied out of it.  Keeps reserve buffers from being lent.
+  bool tryLend() {
+    std::lock_guard<std::mutex> guard(mutex);
+    if (lent + reserve >= count) {
+      return false;
+    }
+    lent++;
+    return true;
+  }
+
+  void releaseLent(uint32_t index) {
+    std::lock_guard<std::mutex> guard(mutex);
+    lent--;
+    freeList.push_back(index);
+  }
+
+  void* memory;
+  size_t bufferSize;
+  uint32_t count;
+  // Buffers that are never lent, so reads keep going however long the
+  // data handed out is held
+  uint32_t reserve;
+  folly::EventBase* evb;
+  // Only accessed in the evb thread; cleared when the reader goes away
+  IoUringFileReader* reader{nullptr};
+  std::mutex mutex;
+  std::vector<uint32_t> freeList;
+  // Buffers owned by IOBufs handed out
+  uint32_t lent{0};
+};
+
+// userData of the IOBufs handed to readSuccess()
+struct IoUringFileReader::BufferRef {
+  std::shared_ptr<BufferPool> pool;
+  uint32_t index;
+};
+
+std::unique_ptr<IoUringFileReader> IoUringFileReader::make(
+    folly::EventBase* evb, const Options& options) {
+#ifdef PROXYGEN_HAVE_IO_URING
+  CHECK_GT(options.queueDepth, 0);
+  // buf_index is 16 bits
+  auto count = std::min<uint32_t>(options.queueDepth, 1 << 16);
+  auto ring = Ring::create(count);
+  if (!ring) {
+    return nullptr;
+  }
+  auto pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  auto bufferSize =
+    (options.maxReadSize + pageSize - 1) / pageSize * pageSize;
+  auto memory = mmap(nullptr, bufferSize * count, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) {
+    return nullptr;
+  }
+  auto buffers = std::make_shared<BufferPool>(memory, bufferSize, count, evb);
+  if (!ring->registerBuffers(memory, bufferSize, count)) {
+    return nullptr;
+  }
+  int eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (eventFd < 0) {
+    return nullptr;
+  }
+  if (!ring->registerEventFd(eventFd)) {
+    close(eventFd);
+    return nullptr;
+  }
+  return std::unique_ptr<IoUringFileReader>(new IoUringFileReader(
+    evb, std::move(ring), std::move(buffers), eventFd));
+#else
+  (void)evb;
+  (void)options;
+  return nullptr;
+#endif
+}
+
+IoUringFileReader::IoUringFileReader(folly::EventBase* evb,
+                                     std::unique_ptr<Ring> ring,
+                                     std::shared_ptr<BufferPool> buffers,
+                                     int eventFd)
+    : AsyncFileReader(evb),
+      folly::EventHandler(evb, folly::NetworkSocket::fromFd(eventFd)),
+      ring_(std::move(ring)),
+      buffers_(std::move(buffers)),
+      eventFd_(eventFd),
+      bufferSize_(buffers_->bufferSize),
+      reads_(buffers_->count) {
+  buffers_->reader = this;
+  registerHandler(folly::EventHandler::READ | folly::EventHandler::PERSIST);
+}
+
+IoUringFileReader::~IoUringFileReader() {
+  DCHECK_EQ(getNumReadsInFlight(), 0);
+  unregisterHandler();
+  cancelLoopCallback();
+  buffers_->reader = nullptr;
+  ring_.reset();
+  close(eventFd_);
+}
+
+void IoUringFileReader::read(const FileRegion& region, Callback* callback) {
+  evb_->dcheckIsInEventBaseThread();
+  CHECK_LE(region.getLength(), bufferSize_);
+  pending_.push_back({region, callback});
+  startPending();
+}
+
+void IoUringFileReader::startPending() {
+  while (!pending_.empty()) {
+    auto buffer = buffers_->acquire();
+    if (!buffer) {
+      break;
+    }
+    auto& read = pending_.front();
+    if (!ring_->prepareRead(read.region.getFile()->fd(),
+                            read.region.getOffset(),
+                            buffers_->getBuffer(*buffer),
+                            read.region.getLength(),
+                            *buffer)) {
+      buffers_->release(*buffer);
+      break;
+    }
+    reads_[*buffer] = std::move(read);
+    pending_.pop_front();
+    toSubmit_++;
+    inFlight_++;
+  }
+  if (toSubmit_ > 0 && !isLoopCallbackScheduled()) {
+    evb_->runInLoop(this);
+  }
+}
+
+void IoUringFileReader::runLoopCallback() noexcept {
+  auto rc = ring_->submit(toSubmit_);
+  if (rc < 0) {
+    if (rc == -EINTR || rc == -EAGAIN || rc == -EBUSY) {
+      // Out of kernel resources or completions to reap; try again next loop
+      evb_->runInLoop(this);
+    } else {
+      LOG(ERROR) << "io_uring_enter failed errno=" << -rc;
+      failUnsubmitted(-rc);
+    }
+    return;
+  }
+  toSubmit_ -= rc;
+  if (toSubmit_ > 0) {
+    evb_->runInLoop(this);
+  }
+}
+
+void IoUringFileReader::failUnsubmitted(int errnum) {
+  std::vector<uint16_t> indices;
+  ring_->unprepare(toSubmit_, indices);
+  toSubmit_ = 0;
+  // Callbacks may issue more reads, so settle the state first
+  std::vector<Read> failed;
+  for (auto index : indices) {
+    CHECK(reads_[index]);
+    failed.push_back(std::move(*reads_[index]));
+    reads_[index].reset();
+    inFlight_--;
+    buffers_->release(index);
+  }
+  for (auto& read : failed) {
+    read.callback->readError(errnum);
+  }
+}
+
+void IoUringFileReader::handlerReady(uint16_t /*events*/) noexcept {
+  uint64_t count;
+  // Clear the eventfd before reaping, so later completions wake us again
+  auto rc = ::read(eventFd_, &count, sizeof(count));
+  (void)rc;
+
+  std::vector<std::pair<uint16_t, int32_t>> completions;
+  ring_->reap(completions);
+  for (const auto& completion : completions) {
+    auto index = completion.first;
+    auto res = completion.second;
+    CHECK(reads_[index]);
+    auto read = std::move(*reads_[index]);
+    reads_[index].reset();
+    inFlight_--;
+    if (res < 0 || static_cast<size_t>(res) != read.region.getLength()) {
+      buffers_->release(index);
+      read.callback->readError(res < 0 ? -res : EIO);
+      continue;
+    }
+    std::unique_ptr<folly::IOBuf> data;
+    if (buffers_->tryLend()) {
+      data = folly::IOBuf::takeOwnership(
+        buffers_->getBuffer(index), bufferSize_, res, releaseBuffer,
+        new BufferRef{buffers_, index});
+    } else {
+      data = folly::IOBuf::copyBuffer(buffers_->getBuffer(index), res);
+      buffers_->release(index);
+    }
+    read.callback->readSuccess(std::move(data));
+  }
+  startPending();
+}
+
+void IoUringFileReader::releaseBuffer(void* /*buf*/, void* userData) {
+  std::unique_ptr<BufferRef> ref(static_cast<BufferRef*>(userData));
+  auto pool = std::move(ref->pool);
+  pool->releaseLent(ref->index);
+  if (pool->evb->isInEventBaseThread()) {
+    if (pool->reader) {
+      pool->reader->onBufferReleased();
+    }
+  } else {
+    pool->evb->runInEventBaseThread([pool] {
+        if (pool->reader) {
+          pool->reader->onBufferReleased();
+        }
+      });
+  }
+}
+
+void IoUringFileReader::onBufferReleased() {
+  if (!pending_.empty()) {
+    startPending();
+  }
+}
+
+} // namespace proxygen
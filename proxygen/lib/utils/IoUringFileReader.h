@@ -0,0 +1,107 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <deque>
+#include <folly/Optional.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/io/async/EventHandler.h>
+#include <proxygen/lib/utils/AsyncFileReader.h>
+
+namespace proxygen {
+
+/**
+ * AsyncFileReader on an io_uring owned by one EventBase.
+ *
+ * Completions are signalled through an eventfd registered on the
+ * EventBase, so callbacks run in the loop without any thread hop.  Reads
+ * issued during one loop iteration are submitted with a single
+ * io_uring_enter(2) at the end of it.
+ *
+ * Data is read into queueDepth buffers of maxReadSize bytes that are
+ * registered with the ring once (IORING_OP_READ_FIXED), which saves the
+ * kernel from pinning pages on every read.  The IOBuf handed to
+ * readSuccess() owns the buffer until it and its clones are freed, after
+ * the body is written to the socket; reads wait for a free buffer.  A
+ * quarter of the buffers are never handed out: once the rest are, data is
+ * copied out to the heap, so callers that hold on to theirs cannot stall
+ * everyone else's reads.
+ */
+class IoUringFileReader
+    : public AsyncFileReader,
+      private folly::EventHandler,
+      private folly::EventBase::LoopCallback {
+ public:
+  /**
+   * Returns nullptr if io_uring is not available, e.g. on kernels older
+   * than 5.1, under seccomp filters that block it, or if the buffers
+   * cannot be registered (RLIMIT_MEMLOCK).
+   */
+  static std::unique_ptr<IoUringFileReader> make(folly::EventBase* evb,
+                                                 const Options& options);
+
+  ~IoUringFileReader() override;
+
+  void read(const FileRegion& region, Callback* callback) override;
+
+  size_t getMaxReadSize() const override {
+    return bufferSize_;
+  }
+
+  uint32_t getNumReadsInFlight() const override {
+    return inFlight_ + pending_.size();
+  }
+
+ private:
+  struct Ring;
+  struct BufferPool;
+  struct BufferRef;
+  struct Read {
+    FileRegion region;
+    Callback* callback;
+  };
+
+  IoUringFileReader(folly::EventBase* evb,
+                    std::unique_ptr<Ring> ring,
+                    std::shared_ptr<BufferPool> buffers,
+                    int eventFd);
+
+  // Queue as many pending reads as there are free buffers and SQ entries
+  void startPending();
+
+  // folly::EventHandler, the eventfd became readable
+  void handlerReady(uint16_t events) noexcept override;
+
+  // folly::EventBase::LoopCallback, submit what startPending() queued
+  void runLoopCallback() noexcept override;
+
+  // io_uring_enter(2) failed for good: fail the reads it did not take,
+  // freeing their buffers
+  void failUnsubmitted(int errnum);
+
+  // IOBuf free function for the buffers handed out
+  static void releaseBuffer(void* buf, void* userData);
+
+  void onBufferReleased();
+
+  std::unique_ptr<Ring> ring_;
+  std::shared_ptr<BufferPool> buffers_;
+  int eventFd_;
+  size_t bufferSize_;
+  // Reads waiting for a buffer or a submission queue entry
+  std::deque<Read> pending_;
+  // Reads in flight, indexed by the buffer they read into
+  std::vector<folly::Optional<Read>> reads_;
+  // Reads queued for the next io_uring_enter(2)
+  uint32_t toSubmit_{0};
+  uint32_t inFlight_{0};
+};
+
+} // namespace proxygen
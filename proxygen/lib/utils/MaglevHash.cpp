@@ -0,0 +1,205 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/utils/MaglevHash.h>
+#include <folly/hash/Hash.h>
+#include <folly/small_vector.h>
+#include <glog/logging.h>
+#include <algorithm>
+#include <limits>
+#include <math.h>
+
+namespace proxygen {
+
+namespace {
+
+constexpr uint32_t kEmpty = std::numeric_limits<uint32_t>::max();
+
+constexpr size_t kProbesPerRank = 8;
+// Fallback ranks get() tracks on the stack; deeper ones allocate
+constexpr size_t kInlineRanks = 8;
+
+bool isPrime(size_t n) {
+  if (n < 2) {
+    return false;
+  }
+  for (size_t i = 2; i * i <= n; ++i) {
+    if (n % i == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}
+
+constexpr size_t MaglevHash::kDefaultTableSize;
+
+MaglevHash::MaglevHash(size_t tableSize) : tableSize_(tableSize) {
+  CHECK(isPrime(tableSize))
+    << "Maglev table size must be prime, got " << tableSize;
+  CHECK_LT(tableSize, kEmpty);
+}
+
+std::vector<size_t> MaglevHash::computeQuotas(
+    const std::vector<std::pair<std::string, uint64_t>>& nodes,
+    size_t tableSize) {
+  std::vector<size_t> quotas(nodes.size(), 0);
+  double totalWeight = 0;
+  for (const auto& node : nodes) {
+    totalWeight += node.second;
+  }
+  if (totalWeight == 0) {
+    return quotas;
+  }
+  // Largest remainder: round every share down, then hand the entries left
+  // over to the nodes that lost the most by rounding
+  std::vector<std::pair<double, size_t>> remainders;
+  size_t assigned = 0;
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    double share = tableSize * (nodes[i].second / totalWeight);
+    quotas[i] = size_t(share);
+    assigned += quotas[i];
+    if (nodes[i].second > 0) {
+      remainders.emplace_back(share - quotas[i], i);
+    }
+  }
+  std::sort(remainders.begin(),
+            remainders.end(),
+            [](const std::pair<double, size_t>& a,
+               const std::pair<double, size_t>& b) {
+              return a.first > b.first ||
+                (a.first == b.first && a.second < b.second);
+            });
+  for (size_t i = 0; assigned < tableSize; ++i) {
+    quotas[remainders[i % remainders.size()].second]++;
+    assigned++;
+  }
+  return quotas;
+}
+
+/*
+ * Every node has its own permutation of the table slots, derived from two
+ * hashes of its name:
+ *
+ *   offset = h1(name) % M
+ *   skip   = h2(name) % (M - 1) + 1
+ *   permutation[j] = (offset + j * skip) % M
+ *
+ * M is prime, so every skip visits every slot.  The nodes take turns
+ * claiming the next slot in their permutation that is still free, until the
+ * table is full.  A node whose quota is used up drops out of the rotation,
+ * which is how weights are honoured.
+ *
+ * Because each node's preferences depend only on its own name, adding or
+ * removing one node mostly changes the slots that node claims and leaves
+ * the others alone.
+ */
+void MaglevHash::build(std::vector<std::pair<std::string, uint64_t>>& nodes) {
+  CHECK_LT(nodes.size(), kEmpty);
+  const size_t tableSize = tableSize_;
+  table_.assign(tableSize, kEmpty);
+  numNodesInTable_ = 0;
+  maxErrorRate_ = 0;
+
+  auto quotas = computeQuotas(nodes, tableSize);
+  struct Permutation {
+    uint32_t node;
+    uint64_t offset;
+    uint64_t skip;
+    uint64_t next;
+    size_t remaining;
+  };
+  std::vector<Permutation> active;
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    if (quotas[i] == 0) {
+      continue;
+    }
+    const auto& name = nodes[i].first;
+    uint64_t h1 = folly::hash::fnv64_buf(name.data(), name.size());
+    uint64_t h2 = folly::hash::twang_mix64(h1);
+    active.push_back(
+      {uint32_t(i), h1 % tableSize, h2 % (tableSize - 1) + 1, 0, quotas[i]});
+  }
+  numNodesInTable_ = active.size();
+
+  size_t filled = 0;
+  while (!active.empty()) {
+    for (auto it = active.begin(); it != active.end();) {
+      auto& perm = *it;
+      uint64_t slot;
+      do {
+        slot = (perm.offset + perm.next * perm.skip) % tableSize;
+        perm.next++;
+      } while (table_[slot] != kEmpty);
+      table_[slot] = perm.node;
+      filled++;
+      if (--perm.remaining == 0) {
+        it = active.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+  DCHECK(nodes.empty() || filled == tableSize);
+
+  double totalWeight = 0;
+  for (const auto& node : nodes) {
+    totalWeight += node.second;
+  }
+  for (size_t i = 0; i < nodes.size() && totalWeight > 0; ++i) {
+    if (nodes[i].second == 0) {
+      continue;
+    }
+    double expected = nodes[i].second / totalWeight;
+    double actual = double(quotas[i]) / tableSize;
+    maxErrorRate_ =
+      std::max(maxErrorRate_, fabs(actual - expected) / expected);
+  }
+}
+
+size_t MaglevHash::get(const uint64_t key, const size_t rank) const {
+  if (numNodesInTable_ == 0) {
+    return 0;
+  }
+  uint64_t hash = folly::hash::twang_mix64(key);
+  size_t slot = hash % table_.size();
+  size_t modRank = rank % numNodesInTable_;
+  if (modRank == 0) {
+    return table_[slot];
+  }
+  // Fallbacks are rare and shallow, so a linear scan of the nodes seen so
+  // far, kept on the stack, beats a set
+  folly::small_vector<uint32_t, kInlineRanks> seen;
+  seen.push_back(table_[slot]);
+  // Rehashing picks each fallback in proportion to weight.  Past a few
+  // probes per rank, walk the table instead, which is sure to end.
+  size_t maxProbes = kProbesPerRank * (modRank + 1);
+  for (size_t probe = 1;; ++probe) {
+    if (probe < maxProbes) {
+      slot = folly::hash::twang_mix64(hash + probe) % table_.size();
+    } else {
+      slot = slot + 1 == table_.size() ? 0 : slot + 1;
+    }
+    auto node = table_[slot];
+    if (std::find(seen.begin(), seen.end(), node) != seen.end()) {
+      continue;
+    }
+    if (seen.size() == modRank) {
+      return node;
+    }
+    seen.push_back(node);
+  }
+}
+
+double MaglevHash::getMaxErrorRate() const {
+  return maxErrorRate_;
+}
+
+}
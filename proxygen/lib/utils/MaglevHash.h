@@ -0,0 +1,78 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+#include <proxygen/lib/utils/ConsistentHash.h>
+
+namespace proxygen {
+/*
+ * Maglev hashing (Eisenbud et al., NSDI 2016) fills a lookup table in
+ * build(), so get() is a single table read no matter how many nodes there
+ * are, where RendezvousHash hashes the key against every node.
+ *
+ * Each node owns a share of the table proportional to its weight.  When a
+ * node is added, removed or reweighted, most keys stay where they were,
+ * though a few more move than with RendezvousHash.
+ *
+ * The table holds whole entries, so each node's share is only accurate to
+ * within one entry, a relative error of up to about nodes/tableSize.
+ * getMaxErrorRate() reports how far off the worst node is.  Changing the
+ * table size moves nearly every key, so pick one with room for the largest
+ * expected pool and keep it across builds.
+ */
+class MaglevHash : public ConsistentHash {
+ public:
+  // Prime, and a few hundred KB; enough for around 1000 nodes.  Around
+  // 10000 nodes need a table of about a million entries, e.g. 1048573.
+  static constexpr size_t kDefaultTableSize = 65521;
+
+  /**
+   * tableSize must be prime.
+   */
+  explicit MaglevHash(size_t tableSize = kDefaultTableSize);
+
+  /**
+   * Largest relative difference between a node's share of the table and its
+   * share of the total weight.
+   */
+  double getMaxErrorRate() const override;
+
+  void build(std::vector<std::pair<std::string, uint64_t>>&) override;
+
+  /**
+   * Rank 0 is the key's table entry.  Higher ranks are the next distinct
+   * nodes found at further table entries picked by rehashing the key, so
+   * fallbacks follow the weights too.  As with RendezvousHash, rank wraps
+   * at the number of nodes that have entries.
+   */
+  size_t get(const uint64_t key, const size_t rank = 0) const override;
+
+  size_t getTableSize() const {
+    return tableSize_;
+  }
+
+ private:
+  /**
+   * How many table entries each node gets: its share of the table,
+   * rounded so the total comes out exact.
+   */
+  static std::vector<size_t> computeQuotas(
+      const std::vector<std::pair<std::string, uint64_t>>& nodes,
+      size_t tableSize);
+
+  size_t tableSize_;
+  std::vector<uint32_t> table_;
+  size_t numNodesInTable_{0};
+  double maxErrorRate_{0};
+};
+
+} // proxygen
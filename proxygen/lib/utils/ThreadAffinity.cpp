@@ -0,0 +1,183 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/utils/ThreadAffinity.h>
+
+#include <algorithm>
+#include <dirent.h>
+#include <folly/Conv.h>
+#include <folly/FileUtil.h>
+#include <folly/String.h>
+#include <glog/logging.h>
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+std::vector<std::string> listDir(const std::string& path) {
+  std::vector<std::string> entries;
+  auto dir = opendir(path.c_str());
+  if (!dir) {
+    return entries;
+  }
+  while (auto entry = readdir(dir)) {
+    std::string name(entry->d_name);
+    if (name != "." && name != "..") {
+      entries.push_back(std::move(name));
+    }
+  }
+  closedir(dir);
+  return entries;
+}
+
+} // namespace
+
+namespace proxygen {
+
+std::vector<int> parseCpuList(folly::StringPiece list) {
+  std::vector<int> cpus;
+  std::vector<folly::StringPiece> ranges;
+  folly::split(',', folly::trimWhitespace(list), ranges);
+  for (auto range : ranges) {
+    if (range.empty()) {
+      continue;
+    }
+    folly::StringPiece first, last;
+    if (!folly::split('-', range, first, last)) {
+      first = last = range;
+    }
+    auto lo = folly::tryTo<int>(first);
+    auto hi = folly::tryTo<int>(last);
+    if (!lo || !hi || *lo < 0 || *hi < *lo) {
+      return {};
+    }
+    for (int cpu = *lo; cpu <= *hi; cpu++) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+std::vector<int> getNicRxQueueCpus(const std::string& ifname,
+                                   const std::string& sysRoot,
+                                   const std::string& procRoot) {
+  std::vector<int> irqs;
+  for (auto& entry : listDir(folly::to<std::string>(
+           sysRoot, "/class/net/", ifname, "/device/msi_irqs"))) {
+    auto irq = folly::tryTo<int>(entry);
+    if (irq) {
+      irqs.push_back(*irq);
+    }
+  }
+  std::sort(irqs.begin(), irqs.end());
+
+  std::vector<int> cpus;
+  for (auto irq : irqs) {
+    std::string affinity;
+    if (!folly::readFile(
+            folly::to<std::string>(procRoot, "/irq/", irq, "/smp_affinity_list")
+                .c_str(),
+            affinity)) {
+      continue;
+    }
+    // An IRQ allowed on several CPUs is effectively not steered
+    auto irqCpus = parseCpuList(affinity);
+    if (irqCpus.size() == 1 &&
+        std::find(cpus.begin(), cpus.end(), irqCpus[0]) == cpus.end()) {
+      cpus.push_back(irqCpus[0]);
+    }
+  }
+  return cpus;
+}
+
+bool pinCurrentThread(const std::vector<int>& cpus) {
+#ifdef __linux__
+  if (cpus.empty()) {
+    return false;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (auto cpu : cpus) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+      return false;
+    }
+    CPU_SET(cpu, &set);
+  }
+  auto err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if (err != 0) {
+    VLOG(2) << "failed to pin thread: " << folly::errnoStr(err);
+    return false;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool preferLocalNumaMemory() {
+#ifdef __linux__
+  unsigned cpu = 0, node = 0;
+  if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) {
+    return false;
+  }
+  constexpr unsigned long kMaxNodes = sizeof(unsigned long) * 8;
+  if (node >= kMaxNodes) {
+    return false;
+  }
+  unsigned long nodeMask = 1UL << node;
+  // MPOL_PREFERRED still falls back to other nodes under memory pressure
+  if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, &nodeMask, kMaxNodes) != 0) {
+    VLOG(2) << "set_mempolicy failed: " << folly::errnoStr(errno);
+    return false;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+CpuMigrationObserver::CpuMigrationObserver(uint32_t sampleRate)
+    : sampleRate_(std::max<uint32_t>(sampleRate, 1)) {
+}
+
+void CpuMigrationObserver::loopSample(int64_t /*busyTime*/,
+                                      int64_t /*idleTime*/) {
+#ifdef __linux__
+  int cpu = sched_getcpu();
+  if (cpu < 0) {
+    return;
+  }
+  int node = lastNode_;
+  if (cpu != lastCpu_) {
+    unsigned c = 0, n = 0;
+    node = syscall(SYS_getcpu, &c, &n, nullptr) == 0 ? int(n) : -1;
+  }
+  onCpuSample(cpu, node);
+#endif
+}
+
+void CpuMigrationObserver::onCpuSample(int cpu, int node) {
+  samples_.fetch_add(1, std::memory_order_relaxed);
+  if (lastCpu_ >= 0 && cpu != lastCpu_) {
+    cpuMigrations_.fetch_add(1, std::memory_order_relaxed);
+    if (node != lastNode_) {
+      nodeMigrations_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  lastCpu_ = cpu;
+  lastNode_ = node;
+}
+
+} // namespace proxygen
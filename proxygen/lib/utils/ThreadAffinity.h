@@ -0,0 +1,99 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <folly/Range.h>
+#include <folly/io/async/EventBase.h>
+#include <string>
+#include <vector>
+
+namespace proxygen {
+
+/**
+ * Helpers to pin event loop threads to CPUs and keep their memory on the
+ * local NUMA node.  CPU topology is read from sysfs; everything here is a
+ * no-op returning false / empty outside Linux.
+ */
+
+/**
+ * Parse a kernel cpu list such as "0-3,8,10-11".  Returns an empty vector
+ * if the list is malformed.
+ */
+std::vector<int> parseCpuList(folly::StringPiece list);
+
+/**
+ * CPUs that service the interrupts of network interface ifname, read from
+ * the MSI IRQs of the device and their /proc/irq/<irq>/smp_affinity_list.
+ * Ordered by IRQ number, which usually follows RX queue order, without
+ * duplicates.  Pinning IO thread i to the i-th entry keeps a connection's
+ * packets and its session state on the same core when the NIC steers flows
+ * by RSS.
+ */
+std::vector<int> getNicRxQueueCpus(const std::string& ifname,
+                                   const std::string& sysRoot = "/sys",
+                                   const std::string& procRoot = "/proc");
+
+/**
+ * Pin the calling thread to cpus.  Returns false on failure.
+ */
+bool pinCurrentThread(const std::vector<int>& cpus);
+
+/**
+ * Prefer allocating memory for the calling thread on the NUMA node of the
+ * CPU it runs on.  Call after pinning.  Returns false on failure.
+ */
+bool preferLocalNumaMemory();
+
+/**
+ * EventBaseObserver counting CPU migrations of the loop thread: sampled loop
+ * iterations that ran on a different CPU than the previous sample, and
+ * those that also crossed a NUMA node.  Migrations between two samples
+ * that land back on the same CPU go unseen.  Counters may be read from any
+ * thread.
+ */
+class CpuMigrationObserver : public folly::EventBaseObserver {
+ public:
+  explicit CpuMigrationObserver(uint32_t sampleRate = 1);
+
+  uint32_t getSampleRate() const override {
+    return sampleRate_;
+  }
+
+  void loopSample(int64_t busyTime, int64_t idleTime) override;
+
+  uint64_t getNumSamples() const {
+    return samples_.load(std::memory_order_relaxed);
+  }
+
+  // Samples on a different CPU than the previous one
+  uint64_t getNumCpuMigrations() const {
+    return cpuMigrations_.load(std::memory_order_relaxed);
+  }
+
+  // Of those, samples on a different NUMA node
+  uint64_t getNumNodeMigrations() const {
+    return nodeMigrations_.load(std::memory_order_relaxed);
+  }
+
+ protected:
+  // Exposed for testing
+  void onCpuSample(int cpu, int node);
+
+ private:
+  uint32_t sampleRate_;
+  int lastCpu_{-1};
+  int lastNode_{-1};
+  std::atomic<uint64_t> samples_{0};
+  std::atomic<uint64_t> cpuMigrations_{0};
+  std::atomic<uint64_t> nodeMigrations_{0};
+};
+
+} // namespace proxygen
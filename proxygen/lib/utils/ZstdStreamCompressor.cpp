@@ -0,0 +1,83 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/utils/ZstdStreamCompressor.h>
+
+#include <folly/io/IOBuf.h>
+#include <folly/io/IOBufQueue.h>
+#include <glog/logging.h>
+
+namespace proxygen {
+
+void ZstdStreamCompressor::freeCStream(ZSTD_CStream* cstream) {
+  ZSTD_freeCStream(cstream);
+}
+
+ZstdStreamCompressor::ZstdStreamCompressor(int level)
+    : cstream_(ZSTD_createCStream()) {
+  DCHECK(level >= 1 && level <= kMaxLevel)
+      << "Invalid zstd compression level. level=" << level;
+  if (!cstream_ || ZSTD_isError(ZSTD_initCStream(cstream_.get(), level))) {
+    LOG(ERROR) << "error initializing zstd stream";
+    error_ = true;
+  }
+}
+
+std::unique_ptr<folly::IOBuf> ZstdStreamCompressor::compress(
+    const folly::IOBuf* in, bool trailer) {
+  if (hasError()) {
+    return nullptr;
+  }
+
+  const size_t outBufMinSize = 1; // avoid wasting space in existing bufs
+  const size_t outBufAllocSize = ZSTD_CStreamOutSize();
+  folly::IOBufQueue outqueue;
+
+  for (const folly::ByteRange range : *in) {
+    if (range.data() == nullptr) {
+      continue;
+    }
+
+    ZSTD_inBuffer ibuf = {range.data(), range.size(), 0};
+    while (ibuf.pos < ibuf.size) {
+      auto outpair = outqueue.preallocate(outBufMinSize, outBufAllocSize);
+      ZSTD_outBuffer obuf = {outpair.first, outpair.second, 0};
+      auto ret = ZSTD_compressStream(cstream_.get(), &obuf, &ibuf);
+      outqueue.postallocate(obuf.pos);
+      if (ZSTD_isError(ret)) {
+        DLOG(ERROR) << "zstd compression failed: " << ZSTD_getErrorName(ret);
+        error_ = true;
+        return nullptr;
+      }
+    }
+  }
+
+  // Both return the number of bytes still to be flushed
+  size_t remaining;
+  do {
+    auto outpair = outqueue.preallocate(outBufMinSize, outBufAllocSize);
+    ZSTD_outBuffer obuf = {outpair.first, outpair.second, 0};
+    remaining = trailer ? ZSTD_endStream(cstream_.get(), &obuf)
+                        : ZSTD_flushStream(cstream_.get(), &obuf);
+    outqueue.postallocate(obuf.pos);
+    if (ZSTD_isError(remaining)) {
+      DLOG(ERROR) << "zstd compression failed: "
+                  << ZSTD_getErrorName(remaining);
+      error_ = true;
+      return nullptr;
+    }
+  } while (remaining != 0);
+
+  auto out = outqueue.move();
+  if (!out) {
+    out = folly::IOBuf::create(0);
+  }
+  return out;
+}
+} // namespace proxygen
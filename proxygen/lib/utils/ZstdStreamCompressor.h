@@ -0,0 +1,55 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <zstd.h>
+
+#include <folly/Memory.h>
+
+#include <proxygen/lib/utils/StreamCompressor.h>
+
+namespace folly {
+class IOBuf;
+}
+
+namespace proxygen {
+
+/**
+ * Streaming zstd compressor producing a single frame.  As with
+ * ZlibStreamCompressor, compress() can be called multiple times: each call
+ * flushes what it was given, and the call with trailer set ends the frame.
+ */
+class ZstdStreamCompressor : public StreamCompressor {
+ public:
+  // Levels above this use windows larger than 8MB, which clients are not
+  // required to support for Content-Encoding: zstd
+  static constexpr int kMaxLevel = 19;
+
+  explicit ZstdStreamCompressor(int level);
+
+  std::unique_ptr<folly::IOBuf> compress(const folly::IOBuf* in,
+                                         bool trailer = true) override;
+
+  bool hasError() override {
+    return error_;
+  }
+
+ private:
+  static void freeCStream(ZSTD_CStream* cstream);
+
+  bool error_{false};
+
+  const std::unique_ptr<
+      ZSTD_CStream,
+      folly::static_function_deleter<ZSTD_CStream, freeCStream>>
+      cstream_;
+};
+} // namespace proxygen
@@ -0,0 +1,210 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/FileUtil.h>
+#include <folly/executors/CPUThreadPoolExecutor.h>
+#include <folly/experimental/TestUtil.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/portability/GTest.h>
+
+#include <proxygen/lib/utils/AsyncFileReader.h>
+#include <proxygen/lib/utils/IoUringFileReader.h>
+
+using namespace proxygen;
+
+namespace {
+
+class TestCallback : public AsyncFileReader::Callback {
+ public:
+  explicit TestCallback(folly::EventBase* evb) : evb_(evb) {
+  }
+
+  void readSuccess(std::unique_ptr<folly::IOBuf> buf) noexcept override {
+    EXPECT_TRUE(evb_->isInEventBaseThread());
+    data = std::move(buf);
+    done = true;
+  }
+
+  void readError(int errnum) noexcept override {
+    EXPECT_TRUE(evb_->isInEventBaseThread());
+    error = errnum;
+    done = true;
+  }
+
+  std::unique_ptr<folly::IOBuf> data;
+  int error{0};
+  bool done{false};
+
+ private:
+  folly::EventBase* evb_;
+};
+
+}
+
+// Parameter: use io_uring
+class AsyncFileReaderTest : public testing::TestWithParam<bool> {
+ public:
+  void SetUp() override {
+    for (size_t i = 0; i < 1024 * 1024; i++) {
+      contents_.push_back('a' + i % 26);
+    }
+    ASSERT_TRUE(folly::writeFile(contents_, tmp_.path().string().c_str()));
+    file_ = std::make_shared<folly::File>(tmp_.path().string());
+  }
+
+  std::unique_ptr<AsyncFileReader> makeReader(uint32_t queueDepth) {
+    AsyncFileReader::Options options;
+    options.queueDepth = queueDepth;
+    options.maxReadSize = 64 * 1024;
+    if (GetParam()) {
+      return IoUringFileReader::make(&evb_, options);
+    }
+    return std::make_unique<ThreadPoolFileReader>(
+      &evb_, executor_, options.maxReadSize);
+  }
+
+  void loopUntilDone(const std::vector<std::unique_ptr<TestCallback>>& cbs) {
+    auto allDone = [&] {
+      for (const auto& cb : cbs) {
+        if (!cb->done) {
+          return false;
+        }
+      }
+      return true;
+    };
+    while (!allDone()) {
+      evb_.loopOnce();
+    }
+  }
+
+ protected:
+  folly::test::TemporaryFile tmp_;
+  std::string contents_;
+  std::shared_ptr<folly::File> file_;
+  folly::EventBase evb_;
+  std::shared_ptr<folly::Executor> executor_{
+    std::make_shared<folly::CPUThreadPoolExecutor>(2)};
+};
+
+TEST_P(AsyncFileReaderTest, Read) {
+  auto reader = makeReader(8);
+  if (!reader) {
+    LOG(INFO) << "io_uring unavailable, skipping";
+    return;
+  }
+  std::vector<std::unique_ptr<TestCallback>> cbs;
+  for (size_t i = 0; i < 4; i++) {
+    cbs.push_back(std::make_unique<TestCallback>(&evb_));
+    reader->read(FileRegion(file_, 1000 + i * 50000, 50000), cbs.back().get());
+  }
+  EXPECT_EQ(reader->getNumReadsInFlight(), 4);
+  loopUntilDone(cbs);
+  EXPECT_EQ(reader->getNumReadsInFlight(), 0);
+  for (size_t i = 0; i < cbs.size(); i++) {
+    ASSERT_NE(cbs[i]->data, nullptr);
+    EXPECT_EQ(cbs[i]->data->moveToFbString().toStdString(),
+              contents_.substr(1000 + i * 50000, 50000));
+  }
+}
+
+TEST_P(AsyncFileReaderTest, PastEndOfFile) {
+  auto reader = makeReader(8);
+  if (!reader) {
+    LOG(INFO) << "io_uring unavailable, skipping";
+    return;
+  }
+  std::vector<std::unique_ptr<TestCallback>> cbs;
+  cbs.push_back(std::make_unique<TestCallback>(&evb_));
+  reader->read(FileRegion(file_, contents_.size() - 100, 200),
+               cbs.back().get());
+  loopUntilDone(cbs);
+  EXPECT_EQ(cbs[0]->data, nullptr);
+  EXPECT_EQ(cbs[0]->error, EIO);
+}
+
+TEST_P(AsyncFileReaderTest, MoreReadsThanQueueDepth) {
+  auto reader = makeReader(2);
+  if (!reader) {
+    LOG(INFO) << "io_uring unavailable, skipping";
+    return;
+  }
+  std::vector<std::unique_ptr<TestCallback>> cbs;
+  for (size_t i = 0; i < 16; i++) {
+    cbs.push_back(std::make_unique<TestCallback>(&evb_));
+    reader->read(FileRegion(file_, i * 65536, 65536), cbs.back().get());
+  }
+  // Buffers are recycled as the data is freed
+  size_t checked = 0;
+  while (checked < cbs.size()) {
+    evb_.loopOnce();
+    for (; checked < cbs.size() && cbs[checked]->done; checked++) {
+      ASSERT_NE(cbs[checked]->data, nullptr);
+      EXPECT_EQ(cbs[checked]->data->moveToFbString().toStdString(),
+                contents_.substr(checked * 65536, 65536));
+      cbs[checked]->data.reset();
+    }
+  }
+}
+
+TEST_P(AsyncFileReaderTest, DataOutlivesReader) {
+  auto reader = makeReader(4);
+  if (!reader) {
+    LOG(INFO) << "io_uring unavailable, skipping";
+    return;
+  }
+  std::vector<std::unique_ptr<TestCallback>> cbs;
+  cbs.push_back(std::make_unique<TestCallback>(&evb_));
+  reader->read(FileRegion(file_, 0, 4096), cbs.back().get());
+  loopUntilDone(cbs);
+  reader.reset();
+  ASSERT_NE(cbs[0]->data, nullptr);
+  EXPECT_EQ(cbs[0]->data->moveToFbString().toStdString(),
+            contents_.substr(0, 4096));
+}
+
+TEST_P(AsyncFileReaderTest, HeldDataDoesNotStallReads) {
+  auto reader = makeReader(4);
+  if (!reader) {
+    LOG(INFO) << "io_uring unavailable, skipping";
+    return;
+  }
+  // As a handler whose client stopped reading would, hold on to the data
+  // of as many reads as there are buffers
+  std::vector<std::unique_ptr<TestCallback>> held;
+  for (size_t i = 0; i < 4; i++) {
+    held.push_back(std::make_unique<TestCallback>(&evb_));
+    reader->read(FileRegion(file_, i * 65536, 65536), held.back().get());
+  }
+  loopUntilDone(held);
+  for (size_t i = 0; i < held.size(); i++) {
+    ASSERT_NE(held[i]->data, nullptr);
+  }
+
+  // Others still get theirs
+  std::vector<std::unique_ptr<TestCallback>> cbs;
+  for (size_t i = 0; i < 4; i++) {
+    cbs.push_back(std::make_unique<TestCallback>(&evb_));
+    reader->read(FileRegion(file_, 500000 + i * 1000, 1000),
+                 cbs.back().get());
+  }
+  loopUntilDone(cbs);
+  for (size_t i = 0; i < cbs.size(); i++) {
+    ASSERT_NE(cbs[i]->data, nullptr);
+    EXPECT_EQ(cbs[i]->data->moveToFbString().toStdString(),
+              contents_.substr(500000 + i * 1000, 1000));
+  }
+  for (size_t i = 0; i < held.size(); i++) {
+    EXPECT_EQ(held[i]->data->moveToFbString().toStdString(),
+              contents_.substr(i * 65536, 65536));
+  }
+}
+
+INSTANTIATE_TEST_CASE_P(AsyncFileReader,
+                        AsyncFileReaderTest,
+                        testing::Values(false, true));
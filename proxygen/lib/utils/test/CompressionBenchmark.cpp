@@ -0,0 +1,165 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Benchmark.h>
+#include <folly/Conv.h>
+#include <folly/FileUtil.h>
+#include <folly/Format.h>
+#include <folly/Random.h>
+#include <folly/io/IOBuf.h>
+#include <folly/portability/GFlags.h>
+#include <glog/logging.h>
+#include <proxygen/lib/utils/ZlibStreamCompressor.h>
+#include <proxygen/lib/utils/ZstdStreamCompressor.h>
+
+using namespace folly;
+using namespace proxygen;
+
+DEFINE_string(corpus, "",
+              "File to compress; by default a generated HTML-like corpus");
+DEFINE_int32(chunk_size, 16 * 1024,
+             "Bytes per compress() call, as CompressionFilter does for "
+             "chunked responses");
+
+// Throughput and ratio of the content encoders CompressionFilter can use,
+// at the levels worth considering for dynamic responses.
+//
+// ./compression_benchmark [-corpus <file>] [-chunk_size <bytes>]
+//
+// Prints a table of compressed size and ratio per codec/level, then the
+// benchmarks.  Each benchmark iteration counts as one input byte, so the
+// iters/s column reads as compression speed in bytes per second.
+
+namespace {
+
+const size_t kGeneratedCorpusSize = 4 * 1024 * 1024;
+
+std::string generateCorpus() {
+  static const char* kWords[] = {
+      "<div class=\"item\">", "</div>",  "<a href=\"/item/", "\">",  "</a>",
+      "<span>",               "</span>", "proxygen",         "http", "server",
+      "request",              "response", "header",          "body", "the",
+      "a",                    "of",       "and",             "to",   "in"};
+  std::string corpus;
+  corpus.reserve(kGeneratedCorpusSize);
+  while (corpus.size() < kGeneratedCorpusSize) {
+    auto i = folly::Random::rand32(sizeof(kWords) / sizeof(kWords[0]));
+    corpus.append(kWords[i]);
+    corpus.append(folly::Random::oneIn(8)
+                      ? folly::to<std::string>(folly::Random::rand32(10000))
+                      : " ");
+  }
+  return corpus;
+}
+
+const std::vector<std::unique_ptr<IOBuf>>& getCorpus() {
+  static auto chunks = [] {
+    std::string data;
+    if (!FLAGS_corpus.empty()) {
+      CHECK(readFile(FLAGS_corpus.c_str(), data))
+          << "Unable to read " << FLAGS_corpus;
+    } else {
+      data = generateCorpus();
+    }
+    std::vector<std::unique_ptr<IOBuf>> out;
+    for (size_t off = 0; off < data.size(); off += FLAGS_chunk_size) {
+      out.push_back(IOBuf::copyBuffer(data.data() + off,
+                                      std::min<size_t>(FLAGS_chunk_size,
+                                                       data.size() - off)));
+    }
+    return out;
+  }();
+  return chunks;
+}
+
+size_t getCorpusSize() {
+  size_t size = 0;
+  for (const auto& chunk : getCorpus()) {
+    size += chunk->length();
+  }
+  return size;
+}
+
+std::unique_ptr<StreamCompressor> makeCompressor(const std::string& codec,
+                                                 int level) {
+  if (codec == "zstd") {
+    return std::make_unique<ZstdStreamCompressor>(level);
+  }
+  return std::make_unique<ZlibStreamCompressor>(CompressionType::GZIP, level);
+}
+
+// Compresses the whole corpus as one response, returning the output size
+size_t compressCorpus(const std::string& codec, int level) {
+  auto compressor = makeCompressor(codec, level);
+  const auto& chunks = getCorpus();
+  size_t compressedSize = 0;
+  for (size_t i = 0; i < chunks.size(); i++) {
+    auto out = compressor->compress(chunks[i].get(), i + 1 == chunks.size());
+    CHECK(!compressor->hasError());
+    compressedSize += out->computeChainDataLength();
+  }
+  return compressedSize;
+}
+
+unsigned compressBench(unsigned iters, const std::string& codec, int level) {
+  size_t bytes = 0;
+  while (bytes < iters) {
+    doNotOptimizeAway(compressCorpus(codec, level));
+    bytes += getCorpusSize();
+  }
+  return bytes;
+}
+
+const std::vector<std::pair<std::string, int>> kConfigs = {
+    {"gzip", 1},
+    {"gzip", 4},
+    {"gzip", 6},
+    {"gzip", 9},
+    {"zstd", 1},
+    {"zstd", 3},
+    {"zstd", 6},
+    {"zstd", 12},
+    {"zstd", 19},
+};
+
+void printRatios() {
+  auto corpusSize = getCorpusSize();
+  LOG(INFO) << "corpus: " << corpusSize << " bytes in "
+            << getCorpus().size() << " chunks";
+  for (const auto& config : kConfigs) {
+    auto compressedSize = compressCorpus(config.first, config.second);
+    LOG(INFO) << sformat("{}-{:<2}  {:>10} bytes  ratio {:.3f}",
+                         config.first,
+                         config.second,
+                         compressedSize,
+                         double(corpusSize) / compressedSize);
+  }
+}
+
+} // namespace
+
+BENCHMARK_NAMED_PARAM_MULTI(compressBench, gzip_1, "gzip", 1)
+BENCHMARK_NAMED_PARAM_MULTI(compressBench, gzip_4, "gzip", 4)
+BENCHMARK_NAMED_PARAM_MULTI(compressBench, gzip_6, "gzip", 6)
+BENCHMARK_NAMED_PARAM_MULTI(compressBench, gzip_9, "gzip", 9)
+BENCHMARK_DRAW_LINE();
+BENCHMARK_NAMED_PARAM_MULTI(compressBench, zstd_1, "zstd", 1)
+BENCHMARK_NAMED_PARAM_MULTI(compressBench, zstd_3, "zstd", 3)
+BENCHMARK_NAMED_PARAM_MULTI(compressBench, zstd_6, "zstd", 6)
+BENCHMARK_NAMED_PARAM_MULTI(compressBench, zstd_12, "zstd", 12)
+BENCHMARK_NAMED_PARAM_MULTI(compressBench, zstd_19, "zstd", 19)
+
+int main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+  printRatios();
+  folly::runBenchmarks();
+  return 0;
+}
@@ -0,0 +1,132 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Benchmark.h>
+#include <folly/Conv.h>
+#include <folly/Format.h>
+#include <folly/portability/GFlags.h>
+#include <glog/logging.h>
+#include <map>
+#include <memory>
+#include <proxygen/lib/utils/MaglevHash.h>
+#include <proxygen/lib/utils/RendezvousHash.h>
+#include <proxygen/lib/utils/Time.h>
+
+using namespace folly;
+using namespace proxygen;
+
+// Per-key lookup cost of the ConsistentHash implementations as the number
+// of nodes grows, for the primary (rank 0) and first fallback (rank 1).
+//
+// ./consistent_hash_benchmark
+//
+// First logs, per implementation and node count, how long build() took and
+// getMaxErrorRate().  Then the benchmarks; each iteration is one get().
+// MaglevHash uses its default table up to 500 nodes and a 1048573 entry
+// table beyond, keeping the error rate around 1%.
+
+namespace {
+
+const std::vector<size_t> kNodeCounts = {10, 100, 1000, 10000};
+
+size_t maglevTableSize(size_t numNodes) {
+  return numNodes <= 500 ? MaglevHash::kDefaultTableSize : 1048573;
+}
+
+std::unique_ptr<ConsistentHash> makeHash(const std::string& impl,
+                                         size_t numNodes) {
+  std::unique_ptr<ConsistentHash> hash;
+  if (impl == "rendezvous") {
+    hash = std::make_unique<RendezvousHash>();
+  } else {
+    hash = std::make_unique<MaglevHash>(maglevTableSize(numNodes));
+  }
+  std::vector<std::pair<std::string, uint64_t>> nodes;
+  for (size_t i = 0; i < numNodes; ++i) {
+    // Some spread in weights, as from health or capacity
+    nodes.emplace_back(to<std::string>("upstream", i), 100 + i % 7);
+  }
+  hash->build(nodes);
+  return hash;
+}
+
+const ConsistentHash& getHash(const std::string& impl, size_t numNodes) {
+  static std::map<std::pair<std::string, size_t>,
+                  std::unique_ptr<ConsistentHash>> hashes;
+  auto& hash = hashes[std::make_pair(impl, numNodes)];
+  if (!hash) {
+    hash = makeHash(impl, numNodes);
+  }
+  return *hash;
+}
+
+void getBench(unsigned iters,
+              const std::string& impl,
+              size_t numNodes,
+              size_t rank) {
+  const ConsistentHash* hash = nullptr;
+  BENCHMARK_SUSPEND {
+    hash = &getHash(impl, numNodes);
+  }
+  for (unsigned i = 0; i < iters; ++i) {
+    doNotOptimizeAway(hash->get(i * 0x9e3779b97f4a7c15ULL, rank));
+  }
+}
+
+void printBuildStats() {
+  for (auto impl : {"rendezvous", "maglev"}) {
+    for (auto numNodes : kNodeCounts) {
+      auto start = getCurrentTime();
+      auto hash = makeHash(impl, numNodes);
+      auto elapsed = microsecondsSince(start);
+      LOG(INFO) << sformat("{:<10} nodes={:<6} build={:>8}us  maxError={:.4f}",
+                           impl,
+                           numNodes,
+                           elapsed.count(),
+                           hash->getMaxErrorRate());
+    }
+  }
+}
+
+} // namespace
+
+BENCHMARK_NAMED_PARAM(getBench, rendezvous_10, "rendezvous", 10, 0)
+BENCHMARK_RELATIVE_NAMED_PARAM(getBench, maglev_10, "maglev", 10, 0)
+BENCHMARK_NAMED_PARAM(getBench, rendezvous_100, "rendezvous", 100, 0)
+BENCHMARK_RELATIVE_NAMED_PARAM(getBench, maglev_100, "maglev", 100, 0)
+BENCHMARK_NAMED_PARAM(getBench, rendezvous_1000, "rendezvous", 1000, 0)
+BENCHMARK_RELATIVE_NAMED_PARAM(getBench, maglev_1000, "maglev", 1000, 0)
+BENCHMARK_NAMED_PARAM(getBench, rendezvous_10000, "rendezvous", 10000, 0)
+BENCHMARK_RELATIVE_NAMED_PARAM(getBench, maglev_10000, "maglev", 10000, 0)
+BENCHMARK_DRAW_LINE();
+BENCHMARK_NAMED_PARAM(getBench, rendezvous_10_rank1, "rendezvous", 10, 1)
+BENCHMARK_RELATIVE_NAMED_PARAM(getBench, maglev_10_rank1, "maglev", 10, 1)
+BENCHMARK_NAMED_PARAM(getBench, rendezvous_100_rank1, "rendezvous", 100, 1)
+BENCHMARK_RELATIVE_NAMED_PARAM(getBench, maglev_100_rank1, "maglev", 100, 1)
+BENCHMARK_NAMED_PARAM(getBench, rendezvous_1000_rank1, "rendezvous", 1000, 1)
+BENCHMARK_RELATIVE_NAMED_PARAM(getBench, maglev_1000_rank1, "maglev", 1000, 1)
+BENCHMARK_NAMED_PARAM(getBench,
+                      rendezvous_10000_rank1,
+                      "rendezvous",
+                      10000,
+                      1)
+BENCHMARK_RELATIVE_NAMED_PARAM(getBench,
+                               maglev_10000_rank1,
+                               "maglev",
+                               10000,
+                               1)
+
+int main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+  printBuildStats();
+  folly::runBenchmarks();
+  return 0;
+}
@@ -0,0 +1,80 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/FileUtil.h>
+#include <folly/experimental/TestUtil.h>
+#include <folly/portability/GTest.h>
+
+#include <proxygen/lib/utils/FileRegion.h>
+
+using namespace proxygen;
+
+class FileRegionTest : public testing::Test {
+ public:
+  void SetUp() override {
+    // Spans a few pages so offsets are not page aligned
+    for (size_t i = 0; i < 3 * 4096 + 100; i++) {
+      contents_.push_back('a' + i % 26);
+    }
+    ASSERT_TRUE(folly::writeFile(contents_, tmp_.path().string().c_str()));
+    file_ = std::make_shared<folly::File>(tmp_.path().string());
+  }
+
+ protected:
+  folly::test::TemporaryFile tmp_;
+  std::string contents_;
+  std::shared_ptr<folly::File> file_;
+};
+
+TEST_F(FileRegionTest, Map) {
+  FileRegion region(file_, 5000, 5000);
+  auto buf = region.map();
+  ASSERT_NE(buf, nullptr);
+  EXPECT_EQ(buf->moveToFbString().toStdString(), contents_.substr(5000, 5000));
+
+  // Clones keep the mapping alive
+  auto whole = FileRegion(file_, 0, contents_.size()).map();
+  ASSERT_NE(whole, nullptr);
+  auto clone = whole->clone();
+  whole.reset();
+  EXPECT_EQ(clone->moveToFbString().toStdString(), contents_);
+
+  auto empty = FileRegion(file_, 100, 0).map();
+  ASSERT_NE(empty, nullptr);
+  EXPECT_EQ(empty->computeChainDataLength(), 0);
+}
+
+TEST_F(FileRegionTest, Read) {
+  FileRegion region(file_, 4095, 2);
+  auto buf = region.read();
+  ASSERT_NE(buf, nullptr);
+  EXPECT_EQ(buf->moveToFbString().toStdString(), contents_.substr(4095, 2));
+
+  EXPECT_EQ(FileRegion(file_, contents_.size() - 10, 20).read(), nullptr)
+    << "Region past the end of the file";
+}
+
+TEST_F(FileRegionTest, SubRegion) {
+  FileRegion region(file_, 100, 1000);
+  auto sub = region.subRegion(10, 20);
+  EXPECT_EQ(sub.getOffset(), 110);
+  EXPECT_EQ(sub.getLength(), 20);
+
+  sub = region.subRegion(990, 20);
+  EXPECT_EQ(sub.getOffset(), 1090);
+  EXPECT_EQ(sub.getLength(), 10);
+
+  EXPECT_TRUE(region.subRegion(2000, 1).empty());
+
+  region.advance(400);
+  EXPECT_EQ(region.getOffset(), 500);
+  EXPECT_EQ(region.getLength(), 600);
+  region.advance(1000);
+  EXPECT_TRUE(region.empty());
+}
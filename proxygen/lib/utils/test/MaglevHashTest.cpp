@@ -0,0 +1,214 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Conv.h>
+#include <folly/container/Foreach.h>
+#include <folly/portability/GTest.h>
+#include <map>
+#include <set>
+#include <vector>
+
+#include <proxygen/lib/utils/MaglevHash.h>
+
+using namespace proxygen;
+
+namespace {
+
+std::vector<std::pair<std::string, uint64_t>> makeNodes(int numNodes) {
+  std::vector<std::pair<std::string, uint64_t>> nodes;
+  for (int i = 0; i < numNodes; ++i) {
+    nodes.emplace_back(folly::to<std::string>("key", i), 1);
+  }
+  return nodes;
+}
+
+}
+
+TEST(MaglevHash, Consistency) {
+  MaglevHash hashes;
+  auto nodes = makeNodes(10);
+  hashes.build(nodes);
+
+  for (size_t rank = 0; rank < nodes.size() + 2; rank++) {
+    std::map<uint64_t, size_t> mapping;
+    for (int i = 0; i < 10000; ++i) {
+      mapping[i] = hashes.get(i, rank);
+    }
+
+    FOR_EACH_KV(key, expected, mapping) {
+      EXPECT_EQ(expected, hashes.get(key, rank));
+    }
+  }
+}
+
+TEST(MaglevHash, ConsistencyWithNewNode) {
+  MaglevHash hashes;
+  int numNodes = 100;
+  auto nodes = makeNodes(numNodes);
+  hashes.build(nodes);
+  std::map<uint64_t, size_t> mapping;
+  for (uint64_t i = 0; i < 100000; ++i) {
+    mapping[i] = hashes.get(i);
+  }
+  hashes = MaglevHash();
+  // Adding a new node and rebuild the hash
+  nodes.emplace_back(folly::to<std::string>("key", numNodes), 1);
+  hashes.build(nodes);
+  // Most of the moved traffic goes to the new node; unlike RendezvousHash,
+  // a little shuffles between the old ones too
+  int toNewNode = 0;
+  int toOldNodes = 0;
+  FOR_EACH_KV (key, expected, mapping) {
+    size_t id = hashes.get(key);
+    if (id == size_t(numNodes)) {
+      toNewNode++;
+    } else if (id != expected) {
+      toOldNodes++;
+    }
+  }
+  EXPECT_NEAR(toNewNode, mapping.size() / (numNodes + 1), 300);
+  EXPECT_LT(toOldNodes, mapping.size() / 50);
+}
+
+TEST(MaglevHash, ConsistencyWithRemovedNode) {
+  MaglevHash hashes;
+  int numNodes = 100;
+  auto nodes = makeNodes(numNodes);
+  hashes.build(nodes);
+  std::map<uint64_t, size_t> mapping;
+  for (uint64_t i = 0; i < 100000; ++i) {
+    mapping[i] = hashes.get(i);
+  }
+
+  // Zero weight takes the node out while keeping the indexes
+  hashes = MaglevHash();
+  size_t removed = 42;
+  nodes[removed].second = 0;
+  hashes.build(nodes);
+  int disrupted = 0;
+  FOR_EACH_KV (key, expected, mapping) {
+    size_t id = hashes.get(key);
+    EXPECT_NE(id, removed);
+    if (expected != removed && id != expected) {
+      disrupted++;
+    }
+  }
+  EXPECT_LT(disrupted, mapping.size() / 50);
+}
+
+TEST(MaglevHash, DistributionAccuracy) {
+  std::vector<std::string> keys =
+    {"ash_proxy", "prn_proxy", "snc_proxy", "frc_proxy"};
+
+  std::vector<std::vector<uint64_t>> weights = {
+    {248, 342, 2, 384},
+    {10, 10, 10, 10},
+    {25, 25, 10, 10},
+    {100, 10, 10, 1},
+    {100, 5, 5, 5},
+    {922337203685, 12395828300, 50192385101, 59293845010}
+  };
+
+  for (auto& weight: weights) {
+    MaglevHash hashes;
+    std::vector<std::pair<std::string, uint64_t> > nodes;
+    FOR_EACH_RANGE (i, 0, keys.size()) {
+      nodes.emplace_back(keys[i], weight[i]);
+    }
+    hashes.build(nodes);
+    // Four nodes in a 65521 entry table round to well under 1%
+    EXPECT_LT(hashes.getMaxErrorRate(), 0.01);
+
+    std::vector<uint64_t> distribution(keys.size());
+
+    for (uint64_t i = 0; i < 21000; ++i) {
+      distribution[hashes.get(i)]++;
+    }
+
+    uint64_t totalWeight = 0;
+
+    for (auto& w: weight) {
+      totalWeight += w;
+    }
+
+    double maxError = 0.0;
+    for (size_t i = 0; i < keys.size(); ++i) {
+      double expected = 100.0 * weight[i] / totalWeight;
+      double actual = 100.0 * distribution[i] / 21000;
+
+      maxError = std::max(maxError, fabs(expected - actual));
+    }
+    // make sure the error rate is less than 1.0%
+    EXPECT_LE(maxError, 1.0);
+  }
+}
+
+TEST(MaglevHash, MaxErrorRate) {
+  // Ten entries per node can't be shared out exactly among 3 nodes
+  MaglevHash hashes(31);
+  auto nodes = makeNodes(3);
+  hashes.build(nodes);
+  EXPECT_EQ(hashes.getTableSize(), 31);
+  // 11 entries instead of 10.33
+  EXPECT_NEAR(hashes.getMaxErrorRate(), 11 / 31.0 * 3 - 1, 1e-9);
+
+  // A node too light to get a single entry is off by 100%
+  for (auto& node : nodes) {
+    node.second = 1000;
+  }
+  nodes.emplace_back("tiny", 1);
+  hashes = MaglevHash(31);
+  hashes.build(nodes);
+  EXPECT_DOUBLE_EQ(hashes.getMaxErrorRate(), 1.0);
+  for (uint64_t i = 0; i < 1000; ++i) {
+    EXPECT_NE(hashes.get(i), 3);
+  }
+}
+
+TEST(MaglevHash, RanksAreDistinct) {
+  MaglevHash hashes;
+  auto nodes = makeNodes(20);
+  nodes[5].second = 0;
+  hashes.build(nodes);
+
+  for (uint64_t key = 0; key < 1000; ++key) {
+    // 19 nodes have entries; ranks past that wrap around
+    std::set<size_t> seen;
+    for (size_t rank = 0; rank < 19; ++rank) {
+      auto id = hashes.get(key, rank);
+      EXPECT_NE(id, 5);
+      EXPECT_TRUE(seen.insert(id).second);
+    }
+    EXPECT_EQ(hashes.get(key, 19), hashes.get(key, 0));
+  }
+}
+
+TEST(MaglevHash, FallbackFollowsWeights) {
+  MaglevHash hashes;
+  std::vector<std::pair<std::string, uint64_t>> nodes = {
+    {"a", 1}, {"b", 1}, {"c", 2}};
+  hashes.build(nodes);
+  // With "a" primary, "c" should be the fallback twice as often as "b"
+  std::vector<uint64_t> fallbacks(nodes.size());
+  for (uint64_t i = 0; i < 100000; ++i) {
+    if (hashes.get(i) == 0) {
+      fallbacks[hashes.get(i, 1)]++;
+    }
+  }
+  EXPECT_EQ(fallbacks[0], 0);
+  EXPECT_NEAR(double(fallbacks[2]) / fallbacks[1], 2.0, 0.2);
+}
+
+TEST(MaglevHash, Empty) {
+  MaglevHash hashes;
+  std::vector<std::pair<std::string, uint64_t>> nodes;
+  hashes.build(nodes);
+  EXPECT_EQ(hashes.get(1234), 0);
+  EXPECT_EQ(hashes.getMaxErrorRate(), 0);
+}
@@ -0,0 +1,79 @@
+/*
+ *  Copyright (c) 2019-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <boost/filesystem.hpp>
+#include <folly/FileUtil.h>
+#include <folly/experimental/TestUtil.h>
+#include <folly/portability/GTest.h>
+
+#include <proxygen/lib/utils/ThreadAffinity.h>
+
+using namespace proxygen;
+
+namespace fs = boost::filesystem;
+
+TEST(ThreadAffinity, ParseCpuList) {
+  EXPECT_EQ(parseCpuList("0-3,8,10-11\n"),
+            std::vector<int>({0, 1, 2, 3, 8, 10, 11}));
+  EXPECT_EQ(parseCpuList("5"), std::vector<int>({5}));
+  EXPECT_TRUE(parseCpuList("").empty());
+  EXPECT_TRUE(parseCpuList("3-1").empty());
+  EXPECT_TRUE(parseCpuList("a,b").empty());
+}
+
+namespace {
+
+void makeFile(const fs::path& path, const std::string& contents) {
+  fs::create_directories(path.parent_path());
+  ASSERT_TRUE(folly::writeFile(contents, path.string().c_str()));
+}
+
+} // namespace
+
+TEST(ThreadAffinity, NicRxQueueCpus) {
+  folly::test::TemporaryDirectory sys;
+  folly::test::TemporaryDirectory proc;
+  auto irqs = sys.path() / "class/net/eth0/device/msi_irqs";
+  // Listed out of order; 99 is the unsteered mailbox interrupt
+  for (auto irq : {"120", "99", "110", "130"}) {
+    makeFile(irqs / irq, "msix\n");
+  }
+  makeFile(proc.path() / "irq/99/smp_affinity_list", "0-7\n");
+  makeFile(proc.path() / "irq/110/smp_affinity_list", "2\n");
+  makeFile(proc.path() / "irq/120/smp_affinity_list", "6\n");
+  makeFile(proc.path() / "irq/130/smp_affinity_list", "2\n");
+
+  EXPECT_EQ(
+      getNicRxQueueCpus("eth0", sys.path().string(), proc.path().string()),
+      std::vector<int>({2, 6}));
+  EXPECT_TRUE(
+      getNicRxQueueCpus("eth1", sys.path().string(), proc.path().string())
+          .empty());
+}
+
+namespace {
+
+class TestCpuMigrationObserver : public CpuMigrationObserver {
+ public:
+  using CpuMigrationObserver::onCpuSample;
+};
+
+} // namespace
+
+TEST(ThreadAffinity, CpuMigrationObserver) {
+  TestCpuMigrationObserver observer;
+  observer.onCpuSample(1, 0);
+  observer.onCpuSample(1, 0);
+  observer.onCpuSample(2, 0);
+  observer.onCpuSample(9, 1);
+  observer.onCpuSample(9, 1);
+  EXPECT_EQ(observer.getNumSamples(), 5);
+  EXPECT_EQ(observer.getNumCpuMigrations(), 2);
+  EXPECT_EQ(observer.getNumNodeMigrations(), 1);
+}
@@ -14,6 +14,7 @@
 #include <folly/io/IOBuf.h>
 #include <folly/portability/GTest.h>
 #include <glog/logging.h>
+#include <proxygen/lib/utils/ZstdStreamCompressor.h>
 #include <proxygen/lib/utils/ZstdStreamDecompressor.h>
 
 using namespace folly;
@@ -116,6 +117,33 @@ void compressThenDecompressPieces(
 
   verifyPieces(std::move(input), std::move(compressed_pieces));
 }
+
+// Compress with ZstdStreamCompressor, one call per piece
+void streamCompressThenDecompress(
+    std::vector<std::unique_ptr<folly::IOBuf>> input_pieces, int level) {
+  ZstdStreamCompressor zc(level);
+  ASSERT_FALSE(zc.hasError());
+
+  std::vector<std::unique_ptr<folly::IOBuf>> compressed_pieces;
+  size_t i = 0;
+  for (const auto& piece : input_pieces) {
+    auto cpiece = zc.compress(piece.get(), ++i == input_pieces.size());
+    ASSERT_FALSE(zc.hasError()) << "Compression error.";
+    ASSERT_NE(cpiece, nullptr);
+    // A flush with nothing new to flush writes nothing
+    if (!cpiece->empty()) {
+      compressed_pieces.push_back(std::move(cpiece));
+    }
+  }
+
+  auto input = folly::IOBuf::create(0);
+  while (!input_pieces.empty()) {
+    input->appendChain(std::move(input_pieces.back()));
+    input_pieces.pop_back();
+  }
+
+  verifyPieces(std::move(input), std::move(compressed_pieces));
+}
 } // anonymous namespace
 
 // Try many different sizes because we've hit truncation problems before
@@ -163,3 +191,34 @@ TEST_F(ZstdTests, CompressDecompressStreaming) {
   ASSERT_NO_FATAL_FAILURE(
       { compressThenDecompressPieces(std::move(input_pieces)); });
 }
+
+TEST_F(ZstdTests, StreamCompressorSingleCall) {
+  std::vector<std::unique_ptr<folly::IOBuf>> input_pieces;
+  input_pieces.push_back(makeBuf(8 * 128 * 1024));
+  ASSERT_NO_FATAL_FAILURE(
+      { streamCompressThenDecompress(std::move(input_pieces), 3); });
+}
+
+TEST_F(ZstdTests, StreamCompressorFlushes) {
+  std::vector<std::unique_ptr<folly::IOBuf>> input_pieces;
+  input_pieces.push_back(makeBuf(38));
+  input_pieces.push_back(makeBuf(12));
+  input_pieces.push_back(makeBuf(0));
+  input_pieces.push_back(makeBuf(256 * 1024));
+  input_pieces.push_back(makeBuf(0));
+
+  ASSERT_NO_FATAL_FAILURE(
+      { streamCompressThenDecompress(std::move(input_pieces), 1); });
+}
+
+TEST_F(ZstdTests, StreamCompressorMaxLevel) {
+  std::vector<std::unique_ptr<folly::IOBuf>> input_pieces;
+  auto buf = makeBuf(1024);
+  buf->appendChain(makeBuf(3000));
+  input_pieces.push_back(std::move(buf));
+  input_pieces.push_back(makeBuf(500));
+  ASSERT_NO_FATAL_FAILURE({
+    streamCompressThenDecompress(std::move(input_pieces),
+                                 ZstdStreamCompressor::kMaxLevel);
+  });
+}